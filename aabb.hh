@@ -0,0 +1,181 @@
+/*! \file
+ * \brief An axis-aligned bounding box.
+ */
+
+#ifndef _AABB_HH__
+#define _AABB_HH__
+
+#include "vector.hh"
+#include <cfloat>
+
+//! An axis-aligned bounding box, stored as its minimum and maximum corners
+/*!
+ * A default constructed AABB is empty (min > max on every axis), so that
+ * expanding it by any point or box yields exactly that point or box.
+ */
+class AABB
+{
+  //! Minimum corner
+  Vector3F lo;
+  //! Maximum corner
+  Vector3F hi;
+
+  public:
+  // === Constructors & methods
+
+  //! Default constructor creates an empty box
+  AABB();
+
+  //! Construct a box from its minimum & maximum corners
+  AABB(const Vector3F &lo, const Vector3F &hi);
+
+  //! Construct the box bounding a sphere
+  static AABB around_sphere(const Vector3F &c, float r);
+
+  // Accessors
+  //! Accessor for the minimum corner
+  const Vector3F & get_min() const;
+  //! Accessor for the maximum corner
+  const Vector3F & get_max() const;
+
+  //! Check if the box contains no points
+  bool empty() const;
+
+  //! Center of the box
+  Vector3F get_center() const;
+
+  //! Surface area of the box (0 if empty)
+  float surface_area() const;
+
+  //! Grow the box to include a point
+  AABB & expand(const Vector3F &p);
+  //! Grow the box to include another box
+  AABB & expand(const AABB &b);
+
+  //! Check if a point lies within the box (inclusive of faces)
+  bool contains(const Vector3F &p) const;
+
+  //! Check if a ray segment passes through the box
+  bool intersects(const Vector3F &orig, const Vector3F &inv_dir,
+                  float t_max) const;
+};
+
+// === Inline function definitions
+
+inline AABB::AABB()
+  : lo({FLT_MAX, FLT_MAX, FLT_MAX})
+  , hi({-FLT_MAX, -FLT_MAX, -FLT_MAX})
+{ }
+
+inline AABB::AABB(const Vector3F &lo, const Vector3F &hi)
+  : lo(lo)
+  , hi(hi)
+{ }
+
+/*!
+ * \param c Center of the sphere
+ * \param r Radius of the sphere
+ */
+inline AABB AABB::around_sphere(const Vector3F &c, float r)
+{
+  Vector3F ext = {r, r, r};
+  return AABB(c - ext, c + ext);
+}
+
+inline const Vector3F & AABB::get_min() const { return lo; }
+inline const Vector3F & AABB::get_max() const { return hi; }
+
+inline bool AABB::empty() const
+{
+  return (lo[0] > hi[0]) || (lo[1] > hi[1]) || (lo[2] > hi[2]);
+}
+
+inline Vector3F AABB::get_center() const
+{
+  return 0.5f * (lo + hi);
+}
+
+inline float AABB::surface_area() const
+{
+  if (empty()) return 0;
+
+  Vector3F d = hi - lo;
+  return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+/*!
+ * \returns This box (for chaining)
+ */
+inline AABB & AABB::expand(const Vector3F &p)
+{
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (p[i] < lo[i]) lo[i] = p[i];
+    if (p[i] > hi[i]) hi[i] = p[i];
+  }
+
+  return *this;
+}
+
+/*!
+ * \returns This box (for chaining)
+ */
+inline AABB & AABB::expand(const AABB &b)
+{
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (b.lo[i] < lo[i]) lo[i] = b.lo[i];
+    if (b.hi[i] > hi[i]) hi[i] = b.hi[i];
+  }
+
+  return *this;
+}
+
+inline bool AABB::contains(const Vector3F &p) const
+{
+  return (p[0] >= lo[0]) && (p[0] <= hi[0])
+         && (p[1] >= lo[1]) && (p[1] <= hi[1])
+         && (p[2] >= lo[2]) && (p[2] <= hi[2]);
+}
+
+// Check if a ray segment passes through the box
+/*!
+ * Uses the slab method.  Taking the reciprocal direction lets a zero
+ * direction component produce infinities, which the comparisons handle.
+ *
+ * The far end of each slab is widened by the worst rounding error of its
+ * computation (as in Ize, Robust BVH Ray Traversal, 2013), so a ray grazing
+ * a face shared by two boxes always enters at least one of them.
+ *
+ * \param orig    Origin of the ray
+ * \param inv_dir Reciprocal of each component of the ray's direction
+ * \param t_max   End of the segment along the ray (the start being 0)
+ * \returns       true if some point of the segment lies within the box
+ */
+inline bool AABB::intersects(const Vector3F &orig, const Vector3F &inv_dir,
+                             float t_max) const
+{
+  float t0 = 0;
+  float t1 = t_max;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    float t_near = (lo[i] - orig[i]) * inv_dir[i];
+    float t_far = (hi[i] - orig[i]) * inv_dir[i];
+
+    if (t_near > t_far) { float tmp = t_near; t_near = t_far; t_far = tmp; }
+
+    // 1 + 2 * gamma(3), for FLT_EPSILON / 2 unit roundoff
+    t_far *= 1 + 2 * (3 * FLT_EPSILON / 2) / (1 - 3 * FLT_EPSILON / 2);
+
+    // (Comparisons written so a NaN leaves the interval unchanged)
+    if (t_near > t0) t0 = t_near;
+    if (t_far < t1) t1 = t_far;
+
+    if (t0 > t1) return false;
+  }
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/* arealight_test.cc
+ *
+ * gtest Unit Test Suite for soft shadows from area lights
+ */
+
+#include "scene.hh"
+#include "random.hh"
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+// A floor lit by a square light, with a ball in between
+struct AreaLightTest : public Test
+{
+  Scene scn;
+  RenderOptions opt;
+
+  virtual void SetUp()
+  {
+    scn.add_object(scn.get_arena().create<Plane>(
+        0, Vector3F({0, 1, 0}), Color(1, 1, 1), 0));
+    scn.add_object(scn.get_arena().create<Sphere>(
+        Vector3F({0, 1, 0}), 0.5, Color(1, 1, 1), 0));
+    scn.add_light(scn.get_arena().create<Light>(
+        Vector3F({0, 3, 0}), Vector3F({2, 0, 0}), Vector3F({0, 0, 2}),
+        Color(1, 1, 1)));
+    scn.prepare();
+  }
+
+  // Brightness of the floor at x along the x axis
+  float floor_at(float x, unsigned int index = 0)
+  {
+    Random rng(opt.seed, index);
+    Ray r(Vector3F({x, 0.25, 0}), Vector3F({0, -1, 0}));
+    return scn.trace_ray(r, opt, rng, opt.max_depth).get_red();
+  }
+};
+
+// Umbra is dark, penumbra is partly lit and beyond is fully lit
+TEST_F(AreaLightTest, SoftShadow)
+{
+  float umbra = floor_at(0);
+  float penumbra = floor_at(0.75);
+  float lit = floor_at(3);
+
+  EXPECT_EQ(0, umbra);
+  EXPECT_LT(0.1 * lit, penumbra);
+  EXPECT_GT(0.9 * lit, penumbra);
+
+  // Far from the ball, the floor sees the whole light
+  // (Only the probes are traced there, so average over generators)
+  lit = 0;
+  for (int i = 0; i < 100; ++i)
+    lit += floor_at(3, i) / 100;
+
+  Vector3F p = {3, 0, 0};
+  float exact = 0;
+  const int N = 64;
+  for (int i = 0; i < N; ++i)
+  {
+    for (int j = 0; j < N; ++j)
+    {
+      Vector3F v_l = Vector3F({-1 + 2 * (i + 0.5f) / N, 3,
+                               -1 + 2 * (j + 0.5f) / N}) - p;
+      exact += v_l[1] / v_l.norm();
+    }
+  }
+  EXPECT_NEAR(exact / (N * N), lit, 0.01);
+}
+
+// Penumbrae are refined with more shadow rays, reducing their noise
+TEST_F(AreaLightTest, RefinesPenumbra)
+{
+  const int N = 200;
+
+  // Spread of brightness at a penumbra point over many generators
+  float spread[2];
+  unsigned int samples[2] = {4, 64};
+
+  for (int k = 0; k < 2; ++k)
+  {
+    opt.area_samples = samples[k];
+
+    float lo = 1, hi = 0;
+    for (int i = 0; i < N; ++i)
+    {
+      float b = floor_at(0.75, i);
+      lo = min(lo, b);
+      hi = max(hi, b);
+    }
+    spread[k] = hi - lo;
+  }
+
+  EXPECT_LT(spread[1], 0.5 * spread[0]);
+
+  // Repeatable with the same generator
+  EXPECT_EQ(floor_at(0.75, 7), floor_at(0.75, 7));
+}
+
+// Few samples or many, penumbrae average to the same brightness (so probes
+// reused as samples of the finer grid don't bias it)
+TEST_F(AreaLightTest, PenumbraUnbiased)
+{
+  opt.area_samples = 4096;
+  float exact = floor_at(0.75);
+
+  const int N = 4000;
+  unsigned int samples[3] = {1, 16, 36};
+
+  for (int k = 0; k < 3; ++k)
+  {
+    opt.area_samples = samples[k];
+
+    float mean = 0;
+    for (int i = 0; i < N; ++i)
+      mean += floor_at(0.75, i) / N;
+
+    EXPECT_NEAR(exact, mean, 0.03 * exact) << samples[k];
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
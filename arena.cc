@@ -0,0 +1,70 @@
+/* arena.cc
+ *
+ * A bump allocator that owns the objects making up a Scene
+ */
+
+#include "arena.hh"
+#include <cstdlib>
+
+using namespace std;
+
+// Default chunk size (in bytes)
+const size_t Arena::default_chunk_size = 64 * 1024;
+
+/*!
+ * \param chunk_size  Size of each chunk requested from the heap.
+ *                    Larger objects are given a chunk of their own size.
+ */
+Arena::Arena(size_t chunk_size)
+  : pools()
+  , objects()
+  , chunk_size(chunk_size)
+  , reserved(0)
+{ }
+
+// Destructor destroys all objects and frees all chunks
+Arena::~Arena()
+{
+  // Destroy objects in reverse order of construction
+  for (vector<Destructor>::reverse_iterator it = objects.rbegin();
+       it != objects.rend(); ++it)
+  {
+    it->destroy(it->p);
+  }
+
+  // Release the chunks
+  for (map<type_index, Pool>::iterator it = pools.begin();
+       it != pools.end(); ++it)
+  {
+    for (unsigned int i = 0; i < it->second.chunks.size(); ++i)
+      free(it->second.chunks[i]);
+  }
+}
+
+/*!
+ * \param pool  Pool from which to allocate
+ * \param size  Number of bytes required
+ * \param align Required alignment of the returned pointer
+ * \returns     Pointer to uninitialized storage
+ */
+void * Arena::allocate(Pool &pool, size_t size, size_t align)
+{
+  // Round the fill position up to the required alignment
+  size_t offset = (pool.used + align - 1) / align * align;
+
+  if (pool.chunks.empty() || offset + size > pool.size)
+  {
+    // Start a new chunk (malloc is suitably aligned for any type)
+    size_t new_size = (size > chunk_size) ? size : chunk_size;
+    char *chunk = static_cast<char *>(malloc(new_size));
+    if (chunk == NULL) throw bad_alloc();
+
+    pool.chunks.push_back(chunk);
+    pool.size = new_size;
+    reserved += new_size;
+    offset = 0;
+  }
+
+  pool.used = offset + size;
+  return pool.chunks.back() + offset;
+}
@@ -0,0 +1,137 @@
+/* arena.hh
+ *
+ * A bump allocator that owns the objects making up a Scene
+ */
+
+#ifndef _ARENA_HH__
+#define _ARENA_HH__
+
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <cstddef>
+#include <map>
+#include <new>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+//! A bump allocator which owns objects constructed within it.
+/*!
+ * Objects are grouped into one pool per type, and each pool carves objects
+ * out of large chunks in allocation order.  Objects of the same type therefore
+ * sit next to each other in memory regardless of the order they were created.
+ *
+ * Objects are never freed individually.  When the Arena is destroyed, the
+ * destructors of all contained objects are run (in reverse order of
+ * construction) and then each chunk is freed.
+ *
+ * Arenas must be owned by a boost::shared_ptr, as the shared pointers handed
+ * out by create() share ownership of the whole Arena rather than allocating
+ * a control block for each object.
+ */
+class Arena : public boost::enable_shared_from_this<Arena>
+{
+  //! A single type's list of chunks
+  struct Pool
+  {
+    //! Chunks allocated for this pool (the last is the one being filled)
+    std::vector<char *> chunks;
+    //! Bytes used in the last chunk
+    std::size_t used;
+    //! Size of the last chunk
+    std::size_t size;
+
+    Pool() : chunks(), used(0), size(0) { }
+  };
+
+  //! Record of a constructed object, so its destructor can be run
+  struct Destructor
+  {
+    //! Pointer to the object
+    void *p;
+    //! Function which destroys the object at p
+    void (*destroy)(void *p);
+  };
+
+  //! Pools, indexed by the type of object they hold
+  std::map<std::type_index, Pool> pools;
+
+  //! Constructed objects, in order of construction
+  std::vector<Destructor> objects;
+
+  //! Default size of each newly allocated chunk
+  std::size_t chunk_size;
+
+  //! Total bytes held in chunks
+  std::size_t reserved;
+
+  //! Allocate raw storage from the pool for a type
+  void * allocate(Pool &pool, std::size_t size, std::size_t align);
+
+  //! Run the destructor of an object of type T
+  template <typename T>
+  static void destroy(void *p);
+
+  // Not copyable: objects are owned by exactly one Arena
+  Arena(const Arena &);
+  Arena & operator=(const Arena &);
+
+  public:
+  // === Constructors/Destructors & methods
+
+  //! Default chunk size (in bytes)
+  static const std::size_t default_chunk_size;
+
+  //! Construct an empty Arena
+  explicit Arena(std::size_t chunk_size = default_chunk_size);
+
+  //! Destructor destroys all objects and frees all chunks
+  ~Arena();
+
+  //! Construct a T within the Arena
+  template <typename T, typename... Args>
+  boost::shared_ptr<T> create(Args&&... args);
+
+  //! Total number of bytes reserved by the Arena
+  std::size_t get_reserved() const;
+};
+
+// === Inline function definitions
+
+inline std::size_t Arena::get_reserved() const { return reserved; }
+
+//! Boost Shared Pointer to Arena
+typedef boost::shared_ptr<Arena> SPArena;
+
+// === Template function definitions
+
+template <typename T>
+void Arena::destroy(void *p)
+{
+  static_cast<T *>(p)->~T();
+}
+
+// Construct a T within the Arena
+/*!
+ * The returned pointer shares ownership of the Arena itself, so the object
+ * remains valid as long as any pointer into the Arena is held.
+ *
+ * \param args  Arguments passed on to T's constructor
+ * \returns     Shared pointer to the new object
+ */
+template <typename T, typename... Args>
+boost::shared_ptr<T> Arena::create(Args&&... args)
+{
+  void *mem = allocate(pools[std::type_index(typeid(T))],
+                       sizeof(T), alignof(T));
+
+  T *p = new (mem) T(std::forward<Args>(args)...);
+
+  Destructor d = { p, &Arena::destroy<T> };
+  objects.push_back(d);
+
+  // Aliasing constructor: share the Arena's reference count
+  return boost::shared_ptr<T>(shared_from_this(), p);
+}
+
+#endif
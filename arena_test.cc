@@ -0,0 +1,86 @@
+/* arena_test.cc
+ *
+ * gtest Unit Test Suite for the Arena allocator
+ */
+
+#include "arena.hh"
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+// Small type which counts live instances
+struct Counted
+{
+  static int live;
+  int value;
+
+  Counted(int v) : value(v) { ++live; }
+  ~Counted() { --live; }
+};
+int Counted::live = 0;
+
+// Objects of the same type are allocated contiguously,
+// even when interleaved with allocations of other types
+TEST(ArenaTest, GroupedByType)
+{
+  SPArena arena(new Arena());
+
+  boost::shared_ptr<double> d1 = arena->create<double>(1.0);
+  boost::shared_ptr<int> i1 = arena->create<int>(1);
+  boost::shared_ptr<double> d2 = arena->create<double>(2.0);
+  boost::shared_ptr<int> i2 = arena->create<int>(2);
+
+  EXPECT_EQ(d1.get() + 1, d2.get());
+  EXPECT_EQ(i1.get() + 1, i2.get());
+
+  EXPECT_DOUBLE_EQ(2.0, *d2);
+  EXPECT_EQ(2, *i2);
+}
+
+// Objects are destroyed once the Arena and all pointers into it are released
+TEST(ArenaTest, SharedOwnership)
+{
+  boost::shared_ptr<Counted> c;
+
+  {
+    SPArena arena(new Arena());
+    c = arena->create<Counted>(5);
+    arena->create<Counted>(6);
+
+    EXPECT_EQ(2, Counted::live);
+  }
+
+  // Arena kept alive by c
+  EXPECT_EQ(2, Counted::live);
+  EXPECT_EQ(5, c->value);
+
+  c.reset();
+  EXPECT_EQ(0, Counted::live);
+}
+
+// Allocations beyond a chunk start a new chunk,
+// and objects bigger than a chunk get a chunk of their own
+TEST(ArenaTest, ChunkGrowth)
+{
+  SPArena arena(new Arena(64));
+
+  for (int i = 0; i < 8; ++i)
+    arena->create<double>(i);
+  EXPECT_EQ(64u, arena->get_reserved());
+
+  arena->create<double>(8);
+  EXPECT_EQ(128u, arena->get_reserved());
+
+  struct Big { char data[200]; };
+  arena->create<Big>();
+  EXPECT_EQ(328u, arena->get_reserved());
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
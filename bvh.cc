@@ -0,0 +1,266 @@
+/* bvh.cc
+ *
+ * A bounding volume hierarchy over a set of axis-aligned bounding boxes
+ */
+
+#include "bvh.hh"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+using namespace std;
+
+// Maximum number of items in a leaf
+const unsigned int BVH::max_leaf_size;
+
+// Ratio of refit to built SAH cost at which refit() rebuilds instead
+const float BVH::rebuild_ratio = 1.5f;
+
+//! SAH cost of traversing a node, relative to intersecting an item
+static const float TRAVERSAL_COST = 0.5f;
+
+// Default constructor creates an empty hierarchy
+BVH::BVH()
+  : nodes()
+  , items()
+  , built_cost(0)
+{ }
+
+/*!
+ * \param bounds  Bounding box of each item, indexed by item
+ */
+void BVH::build(const vector<AABB> &bounds)
+{
+  nodes.clear();
+  items.resize(bounds.size());
+
+  for (unsigned int i = 0; i < items.size(); ++i)
+    items[i] = i;
+
+  if (!items.empty())
+  {
+    nodes.reserve(2 * items.size() / max_leaf_size + 1);
+    build_node(bounds, 0, items.size());
+  }
+
+  built_cost = sah_cost();
+}
+
+/*!
+ * Sums, over all nodes, the probability of a random ray through the root
+ * reaching the node (its surface area relative to the root's) times the cost
+ * of visiting it.  Leaves cost one per item; interior nodes TRAVERSAL_COST.
+ *
+ * \returns The expected cost of a ray through the root (0 if empty)
+ */
+float BVH::sah_cost() const
+{
+  if (nodes.empty()) return 0;
+
+  float root_area = nodes[0].bounds.surface_area();
+  if (root_area <= 0) return 0;
+
+  float cost = 0;
+  for (unsigned int i = 0; i < nodes.size(); ++i)
+  {
+    float p = nodes[i].bounds.surface_area() / root_area;
+    cost += p * (nodes[i].is_leaf() ? nodes[i].count : TRAVERSAL_COST);
+  }
+
+  return cost;
+}
+
+/*!
+ * Nodes are stored depth-first, so a subtree occupies a contiguous range
+ * which ends after its rightmost leaf.
+ *
+ * \param node  Index of root of the subtree
+ * \returns     Index one past the subtree's last node
+ */
+unsigned int BVH::subtree_end(unsigned int node) const
+{
+  while (!nodes[node].is_leaf())
+    node = nodes[node].right;
+
+  return node + 1;
+}
+
+/*!
+ * Each node's children lie after it, so walking the range backwards refits
+ * children before their parents.  The range must be closed under children
+ * (such as a whole subtree).
+ *
+ * \param bounds  Bounding box of each item, indexed by item
+ * \param first   First node to refit
+ * \param end     One past the last node to refit
+ */
+void BVH::refit_range(const vector<AABB> &bounds,
+                      unsigned int first, unsigned int end)
+{
+  for (unsigned int i = end; i-- > first; )
+  {
+    Node &node = nodes[i];
+    AABB box;
+
+    if (node.is_leaf())
+    {
+      for (unsigned int j = node.start; j < node.start + node.count; ++j)
+        box.expand(bounds[items[j]]);
+    }
+    else
+    {
+      box = nodes[i + 1].bounds;
+      box.expand(nodes[node.right].bounds);
+    }
+
+    node.bounds = box;
+  }
+}
+
+/*!
+ * Keeps the tree's structure and recomputes node bounds bottom-up, for items
+ * which have moved since the tree was built.  The number of items must be
+ * unchanged.
+ *
+ * Subtrees near the top of the tree are refit in parallel, and then the few
+ * nodes above them.  If moving items has made the tree much less efficient
+ * than when it was built (its SAH cost has risen by more than rebuild_ratio),
+ * it is rebuilt from scratch instead.
+ *
+ * \param bounds   Bounding box of each item, indexed by item
+ * \param threads  Number of threads to refit with
+ * \returns        true if the tree was rebuilt
+ */
+bool BVH::refit(const vector<AABB> &bounds, unsigned int threads)
+{
+  assert(bounds.size() == items.size());
+
+  if (nodes.empty()) return false;
+
+  // Gather roots of subtrees to refit in parallel, by splitting the top
+  // of the tree until there are a few subtrees per thread
+  vector<unsigned int> roots(1, 0);
+  vector<unsigned int> top;
+
+  if (threads > 1)
+  {
+    for (unsigned int depth = 0;
+         depth < max_depth && roots.size() < 4 * threads; ++depth)
+    {
+      vector<unsigned int> next;
+      for (unsigned int i = 0; i < roots.size(); ++i)
+      {
+        if (nodes[roots[i]].is_leaf())
+        {
+          next.push_back(roots[i]);
+        }
+        else
+        {
+          top.push_back(roots[i]);
+          next.push_back(roots[i] + 1);
+          next.push_back(nodes[roots[i]].right);
+        }
+      }
+
+      if (next.size() == roots.size()) break;
+      roots.swap(next);
+    }
+  }
+
+  if (roots.size() == 1)
+  {
+    refit_range(bounds, 0, nodes.size());
+  }
+  else
+  {
+    // Each thread takes every threads'th subtree
+    vector<thread> pool;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+      pool.push_back(thread([this, &bounds, &roots, t, threads]()
+      {
+        for (unsigned int i = t; i < roots.size(); i += threads)
+          refit_range(bounds, roots[i], subtree_end(roots[i]));
+      }));
+    }
+
+    for (unsigned int t = 0; t < pool.size(); ++t)
+      pool[t].join();
+
+    // Refit the nodes above the subtrees, children before parents
+    sort(top.begin(), top.end());
+    for (unsigned int i = top.size(); i-- > 0; )
+    {
+      Node &node = nodes[top[i]];
+      node.bounds = nodes[top[i] + 1].bounds;
+      node.bounds.expand(nodes[node.right].bounds);
+    }
+  }
+
+  // Rebuild if quality has degraded too far
+  if (sah_cost() > rebuild_ratio * built_cost)
+  {
+    build(bounds);
+    return true;
+  }
+
+  return false;
+}
+
+/*!
+ * Splits at the median item along the axis of greatest spread of the items'
+ * centers.  Median splits keep the tree balanced, bounding its depth.
+ *
+ * \param bounds  Bounding box of each item, indexed by item
+ * \param start   First entry of items in the subtree
+ * \param end     One past the last entry of items in the subtree
+ * \returns       Index of the new node
+ */
+unsigned int BVH::build_node(const vector<AABB> &bounds,
+                             unsigned int start, unsigned int end)
+{
+  unsigned int index = nodes.size();
+  nodes.push_back(Node());
+
+  // Bounds of the items, and of their centers
+  AABB box;
+  AABB centers;
+  for (unsigned int i = start; i < end; ++i)
+  {
+    box.expand(bounds[items[i]]);
+    centers.expand(bounds[items[i]].get_center());
+  }
+  nodes[index].bounds = box;
+
+  if (end - start <= max_leaf_size)
+  {
+    nodes[index].start = start;
+    nodes[index].count = end - start;
+    nodes[index].right = 0;
+    return index;
+  }
+
+  // Pick the axis with the greatest spread of centers
+  Vector3F spread = centers.get_max() - centers.get_min();
+  unsigned int axis = 0;
+  if (spread[1] > spread[axis]) axis = 1;
+  if (spread[2] > spread[axis]) axis = 2;
+
+  // Partition about the median
+  unsigned int mid = start + (end - start) / 2;
+  nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+              [&bounds, axis](unsigned int a, unsigned int b)
+              {
+                return bounds[a].get_center()[axis]
+                       < bounds[b].get_center()[axis];
+              });
+
+  nodes[index].count = 0;
+  build_node(bounds, start, mid);
+  unsigned int right = build_node(bounds, mid, end);
+
+  // (nodes may have been reallocated by the recursion)
+  nodes[index].right = right;
+
+  return index;
+}
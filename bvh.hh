@@ -0,0 +1,151 @@
+/* bvh.hh
+ *
+ * A bounding volume hierarchy over a set of axis-aligned bounding boxes
+ */
+
+#ifndef _BVH_HH__
+#define _BVH_HH__
+
+#include "aabb.hh"
+#include <vector>
+
+//! A bounding volume hierarchy over a list of items' bounding boxes
+/*!
+ * The hierarchy only stores item indices; the caller keeps the items
+ * themselves and is handed back their indices during traversal.
+ *
+ * Nodes are stored depth-first in a single array: an interior node's left
+ * child immediately follows it, and it records the index of its right child.
+ */
+class BVH
+{
+  public:
+  //! A node of the hierarchy
+  struct Node
+  {
+    //! Bounds of everything below this node
+    AABB bounds;
+    //! Leaf: Index of first entry in the item list
+    unsigned int start;
+    //! Leaf: Number of items (0 for interior nodes)
+    unsigned int count;
+    //! Interior: Index of right child node
+    unsigned int right;
+
+    //! Check if this node is a leaf
+    bool is_leaf() const { return count > 0; }
+  };
+
+  private:
+  //! Nodes, depth-first with the root at index 0
+  std::vector<Node> nodes;
+
+  //! Item indices, ordered so each leaf covers a contiguous range
+  std::vector<unsigned int> items;
+
+  //! SAH cost of the hierarchy when it was last built
+  float built_cost;
+
+  //! Recursively build the subtree for items[start, end)
+  unsigned int build_node(const std::vector<AABB> &bounds,
+                          unsigned int start, unsigned int end);
+
+  //! Index one past the last node of a subtree
+  unsigned int subtree_end(unsigned int node) const;
+
+  //! Recompute bounds of nodes [first, end), from the last to the first
+  void refit_range(const std::vector<AABB> &bounds,
+                   unsigned int first, unsigned int end);
+
+  public:
+  // === Constants
+
+  //! Maximum number of items in a leaf
+  static const unsigned int max_leaf_size = 4;
+
+  //! Maximum depth of the hierarchy (sizes traversal stacks)
+  static const unsigned int max_depth = 64;
+
+  //! Ratio of refit to built SAH cost at which refit() rebuilds instead
+  static const float rebuild_ratio;
+
+  // === Constructors & methods
+
+  //! Default constructor creates an empty hierarchy
+  BVH();
+
+  //! (Re)build the hierarchy over a list of item bounds
+  void build(const std::vector<AABB> &bounds);
+
+  //! Update node bounds for moved items, rebuilding if quality degrades
+  bool refit(const std::vector<AABB> &bounds, unsigned int threads = 1);
+
+  //! Surface area heuristic cost of the hierarchy
+  float sah_cost() const;
+
+  //! Check if the hierarchy contains no items
+  bool empty() const;
+
+  //! Accessor for the nodes of the hierarchy
+  const std::vector<Node> & get_nodes() const;
+
+  //! Accessor for the item indices referenced by leaves
+  const std::vector<unsigned int> & get_items() const;
+
+  //! Visit every item whose ancestors all pass a node test
+  template <typename NodeTest, typename ItemFn>
+  void traverse(NodeTest test, ItemFn fn) const;
+};
+
+// === Inline function definitions
+
+inline bool BVH::empty() const { return nodes.empty(); }
+
+inline const std::vector<BVH::Node> & BVH::get_nodes() const
+{
+  return nodes;
+}
+
+inline const std::vector<unsigned int> & BVH::get_items() const
+{
+  return items;
+}
+
+// Visit every item whose ancestors all pass a node test
+/*!
+ * \param test  Called as test(const AABB &) for each node reached;
+ *              the subtree is skipped if it returns false.
+ * \param fn    Called as fn(unsigned int index) for each item in a leaf
+ *              which passed the test.
+ */
+template <typename NodeTest, typename ItemFn>
+void BVH::traverse(NodeTest test, ItemFn fn) const
+{
+  if (nodes.empty()) return;
+
+  // Stack of nodes still to visit
+  unsigned int stack[max_depth];
+  unsigned int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const Node &node = nodes[stack[--top]];
+
+    if (!test(node.bounds)) continue;
+
+    if (node.is_leaf())
+    {
+      for (unsigned int i = node.start; i < node.start + node.count; ++i)
+        fn(items[i]);
+    }
+    else
+    {
+      // Visit left (the next node) before right
+      stack[top++] = node.right;
+      stack[top++] = &node - &nodes[0] + 1;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,164 @@
+/* bvh_test.cc
+ *
+ * gtest Unit Test Suite for the BVH class
+ */
+
+#include "bvh.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+using namespace testing;
+
+// Make a list of randomly placed boxes
+static vector<AABB> random_boxes(unsigned int n)
+{
+  srand(42);
+
+  vector<AABB> boxes;
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    Vector3F c = {float(rand() % 100), float(rand() % 100),
+                  float(rand() % 100)};
+    boxes.push_back(AABB::around_sphere(c, 1 + rand() % 10));
+  }
+
+  return boxes;
+}
+
+// An empty hierarchy visits nothing
+TEST(BVHTest, Empty)
+{
+  BVH bvh;
+  bvh.build(vector<AABB>());
+
+  EXPECT_TRUE(bvh.empty());
+
+  int visited = 0;
+  bvh.traverse([](const AABB &) { return true; },
+               [&visited](unsigned int) { ++visited; });
+  EXPECT_EQ(0, visited);
+}
+
+// Every item is visited exactly once when no nodes are culled
+TEST(BVHTest, VisitAll)
+{
+  vector<AABB> boxes = random_boxes(1000);
+
+  BVH bvh;
+  bvh.build(boxes);
+
+  vector<int> visits(boxes.size(), 0);
+  bvh.traverse([](const AABB &) { return true; },
+               [&visits](unsigned int i) { ++visits[i]; });
+
+  EXPECT_EQ(visits.size(), (size_t) count(visits.begin(), visits.end(), 1));
+}
+
+// Point queries find exactly the boxes a brute-force search does
+TEST(BVHTest, PointQuery)
+{
+  vector<AABB> boxes = random_boxes(1000);
+
+  BVH bvh;
+  bvh.build(boxes);
+
+  Vector3F p = {50, 50, 50};
+
+  vector<unsigned int> expected;
+  for (unsigned int i = 0; i < boxes.size(); ++i)
+    if (boxes[i].contains(p)) expected.push_back(i);
+
+  vector<unsigned int> found;
+  bvh.traverse([&p](const AABB &b) { return b.contains(p); },
+               [&](unsigned int i) { if (boxes[i].contains(p))
+                                       found.push_back(i); });
+  sort(found.begin(), found.end());
+
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(expected, found);
+}
+
+// Each node bounds its children
+TEST(BVHTest, NodesBoundChildren)
+{
+  BVH bvh;
+  bvh.build(random_boxes(100));
+
+  const vector<BVH::Node> &nodes = bvh.get_nodes();
+  for (unsigned int i = 0; i < nodes.size(); ++i)
+  {
+    if (nodes[i].is_leaf()) continue;
+
+    AABB children = nodes[i + 1].bounds;
+    children.expand(nodes[nodes[i].right].bounds);
+
+    for (unsigned int a = 0; a < 3; ++a)
+    {
+      EXPECT_FLOAT_EQ(children.get_min()[a], nodes[i].bounds.get_min()[a]);
+      EXPECT_FLOAT_EQ(children.get_max()[a], nodes[i].bounds.get_max()[a]);
+    }
+  }
+}
+
+// Refitting after small moves matches brute force, in parallel or not
+TEST(BVHTest, RefitSmallMoves)
+{
+  vector<AABB> boxes = random_boxes(1000);
+
+  for (unsigned int threads = 1; threads <= 4; threads += 3)
+  {
+    BVH bvh;
+    bvh.build(boxes);
+
+    // Nudge every box a little
+    vector<AABB> moved;
+    for (unsigned int i = 0; i < boxes.size(); ++i)
+    {
+      Vector3F d = {float(i % 3), float(i % 5) - 2, 1};
+      moved.push_back(AABB(boxes[i].get_min() + d, boxes[i].get_max() + d));
+    }
+
+    EXPECT_FALSE(bvh.refit(moved, threads));
+
+    Vector3F p = {50, 50, 50};
+
+    vector<unsigned int> expected;
+    for (unsigned int i = 0; i < moved.size(); ++i)
+      if (moved[i].contains(p)) expected.push_back(i);
+
+    vector<unsigned int> found;
+    bvh.traverse([&p](const AABB &b) { return b.contains(p); },
+                 [&](unsigned int i) { if (moved[i].contains(p))
+                                         found.push_back(i); });
+    sort(found.begin(), found.end());
+
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(expected, found);
+  }
+}
+
+// Scrambling the items degrades the tree enough to trigger a rebuild
+TEST(BVHTest, RefitRebuildsWhenDegraded)
+{
+  vector<AABB> boxes = random_boxes(1000);
+
+  BVH bvh;
+  bvh.build(boxes);
+  float built = bvh.sah_cost();
+
+  // Pair each box's position with another box's
+  vector<AABB> scrambled(boxes.rbegin(), boxes.rend());
+
+  EXPECT_TRUE(bvh.refit(scrambled));
+  EXPECT_LT(bvh.sah_cost(), BVH::rebuild_ratio * built);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
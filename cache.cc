@@ -0,0 +1,358 @@
+/* cache.cc
+ *
+ * An on-disk cache of rendered framebuffers, keyed by scene content
+ */
+
+#include "cache.hh"
+#include "hash.hh"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+//! Identifies (this version of) the entry format ("RTC2")
+static const uint32_t CACHE_MAGIC = 0x52544332;
+
+//! Number of words in an entry's header
+static const unsigned int HEADER_WORDS = 5;
+
+// Default maximum size of the cache (in bytes)
+const uint64_t RenderCache::default_max_bytes = uint64_t(1) << 30;
+
+/*!
+ * \param dir        Directory holding the entries
+ * \param max_bytes  Maximum total size of the entries in bytes
+ */
+RenderCache::RenderCache(const string &dir, uint64_t max_bytes)
+  : dir(dir)
+  , max_bytes(max_bytes)
+{
+  if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST)
+    cerr << "Warning: Couldn't create cache directory " << dir << endl;
+}
+
+/*!
+ * Hashes everything which determines the sums of a pixel's samples, other
+ * than the number of samples (so entries may be refined).
+ *
+ * \param scn       Scene to render
+ * \param cam       Camera from which to render the scene
+ * \param img_size  Pixel dimensions of image
+ * \param opt       Render settings
+ * \returns         Key for cache entries of the render
+ */
+uint64_t RenderCache::key(const Scene &scn, const Camera &cam, int img_size,
+                          const RenderOptions &opt)
+{
+  Hash h;
+
+  h.add(CACHE_MAGIC);
+  scn.hash(h);
+  cam.hash(h);
+
+  h.add(uint32_t(img_size));
+  h.add(uint32_t(opt.light_samples)).add(uint32_t(opt.seed));
+  h.add(uint32_t(opt.max_depth)).add(uint32_t(opt.area_samples));
+
+  // (Only hashed when set, so keys of existing entries are unchanged)
+  if (opt.hdr) h.add(uint32_t(1));
+  if (opt.refine_hits) h.add(uint32_t(2));
+
+  return h.get_value();
+}
+
+/*!
+ * Files in the directory which are not named like entries are ignored.
+ *
+ * \param[out] entries  Entries found in the cache directory
+ */
+void RenderCache::list(vector<Entry> &entries) const
+{
+  entries.clear();
+
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) return;
+
+  for (dirent *de = readdir(d); de != NULL; de = readdir(d))
+  {
+    Entry e;
+    unsigned long long key;
+    char name[64];
+
+    // Name must be exactly as store() writes it
+    if (sscanf(de->d_name, "%16llx-%d-%d-%u.rtc",
+               &key, &e.y_begin, &e.y_end, &e.samples) != 4)
+      continue;
+
+    snprintf(name, sizeof(name), "%016llx-%d-%d-%u.rtc",
+             key, e.y_begin, e.y_end, e.samples);
+    if (strcmp(name, de->d_name) != 0) continue;
+
+    e.key = key;
+    e.path = dir + '/' + de->d_name;
+
+    struct stat st;
+    if (stat(e.path.c_str(), &st) < 0) continue;
+
+    e.size = st.st_size;
+    e.used = st.st_mtim;
+
+    entries.push_back(e);
+  }
+
+  closedir(d);
+}
+
+/*!
+ * \param e        Entry to load
+ * \param fb       Framebuffer with no samples in the rows to load
+ * \param y_begin  First row to load (if held by the entry)
+ * \param y_end    One past the last row to load (if held by the entry)
+ * \returns        true if the entry was valid and added to fb
+ */
+bool RenderCache::load(const Entry &e, Framebuffer &fb, int y_begin,
+                       int y_end) const
+{
+  ifstream ifs(e.path.c_str(), ios::binary);
+
+  uint32_t header[HEADER_WORDS];
+  if (!ifs.read((char *) header, sizeof(header))) return false;
+
+  if (header[0] != CACHE_MAGIC || int(header[1]) != fb.get_width()
+      || int(header[2]) != e.y_begin || int(header[3]) != e.y_end
+      || header[4] != e.samples || e.y_end > fb.get_height())
+    return false;
+
+  vector<float> sums(3 * fb.get_width() * (e.y_end - e.y_begin));
+  if (!ifs.read((char *) &sums[0], sums.size() * sizeof(float))) return false;
+
+  for (int y = max(e.y_begin, y_begin); y < min(e.y_end, y_end); ++y)
+  {
+    unsigned int i = 3 * fb.get_width() * (y - e.y_begin);
+
+    for (int x = 0; x < fb.get_width(); ++x, i += 3)
+      fb.add(x, y, Color(sums[i], sums[i + 1], sums[i + 2]));
+  }
+
+  return true;
+}
+
+/*!
+ * The entry is written to a temporary file which is then renamed into
+ * place, so readers never see a partially written entry.
+ *
+ * \param key      Key of the render
+ * \param fb       Rendered framebuffer
+ * \param y_begin  First row to store
+ * \param y_end    One past the last row to store
+ * \returns        true if the entry was written
+ */
+bool RenderCache::store(uint64_t key, const Framebuffer &fb, int y_begin,
+                        int y_end) const
+{
+  char name[64];
+  snprintf(name, sizeof(name), "%016llx-%d-%d-%u.rtc",
+           (unsigned long long) key, y_begin, y_end, fb.get_samples());
+
+  string path = dir + '/' + name;
+  string tmp_path = path + ".tmp";
+
+  {
+    ofstream ofs(tmp_path.c_str(), ios::binary);
+
+    uint32_t header[HEADER_WORDS] = { CACHE_MAGIC, uint32_t(fb.get_width()),
+                                      uint32_t(y_begin), uint32_t(y_end),
+                                      fb.get_samples() };
+    ofs.write((const char *) header, sizeof(header));
+
+    vector<float> sums;
+    sums.reserve(3 * fb.get_width() * (y_end - y_begin));
+    for (int y = y_begin; y < y_end; ++y)
+    {
+      for (int x = 0; x < fb.get_width(); ++x)
+      {
+        const Color &c = fb.get_sum(x, y);
+        sums.push_back(c.get_red());
+        sums.push_back(c.get_green());
+        sums.push_back(c.get_blue());
+      }
+    }
+    ofs.write((const char *) &sums[0], sums.size() * sizeof(float));
+
+    if (!ofs)
+    {
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) return false;
+
+  touch(path);
+  return true;
+}
+
+//! Check if one time is before another
+static bool earlier(const timespec &a, const timespec &b)
+{
+  if (a.tv_sec != b.tv_sec) return a.tv_sec < b.tv_sec;
+  return a.tv_nsec < b.tv_nsec;
+}
+
+/*!
+ * Sets the entry's modification time to now, or just after the latest in
+ * the cache if that is no earlier.  (File times may be much coarser than the
+ * interval between uses, so the clock alone may not order them.)
+ *
+ * \param path  Path of the entry's file
+ */
+void RenderCache::touch(const string &path) const
+{
+  vector<Entry> entries;
+  list(entries);
+
+  timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+
+  for (unsigned int i = 0; i < entries.size(); ++i)
+  {
+    if (entries[i].path != path && !earlier(entries[i].used, t))
+    {
+      t = entries[i].used;
+      if (++t.tv_nsec == 1000000000)
+      {
+        ++t.tv_sec;
+        t.tv_nsec = 0;
+      }
+    }
+  }
+
+  timespec times[2] = { t, t };
+  utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+/*!
+ * The most recently used entry is always kept.
+ */
+void RenderCache::evict() const
+{
+  vector<Entry> entries;
+  list(entries);
+
+  uint64_t total = 0;
+  for (unsigned int i = 0; i < entries.size(); ++i)
+    total += entries[i].size;
+
+  // Least recently used first
+  sort(entries.begin(), entries.end(),
+       [](const Entry &a, const Entry &b) { return earlier(a.used, b.used); });
+
+  for (unsigned int i = 0; total > max_bytes && i + 1 < entries.size(); ++i)
+  {
+    if (unlink(entries[i].path.c_str()) == 0)
+      total -= entries[i].size;
+  }
+}
+
+/*!
+ * Renders opt.pixel_samples samples per pixel for rows [y_begin, y_end)
+ * into fb, exactly as Scene::render_pass would for the first pass.
+ *
+ * The cached entry which saves the most work is used: its rows which were
+ * requested are loaded and refined with any further samples requested, and
+ * the other requested rows are rendered in full.  Unless the request was
+ * cached in full, the result is then stored as a new entry.
+ *
+ * \param scn      Prepared Scene to render
+ * \param cam      Camera from which to render the scene
+ * \param opt      Render settings
+ * \param fb       Framebuffer with no samples, in which to render
+ *                 (Only square images supported)
+ * \param y_begin  First row to render
+ * \param y_end    One past the last row to render
+ * \returns        How much of the render was cached
+ */
+RenderCache::Result RenderCache::render(const Scene &scn, const Camera &cam,
+                                        const RenderOptions &opt,
+                                        Framebuffer &fb,
+                                        int y_begin, int y_end) const
+{
+  assert(fb.get_samples() == 0);
+  assert(0 <= y_begin && y_begin < y_end && y_end <= fb.get_height());
+
+  uint64_t k = key(scn, cam, fb.get_width(), opt);
+  unsigned int samples = opt.pixel_samples;
+
+  // Find the entry covering the most requested samples
+  vector<Entry> entries;
+  list(entries);
+
+  const Entry *best = NULL;
+  uint64_t best_work = 0;
+
+  for (unsigned int i = 0; i < entries.size(); ++i)
+  {
+    const Entry &e = entries[i];
+
+    if (e.key != k || e.samples > samples) continue;
+
+    int overlap = min(e.y_end, y_end) - max(e.y_begin, y_begin);
+    if (overlap <= 0) continue;
+
+    uint64_t work = uint64_t(overlap) * e.samples;
+    if (work > best_work)
+    {
+      best = &e;
+      best_work = work;
+    }
+  }
+
+  // Rows & samples already rendered
+  int cached_begin = y_begin, cached_end = y_begin;
+  unsigned int cached_samples = 0;
+
+  if (best != NULL && load(*best, fb, y_begin, y_end))
+  {
+    cached_begin = max(best->y_begin, y_begin);
+    cached_end = min(best->y_end, y_end);
+    cached_samples = best->samples;
+
+    touch(best->path);
+  }
+
+  // Refine the cached rows with the remaining samples
+  if (cached_samples < samples && cached_begin < cached_end)
+  {
+    RenderOptions refine_opt = opt;
+    refine_opt.pixel_samples = samples - cached_samples;
+    scn.render_rows(cam, fb, refine_opt, cached_samples,
+                    cached_begin, cached_end);
+  }
+
+  // Render the uncached rows in full
+  scn.render_rows(cam, fb, opt, 0, y_begin, cached_begin);
+  scn.render_rows(cam, fb, opt, 0, cached_end, y_end);
+
+  fb.end_pass(samples);
+
+  if (cached_begin == y_begin && cached_end == y_end
+      && cached_samples == samples)
+    return HIT;
+
+  if (!store(k, fb, y_begin, y_end))
+    cerr << "Warning: Couldn't write to render cache " << dir << endl;
+  else
+    evict();
+
+  return (cached_end > cached_begin) ? PARTIAL_HIT : MISS;
+}
@@ -0,0 +1,108 @@
+/* cache.hh
+ *
+ * An on-disk cache of rendered framebuffers, keyed by scene content
+ */
+
+#ifndef _CACHE_HH__
+#define _CACHE_HH__
+
+#include "scene.hh"
+#include "camera.hh"
+#include "framebuffer.hh"
+#include "renderoptions.hh"
+#include <stdint.h>
+#include <ctime>
+#include <string>
+#include <vector>
+
+//! An on-disk cache of rendered framebuffers
+/*!
+ * Each entry holds the sums of samples for a band of rows of an image,
+ * and is keyed by a hash of everything else which determines those sums:
+ * the Scene's objects and lights, the Camera, the image size and the
+ * render settings (other than the number of samples).
+ *
+ * Since every sample is keyed by its pixel and sample number, an entry with
+ * fewer samples than requested holds exactly the first samples of the
+ * request, and is refined by rendering only the rest.  Likewise an entry
+ * covering some of the requested rows only leaves the other rows to render.
+ *
+ * Entries are files in the cache directory, named for their key, rows and
+ * samples.  When the cache grows beyond its size limit, the least recently
+ * used entries (by modification time, which is updated on use) are removed.
+ * Entries store floats in host byte order, so a cache should not be shared
+ * between hosts of different architectures.
+ */
+class RenderCache
+{
+  //! An entry in the cache directory
+  struct Entry
+  {
+    //! Path of the entry's file
+    std::string path;
+    //! Key of the scene, camera and settings
+    uint64_t key;
+    //! First row held
+    int y_begin;
+    //! One past the last row held
+    int y_end;
+    //! Number of samples per pixel
+    unsigned int samples;
+    //! Size of the file in bytes
+    uint64_t size;
+    //! Time the entry was last used
+    timespec used;
+  };
+
+  //! Directory holding the entries
+  std::string dir;
+  //! Maximum total size of the entries in bytes
+  uint64_t max_bytes;
+
+  //! List the entries in the cache directory
+  void list(std::vector<Entry> &entries) const;
+
+  //! Add an entry's rows within a band to a framebuffer
+  bool load(const Entry &e, Framebuffer &fb, int y_begin, int y_end) const;
+
+  //! Write rows of a framebuffer as a new entry
+  bool store(uint64_t key, const Framebuffer &fb, int y_begin,
+             int y_end) const;
+
+  //! Mark an entry as the most recently used
+  void touch(const std::string &path) const;
+
+  //! Remove least recently used entries until within the size limit
+  void evict() const;
+
+  public:
+  //! Outcome of a cached render
+  enum Result
+  {
+    MISS,         //!< Nothing usable was cached; everything was rendered
+    PARTIAL_HIT,  //!< A cached entry was refined or extended
+    HIT           //!< The whole request was cached
+  };
+
+  // === Constants
+
+  //! Default maximum size of the cache (in bytes)
+  static const uint64_t default_max_bytes;
+
+  // === Constructors & methods
+
+  //! Construct a cache in a directory (created if need be)
+  explicit RenderCache(const std::string &dir,
+                       uint64_t max_bytes = default_max_bytes);
+
+  //! Compute the key for rendering a Scene
+  static uint64_t key(const Scene &scn, const Camera &cam, int img_size,
+                      const RenderOptions &opt);
+
+  //! Render rows of an image, reusing & adding to cached renders
+  Result render(const Scene &scn, const Camera &cam,
+                const RenderOptions &opt, Framebuffer &fb,
+                int y_begin, int y_end) const;
+};
+
+#endif
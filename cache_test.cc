@@ -0,0 +1,143 @@
+/* cache_test.cc
+ *
+ * gtest Unit Test Suite for RenderCache
+ */
+
+#include "cache.hh"
+#include "testscene.hh"
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cstdlib>
+
+using namespace std;
+using namespace testing;
+
+struct RenderCacheTest : public Test
+{
+  static const int img_size = 24;
+
+  Scene scn;
+  Camera cam;
+  RenderOptions opt;
+  string dir;
+
+  virtual void SetUp()
+  {
+    build_test_scene(scn);
+    cam = test_camera();
+
+    opt.pixel_samples = 4;
+    opt.light_samples = 1;
+
+    char tmpl[] = "/tmp/cache_test.XXXXXX";
+    ASSERT_TRUE(mkdtemp(tmpl) != NULL);
+    dir = tmpl;
+  }
+
+  virtual void TearDown()
+  {
+    DIR *d = opendir(dir.c_str());
+    for (dirent *de = readdir(d); de != NULL; de = readdir(d))
+      unlink((dir + '/' + de->d_name).c_str());
+    closedir(d);
+    rmdir(dir.c_str());
+  }
+
+  // Render rows without the cache
+  string render_fresh(int y_begin, int y_end)
+  {
+    Framebuffer fb(img_size, img_size);
+    scn.render_rows(cam, fb, opt, 0, y_begin, y_end);
+    fb.end_pass(opt.pixel_samples);
+    return to_ppm(fb, y_begin, y_end);
+  }
+
+  // Render rows through a cache, checking how much was cached
+  string render_cached(RenderCache &cache, int y_begin, int y_end,
+                       RenderCache::Result expected)
+  {
+    Framebuffer fb(img_size, img_size);
+    EXPECT_EQ(expected, cache.render(scn, cam, opt, fb, y_begin, y_end));
+    return to_ppm(fb, y_begin, y_end);
+  }
+
+  // Number of entries in the cache directory
+  int count_entries()
+  {
+    int n = 0;
+    DIR *d = opendir(dir.c_str());
+    for (dirent *de = readdir(d); de != NULL; de = readdir(d))
+      if (de->d_name[0] != '.') ++n;
+    closedir(d);
+    return n;
+  }
+};
+
+// A repeated render is a hit, and identical
+TEST_F(RenderCacheTest, HitMatchesFresh)
+{
+  RenderCache cache(dir);
+  string fresh = render_fresh(0, img_size);
+
+  EXPECT_EQ(fresh, render_cached(cache, 0, img_size, RenderCache::MISS));
+  EXPECT_EQ(fresh, render_cached(cache, 0, img_size, RenderCache::HIT));
+
+  // A different camera misses
+  cam = test_camera(1.5);
+  render_cached(cache, 0, img_size, RenderCache::MISS);
+}
+
+// Fewer cached samples, or a crop, are refined to match a fresh render
+TEST_F(RenderCacheTest, PartialHitsRefine)
+{
+  RenderCache cache(dir);
+
+  opt.pixel_samples = 2;
+  render_cached(cache, 4, 12, RenderCache::MISS);
+
+  opt.pixel_samples = 4;
+  EXPECT_EQ(render_fresh(4, 12),
+            render_cached(cache, 4, 12, RenderCache::PARTIAL_HIT));
+
+  // Extend the crop to the whole image
+  EXPECT_EQ(render_fresh(0, img_size),
+            render_cached(cache, 0, img_size, RenderCache::PARTIAL_HIT));
+
+  // A crop of a cached render is a hit
+  EXPECT_EQ(render_fresh(8, 10),
+            render_cached(cache, 8, 10, RenderCache::HIT));
+}
+
+// The least recently used entries are evicted beyond the size limit
+TEST_F(RenderCacheTest, EvictsLeastRecentlyUsed)
+{
+  // Room for about two full images
+  RenderCache cache(dir, 2 * 12 * img_size * img_size + 100);
+
+  opt.seed = 1;
+  render_cached(cache, 0, img_size, RenderCache::MISS);
+  opt.seed = 2;
+  render_cached(cache, 0, img_size, RenderCache::MISS);
+
+  // Use the first, so the second is least recently used
+  opt.seed = 1;
+  render_cached(cache, 0, img_size, RenderCache::HIT);
+
+  opt.seed = 3;
+  render_cached(cache, 0, img_size, RenderCache::MISS);
+  EXPECT_EQ(2, count_entries());
+
+  opt.seed = 1;
+  render_cached(cache, 0, img_size, RenderCache::HIT);
+  opt.seed = 2;
+  render_cached(cache, 0, img_size, RenderCache::MISS);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
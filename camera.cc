@@ -4,6 +4,7 @@
  */
 
 #include "camera.hh"
+#include "rebase.hh"
 
 // define math constants such as M_PI
 #define _USE_MATH_DEFINES
@@ -76,12 +77,50 @@ bool Camera::valid()
  * \param img_size  Pixel dimensions of image (only square images supported)
  */
 Ray Camera::get_ray_for_pixel(int x, int y, int img_size) const
+{
+  return get_ray_for_pixel(float(x), float(y), img_size);
+}
+
+// Generate a ray for a point within the image, in pixel coordinates
+/*!
+ * Pixel (x, y) is centered on the point (x, y), so fractional coordinates
+ * may be used to sample anywhere within a pixel.
+ *
+ * The ray's differentials are those of the beam through a whole pixel.
+ *
+ * \param x, y      Image coordinates, -0.5 <= (x,y) < img_size - 0.5
+ * \param img_size  Pixel dimensions of image (only square images supported)
+ */
+Ray Camera::get_ray_for_pixel(float x, float y, int img_size) const
 {
   Vector3F pixel_dir = distance * direction
-                       + (0.5f - float(y) / (img_size - 1)) * up
-                       + (float(x) / (img_size - 1) - 0.5f) * right;
+                       + (0.5f - y / (img_size - 1)) * up
+                       + (x / (img_size - 1) - 0.5f) * right;
+
+  Ray r(position, pixel_dir);
 
-  return Ray(position, pixel_dir);
+  // Change in the unnormalized direction per pixel, less its component
+  // along the ray, which normalizing takes out
+  float len = pixel_dir.norm();
+  Vector3F dx = right / float(img_size - 1);
+  Vector3F dy = up / float(1 - img_size);
+
+  const Vector3F &d = r.get_dir();
+  RayDifferentials diff;
+  diff.dddx = (dx - dot(dx, d) * d) / len;
+  diff.dddy = (dy - dot(dy, d) * d) / len;
+  r.set_differentials(diff);
+
+  return r;
+}
+
+/*!
+ * \param h Hash to which to add the camera
+ */
+void Camera::hash(Hash &h) const
+{
+  h.add(position).add(direction).add(fov);
+  h.add(up).add(right).add(distance);
 }
 
 /*! \relates Camera
@@ -91,6 +130,9 @@ Ray Camera::get_ray_for_pixel(int x, int y, int img_size) const
  * With the read formats for Vectors, this looks like:
  * "(px py pz) (lx ly lz) (ux uy uz)"
  *
+ * The position & lookat point are read with read_position(), so are
+ * relative to the stream's origin, if it has one.
+ *
  * \param is  Input stream from which to read a new Plane
  * \returns   a Camera, (invalid if reading failed)
  */
@@ -104,8 +146,8 @@ Camera read_Camera(std::istream &is)
   Vector3F u;
 
   // Read components
-  is >> p;
-  is >> l;
+  read_position(is, p);
+  read_position(is, l);
   is >> u;
 
   if (is)
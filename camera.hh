@@ -3,7 +3,11 @@
  * A Camera implementation that renders a Scene by ray tracing
  */
 
+#ifndef _CAMERA_HH__
+#define _CAMERA_HH__
+
 #include "ray.hh"
+#include "hash.hh"
 
 //! Camera for generating Rays to trace a Scene
 class Camera
@@ -36,9 +40,17 @@ class Camera
 
   //! Generate a ray for a given pixel
   Ray get_ray_for_pixel(int x, int y, int img_size) const;
+
+  //! Generate a ray for a point within the image, in pixel coordinates
+  Ray get_ray_for_pixel(float x, float y, int img_size) const;
+
+  //! Add everything affecting the camera's view to a hash
+  void hash(Hash &h) const;
 };
 
 /*! \relates Camera
  * \brief Function to read a Camera from an input stream
  */
 Camera read_Camera(std::istream &is);
+
+#endif
@@ -0,0 +1,160 @@
+/* camerapath.cc
+ *
+ * A sequence of Camera placements for rendering animation frames
+ */
+
+#include "camerapath.hh"
+#include "rebase.hh"
+#include <cassert>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+// Default constructor creates an empty path
+CameraPath::CameraPath()
+  : keys()
+{ }
+
+/*!
+ * \param frame     Frame number (must follow the last keyframe)
+ * \param position  Position of the camera
+ * \param target    Position at which the camera is pointed
+ * \param up        Up vector for view
+ * \returns         true if the key was added (false if out of order)
+ */
+bool CameraPath::add_key(unsigned int frame, const Vector3F &position,
+                         const Vector3F &target, const Vector3F &up)
+{
+  if (!keys.empty() && frame <= keys.back().frame)
+    return false;
+
+  Key k = { frame, position, target, up };
+  keys.push_back(k);
+
+  return true;
+}
+
+/*!
+ * Frames are numbered from 0 to the last keyframe.
+ * \returns Number of frames (0 if the path is empty)
+ */
+unsigned int CameraPath::get_frame_count() const
+{
+  return keys.empty() ? 0 : keys.back().frame + 1;
+}
+
+/*!
+ * \returns Frame number following the last keyframe
+ */
+unsigned int CameraPath::get_next_frame() const
+{
+  return get_frame_count();
+}
+
+/*!
+ * Frames before the first keyframe use the first keyframe's placement.
+ *
+ * \param frame Frame number (must be less than get_frame_count())
+ * \returns     Camera for the frame
+ */
+Camera CameraPath::get_camera(unsigned int frame) const
+{
+  assert(frame < get_frame_count());
+
+  // Find the first keyframe at or after frame
+  unsigned int i = 0;
+  while (keys[i].frame < frame) ++i;
+
+  if (i == 0 || keys[i].frame == frame)
+    return Camera(keys[i].position, keys[i].target, keys[i].up);
+
+  // Interpolate between the surrounding keyframes
+  const Key &k0 = keys[i - 1];
+  const Key &k1 = keys[i];
+  float s = float(frame - k0.frame) / (k1.frame - k0.frame);
+
+  return Camera((1 - s) * k0.position + s * k1.position,
+                (1 - s) * k0.target + s * k1.target,
+                (1 - s) * k0.up + s * k1.up);
+}
+
+/*! \relates CameraPath
+ * Reads a CameraPath from the provided input stream.
+ *
+ * Each line describes a keyframe in one of two formats:
+ *
+ * - camera (position vector) (look at vector) (up vector)
+ * - key frame_number (position vector) (look at vector) (up vector)
+ *
+ * A "camera" line is placed at the frame after the previous keyframe,
+ * so a list of camera lines gives one frame each.  Keyframes must be listed
+ * in increasing order of frame number.
+ *
+ * Empty lines are ignored, as are comment lines which begin with "#".
+ *
+ * Positions & look at points are relative to the stream's origin, if it
+ * has one (see rebase.hh).
+ *
+ * \param[in]  is    An input stream to read.  Reading stops at EOF.
+ * \param[out] path  Camera path read from the stream
+ * \returns          true if input reaches EOF successfully.
+ */
+bool read_CameraPath(istream &is, CameraPath &path)
+{
+  path = CameraPath();
+
+  // Success flag (continue reading lines after error, to identify all errors)
+  bool success = true;
+
+  string line;
+  int ln = 0;
+  while (getline(is, line))
+  {
+    ++ln;
+
+    // Check for comment line
+    if (line.length() == 0 || line[0] == '#') continue;
+
+    istringstream iss(line);
+    set_read_origin(iss, get_read_origin(is));
+
+    string type;
+    iss >> type;
+
+    // Check for empty line
+    if (!iss) continue;
+
+    unsigned int frame = path.get_next_frame();
+    if (type == "key")
+    {
+      iss >> frame;
+    }
+    else if (type != "camera")
+    {
+      success = false;
+      cerr << "Error: Unrecognized type \"" << type << "\" on line " << ln;
+      cerr << endl;
+      continue;
+    }
+
+    Vector3F p, l, u;
+    read_position(iss, p);
+    read_position(iss, l);
+    iss >> u;
+
+    if (!iss || !Camera(p, l, u).valid())
+    {
+      success = false;
+      cerr << "Error: Couldn't read camera (or invalid camera) on line ";
+      cerr << ln << endl;
+    }
+    else if (!path.add_key(frame, p, l, u))
+    {
+      success = false;
+      cerr << "Error: Keyframe out of order on line " << ln << endl;
+    }
+  }
+
+  return success;
+}
@@ -0,0 +1,62 @@
+/* camerapath.hh
+ *
+ * A sequence of Camera placements for rendering animation frames
+ */
+
+#ifndef _CAMERAPATH_HH__
+#define _CAMERAPATH_HH__
+
+#include "camera.hh"
+#include <vector>
+#include <iostream>
+
+//! A sequence of Camera placements, one per animation frame
+/*!
+ * The path is defined by keyframes, each placing the camera at a given frame
+ * with a position, look-at target and up vector.  Frames between keyframes
+ * interpolate these vectors linearly.
+ */
+class CameraPath
+{
+  //! A camera placement at a given frame
+  struct Key
+  {
+    //! Frame number
+    unsigned int frame;
+    //! Camera position
+    Vector3F position;
+    //! Camera look-at target
+    Vector3F target;
+    //! Camera up vector
+    Vector3F up;
+  };
+
+  //! Keyframes, in increasing order of frame number
+  std::vector<Key> keys;
+
+  public:
+  // === Constructors & methods
+
+  //! Default constructor creates an empty path
+  CameraPath();
+
+  //! Add a keyframe after all existing keyframes
+  bool add_key(unsigned int frame, const Vector3F &position,
+               const Vector3F &target, const Vector3F &up);
+
+  //! Number of frames in the path
+  unsigned int get_frame_count() const;
+
+  //! Frame number following the last keyframe (0 if empty)
+  unsigned int get_next_frame() const;
+
+  //! Get the Camera for a frame
+  Camera get_camera(unsigned int frame) const;
+};
+
+/*! \relates CameraPath
+ * \brief Function to read a CameraPath from an input stream
+ */
+bool read_CameraPath(std::istream &is, CameraPath &path);
+
+#endif
@@ -0,0 +1,459 @@
+/* csg.cc
+ *
+ * A SceneObject combining solids by constructive solid geometry
+ */
+
+#include "csg.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include <cassert>
+#include <cmath>
+#include <typeinfo>
+
+using namespace std;
+
+//! Bounds of an operand, which must be bounded
+static AABB operand_bounds(const SceneObject &obj)
+{
+  AABB b;
+  bool bounded = obj.get_bounds(b);
+  assert(bounded);
+  return b;
+}
+
+/*!
+ * \param op  Operation combining the operands
+ * \param l   Left operand (must be a solid; see is_solid)
+ * \param r   Right operand (must be a solid; see is_solid)
+ */
+CSG::CSG(Operation op, const SPSceneObject &l, const SPSceneObject &r)
+  : op(op)
+  , left(l)
+  , right(r)
+{
+  assert(is_solid(*left) && is_solid(*right));
+  bounds = combined_bounds(op, *left, *right);
+}
+
+/*!
+ * \param op   Operation combining the operands
+ * \param l    Left operand (must be a solid; see is_solid)
+ * \param r    Right operand (must be a solid; see is_solid)
+ * \param c    Surface color of the combination
+ * \param ref  Surface reflectivity of the combination
+ */
+CSG::CSG(Operation op, const SPSceneObject &l, const SPSceneObject &r,
+         const Color &c, float ref)
+  : SceneObject(c, ref)
+  , op(op)
+  , left(l)
+  , right(r)
+{
+  assert(is_solid(*left) && is_solid(*right));
+  bounds = combined_bounds(op, *left, *right);
+}
+
+/*!
+ * \param obj  An object
+ * \returns    true if obj is a Sphere, Cylinder or CSG node
+ */
+bool CSG::is_solid(const SceneObject &obj)
+{
+  const type_info &type = typeid(obj);
+
+  return type == typeid(Sphere) || type == typeid(Cylinder)
+         || type == typeid(CSG);
+}
+
+/*!
+ * Spans are found along the whole line of the ray, though only those
+ * reaching in front of the origin are kept.  A span behind which the origin
+ * lies inside the solid starts at -FLT_MAX.
+ *
+ * \param[in]  obj      A solid (see is_solid)
+ * \param[in]  r        Ray to intersect
+ * \param[in]  inv_dir  Reciprocal of each component of the ray's direction
+ * \param[out] spans    Spans of the ray inside obj, in order
+ */
+void CSG::get_spans(const SceneObject &obj, const Ray &r,
+                    const Vector3F &inv_dir, vector<Span> &spans)
+{
+  spans.clear();
+
+  const type_info &type = typeid(obj);
+
+  if (type == typeid(Sphere))
+  {
+    const Sphere &sph = static_cast<const Sphere &>(obj);
+
+    // Only intersections in front of the origin are returned, so a single
+    // intersection is an exit if the origin is inside (else a tangent)
+    float t1, t2;
+    int count = sph.Sphere::get_intersections(r, t1, t2);
+    float radius = sph.get_radius();
+
+    if (count == 2)
+    {
+      Span s = { t1, t2 };
+      spans.push_back(s);
+    }
+    else if (count == 1
+             && (r.get_orig() - sph.get_center()).norm_sq() < radius * radius)
+    {
+      Span s = { -FLT_MAX, t1 };
+      spans.push_back(s);
+    }
+  }
+  else if (type == typeid(Cylinder))
+  {
+    // (Cylinder::get_intersections has no caps, so the closed solid is
+    //  found as the span within the infinite tube and between the caps)
+    const Cylinder &cyl = static_cast<const Cylinder &>(obj);
+
+    Vector3F a = cyl.get_axis().get_normalized();
+    Vector3F o = r.get_orig() - cyl.get_center();
+    const Vector3F &d = r.get_dir();
+
+    float oa = dot(o, a), da = dot(d, a);
+    float half = cyl.get_height() / 2;
+
+    // Span between the caps
+    float t_in = -FLT_MAX, t_out = FLT_MAX;
+
+    if (da != 0)
+    {
+      float s0 = (-half - oa) / da, s1 = (half - oa) / da;
+      t_in = fmin(s0, s1);
+      t_out = fmax(s0, s1);
+    }
+    else if (fabs(oa) > half)
+    {
+      return;
+    }
+
+    // Span within the tube
+    Vector3F o_perp = o - oa * a;
+    Vector3F d_perp = d - da * a;
+
+    float qa = d_perp.norm_sq();
+    float qb = 2 * dot(o_perp, d_perp);
+    float qc = o_perp.norm_sq() - cyl.get_radius() * cyl.get_radius();
+
+    if (qa != 0)
+    {
+      float disc = qb * qb - 4 * qa * qc;
+      if (disc <= 0) return;
+
+      float root = sqrt(disc);
+      t_in = fmax(t_in, (-qb - root) / (2 * qa));
+      t_out = fmin(t_out, (-qb + root) / (2 * qa));
+    }
+    else if (qc > 0)
+    {
+      return;
+    }
+
+    if (t_in >= t_out || t_out < 0) return;
+
+    Span s = { (t_in < 0) ? -FLT_MAX : t_in, t_out };
+    spans.push_back(s);
+  }
+  else
+  {
+    assert(type == typeid(CSG));
+    const CSG &node = static_cast<const CSG &>(obj);
+
+    // Early out for rays missing the node
+    if (!node.bounds.intersects(r.get_orig(), inv_dir, FLT_MAX)) return;
+
+    vector<Span> a, b;
+    get_spans(*node.left, r, inv_dir, a);
+
+    // Nothing for the right operand to add to or take from
+    if (a.empty() && node.op != UNION) return;
+
+    get_spans(*node.right, r, inv_dir, b);
+
+    combine_spans(node.op, a, b, spans);
+  }
+}
+
+/*!
+ * \param[in]  r      Ray to intersect
+ * \param[out] spans  Spans of the ray inside the combined solid, in order
+ */
+void CSG::get_spans(const Ray &r, vector<Span> &spans) const
+{
+  const Vector3F &dir = r.get_dir();
+  Vector3F inv_dir = {1 / dir[0], 1 / dir[1], 1 / dir[2]};
+
+  get_spans(*this, r, inv_dir, spans);
+}
+
+// Identify first intersection with a ray
+// (See sceneobject.hh)
+float CSG::intersection(const Ray &r) const
+{
+  vector<Span> spans;
+  get_spans(r, spans);
+
+  // First boundary in front of the origin
+  for (unsigned int i = 0; i < spans.size(); ++i)
+  {
+    if (spans[i].t_in > 0) return spans[i].t_in;
+    if (spans[i].t_out > 0) return spans[i].t_out;
+  }
+
+  return no_intersection;
+}
+
+/*!
+ * \param[in]  obj   A solid (see is_solid)
+ * \param[in]  p     A point
+ * \param[in]  flip  Whether the solid is subtracted (so faces inward)
+ * \param[out] n     Normal of the surface nearest p
+ * \returns          Distance from p to the nearest surface
+ */
+float CSG::nearest_surface(const SceneObject &obj, const Vector3F &p,
+                           bool flip, Vector3F &n)
+{
+  const type_info &type = typeid(obj);
+  float dist;
+
+  if (type == typeid(Sphere))
+  {
+    const Sphere &sph = static_cast<const Sphere &>(obj);
+
+    dist = fabs((p - sph.get_center()).norm() - sph.get_radius());
+    n = sph.Sphere::get_normal(p);
+  }
+  else if (type == typeid(Cylinder))
+  {
+    const Cylinder &cyl = static_cast<const Cylinder &>(obj);
+
+    Vector3F a = cyl.get_axis().get_normalized();
+    Vector3F o = p - cyl.get_center();
+    float oa = dot(o, a);
+    Vector3F perp = o - oa * a;
+
+    float side = fabs(perp.norm() - cyl.get_radius());
+    float cap = fabs(fabs(oa) - cyl.get_height() / 2);
+
+    if (cap < side)
+    {
+      dist = cap;
+      n = (oa < 0) ? -a : a;
+    }
+    else
+    {
+      dist = side;
+      n = perp.get_normalized();
+    }
+  }
+  else
+  {
+    assert(type == typeid(CSG));
+    const CSG &node = static_cast<const CSG &>(obj);
+
+    Vector3F n_right;
+    dist = nearest_surface(*node.left, p, false, n);
+    float dist_right = nearest_surface(*node.right, p,
+                                       node.op == DIFFERENCE, n_right);
+
+    if (dist_right < dist)
+    {
+      dist = dist_right;
+      n = n_right;
+    }
+  }
+
+  if (flip) n = -n;
+
+  return dist;
+}
+
+// Get the normal to the surface at a point p
+/*!
+ * Uses the normal of the operand surface nearest p, reversed for surfaces
+ * of subtracted operands.
+ *
+ * \param p A point assumed to be on the combined surface
+ * \returns The normal of the surface at p
+ */
+Vector3F CSG::get_normal(const Vector3F &p) const
+{
+  Vector3F n;
+  nearest_surface(*this, p, false, n);
+  return n;
+}
+
+/*!
+ * \param op   Operation combining the operands
+ * \param lop  Left operand
+ * \param rop  Right operand
+ * \returns    Bounds of the combined solid (perhaps empty)
+ */
+AABB CSG::combined_bounds(Operation op, const SceneObject &lop,
+                          const SceneObject &rop)
+{
+  AABB l = operand_bounds(lop);
+  AABB r = operand_bounds(rop);
+  AABB b;
+
+  switch (op)
+  {
+    case UNION:
+      b = l.expand(r);
+      break;
+
+    case INTERSECTION:
+    {
+      Vector3F lo, hi;
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        lo[i] = fmax(l.get_min()[i], r.get_min()[i]);
+        hi[i] = fmin(l.get_max()[i], r.get_max()[i]);
+      }
+      b = AABB(lo, hi);
+      break;
+    }
+
+    case DIFFERENCE:
+      b = l;
+      break;
+  }
+
+  return b;
+}
+
+// Get a bounding box for the object
+// (See sceneobject.hh)
+bool CSG::get_bounds(AABB &b) const
+{
+  b = bounds;
+  return true;
+}
+
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void CSG::hash(Hash &h) const
+{
+  SceneObject::hash(h);
+  h.add(uint32_t(op));
+  left->hash(h);
+  right->hash(h);
+}
+
+// Name of the object's type, for hashing
+// (See sceneobject.hh)
+const char *CSG::type_tag() const
+{
+  return "CSG";
+}
+
+/*! \relates CSG
+ * Sweeps the boundaries of both lists in order, emitting a span wherever the
+ * operation holds.  Boundaries at the same t are taken together, so spans
+ * which touch are merged rather than leaving a surface between them.
+ *
+ * \param[in]  op      Operation combining the lists
+ * \param[in]  a       Spans inside the left operand, in order
+ * \param[in]  b       Spans inside the right operand, in order
+ * \param[out] result  Spans inside the combination, in order
+ */
+void combine_spans(CSG::Operation op, const vector<CSG::Span> &a,
+                   const vector<CSG::Span> &b, vector<CSG::Span> &result)
+{
+  result.clear();
+
+  // Boundary k of a list is the start (k even) or end (k odd) of span k/2
+  unsigned int i = 0, j = 0;
+  unsigned int a_end = 2 * a.size(), b_end = 2 * b.size();
+
+  bool in_a = false, in_b = false, in = false;
+  float start = 0;
+
+  while (i < a_end || j < b_end)
+  {
+    float ta = (i < a_end) ? ((i % 2) ? a[i / 2].t_out : a[i / 2].t_in)
+                           : FLT_MAX;
+    float tb = (j < b_end) ? ((j % 2) ? b[j / 2].t_out : b[j / 2].t_in)
+                           : FLT_MAX;
+    float t = fmin(ta, tb);
+
+    if (i < a_end && ta == t) { in_a = !in_a; ++i; }
+    if (j < b_end && tb == t) { in_b = !in_b; ++j; }
+
+    bool now;
+    switch (op)
+    {
+      case CSG::UNION:        now = in_a || in_b; break;
+      case CSG::INTERSECTION: now = in_a && in_b; break;
+      default:                now = in_a && !in_b; break;
+    }
+
+    if (now && !in)
+    {
+      start = t;
+    }
+    else if (!now && in)
+    {
+      CSG::Span s = { start, t };
+      result.push_back(s);
+    }
+
+    in = now;
+  }
+}
+
+/*! \relates CSG
+ * Reads a CSG combination from the provided input stream in the format:
+ * "operation left right color reflectivity"
+ *
+ * With the read format for Colors, this looks like:
+ * "union|intersection|difference name name [r g b] reflectivity"
+ *
+ * The operands are named solids (see CSG::is_solid).
+ *
+ * \param is      Input stream from which to read a new CSG
+ * \param solids  Objects which may be named as operands
+ * \param arena   Arena in which to allocate the new object
+ * \returns       Pointer to a new CSG, or NULL if reading failed
+ */
+SPSceneObject read_CSG(std::istream &is,
+                       const map<string, SPSceneObject> &solids,
+                       Arena &arena)
+{
+  // Check if stream is already bad
+  if (!is) return SPSceneObject();
+
+  string op_name, l_name, r_name;
+  Color c;
+  float ref;
+
+  // Read components
+  is >> op_name >> l_name >> r_name;
+  is >> c;
+  is >> ref;
+
+  if (!is) return SPSceneObject();
+
+  CSG::Operation op;
+  if (op_name == "union")
+    op = CSG::UNION;
+  else if (op_name == "intersection")
+    op = CSG::INTERSECTION;
+  else if (op_name == "difference")
+    op = CSG::DIFFERENCE;
+  else
+    return SPSceneObject();
+
+  map<string, SPSceneObject>::const_iterator l = solids.find(l_name);
+  map<string, SPSceneObject>::const_iterator r = solids.find(r_name);
+
+  if (l == solids.end() || r == solids.end()
+      || !CSG::is_solid(*l->second) || !CSG::is_solid(*r->second))
+    return SPSceneObject();
+
+  return arena.create<CSG>(op, l->second, r->second, c, ref);
+}
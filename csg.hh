@@ -0,0 +1,131 @@
+/* csg.hh
+ *
+ * A SceneObject combining solids by constructive solid geometry
+ */
+
+#ifndef _CSG_HH__
+#define _CSG_HH__
+
+#include "sceneobject.hh"
+#include <map>
+#include <string>
+#include <vector>
+
+//! A SceneObject combining two solids by a set operation
+/*!
+ * Each operand is a Sphere, a Cylinder (taken as a solid, closed by caps at
+ * its ends) or another CSG node.  A ray is intersected by finding the spans
+ * of the ray inside each operand, and combining the two lists of spans by the
+ * operation; the surface is where the ray first crosses a span's boundary.
+ *
+ * Every node is bounded (by the union or intersection of its operands'
+ * bounds, or by the left operand for a difference).  A ray which misses a
+ * node's bounds is never tested against the node's operands, and the right
+ * operand is skipped when the left operand's spans leave nothing for it to
+ * change.
+ *
+ * CSG nodes may be nested; only the outermost should be added to the Scene.
+ * The operands must not be moved once combined.
+ */
+class CSG: public SceneObject
+{
+  public:
+  //! Set operation combining the operands
+  enum Operation
+  {
+    UNION,         //!< Points in either operand
+    INTERSECTION,  //!< Points in both operands
+    DIFFERENCE     //!< Points in the left operand but not the right
+  };
+
+  //! A span [t_in, t_out] of a ray inside a solid
+  struct Span
+  {
+    //! Where the ray enters the solid (-FLT_MAX if inside at the origin)
+    float t_in;
+    //! Where the ray leaves the solid
+    float t_out;
+  };
+
+  private:
+  //! Operation combining the operands
+  Operation op;
+  //! Left operand
+  SPSceneObject left;
+  //! Right operand
+  SPSceneObject right;
+
+  //! Bounds of the combined solid
+  AABB bounds;
+
+  //! Compute the bounds of a combination from its operands
+  static AABB combined_bounds(Operation op, const SceneObject &l,
+                              const SceneObject &r);
+
+  //! Find the spans of a ray inside an operand
+  static void get_spans(const SceneObject &obj, const Ray &r,
+                        const Vector3F &inv_dir, std::vector<Span> &spans);
+
+  //! Find the operand surface nearest a point
+  static float nearest_surface(const SceneObject &obj, const Vector3F &p,
+                               bool flip, Vector3F &n);
+
+  public:
+  // === Constructors & methods
+
+  //! Construct a combination with default color & reflectivity
+  CSG(Operation op, const SPSceneObject &l, const SPSceneObject &r);
+
+  //! Construct a combination
+  CSG(Operation op, const SPSceneObject &l, const SPSceneObject &r,
+      const Color &c, float ref = 0);
+
+  //! Check if an object may be an operand
+  static bool is_solid(const SceneObject &obj);
+
+  //! Accessor for the operation
+  Operation get_operation() const;
+
+  //! Find the spans of a ray inside the combined solid
+  void get_spans(const Ray &r, std::vector<Span> &spans) const;
+
+  // Identify first intersection with a ray
+  // (See sceneobject.hh)
+  float intersection(const Ray &r) const;
+
+  // Get the normal to the surface at a point p
+  // (See sceneobject.hh)
+  Vector3F get_normal(const Vector3F &p) const;
+
+  // Get a bounding box for the object
+  // (See sceneobject.hh)
+  bool get_bounds(AABB &b) const;
+
+  // Add everything affecting the object's appearance to a hash
+  // (See sceneobject.hh)
+  void hash(Hash &h) const;
+
+  // Name of the object's type, for hashing
+  // (See sceneobject.hh)
+  const char *type_tag() const;
+};
+
+/*! \relates CSG
+ * \brief Function to combine span lists by a set operation
+ */
+void combine_spans(CSG::Operation op, const std::vector<CSG::Span> &a,
+                   const std::vector<CSG::Span> &b,
+                   std::vector<CSG::Span> &result);
+
+/*! \relates CSG
+ * \brief Function to read a CSG combination of named solids
+ */
+SPSceneObject read_CSG(std::istream &is,
+                       const std::map<std::string, SPSceneObject> &solids,
+                       Arena &arena);
+
+// === Inline function definitions
+
+inline CSG::Operation CSG::get_operation() const { return op; }
+
+#endif
@@ -0,0 +1,150 @@
+/* csg_test.cc
+ *
+ * gtest Unit Test Suite for CSG combinations of solids
+ */
+
+#include "csg.hh"
+#include "sphere.hh"
+#include "cylinder.hh"
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+// Make a span list from pairs of t values
+static vector<CSG::Span> spans(std::initializer_list<float> ts)
+{
+  vector<CSG::Span> result;
+  for (const float *t = ts.begin(); t != ts.end(); t += 2)
+  {
+    CSG::Span s = { t[0], t[1] };
+    result.push_back(s);
+  }
+  return result;
+}
+
+// Expect a span list to hold the given pairs of t values
+static void expect_spans(std::initializer_list<float> ts,
+                         const vector<CSG::Span> &actual)
+{
+  vector<CSG::Span> expected = spans(ts);
+  ASSERT_EQ(expected.size(), actual.size());
+
+  for (unsigned int i = 0; i < expected.size(); ++i)
+  {
+    EXPECT_FLOAT_EQ(expected[i].t_in, actual[i].t_in);
+    EXPECT_FLOAT_EQ(expected[i].t_out, actual[i].t_out);
+  }
+}
+
+struct CSGTest : public Test
+{
+  SPArena arena;
+
+  // Spheres of radius 1 at x = 0 and x = 1, and a smaller one at x = 0
+  SPSceneObject a, b, inner;
+
+  CSGTest()
+    : arena(new Arena())
+  {
+    a = arena->create<Sphere>(Vector3F({0, 0, 0}), 1);
+    b = arena->create<Sphere>(Vector3F({1, 0, 0}), 1);
+    inner = arena->create<Sphere>(Vector3F({0, 0, 0}), 0.5);
+  }
+};
+
+// Span lists combine by each operation, merging touching spans
+TEST(CombineSpansTest, Operations)
+{
+  vector<CSG::Span> result;
+  vector<CSG::Span> x = spans({1, 3, 5, 7});
+  vector<CSG::Span> y = spans({2, 5, 8, 9});
+
+  combine_spans(CSG::UNION, x, y, result);
+  expect_spans({1, 7, 8, 9}, result);
+
+  combine_spans(CSG::INTERSECTION, x, y, result);
+  expect_spans({2, 3}, result);
+
+  combine_spans(CSG::DIFFERENCE, x, y, result);
+  expect_spans({1, 2, 5, 7}, result);
+
+  combine_spans(CSG::DIFFERENCE, y, x, result);
+  expect_spans({3, 5, 8, 9}, result);
+
+  combine_spans(CSG::UNION, x, vector<CSG::Span>(), result);
+  expect_spans({1, 3, 5, 7}, result);
+}
+
+// A hollow sphere is entered on the outside & then the cavity's wall
+TEST_F(CSGTest, HollowSphere)
+{
+  CSG hollow(CSG::DIFFERENCE, a, inner);
+
+  Ray r(Vector3F({-3, 0, 0}), Vector3F({1, 0, 0}));
+  vector<CSG::Span> s;
+  hollow.get_spans(r, s);
+  expect_spans({2, 2.5, 3.5, 4}, s);
+
+  EXPECT_FLOAT_EQ(2, hollow.intersection(r));
+
+  // Inside the shell, the cavity's wall faces into the cavity
+  Ray r_in(Vector3F({-0.75, 0, 0}), Vector3F({1, 0, 0}));
+  EXPECT_FLOAT_EQ(0.25, hollow.intersection(r_in));
+
+  Vector3F n = hollow.get_normal(r_in.get_point_at_t(0.25));
+  EXPECT_NEAR(1, n[0], 1e-5);
+}
+
+// The lens where two spheres overlap has the far sphere's surface in front
+TEST_F(CSGTest, Lens)
+{
+  CSG lens(CSG::INTERSECTION, a, b);
+
+  Ray r(Vector3F({-3, 0, 0}), Vector3F({1, 0, 0}));
+  EXPECT_FLOAT_EQ(3, lens.intersection(r));
+  EXPECT_NEAR(-1, lens.get_normal(Vector3F({0, 0, 0}))[0], 1e-5);
+
+  // Bounds are those of the overlap
+  AABB box;
+  ASSERT_TRUE(lens.get_bounds(box));
+  EXPECT_FLOAT_EQ(0, box.get_min()[0]);
+  EXPECT_FLOAT_EQ(1, box.get_max()[0]);
+
+  // Missing the overlap misses entirely
+  Ray miss(Vector3F({-3, 0.95, 0}), Vector3F({1, 0, 0}));
+  EXPECT_EQ(SceneObject::no_intersection, lens.intersection(miss));
+}
+
+// Cylinders are closed by caps, so a hole can be drilled through a sphere
+TEST_F(CSGTest, DrilledSphere)
+{
+  SPSceneObject drill = arena->create<Cylinder>(
+      Vector3F({0, 0, 0}), Vector3F({0, 1, 0}), 0.25, 4);
+  SPSceneObject cap_test = arena->create<Cylinder>(
+      Vector3F({0, 0, 0}), Vector3F({0, 1, 0}), 0.25, 1);
+
+  CSG drilled(CSG::DIFFERENCE, a, drill);
+
+  // Straight down the hole
+  Ray down(Vector3F({0, 3, 0}), Vector3F({0, -1, 0}));
+  EXPECT_EQ(SceneObject::no_intersection, drilled.intersection(down));
+
+  // Beside the hole
+  Ray beside(Vector3F({0.5, 3, 0}), Vector3F({0, -1, 0}));
+  EXPECT_NEAR(3 - sqrt(0.75f), drilled.intersection(beside), 1e-5);
+
+  // A short cylinder is hit on its cap, facing up
+  CSG capped(CSG::UNION, cap_test, inner);
+  EXPECT_FLOAT_EQ(2.5, capped.intersection(down));
+  Vector3F n = capped.get_normal(down.get_point_at_t(2.5));
+  EXPECT_NEAR(1, n[1], 1e-5);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -5,6 +5,7 @@
 
 #include "cylinder.hh"
 #include "sphere.hh"
+#include "rebase.hh"
 #include <cassert>
 #include <cmath>
 
@@ -120,18 +121,69 @@ int Cylinder::get_intersections(const Ray &r, float &t1, float &t2) const
   return count;
 }
 
-// Identify first intersection with a ray
-// (See sceneobject.hh)
-float Cylinder::intersection(const Ray &r) const
+// Identify first intersection with a ray, and the primitive hit
+/*!
+ * As for a sphere, in the cross-section plane: a ray leaving the surface
+ * has its origin as one root, so only the other root can be a hit, where a
+ * ray heading inwards reaches the far side within the cylinder's height.
+ *
+ * \param[in]  r     Ray to intersect
+ * \param[in]  from  0 if the ray starts on the cylinder, or no_primitive
+ * \param[out] prim  Primitive hit (always 0)
+ * \returns          The t value of the nearest intersection
+ *                   or SceneObject::no_intersection
+ */
+float Cylinder::intersection_from(const Ray &r, unsigned int from,
+                                  unsigned int &prim) const
 {
-  float t1, t2;
+  prim = 0;
+
+  if (from == no_primitive)
+    return intersection(r);
+
+  // Origin & direction across the axis
+  Vector3F offset = r.get_orig() - center;
+  Vector3F o_perp = offset - project(offset, axis);
+  Vector3F d_perp = r.get_dir() - project(r.get_dir(), axis);
+
+  float a = d_perp.norm_sq();
+  if (a == 0) return no_intersection;
+
+  float t = -2 * dot(d_perp, o_perp) / a;
+
+  if (t * sqrt(a) <= surface_epsilon(radius))
+    return no_intersection;
+
+  // Check that the intersection is within the height of the cylinder
+  if (fabs(dot(offset + r.get_dir() * t, axis)) > height / 2)
+    return no_intersection;
+
+  return t;
+}
 
-  // Get the intersections
-  get_intersections(r, t1, t2);
+// Refine the t value of a hit in double precision
+/*!
+ * As for a sphere, in the cross-section plane: the quadratic is solved again
+ * in double precision, taking the root nearest the hit found in single
+ * precision.  The hit is already within the cylinder's height.
+ *
+ * \param r     Ray which hit the cylinder
+ * \param t     The t value of the hit
+ * \param prim  Primitive hit (always 0)
+ * \returns     The refined t value
+ */
+float Cylinder::refine_intersection(const Ray &r, float t,
+                                    unsigned int prim) const
+{
+  // Origin & direction across the axis
+  Vector3D a(axis);
+  Vector3D offset = Vector3D(r.get_orig()) - Vector3D(center);
+  Vector3D d(r.get_dir());
+  Vector3D o_perp = offset - project(offset, a);
+  Vector3D d_perp = d - project(d, a);
 
-  // Only care about the first intersection,
-  // which will already be flagged if there are none
-  return t1;
+  return nearest_root(dot(d_perp, d_perp), dot(d_perp, o_perp),
+                      dot(o_perp, o_perp) - double(radius) * radius, t);
 }
 
 // Get the normal to the surface at a point p
@@ -148,6 +200,63 @@ Vector3F Cylinder::get_normal(const Vector3F &p) const
   return result.normalize();
 }
 
+// Get the change in the surface normal over a small step along the surface
+// (See sceneobject.hh)
+Vector3F Cylinder::get_normal_differential(const Vector3F &p,
+                                           const Vector3F &dp) const
+{
+  Vector3F offset = p - center;
+  Vector3F perp = offset - project(offset, axis);
+  float len = perp.norm();
+  Vector3F n = perp / len;
+
+  // Differentiating perp / |perp|, where only the step across the axis
+  // changes perp
+  Vector3F dperp = dp - project(dp, axis);
+  return (dperp - dot(dperp, n) * n) / len;
+}
+
+// Turn the cylinder's axis
+/*!
+ * \param a Direction of long axis (Must be non-zero; normalized by this)
+ */
+void Cylinder::set_axis(const Vector3F &a)
+{
+  axis = a.get_normalized();
+  assert(axis.norm() > 0);
+}
+
+// Get a bounding box for the object
+// (See sceneobject.hh)
+bool Cylinder::get_bounds(AABB &b) const
+{
+  Vector3F a = axis.get_normalized();
+  Vector3F ext;
+
+  // Along each world axis, the rim circles extend by radius * sin(angle)
+  // from the ends of the axis segment
+  for (unsigned int i = 0; i < 3; ++i)
+    ext[i] = fabs(a[i]) * height / 2 + radius * sqrt(fmax(0, 1 - a[i] * a[i]));
+
+  b = AABB(center - ext, center + ext);
+  return true;
+}
+
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void Cylinder::hash(Hash &h) const
+{
+  SceneObject::hash(h);
+  h.add(center).add(axis).add(radius).add(height);
+}
+
+// Name of the object's type, for hashing
+// (See sceneobject.hh)
+const char *Cylinder::type_tag() const
+{
+  return "Cylinder";
+}
+
 /*! \relates Cylinder
  * Reads a Cylinder from the provided input stream in the format:
  * "center radius color"
@@ -155,10 +264,14 @@ Vector3F Cylinder::get_normal(const Vector3F &p) const
  * With the read formats for Vectors & Colors, this looks like:
  * "(x y z) radius [r g b]"
  *
- * \param is  Input stream from which to read a new Plane
- * \returns   Pointer to a new Cylinder, or NULL if reading failed
+ * The center is read with read_position(), so is relative to the stream's
+ * origin, if it has one.
+ *
+ * \param is     Input stream from which to read a new Plane
+ * \param arena  Arena in which to allocate the new object
+ * \returns      Pointer to a new Cylinder, or NULL if reading failed
  */
-SPSceneObject read_Cylinder(std::istream &is)
+SPSceneObject read_Cylinder(std::istream &is, Arena &arena)
 {
   // Check if stream is already bad
   if (!is) return SPSceneObject();
@@ -171,7 +284,7 @@ SPSceneObject read_Cylinder(std::istream &is)
   float ref;
 
   // Read components
-  is >> pos;
+  read_position(is, pos);
   is >> axis;
   is >> r;
   is >> h;
@@ -180,9 +293,7 @@ SPSceneObject read_Cylinder(std::istream &is)
 
   if (is)
   {
-    SPSceneObject sso(new Cylinder(pos, axis, r, h, c, ref));
-
-    return sso;
+    return arena.create<Cylinder>(pos, axis, r, h, c, ref);
   }
   else
   {
@@ -43,6 +43,11 @@ class Cylinder: public SceneObject
   //! Accessor for cylinder height
   float get_height() const;
 
+  //! Mutator to move the cylinder's center
+  void set_center(const Vector3F &c);
+  //! Mutator to turn the cylinder's axis (Must be non-zero)
+  void set_axis(const Vector3F &a);
+
   //! Identify all (up to 2) intersections with a ray
   int get_intersections(const Ray &r, float &t1, float &t2) const;
 
@@ -50,15 +55,41 @@ class Cylinder: public SceneObject
   // (See sceneobject.hh)
   float intersection(const Ray &r) const;
 
+  // Identify first intersection with a ray, and the primitive hit
+  // (See sceneobject.hh)
+  float intersection_from(const Ray &r, unsigned int from,
+                          unsigned int &prim) const;
+
+  // Refine the t value of a hit in double precision
+  // (See sceneobject.hh)
+  float refine_intersection(const Ray &r, float t, unsigned int prim) const;
+
   // Get the normal to the surface at a point p
   // (See sceneobject.hh)
   Vector3F get_normal(const Vector3F &p) const;
+
+  // Get the change in the surface normal over a small step along the surface
+  // (See sceneobject.hh)
+  Vector3F get_normal_differential(const Vector3F &p,
+                                   const Vector3F &dp) const;
+
+  // Get a bounding box for the object
+  // (See sceneobject.hh)
+  bool get_bounds(AABB &b) const;
+
+  // Add everything affecting the object's appearance to a hash
+  // (See sceneobject.hh)
+  void hash(Hash &h) const;
+
+  // Name of the object's type, for hashing
+  // (See sceneobject.hh)
+  const char *type_tag() const;
 };
 
 /*! \relates Cylinder
  * \brief Function to read a Cylinder from an input stream
  */
-SPSceneObject read_Cylinder(std::istream &is);
+SPSceneObject read_Cylinder(std::istream &is, Arena &arena);
 
 // === Inline function definitions
 
@@ -67,5 +98,20 @@ inline const Vector3F & Cylinder::get_center() const { return center; }
 inline const Vector3F & Cylinder::get_axis() const { return axis; }
 inline float Cylinder::get_radius() const { return radius; }
 inline float Cylinder::get_height() const { return height; }
+inline void Cylinder::set_center(const Vector3F &c) { center = c; }
+
+// Identify first intersection with a ray
+// (See sceneobject.hh)
+inline float Cylinder::intersection(const Ray &r) const
+{
+  float t1, t2;
+
+  // Get the intersections
+  get_intersections(r, t1, t2);
+
+  // Only care about the first intersection,
+  // which will already be flagged if there are none
+  return t1;
+}
 
 #endif
@@ -0,0 +1,621 @@
+/* farm.cc
+ *
+ * Distributes rendering of an image across worker processes over sockets
+ */
+
+#include "farm.hh"
+#include "hash.hh"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+
+using namespace std;
+
+/* Protocol
+ *
+ * Every message is a sequence of 32-bit words in network byte order.
+ * Floats are sent as their bit patterns.
+ *
+ * - Worker to coordinator, on connecting:
+ *     FARM_MAGIC, img_size, pixel_samples, light_samples, seed, max_depth,
+ *     area_samples, refine_hits, then the high & low words of the scene's
+ *     hash
+ *   The coordinator drops workers whose settings or scene (including its
+ *   camera) differ from its own.
+ * - Coordinator to worker, to hand out a tile:
+ *     y_begin, y_end
+ *   An empty range (y_begin == y_end) tells the worker to exit.
+ * - Worker to coordinator, returning a tile:
+ *     y_begin, y_end, then the red, green & blue sums of each pixel
+ *     in row-major order
+ */
+
+//! Identifies (this version of) the farm protocol ("RTF4")
+static const uint32_t FARM_MAGIC = 0x52544634;
+
+//! Number of words in a worker's greeting
+static const unsigned int HELLO_WORDS = 10;
+
+//! Milliseconds to wait for activity before checking on local workers
+static const int POLL_TIMEOUT = 100;
+
+// Default number of rows in each tile
+const unsigned int RenderFarm::default_tile_rows = 16;
+
+/*!
+ * \param[in]  scn       Scene to render
+ * \param[in]  cam       Camera from which to render the scene
+ * \param[in]  opt       Render settings
+ * \param[in]  img_size  Pixel dimensions of image
+ * \param[out] words     Greeting, in host byte order
+ */
+static void make_hello(const Scene &scn, const Camera &cam,
+                       const RenderOptions &opt, int img_size,
+                       uint32_t words[HELLO_WORDS])
+{
+  Hash h;
+  scn.hash(h);
+  cam.hash(h);
+
+  words[0] = FARM_MAGIC;
+  words[1] = img_size;
+  words[2] = opt.pixel_samples;
+  words[3] = opt.light_samples;
+  words[4] = opt.seed;
+  words[5] = opt.max_depth;
+  words[6] = opt.area_samples;
+  words[7] = opt.refine_hits;
+  words[8] = h.get_value() >> 32;
+  words[9] = h.get_value() & 0xffffffff;
+}
+
+/*!
+ * Sends a whole buffer, without raising SIGPIPE if the peer has gone.
+ *
+ * \returns true if every byte was sent
+ */
+static bool send_all(int fd, const void *buf, size_t len)
+{
+  const char *p = static_cast<const char *>(buf);
+
+  while (len > 0)
+  {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+
+    p += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+/*!
+ * \returns true if the whole buffer was filled before the peer disconnected
+ */
+static bool recv_all(int fd, void *buf, size_t len)
+{
+  char *p = static_cast<char *>(buf);
+
+  while (len > 0)
+  {
+    ssize_t n = recv(fd, p, len, 0);
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+
+    p += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+//! Send a list of words in network byte order
+static bool send_words(int fd, vector<uint32_t> &words)
+{
+  for (unsigned int i = 0; i < words.size(); ++i)
+    words[i] = htonl(words[i]);
+
+  return send_all(fd, &words[0], words.size() * sizeof(uint32_t));
+}
+
+//! Read the i'th word of a buffer received in network byte order
+static uint32_t get_word(const vector<char> &buf, unsigned int i)
+{
+  uint32_t w;
+  memcpy(&w, &buf[i * sizeof(uint32_t)], sizeof(w));
+  return ntohl(w);
+}
+
+//! Bit pattern of a float, for sending
+static uint32_t float_bits(float f)
+{
+  uint32_t w;
+  memcpy(&w, &f, sizeof(w));
+  return w;
+}
+
+//! Float from a received bit pattern
+static float bits_float(uint32_t w)
+{
+  float f;
+  memcpy(&f, &w, sizeof(f));
+  return f;
+}
+
+/*!
+ * \param tile_rows  Number of rows in each tile handed to a worker
+ */
+RenderFarm::RenderFarm(unsigned int tile_rows)
+  : listen_fd(-1)
+  , port(0)
+  , tile_rows(tile_rows)
+  , spawned(0)
+  , children()
+{
+  assert(tile_rows > 0);
+}
+
+RenderFarm::~RenderFarm()
+{
+  if (listen_fd >= 0)
+    close(listen_fd);
+
+  // Workers exit once their connections close
+  reap_children(true);
+}
+
+/*!
+ * \param wait  Whether to block until every local worker has exited
+ */
+void RenderFarm::reap_children(bool wait)
+{
+  for (unsigned int i = 0; i < children.size(); )
+  {
+    pid_t r = waitpid(children[i], NULL, wait ? 0 : WNOHANG);
+
+    if (r == 0)
+    {
+      ++i;
+    }
+    else
+    {
+      children[i] = children.back();
+      children.pop_back();
+    }
+  }
+}
+
+/*!
+ * \param port    TCP port to listen on (0 to let the system choose one)
+ * \param remote  Whether to accept workers on other hosts, rather than
+ *                only those connecting from this host
+ * \returns       true if the farm is now listening
+ */
+bool RenderFarm::listen(unsigned short port, bool remote)
+{
+  assert(listen_fd < 0);
+
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0)
+  {
+    cerr << "Error: Couldn't create socket: " << strerror(errno) << endl;
+    return false;
+  }
+
+  int yes = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(remote ? INADDR_ANY : INADDR_LOOPBACK);
+
+  socklen_t len = sizeof(addr);
+
+  if (bind(listen_fd, (sockaddr *) &addr, sizeof(addr)) < 0
+      || ::listen(listen_fd, SOMAXCONN) < 0
+      || getsockname(listen_fd, (sockaddr *) &addr, &len) < 0)
+  {
+    cerr << "Error: Couldn't listen on port " << port << ": "
+         << strerror(errno) << endl;
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  this->port = ntohs(addr.sin_port);
+  return true;
+}
+
+/*!
+ * The worker is a fork of this process, so it shares the Scene as already
+ * loaded and prepared, and connects to the farm over the loopback interface.
+ * The farm must be listening.
+ *
+ * \param scn       Prepared Scene to render
+ * \param cam       Camera from which to render the scene
+ * \param opt       Render settings
+ * \param img_size  Pixel dimensions of image (Only square images supported)
+ * \returns         true if the worker process was started
+ */
+bool RenderFarm::spawn_worker(const Scene &scn, const Camera &cam,
+                              const RenderOptions &opt, int img_size)
+{
+  assert(listen_fd >= 0);
+
+  pid_t pid = fork();
+
+  if (pid < 0)
+  {
+    cerr << "Error: Couldn't start worker: " << strerror(errno) << endl;
+    return false;
+  }
+
+  if (pid == 0)
+  {
+    close(listen_fd);
+
+    // Local workers share the host, so each renders on one thread
+    RenderOptions worker_opt = opt;
+    worker_opt.threads = 1;
+
+    bool ok = run_farm_worker(scn, cam, worker_opt, img_size, "127.0.0.1",
+                              port);
+
+    // Skip exit handlers & buffered output belonging to the coordinator
+    _exit(ok ? 0 : 1);
+  }
+
+  children.push_back(pid);
+  ++spawned;
+  return true;
+}
+
+/*!
+ * Hands out tiles until every tile of the image has been returned, adding
+ * the returned samples into fb.  Tiles of workers which disconnect or
+ * misbehave are handed to other workers.
+ *
+ * Rendering fails if local workers were spawned but have all exited with
+ * no other workers connected, as nothing could then finish the image.
+ * (With no local workers, the farm waits for remote workers indefinitely.)
+ *
+ * \param fb   Framebuffer in which to accumulate the image
+ *             (Only square images supported)
+ * \param scn  Scene to render, which every worker must share
+ * \param cam  Camera from which to render the scene, which every worker
+ *             must share
+ * \param opt  Render settings, which every worker must share
+ * \returns    true if the whole image was rendered
+ */
+bool RenderFarm::render(Framebuffer &fb, const Scene &scn, const Camera &cam,
+                        const RenderOptions &opt)
+{
+  assert(listen_fd >= 0);
+  assert(fb.get_width() == fb.get_height());
+
+  int img_size = fb.get_width();
+
+  //! A connected worker
+  struct Connection
+  {
+    //! Socket connected to the worker
+    int fd;
+    //! Whether the worker's greeting has been accepted
+    bool greeted;
+    //! Tile the worker is rendering (-1 for none)
+    int tile;
+    //! Bytes received and not yet processed
+    vector<char> buf;
+  };
+
+  vector<Connection> conns;
+
+  // Tiles not handed out, and number of tiles returned
+  unsigned int n_tiles = (img_size + tile_rows - 1) / tile_rows;
+  deque<unsigned int> pending;
+  for (unsigned int i = 0; i < n_tiles; ++i)
+    pending.push_back(i);
+  unsigned int done = 0;
+
+  uint32_t hello[HELLO_WORDS];
+  make_hello(scn, cam, opt, img_size, hello);
+
+  // Drop a connection, returning its tile to be handed out again
+  auto drop = [&](unsigned int i)
+  {
+    close(conns[i].fd);
+    if (conns[i].tile >= 0)
+      pending.push_front(conns[i].tile);
+    conns.erase(conns.begin() + i);
+  };
+
+  bool success = true;
+
+  while (done < n_tiles)
+  {
+    // Hand out tiles to idle workers
+    for (unsigned int i = 0; i < conns.size(); )
+    {
+      Connection &c = conns[i];
+
+      if (c.greeted && c.tile < 0 && !pending.empty())
+      {
+        c.tile = pending.front();
+        pending.pop_front();
+
+        vector<uint32_t> msg;
+        msg.push_back(c.tile * tile_rows);
+        msg.push_back(min<unsigned int>((c.tile + 1) * tile_rows, img_size));
+
+        if (!send_words(c.fd, msg))
+        {
+          drop(i);
+          continue;
+        }
+      }
+
+      ++i;
+    }
+
+    reap_children(false);
+
+    if (conns.empty() && spawned > 0 && children.empty())
+    {
+      cerr << "Error: All render farm workers have exited." << endl;
+      success = false;
+      break;
+    }
+
+    // Wait for new workers or returned tiles
+    vector<pollfd> fds(conns.size() + 1);
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    for (unsigned int i = 0; i < conns.size(); ++i)
+    {
+      fds[i + 1].fd = conns[i].fd;
+      fds[i + 1].events = POLLIN;
+    }
+
+    int n = poll(&fds[0], fds.size(), POLL_TIMEOUT);
+
+    if (n < 0 && errno != EINTR)
+    {
+      cerr << "Error: Render farm poll failed: " << strerror(errno) << endl;
+      success = false;
+      break;
+    }
+
+    if (n <= 0) continue;
+
+    // Read from existing workers (backwards, so drops keep indices valid)
+    for (unsigned int i = conns.size(); i-- > 0; )
+    {
+      if (fds[i + 1].revents == 0) continue;
+
+      Connection &c = conns[i];
+
+      char data[65536];
+      ssize_t len = recv(c.fd, data, sizeof(data), 0);
+
+      if (len < 0 && errno == EINTR) continue;
+      if (len <= 0)
+      {
+        drop(i);
+        continue;
+      }
+
+      c.buf.insert(c.buf.end(), data, data + len);
+
+      // Check the greeting
+      if (!c.greeted)
+      {
+        if (c.buf.size() < HELLO_WORDS * sizeof(uint32_t)) continue;
+
+        bool match = true;
+        for (unsigned int w = 0; w < HELLO_WORDS; ++w)
+          match = match && get_word(c.buf, w) == hello[w];
+
+        if (!match)
+        {
+          cerr << "Warning: Dropped render farm worker with different "
+               << "settings or scene." << endl;
+          drop(i);
+          continue;
+        }
+
+        c.greeted = true;
+        c.buf.erase(c.buf.begin(),
+                    c.buf.begin() + HELLO_WORDS * sizeof(uint32_t));
+      }
+
+      if (c.buf.empty()) continue;
+
+      // Anything else must be the tile the worker was given
+      if (c.tile < 0)
+      {
+        drop(i);
+        continue;
+      }
+
+      unsigned int y_begin = c.tile * tile_rows;
+      unsigned int y_end = min<unsigned int>(y_begin + tile_rows, img_size);
+      size_t words = 2 + 3 * (y_end - y_begin) * img_size;
+
+      if (c.buf.size() < words * sizeof(uint32_t)) continue;
+
+      if (c.buf.size() > words * sizeof(uint32_t)
+          || get_word(c.buf, 0) != y_begin || get_word(c.buf, 1) != y_end)
+      {
+        drop(i);
+        continue;
+      }
+
+      // Stitch the tile into the image
+      unsigned int w = 2;
+      for (unsigned int y = y_begin; y < y_end; ++y)
+      {
+        for (int x = 0; x < img_size; ++x, w += 3)
+        {
+          fb.add(x, y, Color(bits_float(get_word(c.buf, w)),
+                             bits_float(get_word(c.buf, w + 1)),
+                             bits_float(get_word(c.buf, w + 2))));
+        }
+      }
+
+      c.buf.clear();
+      c.tile = -1;
+      ++done;
+    }
+
+    // Accept new workers
+    if (fds[0].revents & POLLIN)
+    {
+      int fd = accept(listen_fd, NULL, NULL);
+
+      if (fd >= 0)
+      {
+        Connection c = { fd, false, -1, vector<char>() };
+        conns.push_back(c);
+      }
+    }
+  }
+
+  // Tell the remaining workers to exit
+  for (unsigned int i = 0; i < conns.size(); ++i)
+  {
+    vector<uint32_t> msg(2, 0);
+    send_words(conns[i].fd, msg);
+    close(conns[i].fd);
+  }
+
+  if (success)
+    fb.end_pass(opt.pixel_samples);
+
+  return success;
+}
+
+/*!
+ * Connects to a coordinator, then renders each tile it hands out (as the
+ * first pass of the image) and returns the tile's sums of samples.
+ *
+ * \param scn       Prepared Scene to render
+ * \param cam       Camera from which to render the scene
+ * \param opt       Render settings (Must match the coordinator's)
+ * \param img_size  Pixel dimensions of image (Only square images supported)
+ * \param host      Host name or address of the coordinator
+ * \param port      Port on which the coordinator listens
+ * \returns         true if the coordinator finished without error
+ */
+bool run_farm_worker(const Scene &scn, const Camera &cam,
+                     const RenderOptions &opt, int img_size,
+                     const string &host, unsigned short port)
+{
+  // Look up & connect to the coordinator
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  char port_str[8];
+  snprintf(port_str, sizeof(port_str), "%u", port);
+
+  addrinfo *addrs;
+  if (getaddrinfo(host.c_str(), port_str, &hints, &addrs) != 0)
+  {
+    cerr << "Error: Couldn't find render farm host " << host << endl;
+    return false;
+  }
+
+  int fd = -1;
+  for (addrinfo *a = addrs; a != NULL && fd < 0; a = a->ai_next)
+  {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  freeaddrinfo(addrs);
+
+  if (fd < 0)
+  {
+    cerr << "Error: Couldn't connect to render farm at " << host << ':'
+         << port << endl;
+    return false;
+  }
+
+  uint32_t hello[HELLO_WORDS];
+  make_hello(scn, cam, opt, img_size, hello);
+  vector<uint32_t> msg(hello, hello + HELLO_WORDS);
+
+  bool success = send_words(fd, msg);
+
+  // Only the rows of tiles handed out are rendered into this image
+  Framebuffer fb(img_size, img_size);
+
+  while (success)
+  {
+    uint32_t range[2];
+    if (!recv_all(fd, range, sizeof(range)))
+    {
+      cerr << "Error: Lost connection to render farm." << endl;
+      success = false;
+      break;
+    }
+
+    uint32_t y_begin = ntohl(range[0]);
+    uint32_t y_end = ntohl(range[1]);
+
+    // Empty range: the image is done
+    if (y_begin == y_end) break;
+
+    if (y_begin > y_end || y_end > uint32_t(img_size))
+    {
+      cerr << "Error: Invalid tile from render farm." << endl;
+      success = false;
+      break;
+    }
+
+    scn.render_rows(cam, fb, opt, 0, y_begin, y_end);
+
+    // Return the tile's sums
+    msg.clear();
+    msg.push_back(y_begin);
+    msg.push_back(y_end);
+    for (unsigned int y = y_begin; y < y_end; ++y)
+    {
+      for (int x = 0; x < img_size; ++x)
+      {
+        const Color &c = fb.get_sum(x, y);
+        msg.push_back(float_bits(c.get_red()));
+        msg.push_back(float_bits(c.get_green()));
+        msg.push_back(float_bits(c.get_blue()));
+      }
+    }
+
+    success = send_words(fd, msg);
+  }
+
+  close(fd);
+  return success;
+}
@@ -0,0 +1,92 @@
+/* farm.hh
+ *
+ * Distributes rendering of an image across worker processes over sockets
+ */
+
+#ifndef _FARM_HH__
+#define _FARM_HH__
+
+#include "scene.hh"
+#include "camera.hh"
+#include "framebuffer.hh"
+#include "renderoptions.hh"
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+//! Coordinator of a render farm, handing out tiles of an image to workers
+/*!
+ * Workers connect to the coordinator over TCP.  They may be forked locally
+ * by spawn_worker() (sharing the coordinator's already loaded Scene), or be
+ * separate processes, possibly on other hosts, which load the same scene
+ * themselves and call run_farm_worker().  Workers whose settings, scene or
+ * camera differ from the coordinator's (by the scene's hash, as the render
+ * cache keys it) are dropped.
+ *
+ * The image is split into tiles of tile_rows rows.  Each worker is given one
+ * tile at a time, and is given the next tile when it returns the last, so
+ * faster workers render more of the image.  If a worker disconnects before
+ * returning its tile, the tile is given to another worker.
+ *
+ * Workers return the sums of their samples, so the stitched image is exactly
+ * the image a single process would have rendered.
+ */
+class RenderFarm
+{
+  //! Socket listening for workers (-1 if not listening)
+  int listen_fd;
+  //! Port the socket is bound to
+  unsigned short port;
+  //! Number of rows in each tile
+  unsigned int tile_rows;
+  //! Number of local workers started
+  unsigned int spawned;
+  //! Local worker processes which have not yet been reaped
+  std::vector<pid_t> children;
+
+  //! Reap any local workers which have exited
+  void reap_children(bool wait);
+
+  // Not copyable: owns a socket and child processes
+  RenderFarm(const RenderFarm &);
+  RenderFarm & operator=(const RenderFarm &);
+
+  public:
+  // === Constants
+
+  //! Default number of rows in each tile
+  static const unsigned int default_tile_rows;
+
+  // === Constructors/Destructors & methods
+
+  //! Construct a farm which is not yet listening
+  explicit RenderFarm(unsigned int tile_rows = default_tile_rows);
+
+  //! Destructor stops listening and waits for local workers to exit
+  ~RenderFarm();
+
+  //! Start listening for workers
+  bool listen(unsigned short port = 0, bool remote = false);
+
+  //! Accessor for the port on which the farm listens
+  unsigned short get_port() const;
+
+  //! Fork a local worker process rendering a prepared Scene
+  bool spawn_worker(const Scene &scn, const Camera &cam,
+                    const RenderOptions &opt, int img_size);
+
+  //! Render an image by distributing its tiles to workers
+  bool render(Framebuffer &fb, const Scene &scn, const Camera &cam,
+              const RenderOptions &opt);
+};
+
+//! Render tiles handed out by a farm coordinator until it is done
+bool run_farm_worker(const Scene &scn, const Camera &cam,
+                     const RenderOptions &opt, int img_size,
+                     const std::string &host, unsigned short port);
+
+// === Inline function definitions
+
+inline unsigned short RenderFarm::get_port() const { return port; }
+
+#endif
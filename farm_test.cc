@@ -0,0 +1,148 @@
+/* farm_test.cc
+ *
+ * gtest Unit Test Suite for RenderFarm
+ */
+
+#include "farm.hh"
+#include "testscene.hh"
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace testing;
+
+struct RenderFarmTest : public Test
+{
+  static const int img_size = 32;
+
+  Scene scn;
+  Camera cam;
+  RenderOptions opt;
+
+  virtual void SetUp()
+  {
+    build_test_scene(scn);
+    cam = test_camera();
+
+    opt.pixel_samples = 2;
+  }
+
+  // Render in a single process through Scene::render
+  string render_local()
+  {
+    return render_ppm(scn, cam, img_size, opt);
+  }
+
+  // Render through a farm, returning the image in PPM format
+  string render_farm(RenderFarm &farm)
+  {
+    Framebuffer fb(img_size, img_size);
+    EXPECT_TRUE(farm.render(fb, scn, cam, opt));
+
+    return to_ppm(fb, 0, img_size);
+  }
+};
+
+// Stitched tiles from several workers reproduce a single-process render
+TEST_F(RenderFarmTest, MatchesSceneRender)
+{
+  RenderFarm farm(3);
+  ASSERT_TRUE(farm.listen());
+
+  for (int i = 0; i < 3; ++i)
+    ASSERT_TRUE(farm.spawn_worker(scn, cam, opt, img_size));
+
+  EXPECT_EQ(render_local(), render_farm(farm));
+}
+
+// A worker which dies holding a tile has the tile given to another worker
+TEST_F(RenderFarmTest, ReassignsTilesOfDeadWorker)
+{
+  RenderFarm farm(4);
+  ASSERT_TRUE(farm.listen());
+
+  // Connected before the good worker, so it is handed the first tile
+  int ready[2];
+  ASSERT_EQ(0, pipe(ready));
+
+  pid_t bad = fork();
+  ASSERT_GE(bad, 0);
+
+  if (bad == 0)
+  {
+    // Greet the farm as farm.cc's workers do, take a tile and exit
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(farm.get_port());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, (sockaddr *) &addr, sizeof(addr)) < 0) _exit(2);
+
+    Hash h;
+    scn.hash(h);
+    cam.hash(h);
+
+    uint32_t hello[10] = { htonl(0x52544634), htonl(img_size),
+                           htonl(opt.pixel_samples), htonl(opt.light_samples),
+                           htonl(opt.seed), htonl(opt.max_depth),
+                           htonl(opt.area_samples), htonl(opt.refine_hits),
+                           htonl(h.get_value() >> 32),
+                           htonl(h.get_value() & 0xffffffff) };
+    if (write(fd, hello, sizeof(hello)) != sizeof(hello)) _exit(2);
+    if (write(ready[1], "", 1) != 1) _exit(2);
+
+    uint32_t range[2];
+    bool got_tile = recv(fd, range, sizeof(range), MSG_WAITALL)
+                      == sizeof(range) && range[0] != range[1];
+    _exit(got_tile ? 0 : 1);
+  }
+
+  char c;
+  ASSERT_EQ(1, read(ready[0], &c, 1));
+
+  ASSERT_TRUE(farm.spawn_worker(scn, cam, opt, img_size));
+
+  EXPECT_EQ(render_local(), render_farm(farm));
+
+  int status;
+  ASSERT_EQ(bad, waitpid(bad, &status, 0));
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+
+  close(ready[0]);
+  close(ready[1]);
+}
+
+// A worker rendering a different scene, or with different settings, is
+// dropped, and renders nothing
+TEST_F(RenderFarmTest, DropsWorkerWithDifferentScene)
+{
+  RenderFarm farm(4);
+  ASSERT_TRUE(farm.listen());
+
+  // The same scene seen from elsewhere (as if rebased differently)
+  Camera moved(Vector3F({-1.5, 1, 4}), Vector3F({0, 0.5, 0}),
+               Vector3F({0, 1, 0}));
+  ASSERT_TRUE(farm.spawn_worker(scn, moved, opt, img_size));
+
+  // The same scene without refined hits
+  RenderOptions unrefined = opt;
+  unrefined.refine_hits = !opt.refine_hits;
+  ASSERT_TRUE(farm.spawn_worker(scn, cam, unrefined, img_size));
+  ASSERT_TRUE(farm.spawn_worker(scn, cam, opt, img_size));
+
+  EXPECT_EQ(render_local(), render_farm(farm));
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
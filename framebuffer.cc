@@ -0,0 +1,164 @@
+/* framebuffer.cc
+ *
+ * A floating point image which accumulates samples
+ */
+
+#include "framebuffer.hh"
+#include "tonemap.hh"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+
+/*!
+ * \param width   Width of image in pixels
+ * \param height  Height of image in pixels
+ */
+Framebuffer::Framebuffer(int width, int height)
+  : width(width)
+  , height(height)
+  , sums(width * height)
+  , samples(0)
+  , tone_map(NULL)
+{ }
+
+/*!
+ * \param width   Width of image in pixels
+ * \param height  Height of image in pixels
+ */
+void Framebuffer::resize(int width, int height)
+{
+  this->width = width;
+  this->height = height;
+  sums.assign(width * height, Color());
+  samples = 0;
+}
+
+// Discard all samples
+void Framebuffer::clear()
+{
+  sums.assign(sums.size(), Color());
+  samples = 0;
+}
+
+/*!
+ * \param n Number of samples each pixel received in the pass
+ */
+void Framebuffer::end_pass(unsigned int n)
+{
+  samples += n;
+}
+
+/*!
+ * \param x, y  Pixel coordinates
+ * \returns     Average of the pixel's samples (black if there are none)
+ */
+Color Framebuffer::get_pixel(int x, int y) const
+{
+  assert(x >= 0 && x < width && y >= 0 && y < height);
+
+  if (samples == 0) return Color();
+
+  return sums[y * width + x] / samples;
+}
+
+/*!
+ * Colors are mapped by the tone map if one is set, and otherwise clamped to
+ * [0,1] and quantized as for write_ppm().
+ *
+ * Each pixel is averaged over n samples rather than get_samples(), so a row
+ * may be read as soon as it has all the samples of a pass, before the pass
+ * ends.
+ *
+ * \param[in]  y    Row to quantize
+ * \param[in]  n    Number of samples in each pixel (nonzero)
+ * \param[out] rgb  Red, green & blue bytes of each pixel (3 * width bytes)
+ */
+void Framebuffer::get_rgb8(int y, unsigned int n, unsigned char *rgb) const
+{
+  assert(y >= 0 && y < height && n > 0);
+
+  if (tone_map != NULL)
+  {
+    tone_map->map_row(&sums[y * width], n, y, width, rgb);
+    return;
+  }
+
+  for (int x = 0; x < width; ++x)
+  {
+    Color c = sums[y * width + x] / n;
+    c.clamp();
+
+    *rgb++ = int(c.get_red() * 255 + 0.5);
+    *rgb++ = int(c.get_green() * 255 + 0.5);
+    *rgb++ = int(c.get_blue() * 255 + 0.5);
+  }
+}
+
+/*!
+ * Colors are clamped to [0,1] and quantized to 8 bits per channel (or
+ * mapped by the tone map if one is set).
+ *
+ * \param os  Output stream to write image in ppm format
+ */
+void Framebuffer::write_ppm(ostream &os) const
+{
+  write_ppm(os, 0, height);
+}
+
+/*!
+ * Writes rows [y_begin, y_end) as an image of their own.
+ *
+ * \param os       Output stream to write image in ppm format
+ * \param y_begin  First row to write
+ * \param y_end    One past the last row to write
+ */
+void Framebuffer::write_ppm(ostream &os, int y_begin, int y_end) const
+{
+  assert(0 <= y_begin && y_begin <= y_end && y_end <= height);
+
+  // Maximum integer value for colors
+  static int MAX_C = 255;
+
+  // Header of a PPM file
+  os << "P3 " << width << ' ' << (y_end - y_begin) << ' ' << MAX_C << endl;
+
+  // (Black if there are no samples)
+  vector<unsigned char> rgb(3 * width, 0);
+
+  for (int y = y_begin; y < y_end; ++y)
+  {
+    if (samples > 0)
+      get_rgb8(y, samples, &rgb[0]);
+
+    for (int x = 0; x < width; ++x)
+    {
+      // Output for each pixel
+      os << int(rgb[3 * x]) << ' ';
+      os << int(rgb[3 * x + 1]) << ' ';
+      os << int(rgb[3 * x + 2]) << endl;
+    }
+  }
+}
+
+/*!
+ * The image is written to a temporary file which is then renamed over path,
+ * so a reader never sees a partially written image.
+ *
+ * \param path  Path of file to write
+ * \returns     true if the file was written successfully
+ */
+bool Framebuffer::write_ppm(const string &path) const
+{
+  string tmp_path = path + ".tmp";
+
+  {
+    ofstream ofs(tmp_path.c_str());
+    write_ppm(ofs);
+
+    if (!ofs) return false;
+  }
+
+  return rename(tmp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,107 @@
+/* framebuffer.hh
+ *
+ * A floating point image which accumulates samples
+ */
+
+#ifndef _FRAMEBUFFER_HH__
+#define _FRAMEBUFFER_HH__
+
+#include "color.hh"
+#include <vector>
+#include <iostream>
+#include <string>
+
+class ToneMap;
+
+//! A floating point image which accumulates samples
+/*!
+ * Each pixel holds the sum of the samples taken for it.  Samples are taken in
+ * passes which cover the whole image, so every pixel has the same number of
+ * samples, and the image is the sum divided by that count.
+ */
+class Framebuffer
+{
+  //! Width of image in pixels
+  int width;
+  //! Height of image in pixels
+  int height;
+
+  //! Sum of samples for each pixel, in row-major order
+  std::vector<Color> sums;
+
+  //! Number of samples accumulated into every pixel
+  unsigned int samples;
+
+  //! Mapping of colors to 8-bit values (NULL to clamp & round)
+  const ToneMap *tone_map;
+
+  public:
+  // === Constructors & methods
+
+  //! Construct a black image with no samples
+  Framebuffer(int width = 0, int height = 0);
+
+  // Accessors
+  //! Accessor for image width
+  int get_width() const;
+  //! Accessor for image height
+  int get_height() const;
+  //! Accessor for number of samples per pixel
+  unsigned int get_samples() const;
+
+  //! Set the mapping of colors to 8-bit values (NULL to clamp & round)
+  void set_tone_map(const ToneMap *tone_map);
+
+  //! Resize to a new image size, discarding all samples
+  void resize(int width, int height);
+
+  //! Discard all samples
+  void clear();
+
+  //! Add a sample to a pixel
+  void add(int x, int y, const Color &c);
+
+  //! Record that a pass of n samples per pixel has been accumulated
+  void end_pass(unsigned int n);
+
+  //! Get the sum of a pixel's samples
+  const Color & get_sum(int x, int y) const;
+
+  //! Get the averaged color of a pixel
+  Color get_pixel(int x, int y) const;
+
+  //! Quantize a row of averaged colors to 8-bit RGB
+  void get_rgb8(int y, unsigned int n, unsigned char *rgb) const;
+
+  //! Write the image in PPM format
+  void write_ppm(std::ostream &os) const;
+
+  //! Write a band of rows of the image in PPM format
+  void write_ppm(std::ostream &os, int y_begin, int y_end) const;
+
+  //! Write the image in PPM format to a file
+  bool write_ppm(const std::string &path) const;
+};
+
+// === Inline function definitions
+
+inline int Framebuffer::get_width() const { return width; }
+inline int Framebuffer::get_height() const { return height; }
+inline unsigned int Framebuffer::get_samples() const { return samples; }
+
+inline void Framebuffer::set_tone_map(const ToneMap *tone_map)
+{
+  this->tone_map = tone_map;
+}
+
+inline const Color & Framebuffer::get_sum(int x, int y) const
+{
+  return sums[y * width + x];
+}
+
+inline void Framebuffer::add(int x, int y, const Color &c)
+{
+  sums[y * width + x] += c;
+}
+
+#endif
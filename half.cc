@@ -0,0 +1,103 @@
+/* half.cc
+ *
+ * Conversion of arrays between floats and half floats, with the F16C
+ * instructions where the CPU has them
+ */
+
+#include "half.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HALF_F16C 1
+#include <immintrin.h>
+#endif
+
+#ifdef HALF_F16C
+
+// Eight values at a time with F16C, the rest with the scalar conversion
+// (which rounds the same way)
+__attribute__((target("avx,f16c")))
+static void floats_to_halves_f16c(const float *in, uint16_t *out, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+                                _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *) (out + i), h);
+  }
+
+  for (; i < n; ++i)
+    out[i] = float_to_half(in[i]);
+}
+
+__attribute__((target("avx,f16c")))
+static void halves_to_floats_f16c(const uint16_t *in, float *out, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i h = _mm_loadu_si128((const __m128i *) (in + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+  }
+
+  for (; i < n; ++i)
+    out[i] = half_to_float(in[i]);
+}
+
+#endif
+
+/*!
+ * \returns  true if the CPU supports F16C (checked once)
+ */
+bool has_f16c()
+{
+#ifdef HALF_F16C
+  static const bool f16c = __builtin_cpu_supports("avx")
+                           && __builtin_cpu_supports("f16c");
+  return f16c;
+#else
+  return false;
+#endif
+}
+
+/*!
+ * Rounds to nearest even, giving the same result with or without F16C.
+ *
+ * \param[in]  in   Floats to convert
+ * \param[out] out  Half floats (may not overlap in)
+ * \param[in]  n    Number of values
+ */
+void floats_to_halves(const float *in, uint16_t *out, size_t n)
+{
+#ifdef HALF_F16C
+  if (has_f16c())
+  {
+    floats_to_halves_f16c(in, out, n);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < n; ++i)
+    out[i] = float_to_half(in[i]);
+}
+
+/*!
+ * \param[in]  in   Half floats to convert
+ * \param[out] out  Floats (may not overlap in)
+ * \param[in]  n    Number of values
+ */
+void halves_to_floats(const uint16_t *in, float *out, size_t n)
+{
+#ifdef HALF_F16C
+  if (has_f16c())
+  {
+    halves_to_floats_f16c(in, out, n);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < n; ++i)
+    out[i] = half_to_float(in[i]);
+}
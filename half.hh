@@ -0,0 +1,105 @@
+/*! \file
+ * \brief Conversion between 32-bit floats and 16-bit half floats.
+ */
+
+#ifndef _HALF_HH__
+#define _HALF_HH__
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+
+//! Convert a float to a half float, rounding to nearest even
+/*!
+ * Values too large for a half become infinity, and NaNs stay NaN.
+ *
+ * \param f  Value to convert
+ * \returns  Bits of the nearest half float
+ */
+inline uint16_t float_to_half(float f)
+{
+  // Float bits of the largest value (2^16) & the magic number for denormals
+  static const uint32_t F16_MAX = (127 + 16) << 23;
+  static const uint32_t DENORM_MAGIC = ((127 - 15) + (23 - 10) + 1) << 23;
+
+  uint32_t x;
+  memcpy(&x, &f, 4);
+
+  uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+
+  uint16_t h;
+
+  if (x >= F16_MAX)
+  {
+    // Infinity (or overflow), or NaN
+    h = (x > (255u << 23)) ? 0x7e00 : 0x7c00;
+  }
+  else if (x < (113u << 23))
+  {
+    // Denormal (or zero): let float addition do the rounding
+    float d, magic;
+    memcpy(&d, &x, 4);
+    memcpy(&magic, &DENORM_MAGIC, 4);
+    d += magic;
+    memcpy(&x, &d, 4);
+    h = x - DENORM_MAGIC;
+  }
+  else
+  {
+    // Normal: rebias the exponent & round the mantissa to nearest even
+    uint32_t odd = (x >> 13) & 1;
+    x += (uint32_t(15 - 127) << 23) + 0xfff + odd;
+    h = x >> 13;
+  }
+
+  return h | (sign >> 16);
+}
+
+//! Convert a half float to a float (exactly)
+/*!
+ * \param h  Bits of a half float
+ * \returns  The same value as a float
+ */
+inline float half_to_float(uint16_t h)
+{
+  static const uint32_t SHIFTED_EXP = 0x7c00 << 13;
+  static const uint32_t DENORM_BIAS = 113 << 23;
+
+  uint32_t x = (h & 0x7fff) << 13;
+  uint32_t exp = x & SHIFTED_EXP;
+  x += (127 - 15) << 23;
+
+  float f;
+
+  if (exp == SHIFTED_EXP)
+  {
+    // Infinity or NaN
+    x += (128 - 16) << 23;
+  }
+  else if (exp == 0)
+  {
+    // Denormal (or zero): renormalize with float subtraction
+    float bias;
+    x += 1 << 23;
+    memcpy(&f, &x, 4);
+    memcpy(&bias, &DENORM_BIAS, 4);
+    f -= bias;
+    memcpy(&x, &f, 4);
+  }
+
+  x |= uint32_t(h & 0x8000) << 16;
+  memcpy(&f, &x, 4);
+  return f;
+}
+
+//! Convert an array of floats to half floats
+void floats_to_halves(const float *in, uint16_t *out, size_t n);
+
+//! Convert an array of half floats to floats
+void halves_to_floats(const uint16_t *in, float *out, size_t n);
+
+//! Check if the array conversions use the F16C instructions
+bool has_f16c();
+
+#endif
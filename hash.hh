@@ -0,0 +1,105 @@
+/*! \file
+ * \brief An incremental hash for identifying scene content.
+ */
+
+#ifndef _HASH_HH__
+#define _HASH_HH__
+
+#include "vector.hh"
+#include "color.hh"
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+//! An incremental 64-bit FNV-1a hash
+/*!
+ * Values are fed in as little-endian bytes (floats by their bit patterns),
+ * so the hash of the same sequence of values is the same on every host.
+ */
+class Hash
+{
+  //! Hash of the bytes added so far
+  uint64_t value;
+
+  //! Add one byte
+  void add_byte(unsigned char b);
+
+  public:
+  // === Constructors & methods
+
+  //! Default constructor gives the hash of no data
+  Hash();
+
+  //! Add raw bytes
+  Hash & add(const void *data, std::size_t len);
+  //! Add an integer
+  Hash & add(uint32_t v);
+  //! Add a float
+  Hash & add(float f);
+  //! Add a vector
+  Hash & add(const Vector3F &v);
+  //! Add a color
+  Hash & add(const Color &c);
+  //! Add a string (including its length)
+  Hash & add(const std::string &s);
+
+  //! Accessor for the hash of everything added so far
+  uint64_t get_value() const;
+};
+
+// === Inline function definitions
+
+inline Hash::Hash()
+  : value(14695981039346656037ULL)
+{ }
+
+inline void Hash::add_byte(unsigned char b)
+{
+  value = (value ^ b) * 1099511628211ULL;
+}
+
+inline Hash & Hash::add(const void *data, std::size_t len)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+
+  for (std::size_t i = 0; i < len; ++i)
+    add_byte(p[i]);
+
+  return *this;
+}
+
+inline Hash & Hash::add(uint32_t v)
+{
+  for (unsigned int i = 0; i < 4; ++i)
+    add_byte((v >> (8 * i)) & 0xff);
+
+  return *this;
+}
+
+inline Hash & Hash::add(float f)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return add(bits);
+}
+
+inline Hash & Hash::add(const Vector3F &v)
+{
+  return add(v[0]).add(v[1]).add(v[2]);
+}
+
+inline Hash & Hash::add(const Color &c)
+{
+  return add(c.get_red()).add(c.get_green()).add(c.get_blue());
+}
+
+inline Hash & Hash::add(const std::string &s)
+{
+  add(uint32_t(s.size()));
+  return add(s.data(), s.size());
+}
+
+inline uint64_t Hash::get_value() const { return value; }
+
+#endif
@@ -0,0 +1,194 @@
+/* hdr_test.cc
+ *
+ * gtest Unit Test Suite for half floats & HDR images
+ */
+
+#include "hdrimage.hh"
+#include "half.hh"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <limits>
+
+using namespace std;
+using namespace testing;
+
+// Read a little-endian 32-bit value
+static uint32_t read_le32(const string &s, size_t i)
+{
+  return uint32_t((unsigned char) s[i])
+         | (uint32_t((unsigned char) s[i + 1]) << 8)
+         | (uint32_t((unsigned char) s[i + 2]) << 16)
+         | (uint32_t((unsigned char) s[i + 3]) << 24);
+}
+
+// Known values, rounding, & the array conversion agreeing with the scalar one
+TEST(HalfTest, Conversion)
+{
+  EXPECT_EQ(0x0000, float_to_half(0.f));
+  EXPECT_EQ(0x8000, float_to_half(-0.f));
+  EXPECT_EQ(0x3c00, float_to_half(1.f));
+  EXPECT_EQ(0xc000, float_to_half(-2.f));
+  EXPECT_EQ(0x7bff, float_to_half(65504.f));
+  EXPECT_EQ(0x7c00, float_to_half(65520.f));
+  EXPECT_EQ(0x7c00, float_to_half(numeric_limits<float>::infinity()));
+  EXPECT_EQ(0x0001, float_to_half(5.9604645e-8f));
+
+  // Halfway between 1 and the next half rounds to even (down), and just above
+  // rounds up
+  EXPECT_EQ(0x3c00, float_to_half(1.f + 1.f / 2048));
+  EXPECT_EQ(0x3c01, float_to_half(1.f + 1.f / 2048 + 1.f / 8192));
+  EXPECT_EQ(0x3c02, float_to_half(1.f + 3.f / 2048));
+
+  // Every finite half converts back to the same float
+  for (uint32_t h = 0; h < 0x10000; ++h)
+  {
+    if ((h & 0x7c00) == 0x7c00) continue;
+    ASSERT_EQ(h, float_to_half(half_to_float(h))) << h;
+  }
+
+  // Values across the whole range (including denormals & overflow), whose
+  // count isn't a multiple of a SIMD width
+  vector<float> in;
+  for (float f = 1e-9f; f < 1e6f; f *= 1.0137f)
+  {
+    in.push_back(f);
+    in.push_back(-f * 1.3f);
+  }
+  in.push_back(0.f);
+
+  vector<uint16_t> out(in.size());
+  floats_to_halves(&in[0], &out[0], in.size());
+
+  vector<float> back(in.size());
+  halves_to_floats(&out[0], &back[0], in.size());
+
+  for (unsigned int i = 0; i < in.size(); ++i)
+  {
+    ASSERT_EQ(float_to_half(in[i]), out[i]) << in[i];
+    ASSERT_EQ(half_to_float(out[i]), back[i]) << in[i];
+  }
+}
+
+// A framebuffer with colors above 1, with two samples per pixel
+struct HDRImageTest : public Test
+{
+  Framebuffer fb;
+  HDRImage img;
+
+  HDRImageTest()
+    : fb(13, 7)
+    , img(13, 7)
+  {
+    for (int y = 0; y < fb.get_height(); ++y)
+      for (int x = 0; x < fb.get_width(); ++x)
+        fb.add(x, y, Color(x, 0.25f * y, 1000.f));
+    fb.end_pass(2);
+
+    img.set_rows(fb, 2, 0, fb.get_height());
+  }
+};
+
+// Colors are averaged and kept unclamped
+TEST_F(HDRImageTest, Pixels)
+{
+  EXPECT_FLOAT_EQ(6.f, img.get_pixel(12, 3).get_red());
+  EXPECT_FLOAT_EQ(0.375f, img.get_pixel(12, 3).get_green());
+  EXPECT_FLOAT_EQ(500.f, img.get_pixel(12, 3).get_blue());
+}
+
+// An OpenEXR band: header, offsets, & blocks of B, G, R channels
+TEST_F(HDRImageTest, WriteEXR)
+{
+  ostringstream oss;
+  ASSERT_TRUE(img.write_exr(oss, 2, 5));
+  string exr = oss.str();
+
+  EXPECT_EQ(20000630u, read_le32(exr, 0));
+  EXPECT_EQ(2u, read_le32(exr, 4));
+
+  // Data window of the band
+  size_t i = exr.find(string("dataWindow\0box2i\0", 17));
+  ASSERT_NE(string::npos, i);
+  EXPECT_EQ(16u, read_le32(exr, i + 17));
+  EXPECT_EQ(2u, read_le32(exr, i + 25));
+  EXPECT_EQ(12u, read_le32(exr, i + 29));
+  EXPECT_EQ(4u, read_le32(exr, i + 33));
+
+  // Blocks follow the offset table, which follows the header
+  size_t line_size = 3 * 13 * 2;
+  size_t table = exr.size() - 3 * (8 + line_size) - 3 * 8;
+  EXPECT_EQ(string("\0", 1), exr.substr(table - 1, 1));
+
+  for (int k = 0; k < 3; ++k)
+  {
+    size_t block = read_le32(exr, table + 8 * k);
+    EXPECT_EQ(0u, read_le32(exr, table + 8 * k + 4));
+    EXPECT_EQ(table + 3 * 8 + k * (8 + line_size), block);
+    EXPECT_EQ(uint32_t(2 + k), read_le32(exr, block));
+    EXPECT_EQ(line_size, read_le32(exr, block + 4));
+
+    // Green of pixel 5
+    size_t g = block + 8 + 2 * 13 + 2 * 5;
+    uint16_t h = (unsigned char) exr[g] | ((unsigned char) exr[g + 1] << 8);
+    EXPECT_EQ(img.get_row(2 + k)[3 * 5 + 1], h);
+  }
+}
+
+// A PFM band, from the bottom row up
+TEST_F(HDRImageTest, WritePFM)
+{
+  ostringstream oss;
+  ASSERT_TRUE(img.write_pfm(oss, 1, 7));
+  string pfm = oss.str();
+
+  string header = "PF\n13 6\n-1.0\n";
+  ASSERT_EQ(header, pfm.substr(0, header.size()));
+  ASSERT_EQ(header.size() + 13 * 6 * 3 * 4, pfm.size());
+
+  // First pixel is the bottom left
+  uint32_t bits = read_le32(pfm, header.size() + 4);
+  float green;
+  memcpy(&green, &bits, 4);
+  EXPECT_FLOAT_EQ(0.75f, green);
+}
+
+// An image holding only a band writes it the same as a whole image
+TEST_F(HDRImageTest, Band)
+{
+  HDRImage band(13, 7, 2, 5);
+  band.set_rows(fb, 2, 2, 5);
+
+  EXPECT_FLOAT_EQ(6.f, band.get_pixel(12, 3).get_red());
+
+  ostringstream whole_exr, band_exr;
+  ASSERT_TRUE(img.write_exr(whole_exr, 2, 5));
+  ASSERT_TRUE(band.write_exr(band_exr, 2, 5));
+  EXPECT_EQ(whole_exr.str(), band_exr.str());
+
+  ostringstream whole_pfm, band_pfm;
+  ASSERT_TRUE(img.write_pfm(whole_pfm, 3, 5));
+  ASSERT_TRUE(band.write_pfm(band_pfm, 3, 5));
+  EXPECT_EQ(whole_pfm.str(), band_pfm.str());
+}
+
+// Writing straight from a Framebuffer matches writing an HDRImage
+TEST_F(HDRImageTest, WriteFramebuffer)
+{
+  ostringstream img_exr, fb_exr;
+  ASSERT_TRUE(img.write_exr(img_exr, 1, 6));
+  ASSERT_TRUE(write_exr(fb_exr, fb, 2, 1, 6));
+  EXPECT_EQ(img_exr.str(), fb_exr.str());
+
+  ostringstream img_pfm, fb_pfm;
+  ASSERT_TRUE(img.write_pfm(img_pfm, 0, 7));
+  ASSERT_TRUE(write_pfm(fb_pfm, fb, 2, 0, 7));
+  EXPECT_EQ(img_pfm.str(), fb_pfm.str());
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,378 @@
+/* hdrimage.cc
+ *
+ * A high dynamic range image stored as half floats, with OpenEXR & PFM output
+ */
+
+#include "hdrimage.hh"
+#include "half.hh"
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <sstream>
+
+using namespace std;
+
+//! Number of channels per pixel (RGB)
+static const int HDR_CHANNELS = 3;
+
+/*!
+ * \param width   Width of image in pixels
+ * \param height  Height of image in pixels
+ */
+HDRImage::HDRImage(int width, int height)
+  : width(width)
+  , height(height)
+  , band_begin(0)
+  , band_end(height)
+  , pixels(HDR_CHANNELS * width * height, 0)
+{
+}
+
+/*!
+ * \param width    Width of image in pixels
+ * \param height   Height of image in pixels
+ * \param y_begin  First row to hold
+ * \param y_end    One past the last row to hold
+ */
+HDRImage::HDRImage(int width, int height, int y_begin, int y_end)
+  : width(width)
+  , height(height)
+  , band_begin(y_begin)
+  , band_end(y_end)
+  , pixels(HDR_CHANNELS * width * (y_end - y_begin), 0)
+{
+  assert(0 <= y_begin && y_begin <= y_end && y_end <= height);
+}
+
+/*!
+ * \param x  Column of pixel
+ * \param y  Row of pixel
+ * \returns  Color of the pixel
+ */
+Color HDRImage::get_pixel(int x, int y) const
+{
+  assert(x >= 0 && x < width && y >= band_begin && y < band_end);
+
+  const uint16_t *p = get_row(y) + HDR_CHANNELS * x;
+  return Color(half_to_float(p[0]), half_to_float(p[1]),
+               half_to_float(p[2]));
+}
+
+/*!
+ * Each pixel is averaged over n samples, as for Framebuffer::get_rgb8(), and
+ * the row is converted to halves in one go (using F16C where available).
+ *
+ * \param[in]  fb   Framebuffer to read
+ * \param[in]  n    Number of samples in each pixel (nonzero)
+ * \param[in]  y    Row to convert
+ * \param[out] row  Room for the row's floats (3 * width)
+ * \param[out] out  The row's halves (3 * width)
+ */
+static void row_to_halves(const Framebuffer &fb, unsigned int n, int y,
+                          float *row, uint16_t *out)
+{
+  int width = fb.get_width();
+
+  for (int x = 0; x < width; ++x)
+  {
+    Color c = fb.get_sum(x, y) / n;
+    row[HDR_CHANNELS * x] = c.get_red();
+    row[HDR_CHANNELS * x + 1] = c.get_green();
+    row[HDR_CHANNELS * x + 2] = c.get_blue();
+  }
+
+  floats_to_halves(row, out, HDR_CHANNELS * width);
+}
+
+/*!
+ * \param fb       Framebuffer with the same size as the image
+ * \param n        Number of samples in each pixel (nonzero)
+ * \param y_begin  First row to set (held by the image)
+ * \param y_end    One past the last row to set (held by the image)
+ */
+void HDRImage::set_rows(const Framebuffer &fb, unsigned int n,
+                        int y_begin, int y_end)
+{
+  assert(fb.get_width() == width && fb.get_height() == height);
+  assert(band_begin <= y_begin && y_begin <= y_end && y_end <= band_end);
+  assert(n > 0);
+
+  vector<float> row(HDR_CHANNELS * width);
+
+  for (int y = y_begin; y < y_end; ++y)
+    row_to_halves(fb, n, y, &row[0],
+                  &pixels[HDR_CHANNELS * (y - band_begin) * width]);
+}
+
+/*!
+ * \param os    Output stream
+ * \param v     Value to write as 4 little-endian bytes
+ */
+static void write_le32(ostream &os, uint32_t v)
+{
+  char b[4] = { char(v), char(v >> 8), char(v >> 16), char(v >> 24) };
+  os.write(b, 4);
+}
+
+/*!
+ * \param os    Output stream
+ * \param v     Value to write as 8 little-endian bytes
+ */
+static void write_le64(ostream &os, uint64_t v)
+{
+  write_le32(os, uint32_t(v));
+  write_le32(os, uint32_t(v >> 32));
+}
+
+/*!
+ * \param os    Output stream
+ * \param v     Value to write as a little-endian IEEE float
+ */
+static void write_float(ostream &os, float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, 4);
+  write_le32(os, bits);
+}
+
+/*!
+ * \param os    Output stream
+ * \param name  Attribute name
+ * \param type  Attribute type name
+ * \param size  Number of bytes of value, which the caller writes next
+ */
+static void write_attribute(ostream &os, const char *name, const char *type,
+                            uint32_t size)
+{
+  os.write(name, strlen(name) + 1);
+  os.write(type, strlen(type) + 1);
+  write_le32(os, size);
+}
+
+/*!
+ * Writes a single-part scanline file with no compression, and one scanline
+ * per block.  The rows are the data window within a display window of the
+ * whole image, so a band can be placed back into the full frame.
+ *
+ * \param os       Output stream to write image in OpenEXR format
+ * \param width    Width of image in pixels
+ * \param height   Height of image in pixels
+ * \param y_begin  First row to write
+ * \param y_end    One past the last row to write
+ * \param get_row  Function returning the halves of row y (valid until the
+ *                 next call)
+ * \returns        true if the image was written
+ */
+template <typename RowFn>
+static bool write_exr_rows(ostream &os, int width, int height,
+                           int y_begin, int y_end, const RowFn &get_row)
+{
+  assert(0 <= y_begin && y_begin < y_end && y_end <= height);
+
+  // (The header is built first, as offsets are from the start of the file)
+  ostringstream header;
+
+  // Magic number & version 2 (single-part scanline, short names)
+  write_le32(header, 20000630);
+  write_le32(header, 2);
+
+  // Channels, in alphabetical order: each has a name, pixel type (1 = half),
+  // linear flag & reserved bytes, and x & y sampling
+  static const char *CHANNELS[HDR_CHANNELS] = { "B", "G", "R" };
+  write_attribute(header, "channels", "chlist", HDR_CHANNELS * 18 + 1);
+  for (int i = 0; i < HDR_CHANNELS; ++i)
+  {
+    header.write(CHANNELS[i], 2);
+    write_le32(header, 1);
+    header.write("\0\0\0\0", 4);
+    write_le32(header, 1);
+    write_le32(header, 1);
+  }
+  header.put(0);
+
+  // No compression
+  write_attribute(header, "compression", "compression", 1);
+  header.put(0);
+
+  // Data window (the band) & display window (the whole image)
+  write_attribute(header, "dataWindow", "box2i", 16);
+  write_le32(header, 0);
+  write_le32(header, y_begin);
+  write_le32(header, width - 1);
+  write_le32(header, y_end - 1);
+
+  write_attribute(header, "displayWindow", "box2i", 16);
+  write_le32(header, 0);
+  write_le32(header, 0);
+  write_le32(header, width - 1);
+  write_le32(header, height - 1);
+
+  // Increasing y
+  write_attribute(header, "lineOrder", "lineOrder", 1);
+  header.put(0);
+
+  write_attribute(header, "pixelAspectRatio", "float", 4);
+  write_float(header, 1);
+
+  write_attribute(header, "screenWindowCenter", "v2f", 8);
+  write_float(header, 0);
+  write_float(header, 0);
+
+  write_attribute(header, "screenWindowWidth", "float", 4);
+  write_float(header, 1);
+
+  // End of header
+  header.put(0);
+
+  const string h = header.str();
+  os.write(h.data(), h.size());
+
+  // Table of each scanline block's offset from the start of the file
+  uint32_t line_size = HDR_CHANNELS * width * sizeof(uint16_t);
+  uint64_t offset = h.size() + 8 * (y_end - y_begin);
+
+  for (int y = y_begin; y < y_end; ++y)
+  {
+    write_le64(os, offset);
+    offset += 8 + line_size;
+  }
+
+  // Each scanline block: y, size of data, then every pixel of each channel
+  string block(line_size, 0);
+
+  for (int y = y_begin; y < y_end; ++y)
+  {
+    const uint16_t *row = get_row(y);
+
+    for (int c = 0; c < HDR_CHANNELS; ++c)
+    {
+      // (Channels are stored B, G, R and pixels R, G, B)
+      char *out = &block[2 * c * width];
+      for (int x = 0; x < width; ++x)
+      {
+        uint16_t v = row[HDR_CHANNELS * x + (HDR_CHANNELS - 1 - c)];
+        out[2 * x] = char(v);
+        out[2 * x + 1] = char(v >> 8);
+      }
+    }
+
+    write_le32(os, y);
+    write_le32(os, line_size);
+    os.write(block.data(), block.size());
+  }
+
+  return bool(os);
+}
+
+/*!
+ * Writes rows [y_begin, y_end) as an image of their own, as little-endian
+ * floats from the bottom row up.
+ *
+ * \param os       Output stream to write image in PFM format
+ * \param width    Width of image in pixels
+ * \param height   Height of image in pixels
+ * \param y_begin  First row to write
+ * \param y_end    One past the last row to write
+ * \param get_row  Function returning the halves of row y (valid until the
+ *                 next call)
+ * \returns        true if the image was written
+ */
+template <typename RowFn>
+static bool write_pfm_rows(ostream &os, int width, int height,
+                           int y_begin, int y_end, const RowFn &get_row)
+{
+  assert(0 <= y_begin && y_begin < y_end && y_end <= height);
+
+  // Header: color, size, & a negative scale for little-endian
+  os << "PF\n" << width << ' ' << (y_end - y_begin) << "\n-1.0\n";
+
+  vector<float> row(HDR_CHANNELS * width);
+
+  for (int y = y_end - 1; y >= y_begin; --y)
+  {
+    halves_to_floats(get_row(y), &row[0], row.size());
+
+    for (unsigned int i = 0; i < row.size(); ++i)
+      write_float(os, row[i]);
+  }
+
+  return bool(os);
+}
+
+/*!
+ * \param os       Output stream to write image in OpenEXR format
+ * \param y_begin  First row to write (held by the image)
+ * \param y_end    One past the last row to write (held by the image)
+ * \returns        true if the image was written
+ */
+bool HDRImage::write_exr(ostream &os, int y_begin, int y_end) const
+{
+  assert(band_begin <= y_begin && y_end <= band_end);
+
+  return write_exr_rows(os, width, height, y_begin, y_end,
+                        [this](int y) { return get_row(y); });
+}
+
+/*!
+ * \param os       Output stream to write image in PFM format
+ * \param y_begin  First row to write (held by the image)
+ * \param y_end    One past the last row to write (held by the image)
+ * \returns        true if the image was written
+ */
+bool HDRImage::write_pfm(ostream &os, int y_begin, int y_end) const
+{
+  assert(band_begin <= y_begin && y_end <= band_end);
+
+  return write_pfm_rows(os, width, height, y_begin, y_end,
+                        [this](int y) { return get_row(y); });
+}
+
+/*!
+ * Each row is averaged & converted to halves just before it is written, so
+ * the output is the same as an HDRImage's, without holding the image.
+ *
+ * \param os       Output stream to write image in OpenEXR format
+ * \param fb       Framebuffer to write
+ * \param n        Number of samples in each pixel (nonzero)
+ * \param y_begin  First row to write
+ * \param y_end    One past the last row to write
+ * \returns        true if the image was written
+ */
+bool write_exr(ostream &os, const Framebuffer &fb, unsigned int n,
+               int y_begin, int y_end)
+{
+  vector<float> row(HDR_CHANNELS * fb.get_width());
+  vector<uint16_t> halves(row.size());
+
+  return write_exr_rows(os, fb.get_width(), fb.get_height(), y_begin, y_end,
+                        [&](int y)
+                        {
+                          row_to_halves(fb, n, y, &row[0], &halves[0]);
+                          return (const uint16_t *) &halves[0];
+                        });
+}
+
+/*!
+ * Each row is averaged & converted to halves just before it is written, so
+ * the output is the same as an HDRImage's, without holding the image.
+ *
+ * \param os       Output stream to write image in PFM format
+ * \param fb       Framebuffer to write
+ * \param n        Number of samples in each pixel (nonzero)
+ * \param y_begin  First row to write
+ * \param y_end    One past the last row to write
+ * \returns        true if the image was written
+ */
+bool write_pfm(ostream &os, const Framebuffer &fb, unsigned int n,
+               int y_begin, int y_end)
+{
+  vector<float> row(HDR_CHANNELS * fb.get_width());
+  vector<uint16_t> halves(row.size());
+
+  return write_pfm_rows(os, fb.get_width(), fb.get_height(), y_begin, y_end,
+                        [&](int y)
+                        {
+                          row_to_halves(fb, n, y, &row[0], &halves[0]);
+                          return (const uint16_t *) &halves[0];
+                        });
+}
@@ -0,0 +1,92 @@
+/* hdrimage.hh
+ *
+ * A high dynamic range image stored as half floats, with OpenEXR & PFM output
+ */
+
+#ifndef _HDRIMAGE_HH__
+#define _HDRIMAGE_HH__
+
+#include "framebuffer.hh"
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+
+//! A high dynamic range RGB image stored as 16-bit half floats
+/*!
+ * Holds a finished (averaged) image at half the size of a Framebuffer, with
+ * colors kept unclamped: halves cover up to 65504 with 11 significant bits,
+ * more than enough for display.  Samples are still accumulated in float
+ * Framebuffers, as sums of many samples need the extra precision.
+ *
+ * Only a band of the image's rows may be held, for a cropped render.
+ * (To write a finished Framebuffer without keeping a copy of it, see
+ * write_exr() & write_pfm() below.)
+ */
+class HDRImage
+{
+  //! Width of image in pixels
+  int width;
+  //! Height of image in pixels
+  int height;
+  //! First row held
+  int band_begin;
+  //! One past the last row held
+  int band_end;
+
+  //! Red, green & blue halves of each pixel held, in row-major order
+  std::vector<uint16_t> pixels;
+
+  public:
+  // === Constructors & methods
+
+  //! Construct a black image
+  HDRImage(int width = 0, int height = 0);
+
+  //! Construct a black image holding only rows [y_begin, y_end)
+  HDRImage(int width, int height, int y_begin, int y_end);
+
+  // Accessors
+  //! Accessor for image width
+  int get_width() const;
+  //! Accessor for image height
+  int get_height() const;
+
+  //! Get the halves of a row (3 * width values)
+  const uint16_t * get_row(int y) const;
+
+  //! Get the color of a pixel
+  Color get_pixel(int x, int y) const;
+
+  //! Set rows from the averaged samples of a Framebuffer of the same size
+  void set_rows(const Framebuffer &fb, unsigned int n, int y_begin, int y_end);
+
+  //! Write a band of rows in OpenEXR format (uncompressed half scanlines)
+  bool write_exr(std::ostream &os, int y_begin, int y_end) const;
+
+  //! Write a band of rows in PFM (portable float map) format
+  bool write_pfm(std::ostream &os, int y_begin, int y_end) const;
+};
+
+/*! \relates HDRImage
+ * \brief Function to write a band of a Framebuffer's rows in OpenEXR format
+ */
+bool write_exr(std::ostream &os, const Framebuffer &fb, unsigned int n,
+               int y_begin, int y_end);
+
+/*! \relates HDRImage
+ * \brief Function to write a band of a Framebuffer's rows in PFM format
+ */
+bool write_pfm(std::ostream &os, const Framebuffer &fb, unsigned int n,
+               int y_begin, int y_end);
+
+// === Inline function definitions
+
+inline int HDRImage::get_width() const { return width; }
+inline int HDRImage::get_height() const { return height; }
+
+inline const uint16_t * HDRImage::get_row(int y) const
+{
+  return &pixels[3 * (y - band_begin) * width];
+}
+
+#endif
@@ -0,0 +1,219 @@
+/* instance.cc
+ *
+ * A SceneObject placing shared geometry with a transform
+ */
+
+#include "instance.hh"
+#include "rebase.hh"
+#include <cassert>
+
+using namespace std;
+
+// Construct an instance with the geometry's surface (and texture)
+/*!
+ * \param g  Geometry to place (in its own space)
+ * \param t  Transform from the geometry's space to the Scene's
+ */
+Instance::Instance(const SPSceneObject &g, const Transform &t)
+  : SceneObject(g->get_surface_color(), g->get_surface_reflectivity())
+  , geometry(g)
+  , to_world(t)
+{
+  assert(geometry != NULL);
+  set_texture(geometry->get_texture());
+}
+
+// Construct an instance with its own surface (and the geometry's texture)
+/*!
+ * \param g  Geometry to place (in its own space)
+ * \param t  Transform from the geometry's space to the Scene's
+ * \param c  Surface color of instance
+ * \param r  Surface reflectivity of instance
+ */
+Instance::Instance(const SPSceneObject &g, const Transform &t,
+                   const Color &c, float r)
+  : SceneObject(c, r)
+  , geometry(g)
+  , to_world(t)
+{
+  assert(geometry != NULL);
+  set_texture(geometry->get_texture());
+}
+
+// Identify first intersection with a ray
+// (See sceneobject.hh)
+float Instance::intersection(const Ray &r) const
+{
+  Transform to_object = to_world.get_inverse();
+
+  // Left unnormalized, to keep t values
+  Ray r_obj(to_object.apply_point(r.get_orig()),
+            to_object.apply_vector(r.get_dir()), false);
+
+  return geometry->intersection(r_obj);
+}
+
+// Identify first intersection with a ray, and the geometry's primitive hit
+// (See sceneobject.hh)
+float Instance::intersection_from(const Ray &r, unsigned int from,
+                                  unsigned int &prim) const
+{
+  Transform to_object = to_world.get_inverse();
+
+  // Left unnormalized, to keep t values
+  Ray r_obj(to_object.apply_point(r.get_orig()),
+            to_object.apply_vector(r.get_dir()), false);
+
+  return geometry->intersection_from(r_obj, from, prim);
+}
+
+// Refine the t value of a hit on the geometry
+// (See sceneobject.hh)
+float Instance::refine_intersection(const Ray &r, float t,
+                                    unsigned int prim) const
+{
+  Transform to_object = to_world.get_inverse();
+
+  Ray r_obj(to_object.apply_point(r.get_orig()),
+            to_object.apply_vector(r.get_dir()), false);
+
+  return geometry->refine_intersection(r_obj, t, prim);
+}
+
+// Get the normal to the surface at a point p
+// (See sceneobject.hh)
+Vector3F Instance::get_normal(const Vector3F &p) const
+{
+  Transform to_object = to_world.get_inverse();
+
+  Vector3F n = geometry->get_normal(to_object.apply_point(p));
+
+  return to_world.apply_normal(n).get_normalized();
+}
+
+// Get the normal to the surface at a point p on a known primitive
+// (See sceneobject.hh)
+Vector3F Instance::get_normal(const Vector3F &p, unsigned int prim) const
+{
+  Transform to_object = to_world.get_inverse();
+
+  Vector3F n = geometry->get_normal(to_object.apply_point(p), prim);
+
+  return to_world.apply_normal(n).get_normalized();
+}
+
+// Get the change in the surface normal over a small step along the surface
+// (See sceneobject.hh)
+Vector3F Instance::get_normal_differential(const Vector3F &p,
+                                           const Vector3F &dp) const
+{
+  Transform to_object = to_world.get_inverse();
+
+  Vector3F p_obj = to_object.apply_point(p);
+  Vector3F dn = geometry->get_normal_differential(
+      p_obj, to_object.apply_vector(dp));
+
+  // Flat geometry stays flat (without finding its normal)
+  if (dn.norm_sq() == 0)
+    return dn;
+
+  Vector3F n = geometry->get_normal(p_obj);
+
+  // Differentiating the normalized transformed normal
+  Vector3F m = to_world.apply_normal(n);
+  float len = m.norm();
+  Vector3F n_world = m / len;
+  Vector3F dm = to_world.apply_normal(dn);
+
+  return (dm - dot(dm, n_world) * n_world) / len;
+}
+
+// Get the surface color at a point p
+// Textures are evaluated in the geometry's space, so they move with it
+Color Instance::get_color(const Vector3F &p, const Vector3F &dpdx,
+                          const Vector3F &dpdy) const
+{
+  if (!get_texture()) return get_surface_color();
+
+  Transform to_object = to_world.get_inverse();
+
+  return get_texture()->get_color(to_object.apply_point(p),
+                                  to_object.apply_vector(dpdx),
+                                  to_object.apply_vector(dpdy));
+}
+
+// Get a bounding box for the object
+// (See sceneobject.hh)
+bool Instance::get_bounds(AABB &b) const
+{
+  AABB box;
+  if (!geometry->get_bounds(box)) return false;
+
+  b = to_world.apply_bounds(box);
+  return true;
+}
+
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void Instance::hash(Hash &h) const
+{
+  SceneObject::hash(h);
+  to_world.hash(h);
+  geometry->hash(h);
+}
+
+// Name of the object's type, for hashing
+// (See sceneobject.hh)
+const char *Instance::type_tag() const
+{
+  return "Instance";
+}
+
+/*! \relates Instance
+ * Reads an Instance from the provided input stream in the format:
+ * "position axis angle scale color reflectivity"
+ *
+ * With the read formats for Vectors & Colors, this looks like:
+ * "(x y z) (x y z) degrees (x y z) [r g b] reflectivity"
+ *
+ * The geometry is scaled by each component of scale, then rotated about
+ * the axis, then moved to the position.  The position is read with
+ * read_position(), so is relative to the stream's origin, if it has one.
+ * A texture of the geometry replaces the color read, as it does the
+ * geometry's own.
+ *
+ * \param is     Input stream from which to read a new Instance
+ * \param g      Geometry to place
+ * \param arena  Arena in which to allocate the new object
+ * \returns      Pointer to a new Instance, or NULL if reading failed
+ */
+SPSceneObject read_Instance(std::istream &is, const SPSceneObject &g,
+                            Arena &arena)
+{
+  // Check if stream is already bad
+  if (!is) return SPSceneObject();
+
+  Vector3F pos;
+  Vector3F axis;
+  float angle;
+  Vector3F scale;
+  Color c;
+  float ref;
+
+  // Read components
+  read_position(is, pos);
+  is >> axis;
+  is >> angle;
+  is >> scale;
+  is >> c;
+  is >> ref;
+
+  if (!is || axis.norm_sq() == 0
+      || scale[0] == 0 || scale[1] == 0 || scale[2] == 0)
+    return SPSceneObject();
+
+  Transform t = Transform::translate(pos) * Transform::rotate(axis, angle)
+                * Transform::scale(scale);
+
+  return arena.create<Instance>(g, t, c, ref);
+}
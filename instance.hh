@@ -0,0 +1,117 @@
+/* instance.hh
+ *
+ * A SceneObject placing shared geometry with a transform
+ */
+
+#ifndef _INSTANCE_HH__
+#define _INSTANCE_HH__
+
+#include "sceneobject.hh"
+#include "transform.hh"
+
+//! A SceneObject placing shared geometry with a transform
+/*!
+ * The geometry is any SceneObject (such as a TriangleMesh with its own
+ * hierarchy), which may be shared by any number of instances, each storing
+ * only a reference to it and its own transform and surface.  Rays are
+ * transformed into the geometry's space, so a Scene's object hierarchy over
+ * the instances' bounds and each geometry's own hierarchy form two levels,
+ * and memory grows only with the unique geometry.
+ *
+ * Directions are not normalized in object space, so t values along the
+ * transformed ray are the same as along the original.
+ *
+ * The geometry should not itself be added to the Scene.
+ */
+class Instance: public SceneObject
+{
+  //! Geometry to place
+  SPSceneObject geometry;
+
+  //! Transform from the geometry's space to the Scene's
+  Transform to_world;
+
+  public:
+  // === Constructors & methods
+
+  //! Construct an instance with the geometry's surface
+  Instance(const SPSceneObject &g, const Transform &t);
+
+  //! Construct an instance with its own surface
+  Instance(const SPSceneObject &g, const Transform &t, const Color &c,
+           float r = 0);
+
+  //! Accessor for the shared geometry
+  const SceneObject & get_geometry() const;
+
+  //! Accessor for the transform from object to world space
+  const Transform & get_transform() const;
+
+  //! Mutator to move the instance
+  void set_transform(const Transform &t);
+
+  // Identify first intersection with a ray
+  // (See sceneobject.hh)
+  float intersection(const Ray &r) const;
+
+  // Identify first intersection with a ray, and the geometry's primitive hit
+  // (See sceneobject.hh)
+  float intersection_from(const Ray &r, unsigned int from,
+                          unsigned int &prim) const;
+
+  // Refine the t value of a hit on the geometry
+  // (See sceneobject.hh)
+  float refine_intersection(const Ray &r, float t, unsigned int prim) const;
+
+  // Get the normal to the surface at a point p
+  // (See sceneobject.hh)
+  Vector3F get_normal(const Vector3F &p) const;
+
+  // Get the normal to the surface at a point p on a known primitive
+  // (See sceneobject.hh)
+  Vector3F get_normal(const Vector3F &p, unsigned int prim) const;
+
+  // Get the change in the surface normal over a small step along the surface
+  // (See sceneobject.hh)
+  Vector3F get_normal_differential(const Vector3F &p,
+                                   const Vector3F &dp) const;
+
+  // Get the surface color at a point p
+  // (See sceneobject.hh)
+  Color get_color(const Vector3F &p, const Vector3F &dpdx,
+                  const Vector3F &dpdy) const;
+
+  // Get a bounding box for the object
+  // (See sceneobject.hh)
+  bool get_bounds(AABB &b) const;
+
+  // Add everything affecting the object's appearance to a hash
+  // (See sceneobject.hh)
+  void hash(Hash &h) const;
+
+  // Name of the object's type, for hashing
+  // (See sceneobject.hh)
+  const char *type_tag() const;
+};
+
+/*! \relates Instance
+ * \brief Function to read an Instance of geometry from an input stream
+ */
+SPSceneObject read_Instance(std::istream &is, const SPSceneObject &g,
+                            Arena &arena);
+
+// === Inline function definitions
+
+inline const SceneObject & Instance::get_geometry() const
+{
+  return *geometry;
+}
+
+inline const Transform & Instance::get_transform() const
+{
+  return to_world;
+}
+
+inline void Instance::set_transform(const Transform &t) { to_world = t; }
+
+#endif
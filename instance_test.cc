@@ -0,0 +1,150 @@
+/* instance_test.cc
+ *
+ * gtest Unit Test Suite for Transform and Instance
+ */
+
+#include "instance.hh"
+#include "sphere.hh"
+#include "trianglemesh.hh"
+#include "random.hh"
+#include "texture.hh"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace std;
+using namespace testing;
+
+// Expect two vectors to be (nearly) equal
+static void expect_near(const Vector3F &a, const Vector3F &b, float tol)
+{
+  for (unsigned int i = 0; i < 3; ++i)
+    EXPECT_NEAR(a[i], b[i], tol) << "component " << i;
+}
+
+// A composed transform and its inverse cancel out
+TEST(TransformTest, InverseCancels)
+{
+  Transform t = Transform::translate(Vector3F({1, -2, 3}))
+                * Transform::rotate(Vector3F({1, 1, 0}), 30)
+                * Transform::scale(Vector3F({2, 0.5, 3}));
+  Transform identity = t.get_inverse() * t;
+
+  Vector3F p = {0.3, -4, 2};
+  expect_near(p, identity.apply_point(p), 1e-5);
+  expect_near(p, t.apply_point(t.get_inverse().apply_point(p)), 1e-5);
+
+  // Rotating a quarter turn about z takes x to y
+  Transform r = Transform::rotate(Vector3F({0, 0, 1}), 90);
+  expect_near(Vector3F({0, 1, 0}), r.apply_vector(Vector3F({1, 0, 0})),
+              1e-6);
+}
+
+// An instance of a unit sphere matches the equivalent sphere
+TEST(InstanceTest, MatchesTransformedSphere)
+{
+  SPArena arena(new Arena());
+  SPSceneObject unit = arena->create<Sphere>(Vector3F({0, 0, 0}), 1);
+
+  Transform t = Transform::translate(Vector3F({2, 1, -3}))
+                * Transform::rotate(Vector3F({0, 1, 0}), 45)
+                * Transform::scale(Vector3F({1.5, 1.5, 1.5}));
+  Instance inst(unit, t);
+  Sphere sph(Vector3F({2, 1, -3}), 1.5);
+
+  Random rng(2);
+  for (int k = 0; k < 1000; ++k)
+  {
+    Vector3F orig = {rng.next_float() * 4 - 2, 5, rng.next_float() * 4 - 5};
+    Ray r(orig, Vector3F({rng.next_float() - 0.5f, -1,
+                          rng.next_float() - 0.5f}));
+
+    float t_sph = sph.intersection(r);
+    float t_inst = inst.intersection(r);
+
+    if (t_sph == SceneObject::no_intersection)
+    {
+      EXPECT_EQ(SceneObject::no_intersection, t_inst);
+      continue;
+    }
+
+    ASSERT_NEAR(t_sph, t_inst, 1e-4);
+
+    Vector3F p = r.get_point_at_t(t_sph);
+    expect_near(sph.get_normal(p), inst.get_normal(p), 1e-4);
+  }
+
+  // Bounds of the rotated box around the unit sphere
+  AABB b;
+  ASSERT_TRUE(inst.get_bounds(b));
+  float e = 1.5f * sqrt(2.f);
+  expect_near(Vector3F({2 - e, -0.5, -3 - e}), b.get_min(), 1e-5);
+  expect_near(Vector3F({2 + e, 2.5, -3 + e}), b.get_max(), 1e-5);
+}
+
+// Normals of a non-uniformly scaled mesh stay perpendicular to its faces
+TEST(InstanceTest, ScaledMeshNormals)
+{
+  SPArena arena(new Arena());
+  boost::shared_ptr<TriangleMesh> mesh = arena->create<TriangleMesh>();
+
+  // A single slanted triangle
+  mesh->add_vertex(Vector3F({1, 0, 0}));
+  mesh->add_vertex(Vector3F({0, 1, 0}));
+  mesh->add_vertex(Vector3F({0, 0, 1}));
+  mesh->add_triangle(0, 1, 2);
+  mesh->build();
+
+  Transform t = Transform::scale(Vector3F({4, 1, 1}));
+  Instance inst(mesh, t);
+
+  // The scaled triangle's corners, and a ray to its center
+  Vector3F a = {4, 0, 0}, b = {0, 1, 0}, c = {0, 0, 1};
+  Vector3F center = (a + b + c) / 3.f;
+  Ray r(Vector3F({0, 0, 0}), center);
+
+  float hit = inst.intersection(r);
+  ASSERT_NEAR(center.norm(), hit, 1e-5);
+
+  Vector3F n = inst.get_normal(r.get_point_at_t(hit));
+  EXPECT_NEAR(0, dot(n, b - a), 1e-5);
+  EXPECT_NEAR(0, dot(n, c - a), 1e-5);
+  EXPECT_NEAR(1, n.norm(), 1e-5);
+}
+
+// An instance read with its own surface keeps its geometry's texture,
+// which moves with it
+TEST(InstanceTest, KeepsGeometryTexture)
+{
+  SPArena arena(new Arena());
+  SPSceneObject ball = arena->create<Sphere>(Vector3F({0, 0, 0}), 1);
+  SPTexture checks = arena->create<CheckerTexture>(
+      Vector3F({0, 0, 0}), 0.25, Color(1, 0, 0), Color(0, 0, 1));
+  ball->set_texture(checks);
+
+  istringstream iss("(3 0 0) (0 1 0) 90 (2 2 2) [0.5 0.5 0.5] 0");
+  SPSceneObject inst = read_Instance(iss, ball, *arena);
+  ASSERT_TRUE(inst != NULL);
+  EXPECT_EQ(checks, inst->get_texture());
+
+  Transform t = Transform::translate(Vector3F({3, 0, 0}))
+                * Transform::rotate(Vector3F({0, 1, 0}), 90)
+                * Transform::scale(Vector3F({2, 2, 2}));
+
+  Random rng(5);
+  Vector3F zero;
+  for (int k = 0; k < 100; ++k)
+  {
+    Vector3F p = {rng.next_float() * 2 - 1, rng.next_float() * 2 - 1,
+                  rng.next_float() * 2 - 1};
+    Color c = inst->get_color(t.apply_point(p), zero, zero);
+    EXPECT_EQ(checks->get_color(p).get_red(), c.get_red()) << k;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
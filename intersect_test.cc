@@ -9,6 +9,7 @@
 #include "ray.hh"
 #include "sphere.hh"
 #include "plane.hh"
+#include "camera.hh"
 #include <gtest/gtest.h>
 
 using namespace std;
@@ -183,6 +184,47 @@ TEST(SphereTest, Miss)
   EXPECT_FLOAT_EQ(SceneObject::no_intersection, t2);
 }
 
+// Ray leaving the sphere's surface, hitting only the far side (if anything)
+TEST(SphereTest, FromSurface)
+{
+  Sphere s1 = Sphere(Vector3F({0, 0, 0}), 1);
+  unsigned int prim;
+
+  // Across the inside, on a chord
+  Ray r1 = Ray(Vector3F({0.6, 0.8, 0}), Vector3F({-1, 0, 0}));
+  EXPECT_NEAR(1.2, s1.intersection_from(r1, 0, prim), 1e-6);
+  EXPECT_EQ(0u, prim);
+
+  // Away from the sphere, & along its surface
+  Ray r2 = Ray(Vector3F({0.6, 0.8, 0}), Vector3F({0.6, 0.8, 0}));
+  EXPECT_FLOAT_EQ(SceneObject::no_intersection,
+                  s1.intersection_from(r2, 0, prim));
+  Ray r3 = Ray(Vector3F({1, 0, 0}), Vector3F({0, 1, 0}));
+  EXPECT_FLOAT_EQ(SceneObject::no_intersection,
+                  s1.intersection_from(r3, 0, prim));
+
+  // From elsewhere, the nearest intersection as usual
+  Ray r4 = Ray(Vector3F({-2, 0, 0}), Vector3F({1, 0, 0}));
+  EXPECT_FLOAT_EQ(1., s1.intersection_from(r4, SceneObject::no_primitive,
+                                           prim));
+}
+
+// Hits far from the origin, refined in double precision
+TEST(SphereTest, RefineIntersection)
+{
+  Sphere s1 = Sphere(Vector3F({1e5, 0, 0}), 1);
+  Ray r = Ray(Vector3F({1e5 - 1000, 0.5, 0}), Vector3F({1, 0, 0}));
+
+  // Near side of the circle at y = 0.5, 1000 - sqrt(0.75) along the ray
+  double exact = 1000 - sqrt(0.75);
+  float t = s1.intersection(r);
+  EXPECT_NEAR(exact, s1.refine_intersection(r, t, 0), 1e-4);
+
+  // Other objects keep the hit
+  Plane p1 = Plane(0, Vector3F({0, 1, 0}));
+  EXPECT_EQ(t, p1.refine_intersection(r, t, 0));
+}
+
 // === Plane intersection()
 
 // Ray intersects plane
@@ -241,6 +283,74 @@ TEST(PlaneTest, TangentIntersection)
   EXPECT_FLOAT_EQ(0., p1.intersection(r));
 }
 
+// Ray leaving the plane can't hit it again
+TEST(PlaneTest, FromSurface)
+{
+  Plane p1 = Plane(1, Vector3F({-1, 0, 0}));
+  unsigned int prim;
+
+  // Ray leaving plane, back towards it
+  Ray r = Ray(Vector3F({1, 0, 0}), Vector3F({1, 0, 0}));
+
+  EXPECT_FLOAT_EQ(0., p1.intersection(r));
+  EXPECT_FLOAT_EQ(SceneObject::no_intersection,
+                  p1.intersection_from(r, 0, prim));
+}
+
+// === Ray differentials
+
+// Expect two vectors to be within a tolerance in every component
+static void expect_near(const Vector3F &expected, const Vector3F &actual,
+                        float tol)
+{
+  for (unsigned int k = 0; k < 3; ++k)
+    EXPECT_NEAR(expected[k], actual[k], tol) << k;
+}
+
+// Camera rays' differentials match neighbouring rays, as do those of their
+// reflections off a curved surface
+TEST(RayTest, Differentials)
+{
+  Camera cam(Vector3F({0, 1, -6}), Vector3F({0, 0.5, 0}),
+             Vector3F({0, 1, 0}));
+  Sphere s(Vector3F({0.3, 0.6, 0}), 1);
+
+  const int size = 500;
+  const float x = 262, y = 231, h = 0.01f;
+
+  Ray r = cam.get_ray_for_pixel(x, y, size);
+  Ray rx = cam.get_ray_for_pixel(x + h, y, size);
+  Ray ry = cam.get_ray_for_pixel(x, y + h, size);
+
+  const RayDifferentials &d = r.get_differentials();
+  expect_near((rx.get_dir() - r.get_dir()) / h, d.dddx, 1e-5);
+  expect_near((ry.get_dir() - r.get_dir()) / h, d.dddy, 1e-5);
+  expect_near(Vector3F(), d.dodx, 0);
+
+  // Hits & reflections of the ray and its neighbour along x
+  float t = s.intersection(r), tx = s.intersection(rx);
+  ASSERT_GT(t, 0);
+  ASSERT_GT(tx, 0);
+
+  Vector3F p = r.get_point_at_t(t), px = rx.get_point_at_t(tx);
+  Vector3F n = s.get_normal(p);
+
+  SurfaceDifferentials sd = r.get_surface_differentials(t, n);
+  sd.dndx = s.get_normal_differential(p, sd.dpdx);
+  sd.dndy = s.get_normal_differential(p, sd.dpdy);
+
+  expect_near((px - p) / h, sd.dpdx, 1e-3);
+  EXPECT_NEAR(0, dot(sd.dpdx, n), 1e-5);
+
+  Ray refl = r.reflect(p, n, sd);
+  Ray refl_x = rx.reflect(px, s.get_normal(px));
+
+  expect_near(r.reflect(p, n).get_dir(), refl.get_dir(), 0);
+  expect_near((refl_x.get_dir() - refl.get_dir()) / h,
+              refl.get_differentials().dddx, 1e-3);
+  expect_near(sd.dpdx, refl.get_differentials().dodx, 0);
+}
+
 int main(int argc, char **argv)
 {
   // Parse gtest arguments
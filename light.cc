@@ -4,43 +4,265 @@
  */
 
 #include "light.hh"
+#include "rebase.hh"
+#include <cmath>
 
 /*!
  * \param p Position vector of the light
  * \param c Color of the light
+ * \param r Cutoff radius of the light (optional, default 0: unbounded)
  */
-Light::Light(Vector3F p, Color c)
-  : position(p)
+Light::Light(Vector3F p, Color c, float r)
+  : shape(POINT)
+  , position(p)
   , color(c)
+  , radius(r)
+  , size(0)
+  , edge_u()
+  , edge_v()
 { }
 
+/*!
+ * \param p     Center of the emitting sphere
+ * \param size  Radius of the emitting sphere
+ * \param c     Color of the light
+ * \param r     Cutoff radius of the light, beyond the surface of the sphere
+ *              (optional, default 0: unbounded)
+ */
+Light::Light(const Vector3F &p, float size, const Color &c, float r)
+  : shape(SPHERE)
+  , position(p)
+  , color(c)
+  , radius(r)
+  , size(size)
+  , edge_u()
+  , edge_v()
+{ }
+
+/*!
+ * \param p  Center of the emitting rectangle
+ * \param u  Vector along one edge of the rectangle (its full length)
+ * \param v  Vector along the other edge (its full length)
+ * \param c  Color of the light
+ * \param r  Cutoff radius of the light, beyond the edges of the rectangle
+ *           (optional, default 0: unbounded)
+ */
+Light::Light(const Vector3F &p, const Vector3F &u, const Vector3F &v,
+             const Color &c, float r)
+  : shape(RECTANGLE)
+  , position(p)
+  , color(c)
+  , radius(r)
+  , size(0)
+  , edge_u(u)
+  , edge_v(v)
+{ }
+
+/*!
+ * \returns Radius of a sphere about the position containing the emitter
+ *          (0 for point lights)
+ */
+float Light::get_extent() const
+{
+  switch (shape)
+  {
+    case SPHERE:
+      return size;
+    case RECTANGLE:
+      // Half the longer diagonal
+      return 0.5f * std::fmax((edge_u + edge_v).norm(), (edge_u - edge_v).norm());
+    default:
+      return 0;
+  }
+}
+
+AABB Light::get_emitter_bounds() const
+{
+  if (shape == RECTANGLE)
+  {
+    AABB b;
+    b.expand(position + 0.5f * (edge_u + edge_v));
+    b.expand(position + 0.5f * (edge_u - edge_v));
+    b.expand(position - 0.5f * (edge_u + edge_v));
+    b.expand(position - 0.5f * (edge_u - edge_v));
+    return b;
+  }
+
+  return AABB::around_sphere(position, get_extent());
+}
+
+// Point on the emitting surface for a pair of numbers in [0, 1)
+/*!
+ * Stratified (s, t) pairs give points stratified over the emitter as seen
+ * from the shading point.  A sphere is sampled over the disk through its
+ * center facing the shading point, which is its silhouette from afar.
+ *
+ * \param s, t  Coordinates in [0, 1)
+ * \param from  Position of the shading point
+ * \returns     A point on the emitter (the position for point lights)
+ */
+Vector3F Light::sample_point(float s, float t, const Vector3F &from) const
+{
+  switch (shape)
+  {
+    case SPHERE:
+    {
+      // Basis of the disk facing the shading point
+      Vector3F w = from - position;
+      if (w.norm_sq() == 0) return position;
+      w.normalize();
+
+      Vector3F a = (std::fabs(w[0]) < 0.9f) ? Vector3F({1, 0, 0})
+                                       : Vector3F({0, 1, 0});
+      a = cross(w, a).get_normalized();
+      Vector3F b = cross(w, a);
+
+      // Area-preserving map of the unit square to the disk
+      float rad = size * std::sqrt(s);
+      float theta = 2 * float(M_PI) * t;
+      return position + (rad * std::cos(theta)) * a + (rad * std::sin(theta)) * b;
+    }
+    case RECTANGLE:
+      return position + (s - 0.5f) * edge_u + (t - 0.5f) * edge_v;
+    default:
+      return position;
+  }
+}
+
+/*!
+ * \param h Hash to which to add the light
+ */
+void Light::hash(Hash &h) const
+{
+  h.add(uint32_t(shape));
+  h.add(position).add(color).add(radius);
+  h.add(size).add(edge_u).add(edge_v);
+}
+
 /*! \relates Light
  * Reads a Light from the provided input stream in the format:
- * "position color"
+ * "position color [radius]"
+ *
+ * With the read formats for Vectors & Colors, this looks like:
+ * "(x y z) [r g b] radius"
+ *
+ * The cutoff radius is optional; if it is omitted the light is unbounded.
+ * The position is read with read_position(), so is relative to the
+ * stream's origin, if it has one.
+ *
+ * \param is     Input stream from which to read a new Light
+ * \param arena  Arena in which to allocate the new Light
+ * \returns      Pointer to a new Light, or NULL if reading failed
+ */
+SPLight read_Light(std::istream &is, Arena &arena)
+{
+  // Check if stream is already bad
+  if (!is) return SPLight();
+
+  Vector3F p;
+  Color c;
+  float r = 0;
+
+  // Read components
+  read_position(is, p);
+  is >> c;
+
+  // Read optional radius
+  if (is && !(is >> std::ws).eof())
+    is >> r;
+
+  if (is && r >= 0)
+  {
+    return arena.create<Light>(p, c, r);
+  }
+  else
+  {
+    return SPLight();
+  }
+}
+
+/*! \relates Light
+ * Reads a spherical area Light from the provided input stream in the format:
+ * "center size color [radius]"
  *
  * With the read formats for Vectors & Colors, this looks like:
- * "(x y z) [r g b]"
+ * "(x y z) size [r g b] radius"
+ *
+ * The cutoff radius is optional; if it is omitted the light is unbounded.
+ * The position is read with read_position(), so is relative to the
+ * stream's origin, if it has one.
  *
- * \param is  Input stream from which to read a new Plane
- * \returns   Pointer to a new Light, or NULL if reading failed
+ * \param is     Input stream from which to read a new Light
+ * \param arena  Arena in which to allocate the new Light
+ * \returns      Pointer to a new Light, or NULL if reading failed
  */
-SPLight read_Light(std::istream &is)
+SPLight read_SphereLight(std::istream &is, Arena &arena)
 {
   // Check if stream is already bad
   if (!is) return SPLight();
 
   Vector3F p;
+  float size;
   Color c;
+  float r = 0;
 
   // Read components
-  is >> p;
+  read_position(is, p);
+  is >> size;
   is >> c;
 
-  if (is)
+  // Read optional radius
+  if (is && !(is >> std::ws).eof())
+    is >> r;
+
+  if (is && size > 0 && r >= 0)
+  {
+    return arena.create<Light>(p, size, c, r);
+  }
+  else
   {
-    SPLight sl(new Light(p, c));
+    return SPLight();
+  }
+}
+
+/*! \relates Light
+ * Reads a rectangular area Light from the provided input stream in the format:
+ * "center edge_u edge_v color [radius]"
+ *
+ * With the read formats for Vectors & Colors, this looks like:
+ * "(x y z) (ux uy uz) (vx vy vz) [r g b] radius"
+ *
+ * The edges are the full sides of the rectangle, centered on the center.
+ * The cutoff radius is optional; if it is omitted the light is unbounded.
+ * The position is read with read_position(), so is relative to the
+ * stream's origin, if it has one.
+ *
+ * \param is     Input stream from which to read a new Light
+ * \param arena  Arena in which to allocate the new Light
+ * \returns      Pointer to a new Light, or NULL if reading failed
+ */
+SPLight read_RectLight(std::istream &is, Arena &arena)
+{
+  // Check if stream is already bad
+  if (!is) return SPLight();
+
+  Vector3F p, u, v;
+  Color c;
+  float r = 0;
 
-    return sl;
+  // Read components
+  read_position(is, p);
+  is >> u;
+  is >> v;
+  is >> c;
+
+  // Read optional radius
+  if (is && !(is >> std::ws).eof())
+    is >> r;
+
+  if (is && cross(u, v).norm() > 0 && r >= 0)
+  {
+    return arena.create<Light>(p, u, v, c, r);
   }
   else
   {
@@ -8,41 +8,146 @@
 
 #include "vector.hh"
 #include "color.hh"
+#include "arena.hh"
+#include "aabb.hh"
+#include "hash.hh"
 #include <boost/shared_ptr.hpp>
 
 //! A simple colored light
+/*!
+ * A light may have a cutoff radius, beyond which it contributes nothing.
+ * Within the radius, its intensity falls off smoothly to zero at the cutoff.
+ * A light with a radius of 0 is unbounded and is not attenuated.
+ *
+ * A light is either a point, or an area light with an emitting surface:
+ * a sphere, or a rectangle (which emits from both faces).  Area lights cast
+ * soft shadows, so shading samples points across their surface.
+ */
 class Light
 {
-  //! Position of light
+  public:
+  //! Shape of the emitting surface
+  enum Shape { POINT, SPHERE, RECTANGLE };
+
+  private:
+  //! Shape of light
+  Shape shape;
+  //! Position of light (center of an area light)
   Vector3F position;
   //! Color of light
   Color color;
+  //! Cutoff radius of light (0 if unbounded)
+  float radius;
+  //! Sphere: Radius of the emitting sphere
+  float size;
+  //! Rectangle: Edge vectors of the rectangle
+  Vector3F edge_u, edge_v;
 
   public:
   // === Constructors & methods
 
-  //! Constructor with position and color
-  Light(Vector3F p, Color c);
+  //! Constructor with position, color, and optional cutoff radius
+  Light(Vector3F p, Color c, float r = 0);
+
+  //! Constructor for a spherical area light
+  Light(const Vector3F &p, float size, const Color &c, float r = 0);
+
+  //! Constructor for a rectangular area light
+  Light(const Vector3F &p, const Vector3F &u, const Vector3F &v,
+        const Color &c, float r = 0);
 
   // Accessors
   //! Accessor for light position
   const Vector3F & get_position() const;
   //! Accessor for light color
   const Color & get_color() const;
+  //! Accessor for light cutoff radius (0 if unbounded)
+  float get_radius() const;
+  //! Accessor for shape of light
+  Shape get_shape() const;
+
+  //! Check if light has an emitting surface (and casts soft shadows)
+  bool is_area() const;
+
+  //! Greatest distance from the position to the emitting surface
+  float get_extent() const;
+
+  //! Bounding box of the emitting surface
+  AABB get_emitter_bounds() const;
+
+  //! Point on the emitting surface for a pair of numbers in [0, 1)
+  Vector3F sample_point(float s, float t, const Vector3F &from) const;
+
+  //! Check if light has a cutoff radius
+  bool is_bounded() const;
+
+  //! Bounding box of the region lit by a bounded light
+  AABB get_bounds() const;
+
+  //! Attenuation factor at a squared distance from the light
+  float get_attenuation(float dist_sq) const;
+
+  //! Add the light's shape, position, color and radius to a hash
+  void hash(Hash &h) const;
 };
 
 //! Boost Shared Pointer to Light
 typedef boost::shared_ptr<Light> SPLight;
 
+//! Function type which reads an istream and produces a Light
+/*!
+ * The light is constructed within the provided Arena.
+ */
+typedef SPLight (*LightReader)(std::istream &is, Arena &arena);
+
 /*! \relates Light
  * \brief Function to read a Light from an input stream
  */
-SPLight read_Light(std::istream &is);
+SPLight read_Light(std::istream &is, Arena &arena);
+
+/*! \relates Light
+ * \brief Function to read a spherical area Light from an input stream
+ */
+SPLight read_SphereLight(std::istream &is, Arena &arena);
+
+/*! \relates Light
+ * \brief Function to read a rectangular area Light from an input stream
+ */
+SPLight read_RectLight(std::istream &is, Arena &arena);
 
 // === Inline function definitions
 
 // Accessors
 inline const Vector3F & Light::get_position() const { return position; }
 inline const Color & Light::get_color() const { return color; }
+inline float Light::get_radius() const { return radius; }
+inline Light::Shape Light::get_shape() const { return shape; }
+
+inline bool Light::is_bounded() const { return radius > 0; }
+inline bool Light::is_area() const { return shape != POINT; }
+
+/*!
+ * Includes the cutoff radius around every point of the emitting surface.
+ */
+inline AABB Light::get_bounds() const
+{
+  return AABB::around_sphere(position, radius + get_extent());
+}
+
+// Attenuation factor at a squared distance from the light
+/*!
+ * Uses the windowing function (1 - (d/r)^2)^2, which is 1 at the light
+ * and falls smoothly to 0 at the cutoff radius.
+ *
+ * \param dist_sq Squared distance from the light
+ * \returns       Factor in [0, 1] by which to scale the light's color
+ */
+inline float Light::get_attenuation(float dist_sq) const
+{
+  if (!is_bounded()) return 1;
+
+  float x = 1 - dist_sq / (radius * radius);
+  return (x > 0) ? x * x : 0;
+}
 
 #endif
@@ -0,0 +1,230 @@
+/* lighttree.cc
+ *
+ * A hierarchy over Lights for picking lights by estimated contribution
+ */
+
+#include "lighttree.hh"
+#include <cfloat>
+
+using namespace std;
+
+//! Smallest squared distance used when estimating a contribution
+//! (Keeps importance finite for points at or inside a light's bounds)
+static const float MIN_DIST_SQ = 1e-6f;
+
+// Default constructor creates an empty tree
+LightTree::LightTree()
+  : lights()
+  , bvh()
+  , power()
+  , reach()
+{ }
+
+/*!
+ * Power is the mean of the light's color components.
+ *
+ * \param l A light
+ * \returns The light's power
+ */
+float LightTree::light_power(const Light &l)
+{
+  const Color &c = l.get_color();
+  return (c.get_red() + c.get_green() + c.get_blue()) / 3;
+}
+
+/*!
+ * \param lights  Lights to include in the tree
+ */
+void LightTree::build(const vector<const Light *> &lights)
+{
+  this->lights = lights;
+
+  // Each light is bounded by its emitting surface
+  vector<AABB> bounds(lights.size());
+  for (unsigned int i = 0; i < lights.size(); ++i)
+    bounds[i] = lights[i]->get_emitter_bounds();
+
+  bvh.build(bounds);
+
+  // Accumulate node data bottom-up
+  // (Children always follow their parent in the node array)
+  const vector<BVH::Node> &nodes = bvh.get_nodes();
+  const vector<unsigned int> &items = bvh.get_items();
+
+  power.assign(nodes.size(), 0);
+  reach.assign(nodes.size(), AABB());
+
+  // Region lit by an unbounded light
+  AABB everywhere = AABB(Vector3F({-FLT_MAX, -FLT_MAX, -FLT_MAX}),
+                         Vector3F({FLT_MAX, FLT_MAX, FLT_MAX}));
+
+  for (unsigned int i = nodes.size(); i-- > 0; )
+  {
+    const BVH::Node &node = nodes[i];
+
+    if (node.is_leaf())
+    {
+      for (unsigned int j = node.start; j < node.start + node.count; ++j)
+      {
+        const Light &l = *lights[items[j]];
+
+        power[i] += light_power(l);
+        reach[i].expand(l.is_bounded() ? l.get_bounds() : everywhere);
+      }
+    }
+    else
+    {
+      unsigned int left = i + 1;
+      unsigned int right = node.right;
+
+      power[i] = power[left] + power[right];
+      reach[i] = reach[left];
+      reach[i].expand(reach[right]);
+    }
+  }
+}
+
+/*!
+ * Estimates the contribution as power / distance^2, with the distance
+ * measured to the node's bounds and floored at half the bounds' diagonal.
+ *
+ * \param node  Index of node in bvh
+ * \param p     Position of shading point
+ * \param n     Surface normal at shading point
+ * \returns     Estimated contribution (0 if no light below can contribute)
+ */
+float LightTree::node_importance(unsigned int node, const Vector3F &p,
+                                 const Vector3F &n) const
+{
+  // Reject if outside the region lit by every light below
+  if (!reach[node].contains(p)) return 0;
+
+  const AABB &b = bvh.get_nodes()[node].bounds;
+  const Vector3F &lo = b.get_min();
+  const Vector3F &hi = b.get_max();
+
+  // Reject if every corner of the bounds is behind the surface
+  bool front = false;
+  for (unsigned int corner = 0; corner < 8 && !front; ++corner)
+  {
+    Vector3F v = {(corner & 1) ? hi[0] : lo[0],
+                  (corner & 2) ? hi[1] : lo[1],
+                  (corner & 4) ? hi[2] : lo[2]};
+    front = dot(n, v - p) > 0;
+  }
+  if (!front) return 0;
+
+  // Squared distance from p to the bounds
+  float dist_sq = 0;
+  for (unsigned int a = 0; a < 3; ++a)
+  {
+    float d = (p[a] < lo[a]) ? lo[a] - p[a]
+              : ((p[a] > hi[a]) ? p[a] - hi[a] : 0);
+    dist_sq += d * d;
+  }
+
+  // Floor the distance with the size of the bounds
+  float floor_sq = (hi - lo).norm_sq() / 4;
+  if (dist_sq < floor_sq) dist_sq = floor_sq;
+  if (dist_sq < MIN_DIST_SQ) dist_sq = MIN_DIST_SQ;
+
+  return power[node] / dist_sq;
+}
+
+/*!
+ * \param l   A light
+ * \param p   Position of shading point
+ * \param n   Surface normal at shading point
+ * \returns   Estimated contribution (0 if the light cannot contribute)
+ */
+float LightTree::light_importance(const Light &l, const Vector3F &p,
+                                  const Vector3F &n) const
+{
+  Vector3F v_l = l.get_position() - p;
+
+  // Some of an area light may be in front of the surface
+  if (dot(n, v_l) <= -l.get_extent()) return 0;
+
+  float dist_sq = v_l.norm_sq();
+  float atten = l.get_attenuation(dist_sq);
+
+  if (dist_sq < MIN_DIST_SQ) dist_sq = MIN_DIST_SQ;
+
+  return light_power(l) * atten / dist_sq;
+}
+
+/*!
+ * \param[in]  p    Position of shading point
+ * \param[in]  n    Surface normal at shading point
+ * \param[in]  u    Uniform random number in [0, 1)
+ * \param[out] pdf  Probability with which the returned light was picked
+ * \returns         The picked light, or NULL if no light can contribute
+ */
+const Light * LightTree::sample(const Vector3F &p, const Vector3F &n,
+                                float u, float &pdf) const
+{
+  pdf = 0;
+  if (lights.empty()) return NULL;
+
+  const vector<BVH::Node> &nodes = bvh.get_nodes();
+  const vector<unsigned int> &items = bvh.get_items();
+
+  float prob = 1;
+  unsigned int i = 0;
+
+  // Descend to a leaf
+  while (!nodes[i].is_leaf())
+  {
+    float w_left = node_importance(i + 1, p, n);
+    float w_right = node_importance(nodes[i].right, p, n);
+    float total = w_left + w_right;
+
+    if (total <= 0) return NULL;
+
+    float p_left = w_left / total;
+
+    if (u < p_left)
+    {
+      u /= p_left;
+      prob *= p_left;
+      i = i + 1;
+    }
+    else
+    {
+      u = (u - p_left) / (1 - p_left);
+      prob *= 1 - p_left;
+      i = nodes[i].right;
+    }
+
+    // Guard against rounding pushing u out of range
+    if (u >= 1) u = 0.99999994f;
+  }
+
+  // Pick a light within the leaf
+  const BVH::Node &leaf = nodes[i];
+  float weights[BVH::max_leaf_size];
+  float total = 0;
+
+  for (unsigned int j = 0; j < leaf.count; ++j)
+  {
+    weights[j] = light_importance(*lights[items[leaf.start + j]], p, n);
+    total += weights[j];
+  }
+
+  if (total <= 0) return NULL;
+
+  // Walk the leaf's distribution, skipping lights which cannot be picked
+  // (If rounding exhausts u, the last pickable light is used)
+  unsigned int pick = 0;
+  for (unsigned int j = 0; j < leaf.count; ++j)
+  {
+    if (weights[j] == 0) continue;
+
+    pick = j;
+    if (u < weights[j] / total) break;
+    u -= weights[j] / total;
+  }
+
+  pdf = prob * weights[pick] / total;
+  return lights[items[leaf.start + pick]];
+}
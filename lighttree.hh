@@ -0,0 +1,75 @@
+/* lighttree.hh
+ *
+ * A hierarchy over Lights for picking lights by estimated contribution
+ */
+
+#ifndef _LIGHTTREE_HH__
+#define _LIGHTTREE_HH__
+
+#include "light.hh"
+#include "bvh.hh"
+#include <vector>
+
+//! A hierarchy over Lights, for picking lights by estimated contribution
+/*!
+ * A BVH is built over the positions of all lights, and each node records
+ * the total power of the lights below it and the bounds of the region
+ * they light.
+ *
+ * To pick a light for a shading point, the tree is descended from the root,
+ * choosing each child with probability proportional to an estimate of its
+ * contribution at that point.  The cost of picking a light therefore grows
+ * only with the depth of the tree, not the number of lights.
+ *
+ * Subtrees which cannot contribute (entirely behind the surface, or beyond
+ * every cutoff radius) are never picked.  Every light which can contribute
+ * has a nonzero probability, so weighting by 1/pdf gives an unbiased result.
+ */
+class LightTree
+{
+  //! Lights, indexed by bvh
+  std::vector<const Light *> lights;
+
+  //! Hierarchy over light positions
+  BVH bvh;
+
+  //! Total power of lights below each node
+  std::vector<float> power;
+
+  //! Bounds of the region lit by the lights below each node
+  //! (Unlimited if any light below is unbounded)
+  std::vector<AABB> reach;
+
+  //! Estimated contribution of a node's lights at a point
+  float node_importance(unsigned int node, const Vector3F &p,
+                        const Vector3F &n) const;
+
+  //! Estimated contribution of a single light at a point
+  float light_importance(const Light &l, const Vector3F &p,
+                         const Vector3F &n) const;
+
+  public:
+  // === Constructors & methods
+
+  //! Default constructor creates an empty tree
+  LightTree();
+
+  //! (Re)build the tree over a list of lights
+  void build(const std::vector<const Light *> &lights);
+
+  //! Check if the tree contains no lights
+  bool empty() const;
+
+  //! Power of a light, as used to weight its selection
+  static float light_power(const Light &l);
+
+  //! Pick a light for a shading point
+  const Light * sample(const Vector3F &p, const Vector3F &n, float u,
+                       float &pdf) const;
+};
+
+// === Inline function definitions
+
+inline bool LightTree::empty() const { return lights.empty(); }
+
+#endif
@@ -0,0 +1,106 @@
+/* lighttree_test.cc
+ *
+ * gtest Unit Test Suite for stochastic light selection with LightTree
+ */
+
+#include "lighttree.hh"
+#include "random.hh"
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+using namespace std;
+using namespace testing;
+
+// Exact red contribution of a light to a point facing up
+static float contribution(const Light &l, const Vector3F &p, const Vector3F &n)
+{
+  Vector3F v_l = l.get_position() - p;
+  if (dot(n, v_l) <= 0) return 0;
+
+  float atten = l.get_attenuation(v_l.norm_sq());
+  v_l.normalize();
+
+  return l.get_color().get_red() * dot(n, v_l) * atten;
+}
+
+struct LightTreeTest : public Test
+{
+  vector<Light> storage;
+  vector<const Light *> lights;
+  LightTree tree;
+
+  virtual void SetUp()
+  {
+    srand(3);
+
+    // A mix of bounded lights and a couple of unbounded ones
+    for (int i = 0; i < 200; ++i)
+    {
+      Vector3F p = {float(rand() % 1000) / 100 - 5,
+                    float(rand() % 300) / 100 - 1,
+                    float(rand() % 1000) / 100 - 5};
+      float r = (i % 50 == 0) ? 0 : 0.5f + float(rand() % 150) / 100;
+
+      storage.push_back(Light(p, Color(0.1 + (i % 7) * 0.1, 0, 0), r));
+    }
+
+    for (unsigned int i = 0; i < storage.size(); ++i)
+      lights.push_back(&storage[i]);
+
+    tree.build(lights);
+  }
+};
+
+// The 1/pdf weighted estimate converges to the sum over all lights
+TEST_F(LightTreeTest, Unbiased)
+{
+  Vector3F n = {0, 1, 0};
+  Vector3F points[] = {{0, 0, 0}, {1, 0, 1}, {-2, 0, 0.5}};
+
+  for (unsigned int k = 0; k < 3; ++k)
+  {
+    const Vector3F &p = points[k];
+
+    double exact = 0;
+    for (unsigned int i = 0; i < lights.size(); ++i)
+      exact += contribution(*lights[i], p, n);
+
+    Random rng(1, k);
+    double estimate = 0;
+    const int N = 100000;
+
+    for (int i = 0; i < N; ++i)
+    {
+      float pdf;
+      const Light *l = tree.sample(p, n, rng.next_float(), pdf);
+      if (l != NULL)
+        estimate += contribution(*l, p, n) / pdf;
+    }
+    estimate /= N;
+
+    EXPECT_NEAR(exact, estimate, 0.02 * exact);
+  }
+}
+
+// Lights which cannot contribute are never picked
+TEST_F(LightTreeTest, NeverPicksBackFacing)
+{
+  // Facing down, below every light
+  Vector3F p = {0, -2, 0};
+  Vector3F n = {0, -1, 0};
+
+  Random rng;
+  for (int i = 0; i < 1000; ++i)
+  {
+    float pdf;
+    EXPECT_EQ(NULL, tree.sample(p, n, rng.next_float(), pdf));
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
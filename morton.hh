@@ -0,0 +1,101 @@
+/*! \file
+ * \brief Space-filling curves: Morton (Z-order) & Hilbert codes.
+ */
+
+#ifndef _MORTON_HH__
+#define _MORTON_HH__
+
+#include <stdint.h>
+
+//! Spread the low 10 bits of v out to every third bit
+/*!
+ * \param v  Value to spread (bits above the 10th are ignored)
+ * \returns  Bit i of v moved to bit 3i
+ */
+inline uint32_t morton_spread3(uint32_t v)
+{
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+//! Morton code of a point on a 1024^3 grid
+/*!
+ * Points close together in space mostly have close codes, so sorting by
+ * code groups nearby points together.
+ *
+ * \param x, y, z  Grid coordinates (each less than 1024)
+ * \returns        30-bit code interleaving the bits of x, y & z
+ */
+inline uint32_t morton_encode3(uint32_t x, uint32_t y, uint32_t z)
+{
+  return morton_spread3(x) | (morton_spread3(y) << 1)
+         | (morton_spread3(z) << 2);
+}
+
+//! Spread the low 16 bits of v out to every other bit
+/*!
+ * \param v  Value to spread (bits above the 16th are ignored)
+ * \returns  Bit i of v moved to bit 2i
+ */
+inline uint32_t morton_spread2(uint32_t v)
+{
+  v &= 0xffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+//! Morton code of a point on a 65536^2 grid
+/*!
+ * \param x, y  Grid coordinates (each less than 65536)
+ * \returns     32-bit code interleaving the bits of x & y
+ */
+inline uint32_t morton_encode2(uint32_t x, uint32_t y)
+{
+  return morton_spread2(x) | (morton_spread2(y) << 1);
+}
+
+//! Distance along a Hilbert curve through an n x n grid
+/*!
+ * Unlike the Morton curve, the Hilbert curve never jumps: consecutive cells
+ * along it are always neighbours.
+ *
+ * \param n     Size of the grid (a power of 2, at most 65536)
+ * \param x, y  Grid coordinates (each less than n)
+ * \returns     Number of cells along the curve before (x, y)
+ */
+inline uint32_t hilbert_encode2(uint32_t n, uint32_t x, uint32_t y)
+{
+  uint32_t d = 0;
+
+  for (uint32_t s = n / 2; s > 0; s /= 2)
+  {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    d += s * s * ((3 * rx) ^ ry);
+
+    // Rotate the quadrant, so the curve within it starts & ends correctly
+    if (ry == 0)
+    {
+      if (rx == 1)
+      {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+
+      uint32_t t = x;
+      x = y;
+      y = t;
+    }
+  }
+
+  return d;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/* order_bench.cc
+ *
+ * Benchmark comparing the orders in which pixels are rendered
+ */
+
+#include "scene.hh"
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+using namespace std;
+
+/*!
+ * Builds a large scene: a field of n x n small reflective balls on a
+ * reflective floor, lit by a few point lights.
+ *
+ * \param[out] scn  Scene to fill (must be empty)
+ * \param[in]  n    Balls along each side of the field
+ */
+static void build_scene(Scene &scn, int n)
+{
+  Arena &arena = scn.get_arena();
+
+  scn.add_object(arena.create<Plane>(
+      0, Vector3F({0, 1, 0}), Color(0.4, 0.4, 0.5), 0.3));
+
+  for (int i = 0; i < n; ++i)
+  {
+    for (int j = 0; j < n; ++j)
+    {
+      float x = (i - n / 2) * 0.5f, z = -j * 0.5f;
+      float r = 0.15f + 0.05f * ((i * 7 + j * 3) % 4);
+
+      scn.add_object(arena.create<Sphere>(
+          Vector3F({x, r, z}), r,
+          Color((i % 3) * 0.4f + 0.2f, (j % 3) * 0.4f + 0.2f, 0.6),
+          ((i + j) % 2) ? 0.6f : 0.1f));
+    }
+  }
+
+  scn.add_light(arena.create<Light>(
+      Vector3F({-10, 10, 5}), Color(0.6, 0.6, 0.6)));
+  scn.add_light(arena.create<Light>(
+      Vector3F({10, 8, -n * 0.25f}), Color(0.4, 0.4, 0.3)));
+
+  scn.prepare();
+}
+
+/*!
+ * Usage: order_bench [image size] [balls per side] [threads] [repeats]
+ *
+ * Renders the same scene with pixels in each order, and prints the best time
+ * for each.  Every order gives the same image.
+ */
+int main(int argc, char **argv)
+{
+  int img_size = (argc > 1) ? atoi(argv[1]) : 500;
+  int n = (argc > 2) ? atoi(argv[2]) : 100;
+  unsigned int threads = (argc > 3) ? atoi(argv[3]) : 0;
+  int repeats = (argc > 4) ? atoi(argv[4]) : 3;
+
+  if (img_size <= 0 || n <= 0 || repeats <= 0)
+  {
+    cerr << "Usage: " << argv[0]
+         << " [image size] [balls per side] [threads] [repeats]" << endl;
+    return 1;
+  }
+
+  Scene scn;
+  build_scene(scn, n);
+
+  Camera cam(Vector3F({0, 3, 4}), Vector3F({0, 0, -n * 0.2f}),
+             Vector3F({0, 1, 0}));
+
+  const RenderOptions::PixelOrder orders[] =
+      { RenderOptions::ROW_MAJOR, RenderOptions::MORTON,
+        RenderOptions::HILBERT };
+  const char *names[] = { "row-major", "morton", "hilbert" };
+
+  cout << img_size << "x" << img_size << " image, " << n * n
+       << " balls, best of " << repeats << ":" << endl;
+
+  double row_time = 0;
+
+  for (unsigned int o = 0; o < 3; ++o)
+  {
+    RenderOptions opt;
+    opt.threads = threads;
+    opt.pixel_order = orders[o];
+
+    double best = 0;
+
+    for (int k = 0; k < repeats; ++k)
+    {
+      Framebuffer fb(img_size, img_size);
+
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      scn.render_pass(cam, fb, opt, 0);
+      double t = chrono::duration<double>(
+          chrono::steady_clock::now() - start).count();
+
+      if (k == 0 || t < best) best = t;
+    }
+
+    if (o == 0) row_time = best;
+
+    cout << "  " << names[o] << ": " << best << " s ("
+         << row_time / best << "x row-major)" << endl;
+  }
+
+  return 0;
+}
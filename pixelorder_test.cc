@@ -0,0 +1,91 @@
+/* pixelorder_test.cc
+ *
+ * gtest Unit Test Suite for space-filling curves & pixel orders
+ */
+
+#include "morton.hh"
+#include "testscene.hh"
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+using namespace std;
+using namespace testing;
+
+// Morton codes interleave bits, and the Hilbert curve steps between neighbours
+TEST(CurveTest, Codes)
+{
+  EXPECT_EQ(0u, morton_encode2(0, 0));
+  EXPECT_EQ(1u, morton_encode2(1, 0));
+  EXPECT_EQ(2u, morton_encode2(0, 1));
+  EXPECT_EQ(0x55555555u, morton_encode2(0xffff, 0));
+  EXPECT_EQ(7u, morton_encode3(1, 1, 1));
+  EXPECT_EQ(0x09249249u, morton_encode3(0x3ff, 0, 0));
+
+  // Cell at each distance along the Hilbert curve
+  const unsigned int N = 32;
+  vector<int> xs(N * N, -1), ys(N * N, -1);
+
+  for (unsigned int y = 0; y < N; ++y)
+  {
+    for (unsigned int x = 0; x < N; ++x)
+    {
+      uint32_t d = hilbert_encode2(N, x, y);
+      ASSERT_LT(d, N * N);
+      EXPECT_EQ(-1, xs[d]);
+      xs[d] = x;
+      ys[d] = y;
+    }
+  }
+
+  for (unsigned int d = 1; d < N * N; ++d)
+    EXPECT_EQ(1, abs(xs[d] - xs[d - 1]) + abs(ys[d] - ys[d - 1])) << d;
+}
+
+// Rendering in tiles along a curve gives the same image as row by row
+TEST(PixelOrderTest, SameImage)
+{
+  Scene scn;
+  build_test_scene(scn);
+  Camera cam = test_camera(0);
+
+  // Neither the image nor the band is a whole number of tiles
+  const int size = 37;
+  RenderOptions opt;
+  opt.pixel_samples = 2;
+  opt.threads = 2;
+
+  Framebuffer fb_row(size, size);
+  scn.render_rows(cam, fb_row, opt, 0, 3, 30);
+
+  const RenderOptions::PixelOrder orders[] =
+      { RenderOptions::MORTON, RenderOptions::HILBERT };
+
+  for (unsigned int o = 0; o < 2; ++o)
+  {
+    opt.pixel_order = orders[o];
+
+    Framebuffer fb(size, size);
+    scn.render_rows(cam, fb, opt, 0, 3, 30);
+
+    for (int y = 0; y < size; ++y)
+    {
+      for (int x = 0; x < size; ++x)
+      {
+        const Color &c = fb.get_sum(x, y);
+        const Color &c_row = fb_row.get_sum(x, y);
+
+        ASSERT_EQ(c_row.get_red(), c.get_red()) << x << ", " << y;
+        ASSERT_EQ(c_row.get_green(), c.get_green()) << x << ", " << y;
+        ASSERT_EQ(c_row.get_blue(), c.get_blue()) << x << ", " << y;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
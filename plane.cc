@@ -4,6 +4,7 @@
  */
 
 #include "plane.hh"
+#include "rebase.hh"
 
 // Construct infinite plane with default color & reflectivity
 /*!
@@ -40,43 +41,27 @@ Plane::Plane(float d, const Vector3F &n, const Color &c, float r)
   , norm(n.get_normalized())
 { }
 
-// Identify first intersection with a ray
+// Get the normal to the surface at a point p
 // (See sceneobject.hh)
-float Plane::intersection(const Ray &r) const
+Vector3F Plane::get_normal(const Vector3F &p) const
 {
-  float numerator   = dot(r.get_orig(), norm) + dist;
-  float denominator = dot(r.get_dir(), norm);
-
-  // Test for Ray parallel to Plane
-  if (denominator == 0)
-  {
-    if (numerator == 0)
-    {
-      // (0/0) Ray originates on Plane
-      return 0;
-    }
-    else
-    {
-      // (x/0) parallel Ray will never intersect
-      return no_intersection;
-    }
-  }
-
-  float result = -numerator / denominator;
-
-  // Check for no intersection
-  if (result < 0)
-    result = no_intersection;
+  // Surface normal is constant over an infinite plane
+  return norm;
+}
 
-  return result;
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void Plane::hash(Hash &h) const
+{
+  SceneObject::hash(h);
+  h.add(dist).add(norm);
 }
 
-// Get the normal to the surface at a point p
+// Name of the object's type, for hashing
 // (See sceneobject.hh)
-Vector3F Plane::get_normal(const Vector3F &p) const
+const char *Plane::type_tag() const
 {
-  // Surface normal is constant over an infinite plane
-  return norm;
+  return "Plane";
 }
 
 /*! \relates Plane
@@ -86,15 +71,19 @@ Vector3F Plane::get_normal(const Vector3F &p) const
  * With the read formats for Vectors & Colors, this looks like:
  * "dist (x y z) [r g b]"
  *
- * \param is  Input stream from which to read a new Plane
- * \returns   Pointer to a new Plane, or NULL if reading failed
+ * If the stream has an origin (see rebase.hh), the distance is made
+ * relative to it, in double precision.
+ *
+ * \param is     Input stream from which to read a new Plane
+ * \param arena  Arena in which to allocate the new object
+ * \returns      Pointer to a new Plane, or NULL if reading failed
  */
-SPSceneObject read_Plane(std::istream &is)
+SPSceneObject read_Plane(std::istream &is, Arena &arena)
 {
   // Check if stream is already bad
   if (!is) return SPSceneObject();
 
-  float d;
+  double d;
   Vector3F n;
   Color c;
   float r;
@@ -105,11 +94,17 @@ SPSceneObject read_Plane(std::istream &is)
   is >> c;
   is >> r;
 
-  if (is)
+  const Vector3D *origin = get_read_origin(is);
+  if (is && origin != NULL)
   {
-    SPSceneObject sso(new Plane(d, n, c, r));
+    // Points p on the plane satisfy p . n + d == 0
+    Vector3D n_d = Vector3D(n).normalize();
+    d += dot(*origin, n_d);
+  }
 
-    return sso;
+  if (is)
+  {
+    return arena.create<Plane>(float(d), n, c, r);
   }
   else
   {
@@ -38,15 +38,28 @@ class Plane : public SceneObject
   // (See sceneobject.hh)
   float intersection(const Ray &r) const;
 
+  // Identify first intersection with a ray, and the primitive hit
+  // (See sceneobject.hh)
+  float intersection_from(const Ray &r, unsigned int from,
+                          unsigned int &prim) const;
+
   // Get the normal to the surface at a point p
   // (See sceneobject.hh)
   Vector3F get_normal(const Vector3F &p) const;
+
+  // Add everything affecting the object's appearance to a hash
+  // (See sceneobject.hh)
+  void hash(Hash &h) const;
+
+  // Name of the object's type, for hashing
+  // (See sceneobject.hh)
+  const char *type_tag() const;
 };
 
 /*! \relates Plane
  * \brief Function to read a Plane from an input stream
  */
-SPSceneObject read_Plane(std::istream &is);
+SPSceneObject read_Plane(std::istream &is, Arena &arena);
 
 // === Inline function definitions
 
@@ -54,4 +67,44 @@ SPSceneObject read_Plane(std::istream &is);
 inline float Plane::get_dist() const { return dist; }
 inline const Vector3F & Plane::get_norm() const { return norm; }
 
+// Identify first intersection with a ray
+// (See sceneobject.hh)
+inline float Plane::intersection(const Ray &r) const
+{
+  float numerator   = dot(r.get_orig(), norm) + dist;
+  float denominator = dot(r.get_dir(), norm);
+
+  // Test for Ray parallel to Plane
+  if (denominator == 0)
+  {
+    if (numerator == 0)
+    {
+      // (0/0) Ray originates on Plane
+      return 0;
+    }
+    else
+    {
+      // (x/0) parallel Ray will never intersect
+      return no_intersection;
+    }
+  }
+
+  float result = -numerator / denominator;
+
+  // Check for no intersection
+  if (result < 0)
+    result = no_intersection;
+
+  return result;
+}
+
+// Identify first intersection with a ray, and the primitive hit
+// (A ray leaving a plane never meets it again)
+inline float Plane::intersection_from(const Ray &r, unsigned int from,
+                                      unsigned int &prim) const
+{
+  prim = 0;
+  return (from == no_primitive) ? intersection(r) : no_intersection;
+}
+
 #endif
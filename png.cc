@@ -0,0 +1,409 @@
+/* png.cc
+ *
+ * Encoding of Framebuffers as PNG images, in parallel strips of rows
+ */
+
+#include "png.hh"
+#include <zlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+
+//! Number of bytes per pixel (8-bit RGB)
+static const int PNG_PIXEL_BYTES = 3;
+
+//! Compression level for deflate
+static const int PNG_LEVEL = 6;
+
+const int PNGEncoder::strip_rows;
+
+/*!
+ * \param fb       Framebuffer to encode (must outlive the encoder)
+ * \param samples  Number of samples each pixel will have when its row is
+ *                 added (pixels are averaged over this many samples)
+ * \param y_begin  First row of the image
+ * \param y_end    One past the last row of the image
+ * \param threads  Most threads to compress strips on
+ *                 (0: one per hardware thread)
+ */
+PNGEncoder::PNGEncoder(const Framebuffer &fb, unsigned int samples,
+                       int y_begin, int y_end, unsigned int threads)
+  : fb(fb)
+  , samples(samples)
+  , y_begin(y_begin)
+  , y_end(y_end)
+  , y_added(y_begin)
+  , max_workers(threads)
+  , workers()
+  , queue()
+  , strips()
+  , pending(0)
+  , stop(false)
+{
+  assert(0 <= y_begin && y_begin < y_end && y_end <= fb.get_height());
+  assert(samples > 0);
+
+  if (max_workers == 0) max_workers = thread::hardware_concurrency();
+  if (max_workers == 0) max_workers = 1;
+}
+
+PNGEncoder::~PNGEncoder()
+{
+  stop_workers();
+}
+
+/*!
+ * Rows from the end of those already added up to y_end are split into
+ * strips, which are queued for the workers.  Workers are started as there
+ * are strips for them, up to the encoder's number of threads.
+ *
+ * \param y_end  One past the last finished row
+ *               (The rows must have all their samples)
+ */
+void PNGEncoder::add_rows(int y_end)
+{
+  assert(y_added <= y_end && y_end <= this->y_end);
+
+  {
+    lock_guard<mutex> lock(m);
+
+    for (int y = y_added; y < y_end; y += strip_rows)
+    {
+      Job job = { (unsigned int) strips.size(), y,
+                  min(y + strip_rows, y_end) };
+      queue.push_back(job);
+      strips.push_back(Strip());
+      ++pending;
+    }
+  }
+  queued_cv.notify_all();
+
+  while (workers.size() < min<size_t>(max_workers, strips.size()))
+    workers.push_back(thread(&PNGEncoder::work, this));
+
+  y_added = y_end;
+}
+
+// Compress queued strips until told to stop
+void PNGEncoder::work()
+{
+  for (;;)
+  {
+    Job job;
+    {
+      unique_lock<mutex> lock(m);
+      queued_cv.wait(lock, [this]() { return stop || !queue.empty(); });
+      if (stop) return;
+
+      job = queue.front();
+      queue.pop_front();
+    }
+
+    Strip s = encode_strip(fb, samples, y_begin, job.y_begin, job.y_end,
+                           job.y_end == y_end);
+
+    lock_guard<mutex> lock(m);
+    strips[job.index].data.swap(s.data);
+    strips[job.index].adler = s.adler;
+    strips[job.index].length = s.length;
+    strips[job.index].ok = s.ok;
+
+    if (--pending == 0)
+      done_cv.notify_all();
+  }
+}
+
+// Stop & join the workers
+// Strips still queued are left uncompressed
+void PNGEncoder::stop_workers()
+{
+  {
+    lock_guard<mutex> lock(m);
+    stop = true;
+  }
+  queued_cv.notify_all();
+
+  for (unsigned int i = 0; i < workers.size(); ++i)
+    workers[i].join();
+
+  workers.clear();
+}
+
+//! Paeth predictor (see the PNG specification)
+static inline int paeth(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+  if (pa <= pb && pa <= pc) return a;
+  if (pb <= pc) return b;
+  return c;
+}
+
+/*!
+ * Filters a row with each PNG filter type, keeping the one whose output has
+ * the smallest sum of absolute (signed) values, as a cheap estimate of how
+ * well it will compress.
+ *
+ * \param[in]  row   Bytes of the row
+ * \param[in]  prev  Bytes of the row above (zeros for the first row)
+ * \param[in]  len   Number of bytes in each row
+ * \param[out] out   Filter type followed by the filtered row (len + 1 bytes)
+ */
+static void filter_row(const unsigned char *row, const unsigned char *prev,
+                       unsigned int len, unsigned char *out)
+{
+  vector<unsigned char> trial(len);
+  unsigned long best_sum = ~0ul;
+
+  for (unsigned char type = 0; type < 5; ++type)
+  {
+    unsigned long sum = 0;
+
+    for (unsigned int i = 0; i < len; ++i)
+    {
+      int a = (i >= PNG_PIXEL_BYTES) ? row[i - PNG_PIXEL_BYTES] : 0;
+      int b = prev[i];
+      int c = (i >= PNG_PIXEL_BYTES) ? prev[i - PNG_PIXEL_BYTES] : 0;
+
+      int pred = 0;
+      switch (type)
+      {
+        case 1: pred = a; break;
+        case 2: pred = b; break;
+        case 3: pred = (a + b) / 2; break;
+        case 4: pred = paeth(a, b, c); break;
+      }
+
+      trial[i] = (unsigned char) (row[i] - pred);
+      sum += abs((signed char) trial[i]);
+    }
+
+    if (sum < best_sum)
+    {
+      best_sum = sum;
+      out[0] = type;
+      copy(trial.begin(), trial.end(), out + 1);
+    }
+  }
+}
+
+/*!
+ * \param fb       Framebuffer to encode
+ * \param samples  Number of samples in each pixel
+ * \param y_first  First row of the image (filtered as if above were zeros)
+ * \param y_begin  First row of the strip
+ * \param y_end    One past the last row of the strip
+ * \param last     Whether this is the image's last strip, which ends the
+ *                 deflate stream
+ * \returns        The compressed strip
+ */
+PNGEncoder::Strip PNGEncoder::encode_strip(const Framebuffer &fb,
+                                           unsigned int samples, int y_first,
+                                           int y_begin, int y_end, bool last)
+{
+  unsigned int len = fb.get_width() * PNG_PIXEL_BYTES;
+
+  // Filter every row of the strip, predicting from the row above
+  vector<unsigned char> prev(len, 0), row(len);
+  if (y_begin > y_first)
+    fb.get_rgb8(y_begin - 1, samples, &prev[0]);
+
+  vector<unsigned char> filtered((y_end - y_begin) * (len + 1));
+  unsigned char *out = &filtered[0];
+
+  for (int y = y_begin; y < y_end; ++y)
+  {
+    fb.get_rgb8(y, samples, &row[0]);
+    filter_row(&row[0], &prev[0], len, out);
+    out += len + 1;
+    prev.swap(row);
+  }
+
+  Strip s;
+  s.length = filtered.size();
+  s.adler = adler32(adler32(0, Z_NULL, 0), &filtered[0], filtered.size());
+  s.ok = false;
+
+  // Raw deflate (no zlib header), so strips can be joined
+  z_stream zs;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+
+  if (deflateInit2(&zs, PNG_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)
+      != Z_OK)
+    return s;
+
+  // (Room for the flush marker as well as the worst case)
+  s.data.resize(deflateBound(&zs, filtered.size()) + 16);
+
+  zs.next_in = &filtered[0];
+  zs.avail_in = filtered.size();
+  zs.next_out = (Bytef *) &s.data[0];
+  zs.avail_out = s.data.size();
+
+  // Only the last strip ends the stream; the others end on a byte boundary
+  int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+  s.ok = last ? (ret == Z_STREAM_END)
+              : (ret == Z_OK && zs.avail_in == 0 && zs.avail_out > 0);
+
+  s.data.resize(zs.total_out);
+  deflateEnd(&zs);
+
+  return s;
+}
+
+/*!
+ * \param os    Output stream
+ * \param v     Value to write as 4 big-endian bytes
+ */
+static void write_uint32(ostream &os, uint32_t v)
+{
+  char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+  os.write(b, 4);
+}
+
+/*!
+ * \param os    Output stream
+ * \param type  Four-letter chunk type
+ * \param data  Chunk data
+ * \param len   Number of bytes of data
+ */
+static void write_chunk(ostream &os, const char *type, const void *data,
+                        uint32_t len)
+{
+  write_uint32(os, len);
+  os.write(type, 4);
+  if (len > 0) os.write((const char *) data, len);
+
+  uLong crc = crc32(0, Z_NULL, 0);
+  crc = crc32(crc, (const Bytef *) type, 4);
+  if (len > 0) crc = crc32(crc, (const Bytef *) data, len);
+
+  write_uint32(os, crc);
+}
+
+/*!
+ * Waits for every strip to be compressed, then writes the PNG file: each
+ * strip goes in its own IDAT chunk, with the zlib header before the first
+ * and the combined checksum after the last.
+ *
+ * \param os  Output stream to write image in png format
+ * \returns   true if every strip was compressed and the image written
+ */
+bool PNGEncoder::write(ostream &os)
+{
+  assert(y_added == y_end);
+
+  {
+    unique_lock<mutex> lock(m);
+    done_cv.wait(lock, [this]() { return pending == 0; });
+  }
+
+  stop_workers();
+
+  vector<Strip> done;
+  done.swap(strips);
+
+  bool ok = true;
+  for (unsigned int i = 0; i < done.size(); ++i)
+    ok = ok && done[i].ok;
+
+  if (!ok) return false;
+
+  // Signature
+  static const char SIGNATURE[8] = {
+      char(0x89), 'P', 'N', 'G', '\r', '\n', char(0x1a), '\n' };
+  os.write(SIGNATURE, 8);
+
+  // Header: size, 8 bits per channel, RGB, default methods, not interlaced
+  unsigned char ihdr[13] = {0};
+  uint32_t w = fb.get_width(), h = y_end - y_begin;
+  for (int i = 0; i < 4; ++i)
+  {
+    ihdr[i] = w >> (24 - 8 * i);
+    ihdr[4 + i] = h >> (24 - 8 * i);
+  }
+  ihdr[8] = 8;
+  ihdr[9] = 2;
+  write_chunk(os, "IHDR", ihdr, sizeof(ihdr));
+
+  // zlib header (deflate with 32K window, default level)
+  static const unsigned char ZLIB_HEADER[2] = { 0x78, 0x9c };
+  uLong adler = adler32(0, Z_NULL, 0);
+
+  for (unsigned int i = 0; i < done.size(); ++i)
+  {
+    adler = adler32_combine(adler, done[i].adler, done[i].length);
+
+    string data = done[i].data;
+    if (i == 0)
+      data.insert(0, (const char *) ZLIB_HEADER, 2);
+
+    if (i + 1 == done.size())
+    {
+      char trailer[4] = { char(adler >> 24), char(adler >> 16),
+                          char(adler >> 8), char(adler) };
+      data.append(trailer, 4);
+    }
+
+    write_chunk(os, "IDAT", data.data(), data.size());
+  }
+
+  write_chunk(os, "IEND", NULL, 0);
+
+  return bool(os);
+}
+
+/*!
+ * Strips are compressed in parallel, on one thread per hardware thread.
+ *
+ * \param os  Output stream to write image in png format
+ * \param fb  Framebuffer to write (with at least one sample)
+ * \returns   true if the image was written
+ */
+bool write_png(ostream &os, const Framebuffer &fb)
+{
+  return write_png(os, fb, 0, fb.get_height());
+}
+
+/*!
+ * Writes rows [y_begin, y_end) as an image of their own.
+ *
+ * \param os       Output stream to write image in png format
+ * \param fb       Framebuffer to write (with at least one sample)
+ * \param y_begin  First row to write
+ * \param y_end    One past the last row to write
+ * \returns        true if the image was written
+ */
+bool write_png(ostream &os, const Framebuffer &fb, int y_begin, int y_end)
+{
+  PNGEncoder png(fb, fb.get_samples(), y_begin, y_end);
+  png.add_rows(y_end);
+  return png.write(os);
+}
+
+/*!
+ * The image is written to a temporary file which is then renamed over path,
+ * so a reader never sees a partially written image.
+ *
+ * \param path  Path of file to write
+ * \param fb    Framebuffer to write (with at least one sample)
+ * \returns     true if the file was written successfully
+ */
+bool write_png(const string &path, const Framebuffer &fb)
+{
+  string tmp_path = path + ".tmp";
+  {
+    ofstream ofs(tmp_path.c_str(), ios::binary);
+    if (!write_png(ofs, fb) || !ofs) return false;
+  }
+
+  return rename(tmp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,137 @@
+/* png.hh
+ *
+ * Encoding of Framebuffers as PNG images, in parallel strips of rows
+ */
+
+#ifndef _PNG_HH__
+#define _PNG_HH__
+
+#include "framebuffer.hh"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//! Encoder of a band of a Framebuffer's rows as an 8-bit RGB PNG image
+/*!
+ * The rows are split into strips of strip_rows rows, and each strip is
+ * queued as soon as it is added, to be filtered and deflated by a fixed
+ * number of worker threads.  Each strip is compressed as an independent raw
+ * deflate stream ending on a byte boundary, and the streams are joined into
+ * one zlib stream (with a checksum combined from the strips') when the image
+ * is written.  Strips therefore compress slightly less well than one stream
+ * would, but need no coordination.
+ *
+ * Rows may be added while the rest of the image is still being rendered, so
+ * the encoding of finished rows overlaps rendering.  The Framebuffer must
+ * outlive the encoder, and rows must not change once added.
+ */
+class PNGEncoder
+{
+  public:
+  //! Rows per strip (except perhaps the last)
+  static const int strip_rows = 32;
+
+  private:
+  //! A compressed strip
+  struct Strip
+  {
+    //! Raw deflate data
+    std::string data;
+    //! Adler-32 checksum of the uncompressed (filtered) rows
+    unsigned long adler;
+    //! Number of uncompressed bytes
+    unsigned long length;
+    //! Whether deflate succeeded
+    bool ok;
+  };
+
+  //! Framebuffer being encoded
+  const Framebuffer &fb;
+  //! Number of samples in each pixel of the finished image
+  unsigned int samples;
+  //! First row of the image
+  int y_begin;
+  //! One past the last row of the image
+  int y_end;
+  //! One past the last row added so far
+  int y_added;
+
+  //! A strip waiting to be compressed
+  struct Job
+  {
+    //! Index of the strip
+    unsigned int index;
+    //! First row of the strip
+    int y_begin;
+    //! One past the last row of the strip
+    int y_end;
+  };
+
+  //! Most worker threads to start
+  unsigned int max_workers;
+  //! Worker threads
+  std::vector<std::thread> workers;
+
+  //! Guards the fields below
+  std::mutex m;
+  //! Signalled when a strip is queued, or the workers stop
+  std::condition_variable queued_cv;
+  //! Signalled when the last queued strip is compressed
+  std::condition_variable done_cv;
+  //! Strips waiting for a worker
+  std::deque<Job> queue;
+  //! Compressed strips, in order (valid once compressed)
+  std::vector<Strip> strips;
+  //! Number of strips added but not yet compressed
+  unsigned int pending;
+  //! Whether the workers are to stop
+  bool stop;
+
+  //! Compress queued strips until told to stop
+  void work();
+
+  //! Stop & join the workers
+  void stop_workers();
+
+  //! Filter & compress one strip
+  static Strip encode_strip(const Framebuffer &fb, unsigned int samples,
+                            int y_first, int y_begin, int y_end, bool last);
+
+  public:
+  // === Constructors & methods
+
+  //! Construct an encoder of rows [y_begin, y_end) of a Framebuffer
+  PNGEncoder(const Framebuffer &fb, unsigned int samples,
+             int y_begin, int y_end, unsigned int threads = 0);
+
+  //! Stop compressing, once the strips under way are done
+  ~PNGEncoder();
+
+  //! Start encoding the next finished rows
+  void add_rows(int y_end);
+
+  //! Write the image, once every row has been added
+  bool write(std::ostream &os);
+};
+
+/*! \relates PNGEncoder
+ * \brief Function to write a Framebuffer in PNG format
+ */
+bool write_png(std::ostream &os, const Framebuffer &fb);
+
+/*! \relates PNGEncoder
+ * \brief Function to write a band of a Framebuffer's rows in PNG format
+ */
+bool write_png(std::ostream &os, const Framebuffer &fb,
+               int y_begin, int y_end);
+
+/*! \relates PNGEncoder
+ * \brief Function to write a Framebuffer in PNG format to a file
+ */
+bool write_png(const std::string &path, const Framebuffer &fb);
+
+#endif
@@ -0,0 +1,167 @@
+/* png_test.cc
+ *
+ * gtest Unit Test Suite for PNG encoding
+ */
+
+#include "png.hh"
+#include <gtest/gtest.h>
+#include <zlib.h>
+#include <sstream>
+#include <cstdlib>
+
+using namespace std;
+using namespace testing;
+
+// Read a big-endian 32-bit value
+static uint32_t read_uint32(const string &s, size_t i)
+{
+  return (uint32_t((unsigned char) s[i]) << 24)
+         | (uint32_t((unsigned char) s[i + 1]) << 16)
+         | (uint32_t((unsigned char) s[i + 2]) << 8)
+         | uint32_t((unsigned char) s[i + 3]);
+}
+
+// Decode an 8-bit RGB PNG, checking its chunks, into rows of bytes
+static void decode_png(const string &png, unsigned int &w, unsigned int &h,
+                       vector<unsigned char> &rgb)
+{
+  ASSERT_EQ(string("\x89PNG\r\n\x1a\n", 8), png.substr(0, 8));
+
+  string idat;
+  size_t i = 8;
+  string type;
+
+  while (i < png.size())
+  {
+    uint32_t len = read_uint32(png, i);
+    type = png.substr(i + 4, 4);
+    string data = png.substr(i + 8, len);
+
+    uLong crc = crc32(0, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *) png.data() + i + 4, len + 4);
+    ASSERT_EQ(crc, read_uint32(png, i + 8 + len)) << type;
+
+    if (type == "IHDR")
+    {
+      w = read_uint32(data, 0);
+      h = read_uint32(data, 4);
+      ASSERT_EQ(8, data[8]);
+      ASSERT_EQ(2, data[9]);
+    }
+    else if (type == "IDAT")
+      idat += data;
+
+    i += len + 12;
+  }
+
+  ASSERT_EQ("IEND", type);
+
+  // Inflate (checking the zlib checksum) & undo each row's filter
+  unsigned int row_len = 3 * w;
+  vector<unsigned char> raw(h * (row_len + 1));
+  uLongf raw_len = raw.size();
+  ASSERT_EQ(Z_OK, uncompress(&raw[0], &raw_len,
+                             (const Bytef *) idat.data(), idat.size()));
+  ASSERT_EQ(raw.size(), raw_len);
+
+  rgb.assign(h * row_len, 0);
+  for (unsigned int y = 0; y < h; ++y)
+  {
+    unsigned char filter = raw[y * (row_len + 1)];
+    const unsigned char *in = &raw[y * (row_len + 1) + 1];
+    unsigned char *out = &rgb[y * row_len];
+    const unsigned char *prev = (y > 0) ? out - row_len : NULL;
+
+    for (unsigned int x = 0; x < row_len; ++x)
+    {
+      int a = (x >= 3) ? out[x - 3] : 0;
+      int b = prev ? prev[x] : 0;
+      int c = (prev && x >= 3) ? prev[x - 3] : 0;
+      int p = a + b - c;
+
+      int pred = 0;
+      switch (filter)
+      {
+        case 1: pred = a; break;
+        case 2: pred = b; break;
+        case 3: pred = (a + b) / 2; break;
+        case 4:
+          if (abs(p - a) <= abs(p - b) && abs(p - a) <= abs(p - c))
+            pred = a;
+          else if (abs(p - b) <= abs(p - c))
+            pred = b;
+          else
+            pred = c;
+          break;
+      }
+
+      out[x] = (unsigned char) (in[x] + pred);
+    }
+  }
+}
+
+// A framebuffer with smooth gradients & noise, with two samples per pixel
+struct PNGTest : public Test
+{
+  Framebuffer fb;
+
+  PNGTest()
+    : fb(53, 101)
+  {
+    srand(1);
+    for (int y = 0; y < fb.get_height(); ++y)
+      for (int x = 0; x < fb.get_width(); ++x)
+        fb.add(x, y, Color(2.f * x / fb.get_width(), 2.f * y / 101,
+                           (rand() % 256) / 127.5f));
+    fb.end_pass(2);
+  }
+
+  // Check that a band of rows decodes to the framebuffer's quantized colors
+  void expect_decodes(const string &png, int y_begin, int y_end)
+  {
+    unsigned int w, h;
+    vector<unsigned char> rgb;
+    decode_png(png, w, h, rgb);
+    ASSERT_EQ(unsigned(fb.get_width()), w);
+    ASSERT_EQ(unsigned(y_end - y_begin), h);
+
+    vector<unsigned char> row(3 * w);
+    for (int y = y_begin; y < y_end; ++y)
+    {
+      fb.get_rgb8(y, 2, &row[0]);
+      ASSERT_TRUE(equal(row.begin(), row.end(),
+                        rgb.begin() + (y - y_begin) * 3 * w)) << y;
+    }
+  }
+};
+
+// The whole image, in several strips joined into one stream
+TEST_F(PNGTest, WholeImage)
+{
+  ASSERT_LT(PNGEncoder::strip_rows, fb.get_height());
+
+  ostringstream oss;
+  ASSERT_TRUE(write_png(oss, fb));
+  expect_decodes(oss.str(), 0, fb.get_height());
+}
+
+// A band of rows, added a few at a time, with more strips than threads
+TEST_F(PNGTest, IncrementalBand)
+{
+  PNGEncoder png(fb, 2, 7, 90, 2);
+  png.add_rows(8);
+  png.add_rows(50);
+  png.add_rows(90);
+
+  ostringstream oss;
+  ASSERT_TRUE(png.write(oss));
+  expect_decodes(oss.str(), 7, 90);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
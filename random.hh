@@ -0,0 +1,114 @@
+/*! \file
+ * \brief A small, fast counter-based pseudo-random number generator.
+ */
+
+#ifndef _RANDOM_HH__
+#define _RANDOM_HH__
+
+#include <stdint.h>
+
+//! A Philox4x32-10 counter-based pseudo-random number generator
+/*!
+ * Philox computes each block of four random numbers as a keyed bijection of
+ * a 128-bit counter, so there is no sequential state to share: any number in
+ * any stream can be computed directly.
+ *
+ * The key holds the seed, and the counter holds a stream number (such as a
+ * pixel index), an index within the stream (such as a sample number) and the
+ * number of blocks drawn so far.  The numbers drawn for a sample therefore
+ * depend only on the seed, stream and index, and not on the order in which
+ * samples are taken, nor on which thread or process takes them.
+ */
+class Random
+{
+  //! Key (the seed)
+  uint32_t key[2];
+  //! Counter: block, index, stream (low & high words)
+  uint32_t ctr[4];
+  //! Current block of output
+  uint32_t out[4];
+  //! Number of words of out already used
+  unsigned int used;
+
+  //! Compute the block of output for the current counter
+  void generate();
+
+  public:
+  // === Constructors & methods
+
+  //! Construct a generator for a given seed, stream and index
+  Random(uint64_t seed = 0, uint64_t stream = 0, uint32_t index = 0);
+
+  //! Generate a uniformly distributed 32-bit integer
+  uint32_t next_uint();
+
+  //! Generate a uniformly distributed float in [0, 1)
+  float next_float();
+};
+
+// === Inline function definitions
+
+/*!
+ * \param seed    Seed value
+ * \param stream  Stream selector; different streams are independent
+ * \param index   Index within the stream; different indices are independent
+ */
+inline Random::Random(uint64_t seed, uint64_t stream, uint32_t index)
+  : used(4)
+{
+  key[0] = uint32_t(seed);
+  key[1] = uint32_t(seed >> 32);
+
+  ctr[0] = 0;
+  ctr[1] = index;
+  ctr[2] = uint32_t(stream);
+  ctr[3] = uint32_t(stream >> 32);
+}
+
+inline void Random::generate()
+{
+  static const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+  static const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+
+  for (unsigned int round = 0; round < 10; ++round)
+  {
+    uint64_t p0 = uint64_t(M0) * c0;
+    uint64_t p1 = uint64_t(M1) * c2;
+
+    c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+    c1 = uint32_t(p1);
+    c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+    c3 = uint32_t(p0);
+
+    k0 += W0;
+    k1 += W1;
+  }
+
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+inline uint32_t Random::next_uint()
+{
+  if (used == 4)
+  {
+    generate();
+    ++ctr[0];
+    used = 0;
+  }
+
+  return out[used++];
+}
+
+inline float Random::next_float()
+{
+  // Use the top 24 bits, which a float represents exactly
+  return (next_uint() >> 8) * (1.f / 16777216.f);
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* random_test.cc
+ *
+ * gtest Unit Test Suite for the Random class
+ */
+
+#include "random.hh"
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+// Output matches the Philox4x32-10 known answer for a zero counter & key
+TEST(RandomTest, KnownAnswer)
+{
+  Random rng;
+
+  EXPECT_EQ(0x6627e8d5u, rng.next_uint());
+  EXPECT_EQ(0xe169c58du, rng.next_uint());
+  EXPECT_EQ(0xbc57ac4cu, rng.next_uint());
+  EXPECT_EQ(0x9b00dbd8u, rng.next_uint());
+}
+
+// Numbers depend only on seed, stream & index, not on other generators
+TEST(RandomTest, KeyedNotSequential)
+{
+  Random a(5, 1000, 3);
+  uint32_t first = a.next_uint();
+
+  // Drawing from other streams & indices in between changes nothing
+  Random b(5, 1000, 2);
+  Random c(5, 999, 3);
+  for (unsigned int i = 0; i < 100; ++i)
+  {
+    b.next_uint();
+    c.next_uint();
+  }
+
+  Random a2(5, 1000, 3);
+  EXPECT_EQ(first, a2.next_uint());
+
+  // Neighboring seeds, streams & indices differ
+  EXPECT_NE(first, Random(6, 1000, 3).next_uint());
+  EXPECT_NE(first, Random(5, 1001, 3).next_uint());
+  EXPECT_NE(first, Random(5, 1000, 4).next_uint());
+}
+
+// Floats are in [0, 1) with a mean near 1/2, across streams
+TEST(RandomTest, UniformFloats)
+{
+  double sum = 0;
+  const unsigned int n = 100000;
+
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    float f = Random(0, i).next_float();
+    EXPECT_GE(f, 0.f);
+    EXPECT_LT(f, 1.f);
+    sum += f;
+  }
+
+  EXPECT_NEAR(0.5, sum / n, 0.01);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
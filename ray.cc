@@ -5,6 +5,7 @@
 
 #include "ray.hh"
 #include <cassert>
+#include <cmath>
 
 
 
@@ -19,6 +20,7 @@
 Ray::Ray(const Vector3F &orig, const Vector3F &dir, bool normalize)
   : orig(orig)
   , dir(normalize ? dir.get_normalized() : dir)
+  , diff()
 {
   // Check that direction is valid
   assert(dir.norm() > 0);
@@ -48,18 +50,72 @@ Vector3F Ray::get_point_at_t(float t) const
  * \param p Position of intersection with reflective object
  * \param n Surface normal of object at point of intersection
  *          (must be normalized)
- * \param DELTA delta by which to offset origin,
- *              preventing intersection with the same object again.
- *              (defaults to 0.0001)
- * \returns Reflected ray originating from just past p.
+ * \returns Reflected ray originating at p.  (Nothing is offset, so the
+ *          tracer skips the surface reflected from when tracing the ray.)
  */
-Ray Ray::reflect(const Vector3F &p, const Vector3F &n, float DELTA) const
+Ray Ray::reflect(const Vector3F &p, const Vector3F &n) const
 {
   // New direction negates component in direction of n
   Vector3F new_dir = dir + 2.f * project(-dir, n);
 
-  // New origin offset from intersection point
-  Vector3F new_orig = p + new_dir * DELTA;
+  return Ray(p, new_dir);
+}
+
+// Differentials of the position the ray hits a surface at t
+/*!
+ * The neighbouring rays of the beam travel on to the plane tangent to the
+ * surface at the hit, so the position differentials lie in that plane.
+ * The normal differentials are left zero, for the surface to fill in.
+ *
+ * \param t  The t value of the hit (the ray's direction must be normalized)
+ * \param n  Surface normal at the hit (normalized)
+ * \returns  Differentials of the hit position
+ */
+SurfaceDifferentials Ray::get_surface_differentials(float t,
+                                                    const Vector3F &n) const
+{
+  SurfaceDifferentials sd;
+  sd.dpdx = diff.dodx + t * diff.dddx;
+  sd.dpdy = diff.dody + t * diff.dddy;
+
+  // Move each to the tangent plane along the ray (unless grazing it)
+  float dn = dot(dir, n);
+  if (fabs(dn) > 1e-6f)
+  {
+    sd.dpdx -= (dot(sd.dpdx, n) / dn) * dir;
+    sd.dpdy -= (dot(sd.dpdy, n) / dn) * dir;
+  }
+
+  return sd;
+}
+
+// Reflect Ray, carrying its differentials with it
+/*!
+ * The reflected ray is the same as reflect(p, n) gives, with differentials
+ * for the beam reflected off the surface, which spreads out further where
+ * the surface curves.
+ *
+ * \param p   Position of intersection with reflective object
+ * \param n   Surface normal of object at point of intersection
+ *            (must be normalized)
+ * \param sd  Differentials of the hit, from get_surface_differentials()
+ *            with the surface's normal differentials filled in
+ * \returns   Reflected ray originating at p
+ */
+Ray Ray::reflect(const Vector3F &p, const Vector3F &n,
+                 const SurfaceDifferentials &sd) const
+{
+  Ray r = reflect(p, n);
+
+  // Differentiating dir - 2 (dir . n) n
+  float d_n = dot(dir, n);
+  float dx = dot(diff.dddx, n) + dot(dir, sd.dndx);
+  float dy = dot(diff.dddy, n) + dot(dir, sd.dndy);
+
+  r.diff.dodx = sd.dpdx;
+  r.diff.dody = sd.dpdy;
+  r.diff.dddx = diff.dddx - 2.f * (d_n * sd.dndx + dx * n);
+  r.diff.dddy = diff.dddy - 2.f * (d_n * sd.dndy + dy * n);
 
-  return Ray(new_orig, new_dir);
+  return r;
 }
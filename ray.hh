@@ -8,6 +8,38 @@
 
 #include "vector.hh"
 
+//! Rates of change of a ray with the image's x & y coordinates
+/*!
+ * A ray traced for a pixel stands for a beam as wide as the pixel.  Its
+ * differentials track how the beam spreads (as in Igehy's ray
+ * differentials), so the area a hit covers on a surface is known, and
+ * textures may be filtered over it.  All zero for a ray of no width.
+ */
+struct RayDifferentials
+{
+  //! Change in the origin per pixel along x
+  Vector3F dodx;
+  //! Change in the origin per pixel along y
+  Vector3F dody;
+  //! Change in the (unit) direction per pixel along x
+  Vector3F dddx;
+  //! Change in the (unit) direction per pixel along y
+  Vector3F dddy;
+};
+
+//! Rates of change of a hit on a surface with the image's x & y coordinates
+struct SurfaceDifferentials
+{
+  //! Change in the hit position per pixel along x
+  Vector3F dpdx;
+  //! Change in the hit position per pixel along y
+  Vector3F dpdy;
+  //! Change in the surface normal per pixel along x
+  Vector3F dndx;
+  //! Change in the surface normal per pixel along y
+  Vector3F dndy;
+};
+
 //! A 3-dimensional ray with origin and direction
 class Ray
 {
@@ -15,6 +47,8 @@ class Ray
   Vector3F orig;
   //! Direction vector
   Vector3F dir;
+  //! Differentials of the ray (zero unless set)
+  RayDifferentials diff;
 
   public:
   //! Constructor takes origin and direction vectors
@@ -26,12 +60,24 @@ class Ray
   const Vector3F & get_orig() const;
   //! Accessor for ray direction
   const Vector3F & get_dir() const;
+  //! Accessor for ray differentials
+  const RayDifferentials & get_differentials() const;
+  //! Mutator to set ray differentials
+  void set_differentials(const RayDifferentials &d);
 
   //! Calculate position at point t along ray
   Vector3F get_point_at_t(float t) const;
 
+  //! Differentials of the position the ray hits a surface at t
+  SurfaceDifferentials get_surface_differentials(float t,
+                                                 const Vector3F &n) const;
+
   //! Reflect Ray off of position with surface normal
-  Ray reflect(const Vector3F &p, const Vector3F &n, float DELTA = 0.0001) const;
+  Ray reflect(const Vector3F &p, const Vector3F &n) const;
+
+  //! Reflect Ray off of position, carrying its differentials with it
+  Ray reflect(const Vector3F &p, const Vector3F &n,
+              const SurfaceDifferentials &sd) const;
 };
 
 // === Inline Definitions
@@ -39,5 +85,10 @@ class Ray
 /* Accessors */
 inline const Vector3F & Ray::get_orig() const { return orig; }
 inline const Vector3F & Ray::get_dir() const { return dir; }
+inline const RayDifferentials & Ray::get_differentials() const
+{
+  return diff;
+}
+inline void Ray::set_differentials(const RayDifferentials &d) { diff = d; }
 
 #endif
@@ -0,0 +1,66 @@
+/*! \file
+ * \brief Reading of positions relative to an origin, to rebase coordinates.
+ *
+ * Floats have about 7 significant digits, so a scene with coordinates around
+ * 1e6 has only centimeters left for its detail, and intersection tests
+ * which square coordinates lose far more.  A stream may carry an origin
+ * (such as the camera's position), which read_position() subtracts in
+ * double precision before rounding, so the scene is stored and traced in
+ * float near the origin with none of the precision spent on the offset.
+ */
+
+#ifndef _REBASE_HH__
+#define _REBASE_HH__
+
+#include "vector.hh"
+#include <iostream>
+
+//! Index of the stream storage slot holding a stream's read origin
+inline int read_origin_index()
+{
+  static const int index = std::ios_base::xalloc();
+  return index;
+}
+
+//! Set the origin subtracted from positions read from a stream
+/*!
+ * \param s       Stream to set the origin of
+ * \param origin  Origin (which must outlive the stream's reading),
+ *                or NULL to read positions unchanged
+ */
+inline void set_read_origin(std::ios_base &s, const Vector3D *origin)
+{
+  s.pword(read_origin_index()) = const_cast<Vector3D *>(origin);
+}
+
+//! Get the origin subtracted from positions read from a stream
+/*!
+ * \param s  Stream to get the origin of
+ * \returns  The stream's origin, or NULL if it has none
+ */
+inline const Vector3D * get_read_origin(std::ios_base &s)
+{
+  return static_cast<const Vector3D *>(s.pword(read_origin_index()));
+}
+
+//! Read a position, relative to the stream's origin
+/*!
+ * Positions are read in the format of Vectors.  Directions, which don't
+ * move with the origin, should be read as plain Vectors.
+ *
+ * \param      is  Stream from which to read
+ * \param[out] p   Position read, less the stream's origin (if any)
+ * \returns        The stream
+ */
+inline std::istream & read_position(std::istream &is, Vector3F &p)
+{
+  const Vector3D *origin = get_read_origin(is);
+  if (origin == NULL) return is >> p;
+
+  Vector3D v;
+  if (is >> v) p = Vector3F(v - *origin);
+
+  return is;
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*! \file
+ * \brief Settings controlling how a Scene is rendered.
+ */
+
+#ifndef _RENDEROPTIONS_HH__
+#define _RENDEROPTIONS_HH__
+
+struct WavefrontStats;
+class ToneMap;
+
+//! Settings controlling how a Scene is rendered
+/*!
+ * The defaults reproduce the original deterministic renderer: one sample
+ * through the center of each pixel, with every light evaluated.
+ */
+struct RenderOptions
+{
+  //! Order in which pixels are rendered
+  enum PixelOrder
+  {
+    ROW_MAJOR,  //!< Along each row in turn
+    MORTON,     //!< In tiles, each tile & the tiles along a Morton curve
+    HILBERT     //!< In tiles, each tile & the tiles along a Hilbert curve
+  };
+
+  //! Number of samples per pixel
+  /*!
+   * A pixel's first sample goes through its center,
+   * and any further samples are jittered within the pixel.
+   */
+  unsigned int pixel_samples;
+
+  //! Number of lights sampled per shading point (0 to evaluate every light)
+  /*!
+   * When nonzero, lights are picked stochastically in proportion to their
+   * estimated contribution, and weighted so the result is unbiased.
+   */
+  unsigned int light_samples;
+
+  //! Maximum number of shadow rays per area light at a shading point
+  /*!
+   * A few probe rays are traced first, and the count is only raised to
+   * this (rounded down to a square number) where the probes disagree.
+   */
+  unsigned int area_samples;
+
+  //! Seed for all random sampling
+  unsigned int seed;
+
+  //! Maximum number of reflections traced
+  unsigned int max_depth;
+
+  //! Number of threads to render with (0 for one per hardware thread)
+  unsigned int threads;
+  //! Keep shaded colors above 1 (for high dynamic range output)
+  /*!
+   * Otherwise colors from evaluating every light are clamped to [0, 1].
+   */
+  bool hdr;
+  //! Order in which pixels are rendered (not used by wavefront renders)
+  /*!
+   * The image is the same in any order; only the memory access differs.
+   */
+  PixelOrder pixel_order;
+  //! Render in stages over batches of rays rather than a pixel at a time
+  /*!
+   * The image is the same either way (see Scene::render_rows_wavefront).
+   */
+  bool wavefront;
+  //! Sort each round of reflected rays for coherence (wavefront only)
+  bool coherence_sort;
+  //! Stats to which wavefront renders add their own (NULL for none)
+  WavefrontStats *stats;
+  //! Mapping of colors to 8-bit output (NULL to clamp & round)
+  const ToneMap *tone_map;
+  //! Refine the closest hit of each ray in double precision
+  /*!
+   * Only the hit being shaded is refined, so intersection tests and
+   * traversal stay in float (see SceneObject::refine_intersection).
+   */
+  bool refine_hits;
+
+  /* Progressive rendering (see Scene::render_progressive) */
+
+  //! Stop after this many samples per pixel (0 for no limit)
+  unsigned int max_samples;
+
+  //! Stop before exceeding this many seconds (0 for no limit)
+  double time_budget;
+
+  //! Minimum seconds between snapshots (0 to write one after every pass)
+  double snapshot_interval;
+
+  //! Default constructor gives the default settings
+  RenderOptions()
+    : pixel_samples(1)
+    , light_samples(0)
+    , area_samples(16)
+    , seed(0)
+    , max_depth(6)
+    , threads(0)
+    , hdr(false)
+    , pixel_order(ROW_MAJOR)
+    , wavefront(false)
+    , coherence_sort(true)
+    , stats(NULL)
+    , tone_map(NULL)
+    , refine_hits(false)
+    , max_samples(0)
+    , time_budget(0)
+    , snapshot_interval(0)
+  { }
+};
+
+#endif
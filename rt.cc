@@ -5,143 +5,711 @@
  */
 
 #include "scene.hh"
+#include "scenereader.hh"
 #include "plane.hh"
 #include "sphere.hh"
 #include "cylinder.hh"
+#include "trianglemesh.hh"
+#include "camerapath.hh"
+#include "session.hh"
+#include "farm.hh"
+#include "cache.hh"
+#include "wavefront.hh"
+#include "png.hh"
+#include "hdrimage.hh"
+#include "tonemap.hh"
+#include "rebase.hh"
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <fstream>
 #include <map>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace boost;
 
+//! Pixel dimensions of rendered images
+static const int IMG_SIZE = 500;
+
+//! Settings given on the command line
+struct Settings
+{
+  //! Render settings
+  RenderOptions opt;
+
+  //! File to which to write progressive snapshots (empty for none)
+  string snapshot;
+
+  //! File listing the camera path for batch rendering (empty for none)
+  string batch;
+
+  //! Pattern for file names of batch rendered frames
+  string output;
+
+  //! Whether to coordinate a render farm
+  bool farm;
+  //! Number of local workers to start for the render farm
+  unsigned int farm_workers;
+  //! Port on which the render farm accepts remote workers (0 for none)
+  unsigned int listen_port;
+
+  //! Host of the render farm to work for (empty if not a worker)
+  string worker_host;
+  //! Port of the render farm to work for
+  unsigned int worker_port;
+
+  //! Directory of the render cache (empty for none)
+  string cache;
+  //! Maximum size of the render cache in megabytes
+  unsigned int cache_mb;
+
+  //! First row of the image to render
+  int crop_begin;
+  //! One past the last row of the image to render
+  int crop_end;
+
+  //! Whether to report wavefront rendering stats
+  bool stats;
+
+  //! Whether to read the scene relative to the camera's position
+  bool rebase;
+
+  //! Maximum size of the loaded tiles of image textures in megabytes
+  unsigned int texture_cache_mb;
+
+  //! Whether to write the image in PNG format rather than PPM
+  bool png;
+
+  //! High dynamic range format to write ("exr" or "pfm"; empty for none)
+  string hdr;
+
+  //! Whether to tone map 8-bit output (otherwise colors are clamped)
+  bool tone_map;
+  //! Exposure adjustment in stops
+  double exposure;
+  //! Tone curve
+  ToneMap::Operator tone_op;
+  //! Whether to encode 8-bit output with the sRGB transfer function
+  bool srgb;
+  //! Whether to dither 8-bit output
+  bool dither;
+
+  Settings()
+    : opt()
+    , snapshot()
+    , batch()
+    , output("frame_%04d.ppm")
+    , farm(false)
+    , farm_workers(0)
+    , listen_port(0)
+    , worker_host()
+    , worker_port(0)
+    , cache()
+    , cache_mb(RenderCache::default_max_bytes >> 20)
+    , crop_begin(0)
+    , crop_end(IMG_SIZE)
+    , stats(false)
+    , rebase(false)
+    , texture_cache_mb(TextureCache::default_max_bytes >> 20)
+    , png(false)
+    , hdr()
+    , tone_map(false)
+    , exposure(0)
+    , tone_op(ToneMap::CLAMP)
+    , srgb(false)
+    , dither(false)
+  { }
+};
+
 /*!
- * Reads a scene from the given input stream
+ * Print command line usage to std err
  *
- * Each line of input should describe a different component of the scene.
- * A line starts with the type of component being described, followed by
- * the relevant construction for that component.  These are as follows:
+ * \param prog  Name of the program
+ */
+void usage(const char *prog)
+{
+  cerr << "Usage: " << prog << " [options] < scene.txt > image.ppm" << endl;
+  cerr << "Options:" << endl;
+  cerr << "  -s N        Samples per pixel (default 1)" << endl;
+  cerr << "  -l N        Lights sampled per shading point" << endl;
+  cerr << "              (default 0: evaluate every light)" << endl;
+  cerr << "  --seed N    Seed for random sampling (default 0)" << endl;
+  cerr << "  -j N        Threads to render with" << endl;
+  cerr << "              (default 0: one per hardware thread)" << endl;
+  cerr << "  --area-samples N  Shadow rays per area light in penumbrae"
+       << endl;
+  cerr << "                    (default 16)" << endl;
+  cerr << "  --pixel-order O   Order of pixels: row, morton or hilbert"
+       << endl;
+  cerr << "                    (in tiles along the curve; default row)"
+       << endl;
+  cerr << "  --wavefront       Trace batches of rays in stages" << endl;
+  cerr << "                    (same image, different memory access)" << endl;
+  cerr << "  --no-sort         Trace reflected rays in pixel order in"
+       << endl;
+  cerr << "                    wavefront renders (default: sorted)" << endl;
+  cerr << "  --rebase          Read the scene relative to the camera, for"
+       << endl;
+  cerr << "                    scenes with large coordinates" << endl;
+  cerr << "  --refine          Refine sphere & cylinder hits in double"
+       << endl;
+  cerr << "                    precision" << endl;
+  cerr << "  --texture-cache MB  Maximum size of image texture tiles held"
+       << endl;
+  cerr << "                      in memory (default "
+       << (TextureCache::default_max_bytes >> 20) << ")" << endl;
+  cerr << endl;
+  cerr << "Progressive rendering (enabled by either budget):" << endl;
+  cerr << "  --max-samples N          Stop at N samples per pixel (at least -s)"
+       << endl;
+  cerr << "  --time-budget SECS       Stop before SECS seconds elapse" << endl;
+  cerr << "  --snapshot FILE          Write intermediate images to FILE"
+       << endl;
+  cerr << "  --snapshot-interval SECS Seconds between snapshots" << endl;
+  cerr << "                           (default 0: after every pass)" << endl;
+  cerr << endl;
+  cerr << "Batch rendering:" << endl;
+  cerr << "  --batch FILE      Render every frame of the camera path in FILE"
+       << endl;
+  cerr << "  --output PATTERN  Frame file names, with the frame number"
+       << endl;
+  cerr << "                    substituted for %d or %0Nd" << endl;
+  cerr << "                    (default frame_%04d.ppm; PNG if the name"
+       << endl;
+  cerr << "                    ends in .png)" << endl;
+  cerr << endl;
+  cerr << "Render farm (single pass of -s samples per pixel):" << endl;
+  cerr << "  --farm N            Split the image into tiles rendered by N"
+       << endl;
+  cerr << "                      local worker processes" << endl;
+  cerr << "  --listen PORT       Also accept workers from other hosts on PORT"
+       << endl;
+  cerr << "  --worker HOST:PORT  Work for the farm at HOST:PORT, rendering"
+       << endl;
+  cerr << "                      the same scene with the same options" << endl;
+  cerr << endl;
+  cerr << "Single images:" << endl;
+  cerr << "  --png             Write the image in PNG format, encoding rows"
+       << endl;
+  cerr << "                    as they are rendered (not progressive)"
+       << endl;
+  cerr << "  --hdr FORMAT      Write unclamped colors as half floats, in"
+       << endl;
+  cerr << "                    OpenEXR (exr) or PFM (pfm) format" << endl;
+  cerr << "  --crop Y0:Y1      Render only rows Y0 to Y1 - 1 of the image"
+       << endl;
+  cerr << "  --cache DIR       Reuse & refine renders cached in DIR" << endl;
+  cerr << "  --cache-size MB   Maximum size of the cache (default "
+       << (RenderCache::default_max_bytes >> 20) << ")" << endl;
+  cerr << "  --stats           Report ray counts & stage timings of"
+       << endl;
+  cerr << "                    wavefront renders" << endl;
+  cerr << endl;
+  cerr << "Tone mapping (8-bit PPM & PNG output):" << endl;
+  cerr << "  --exposure EV     Scale colors by 2 to the power EV" << endl;
+  cerr << "  --tonemap OP      Tone curve: clamp (default), reinhard or aces"
+       << endl;
+  cerr << "  --srgb            Encode with the sRGB transfer function" << endl;
+  cerr << "  --dither          Apply ordered dithering before quantizing"
+       << endl;
+}
+
+/*!
+ * Parse an unsigned integer command line argument
  *
- * - camera (position vector) (look at vector) (up vector)
- * - light (position vector) [color]
- * - plane  distance_from_orign (normal vector) [color]
- * - sphere (center position vector) radius [color]
+ * \param[in]  arg  Argument string (may be NULL if missing)
+ * \param[out] val  Parsed value
+ * \returns         true if arg was a valid unsigned integer
+ */
+bool parse_uint(const char *arg, unsigned int &val)
+{
+  if (arg == NULL || *arg == '\0') return false;
+
+  char *end;
+  unsigned long v = strtoul(arg, &end, 10);
+  if (*end != '\0' || arg[0] == '-') return false;
+
+  val = v;
+  return true;
+}
+
+/*!
+ * Parse a non-negative real number command line argument
  *
- * Vectors are in the format "(x y z)"
- * and Colors are in the format "[r g b]"
+ * \param[in]  arg  Argument string (may be NULL if missing)
+ * \param[out] val  Parsed value
+ * \returns         true if arg was a valid non-negative number
+ */
+bool parse_seconds(const char *arg, double &val)
+{
+  if (arg == NULL || *arg == '\0') return false;
+
+  char *end;
+  double v = strtod(arg, &end);
+  if (*end != '\0' || !(v >= 0)) return false;
+
+  val = v;
+  return true;
+}
+
+/*!
+ * Parse the command line into settings
  *
- * If multiple Camera lines are provided, only the last is used.
- * At least one camera must be defined.
+ * \param[in]  argc      Number of arguments
+ * \param[in]  argv      Arguments
+ * \param[out] settings  Settings from the command line
+ * \returns              true if all arguments were understood
+ */
+bool parse_args(int argc, char **argv, Settings &settings)
+{
+  RenderOptions &opt = settings.opt;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    // Value following this argument, if any
+    const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(argv[i], "-s") == 0)
+    {
+      if (!parse_uint(val, opt.pixel_samples) || opt.pixel_samples == 0)
+        return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "-l") == 0)
+    {
+      if (!parse_uint(val, opt.light_samples)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "-j") == 0)
+    {
+      if (!parse_uint(val, opt.threads)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--area-samples") == 0)
+    {
+      if (!parse_uint(val, opt.area_samples) || opt.area_samples == 0)
+        return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--pixel-order") == 0)
+    {
+      if (val == NULL) return false;
+
+      if (strcmp(val, "row") == 0)
+        opt.pixel_order = RenderOptions::ROW_MAJOR;
+      else if (strcmp(val, "morton") == 0)
+        opt.pixel_order = RenderOptions::MORTON;
+      else if (strcmp(val, "hilbert") == 0)
+        opt.pixel_order = RenderOptions::HILBERT;
+      else
+        return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--wavefront") == 0)
+    {
+      opt.wavefront = true;
+    }
+    else if (strcmp(argv[i], "--no-sort") == 0)
+    {
+      opt.coherence_sort = false;
+    }
+    else if (strcmp(argv[i], "--stats") == 0)
+    {
+      settings.stats = true;
+    }
+    else if (strcmp(argv[i], "--rebase") == 0)
+    {
+      settings.rebase = true;
+    }
+    else if (strcmp(argv[i], "--texture-cache") == 0)
+    {
+      if (!parse_uint(val, settings.texture_cache_mb)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--refine") == 0)
+    {
+      opt.refine_hits = true;
+    }
+    else if (strcmp(argv[i], "--batch") == 0)
+    {
+      if (val == NULL) return false;
+      settings.batch = val;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--output") == 0)
+    {
+      if (val == NULL) return false;
+      settings.output = val;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--seed") == 0)
+    {
+      if (!parse_uint(val, opt.seed)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--max-samples") == 0)
+    {
+      if (!parse_uint(val, opt.max_samples)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--time-budget") == 0)
+    {
+      if (!parse_seconds(val, opt.time_budget)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--snapshot") == 0)
+    {
+      if (val == NULL) return false;
+      settings.snapshot = val;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--snapshot-interval") == 0)
+    {
+      if (!parse_seconds(val, opt.snapshot_interval)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--farm") == 0)
+    {
+      if (!parse_uint(val, settings.farm_workers)) return false;
+      settings.farm = true;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--listen") == 0)
+    {
+      if (!parse_uint(val, settings.listen_port)
+          || settings.listen_port == 0 || settings.listen_port > 65535)
+        return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--cache") == 0)
+    {
+      if (val == NULL) return false;
+      settings.cache = val;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--cache-size") == 0)
+    {
+      if (!parse_uint(val, settings.cache_mb)) return false;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--png") == 0)
+    {
+      settings.png = true;
+    }
+    else if (strcmp(argv[i], "--exposure") == 0)
+    {
+      char *end;
+      if (val == NULL || *val == '\0') return false;
+      settings.exposure = strtod(val, &end);
+      if (*end != '\0') return false;
+      settings.tone_map = true;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--tonemap") == 0)
+    {
+      if (val == NULL) return false;
+
+      if (strcmp(val, "clamp") == 0)
+        settings.tone_op = ToneMap::CLAMP;
+      else if (strcmp(val, "reinhard") == 0)
+        settings.tone_op = ToneMap::REINHARD;
+      else if (strcmp(val, "aces") == 0)
+        settings.tone_op = ToneMap::ACES;
+      else
+        return false;
+      settings.tone_map = true;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--srgb") == 0)
+    {
+      settings.srgb = settings.tone_map = true;
+    }
+    else if (strcmp(argv[i], "--dither") == 0)
+    {
+      settings.dither = settings.tone_map = true;
+    }
+    else if (strcmp(argv[i], "--hdr") == 0)
+    {
+      if (val == NULL || (strcmp(val, "exr") != 0 && strcmp(val, "pfm") != 0))
+        return false;
+      settings.hdr = val;
+      opt.hdr = true;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--crop") == 0)
+    {
+      // Split Y0:Y1 at the colon
+      const char *colon = val ? strchr(val, ':') : NULL;
+      unsigned int y0, y1;
+      if (colon == NULL || !parse_uint(colon + 1, y1)
+          || !parse_uint(string(val, colon).c_str(), y0)
+          || y0 >= y1 || y1 > unsigned(IMG_SIZE))
+        return false;
+      settings.crop_begin = y0;
+      settings.crop_end = y1;
+      ++i;
+    }
+    else if (strcmp(argv[i], "--worker") == 0)
+    {
+      // Split HOST:PORT at the last colon
+      const char *colon = val ? strrchr(val, ':') : NULL;
+      if (colon == NULL || colon == val
+          || !parse_uint(colon + 1, settings.worker_port)
+          || settings.worker_port == 0 || settings.worker_port > 65535)
+        return false;
+      settings.worker_host.assign(val, colon);
+      ++i;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  // Every pass takes -s samples, so the first pass must fit in the maximum
+  if (opt.max_samples > 0 && opt.max_samples < opt.pixel_samples)
+    return false;
+
+  // Farms render a single pass of a single frame
+  bool farm = settings.farm || !settings.worker_host.empty();
+  if (farm && (!settings.batch.empty() || opt.max_samples > 0
+               || opt.time_budget > 0))
+    return false;
+
+  if (settings.listen_port != 0 && !settings.farm)
+    return false;
+
+  // Caching & cropping apply to plain single image renders
+  bool single = !farm && settings.batch.empty() && opt.max_samples == 0
+                && opt.time_budget == 0;
+  bool cropped = settings.crop_begin != 0 || settings.crop_end != IMG_SIZE;
+  if (!single && (cropped || !settings.cache.empty()))
+    return false;
+
+  // Only single images & farms write to std out (batches pick the format by
+  // file name, and progressive renders always write PPM)
+  if (settings.png && !single && !settings.farm)
+    return false;
+
+  // HDR images are single images, in one format, and aren't tone mapped
+  if (!settings.hdr.empty() && (!single || settings.png || settings.tone_map))
+    return false;
+
+  return true;
+}
+
+/*!
+ * Substitute a frame number into a file name pattern
  *
- * Empty lines are ignored, as are comment lines which begin with "#".
- * The pound sign must be the first character on the line.
+ * The first "%d" or "%0Nd" in the pattern is replaced by the frame number
+ * (zero padded to N digits).  A pattern without one has the frame number
+ * inserted before its extension.
  *
- * \param[in]  is         An input stream to read.  Reading stops at EOF.
- * \param[in]  readFuncs  A mapping of names to a function that takes an
- *                        istream and returns SPSceneObjects
- * \param[out] scn        Scene containing described objects
- * \param[out] cam        Camera read from scene
- * \returns               true if input reaches EOF successfully.
+ * \param pattern File name pattern
+ * \param frame   Frame number
+ * \returns       File name for the frame
  */
-bool read_Scene(istream &is, map<string, SceneObjectReader> readFuncs,
-           Scene &scn, Camera &cam)
+string frame_filename(const string &pattern, unsigned int frame)
 {
-  // Create an empty scene
-  scn = Scene();
+  size_t pct = pattern.find('%');
+
+  // Width of zero-padding
+  unsigned int width = 0;
+  size_t end = pct;
 
-  // Create a blank camera
-  cam = Camera();
+  if (pct != string::npos)
+  {
+    for (end = pct + 1; end < pattern.size() && isdigit(pattern[end]); ++end)
+      width = width * 10 + (pattern[end] - '0');
+  }
 
-  // Success flag (continue reading lines after error, to identify all errors)
-  bool success = true;
+  char num[32];
+  snprintf(num, sizeof(num), "%0*u", int(width), frame);
 
-  // Loop through lines in input
-  string line;
-  int ln = 0;
-  for (getline(is, line); is.good(); getline(is, line))
+  if (pct == string::npos || end >= pattern.size() || pattern[end] != 'd')
   {
-    // Increment line #
-    ++ln;
+    // No substitution: insert before the extension
+    size_t dot = pattern.rfind('.');
+    if (dot == string::npos) dot = pattern.size();
+    return pattern.substr(0, dot) + '_' + num + pattern.substr(dot);
+  }
 
-    // Check for comment line
-    if (line.length() == 0 || line[0] == '#') continue;
+  return pattern.substr(0, pct) + num + pattern.substr(end + 1);
+}
 
-    // Create a string stream to read the line
-    istringstream iss(line);
+/*!
+ * Render every frame of a camera path, writing each to a numbered file.
+ *
+ * The Scene (and its acceleration structures) is shared by all frames.
+ * Frames are rendered in parallel, with each thread taking the next
+ * unrendered frame until all are done.  Each thread keeps one RenderSession,
+ * so moving to the next frame only swaps the Camera.
+ *
+ * \param scn       Prepared Scene to render
+ * \param path      Camera path to render
+ * \param settings  Settings (output pattern and render settings)
+ * \returns         true if every frame was written successfully
+ */
+bool render_batch(const Scene &scn, const CameraPath &path,
+                  const Settings &settings)
+{
+  const RenderOptions &opt = settings.opt;
 
-    // Read in the next component type
-    string type;
-    iss >> type;
+  unsigned int threads = opt.threads;
+  if (threads == 0) threads = thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
 
-    // Check for empty line
-    if (!iss) continue;
+  // Frames are rendered in parallel, so each frame uses one thread
+  RenderOptions frame_opt = opt;
+  frame_opt.threads = 1;
 
-    if (readFuncs.find(type) != readFuncs.end())
-    {
-      // New object to read
-      SPSceneObject obj;
+  // Next frame to render, and error flag, shared by all threads
+  atomic<unsigned int> next_frame(0);
+  atomic<bool> success(true);
+  // Lock for std err
+  mutex err_lock;
 
-      // Read object using appropriate function
-      obj = readFuncs[type](iss);
+  auto worker = [&]()
+  {
+    RenderSession session(scn, IMG_SIZE, frame_opt);
 
-      if (obj == NULL)
-      {
-        success = false;
-        cerr << "Error: Couldn't read " << type << " on line " << ln << endl;
-      }
-      else
-      {
-        scn.add_object(obj);
-      }
-    }
-    else if (type == "light")
+    for (unsigned int f = next_frame++; f < path.get_frame_count();
+         f = next_frame++)
     {
-      // New light to read
-      SPLight l;
+      session.set_camera(path.get_camera(f));
+      const Framebuffer &fb = session.render();
 
-      l = read_Light(iss);
+      string name = frame_filename(settings.output, f);
+      bool png = name.size() >= 4 && name.substr(name.size() - 4) == ".png";
 
-      if (l == NULL)
+      if (!(png ? write_png(name, fb) : fb.write_ppm(name)))
       {
         success = false;
-        cerr << "Error: Couldn't read light on line " << ln << endl;
-      }
-      else
-      {
-        scn.add_light(l);
-      }
-    }
-    else if (type == "camera")
-    {
-      cam = read_Camera(iss);
 
-      if (!cam.valid())
-      {
-        success = false;
-        cerr << "Error: Couldn't read camera (or invalid camera) on line ";
-        cerr << ln << endl;
+        lock_guard<mutex> lock(err_lock);
+        cerr << "Error: Couldn't write frame " << name << endl;
       }
     }
-    else
-    {
-      success = false;
-      cerr << "Error: Unrecognized type \"" << type << "\" on line " << ln;
-      cerr << endl;
-    }
+  };
 
-  }
+  vector<thread> pool;
+  for (unsigned int i = 0; i < threads; ++i)
+    pool.push_back(thread(worker));
+
+  for (unsigned int i = 0; i < pool.size(); ++i)
+    pool[i].join();
 
   return success;
 }
 
+/*!
+ * Write the rendered rows in the HDR format chosen to std out
+ *
+ * The rows are converted to halves one at a time as they are written, so no
+ * second copy of the image is held.
+ *
+ * \param fb        Framebuffer with the rendered rows
+ * \param settings  Settings (HDR format & rows to write)
+ * \returns         true if the image was written
+ */
+bool write_hdr(const Framebuffer &fb, const Settings &settings)
+{
+  if (settings.hdr == "exr")
+    return write_exr(cout, fb, fb.get_samples(), settings.crop_begin,
+                     settings.crop_end);
+
+  return write_pfm(cout, fb, fb.get_samples(), settings.crop_begin,
+                   settings.crop_end);
+}
+
+/*!
+ * Render the scene through a render farm, writing the image to std out.
+ *
+ * Local workers are forked from this process after the scene is loaded.
+ * If a listening port was given, workers on other hosts may also join.
+ *
+ * \param scn       Prepared Scene to render
+ * \param cam       Camera from which to render the scene
+ * \param settings  Settings (farm and render settings)
+ * \returns         true if the image was rendered
+ */
+bool render_farm(const Scene &scn, const Camera &cam,
+                 const Settings &settings)
+{
+  RenderFarm farm;
+
+  if (!farm.listen(settings.listen_port, settings.listen_port != 0))
+    return false;
+
+  if (settings.listen_port != 0)
+  {
+    cerr << "Render farm listening on port " << farm.get_port() << endl;
+  }
+  else if (settings.farm_workers == 0)
+  {
+    cerr << "Error: A render farm needs workers or a port to listen on."
+         << endl;
+    return false;
+  }
+
+  for (unsigned int i = 0; i < settings.farm_workers; ++i)
+  {
+    if (!farm.spawn_worker(scn, cam, settings.opt, IMG_SIZE))
+      return false;
+  }
+
+  Framebuffer fb(IMG_SIZE, IMG_SIZE);
+  fb.set_tone_map(settings.opt.tone_map);
+
+  if (!farm.render(fb, scn, cam, settings.opt))
+    return false;
+
+  if (settings.png)
+    return write_png(cout, fb);
+
+  fb.write_ppm(cout);
+  return true;
+}
+
 /*!
  * Read a scene description on std in and render it in ppm format on std out.
  *
- * For formatting, see \ref read_Scene;
+ * With --batch, every frame of a camera path is rendered to numbered files
+ * instead.
+ *
+ * For formatting, see \ref read_Scene and \ref read_CameraPath;
+ * for command line options, see \ref usage.
  */
-int main()
+int main(int argc, char **argv)
 {
+  // Settings from the command line
+  Settings settings;
+  const RenderOptions &opt = settings.opt;
+
+  if (!parse_args(argc, argv, settings))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Stats of wavefront renders
+  WavefrontStats stats;
+  if (settings.stats)
+    settings.opt.stats = &stats;
+
+  // Tone mapping of 8-bit output
+  ToneMap tone_map(settings.exposure, settings.tone_op, settings.srgb,
+                   settings.dither);
+  if (settings.tone_map)
+    settings.opt.tone_map = &tone_map;
+
   // Map of type names to SceneObjectReader functions
   map<string, SceneObjectReader> readFuncs;
 
@@ -149,19 +717,149 @@ int main()
   readFuncs["plane"] = read_Plane;
   readFuncs["sphere"] = read_Sphere;
   readFuncs["cylinder"] = read_Cylinder;
+  readFuncs["mesh"] = read_TriangleMesh;
+
+  // Map of type names to LightReader functions
+  map<string, LightReader> lightFuncs;
+
+  lightFuncs["light"] = read_Light;
+  lightFuncs["sphere_light"] = read_SphereLight;
+  lightFuncs["rect_light"] = read_RectLight;
 
   // Read the scene in from std in description
   Scene scn;
   Camera cam;
+  Vector3D origin;
 
-  if(!read_Scene(cin, readFuncs, scn, cam))
+  if(!read_Scene(cin, readFuncs, lightFuncs, scn, cam, settings.rebase,
+                 origin))
   {
     cerr << "Parsing of scene description failed." << endl;
+    return 1;
+  }
+
+  scn.get_texture_cache()->set_max_bytes(
+      size_t(settings.texture_cache_mb) << 20);
+
+  // Camera path for batch rendering (rebased along with the scene)
+  CameraPath path;
+
+  if (!settings.batch.empty())
+  {
+    ifstream ifs(settings.batch.c_str());
+
+    if (!ifs)
+    {
+      cerr << "Error: Couldn't open camera path " << settings.batch << endl;
+      return 1;
+    }
+
+    if (settings.rebase) set_read_origin(ifs, &origin);
+
+    if (!read_CameraPath(ifs, path) || path.get_frame_count() == 0)
+    {
+      cerr << "Parsing of camera path failed." << endl;
+      return 1;
+    }
+  }
+
+  // Build acceleration structures
+  scn.prepare();
+
+  if (!settings.batch.empty())
+  {
+    // Render every frame to files
+    return render_batch(scn, path, settings) ? 0 : 1;
+  }
+
+  if (!settings.worker_host.empty())
+  {
+    // Render tiles for a coordinator elsewhere
+    return run_farm_worker(scn, cam, opt, IMG_SIZE, settings.worker_host,
+                           settings.worker_port) ? 0 : 1;
+  }
+
+  if (settings.farm)
+  {
+    // Coordinate workers rendering tiles of the image
+    return render_farm(scn, cam, settings) ? 0 : 1;
+  }
+
+  // Render the scene to std out
+  if (opt.max_samples > 0 || opt.time_budget > 0)
+  {
+    unsigned int samples =
+        scn.render_progressive(cam, IMG_SIZE, cout, opt, settings.snapshot);
+    cerr << "Rendered " << samples << " samples per pixel." << endl;
+  }
+  else if (!settings.cache.empty())
+  {
+    RenderCache cache(settings.cache, uint64_t(settings.cache_mb) << 20);
+    Framebuffer fb(IMG_SIZE, IMG_SIZE);
+    fb.set_tone_map(opt.tone_map);
+
+    RenderCache::Result result = cache.render(scn, cam, opt, fb,
+                                              settings.crop_begin,
+                                              settings.crop_end);
+
+    if (result == RenderCache::HIT)
+      cerr << "Render cache hit." << endl;
+    else if (result == RenderCache::PARTIAL_HIT)
+      cerr << "Render cache partial hit: refined cached render." << endl;
+
+    if (!settings.hdr.empty())
+      write_hdr(fb, settings);
+    else if (settings.png)
+      write_png(cout, fb, settings.crop_begin, settings.crop_end);
+    else
+      fb.write_ppm(cout, settings.crop_begin, settings.crop_end);
+  }
+  else if (settings.png)
+  {
+    Framebuffer fb(IMG_SIZE, IMG_SIZE);
+    fb.set_tone_map(opt.tone_map);
+    PNGEncoder png(fb, opt.pixel_samples, settings.crop_begin,
+                   settings.crop_end, opt.threads);
+
+    // Render in strips, encoding each while the next is rendered
+    for (int y = settings.crop_begin; y < settings.crop_end;
+         y += PNGEncoder::strip_rows)
+    {
+      int y_end = min(y + PNGEncoder::strip_rows, settings.crop_end);
+
+      scn.render_rows(cam, fb, opt, 0, y, y_end);
+      png.add_rows(y_end);
+    }
+
+    fb.end_pass(opt.pixel_samples);
+
+    if (!png.write(cout))
+    {
+      cerr << "Error: Couldn't encode PNG image." << endl;
+      return 1;
+    }
+  }
+  else if (settings.crop_begin != 0 || settings.crop_end != IMG_SIZE
+           || !settings.hdr.empty())
+  {
+    Framebuffer fb(IMG_SIZE, IMG_SIZE);
+    fb.set_tone_map(opt.tone_map);
+
+    scn.render_rows(cam, fb, opt, 0, settings.crop_begin, settings.crop_end);
+    fb.end_pass(opt.pixel_samples);
+
+    if (!settings.hdr.empty())
+      write_hdr(fb, settings);
+    else
+      fb.write_ppm(cout, settings.crop_begin, settings.crop_end);
   }
   else
   {
-    // Render the scene to std out
-    scn.render(cam, 500, cout);
+    scn.render(cam, IMG_SIZE, cout, opt);
   }
 
+  if (settings.stats)
+    cerr << stats;
+
+  return 0;
 }
@@ -7,17 +7,42 @@
  */
 
 #include "scene.hh"
+#include "morton.hh"
+#include <typeinfo>
 #include <algorithm>
 #include <functional>
 #include <cfloat>
 #include <cmath>
+#include <chrono>
+#include <atomic>
+#include <thread>
 
 using namespace std;
 
+//! Cells along each side of the grid of probe points on an area light
+static const unsigned int AREA_PROBE_GRID = 2;
+
+//! Pixels along each side of a tile, when rendering in tiles
+static const int PIXEL_TILE = 16;
+
 // Default constructor creates an empty scene
 Scene::Scene()
-  : objects()
+  : arena(new Arena())
+  , texture_cache(new TextureCache())
+  , objects()
+  , spheres()
+  , planes()
+  , cylinders()
+  , other_objects()
+  , bounded_objects()
+  , unbounded_objects()
+  , object_bvh()
   , lights()
+  , unbounded_lights()
+  , bounded_lights()
+  , light_bvh()
+  , light_tree()
+  , prepared(false)
 { }
 
 // Add a SceneObject (allocated on heap)
@@ -26,6 +51,21 @@ void Scene::add_object(SPSceneObject so)
 {
   assert(so != NULL);
   objects.push_back(so);
+  prepared = false;
+
+  // File the object under its exact type.
+  // (Subclasses of the primitives may override intersection(),
+  // so they must go through the virtual interface)
+  const type_info &type = typeid(*so);
+
+  if (type == typeid(Sphere))
+    spheres.push_back(static_cast<const Sphere *>(so.get()));
+  else if (type == typeid(Plane))
+    planes.push_back(static_cast<const Plane *>(so.get()));
+  else if (type == typeid(Cylinder))
+    cylinders.push_back(static_cast<const Cylinder *>(so.get()));
+  else
+    other_objects.push_back(so.get());
 }
 
 // Add a Light (allocated on heap)
@@ -34,10 +74,395 @@ void Scene::add_light(SPLight l)
 {
   assert(l != NULL);
   lights.push_back(l);
+  prepared = false;
+}
+
+// Build acceleration structures
+/*!
+ * Must be called after the last object or light is added,
+ * and before the Scene is rendered.
+ */
+void Scene::prepare()
+{
+  // Split objects by whether they have bounds.
+  // (Planes are never bounded, so are left to their own typed loop)
+  bounded_objects.clear();
+  unbounded_objects.clear();
+
+  AABB box;
+
+  for (unsigned int i = 0; i < spheres.size(); ++i)
+  {
+    Primitive p = { Primitive::SPHERE, spheres[i] };
+    bounded_objects.push_back(p);
+  }
+
+  for (unsigned int i = 0; i < cylinders.size(); ++i)
+  {
+    Primitive p = { Primitive::CYLINDER, cylinders[i] };
+    bounded_objects.push_back(p);
+  }
+
+  for (unsigned int i = 0; i < other_objects.size(); ++i)
+  {
+    if (other_objects[i]->get_bounds(box))
+    {
+      Primitive p = { Primitive::OTHER, other_objects[i] };
+      bounded_objects.push_back(p);
+    }
+    else
+    {
+      unbounded_objects.push_back(other_objects[i]);
+    }
+  }
+
+  vector<AABB> object_bounds;
+  get_object_bounds(object_bounds);
+  object_bvh.build(object_bounds);
+
+  unbounded_lights.clear();
+  bounded_lights.clear();
+
+  // Bounds of the region lit by each bounded light
+  vector<AABB> bounds;
+
+  for (unsigned int i = 0; i < lights.size(); ++i)
+  {
+    if (lights[i]->is_bounded())
+    {
+      bounded_lights.push_back(lights[i].get());
+      bounds.push_back(lights[i]->get_bounds());
+    }
+    else
+    {
+      unbounded_lights.push_back(lights[i].get());
+    }
+  }
+
+  light_bvh.build(bounds);
+
+  // Tree over every light
+  vector<const Light *> all_lights;
+  for (unsigned int i = 0; i < lights.size(); ++i)
+    all_lights.push_back(lights[i].get());
+
+  light_tree.build(all_lights);
+
+  prepared = true;
+}
+
+/*!
+ * \param[out] bounds  Bounding box of each of bounded_objects, in order
+ */
+void Scene::get_object_bounds(vector<AABB> &bounds) const
+{
+  bounds.resize(bounded_objects.size());
+
+  for (unsigned int i = 0; i < bounded_objects.size(); ++i)
+    bounded_objects[i].obj->get_bounds(bounds[i]);
+}
+
+/*!
+ * Objects and lights are added in the order they were added to the Scene,
+ * so scenes read from the same description hash the same.
+ *
+ * \param h Hash to which to add the scene
+ */
+void Scene::hash(Hash &h) const
+{
+  h.add(uint32_t(objects.size()));
+  for (unsigned int i = 0; i < objects.size(); ++i)
+    objects[i]->hash(h);
+
+  h.add(uint32_t(lights.size()));
+  for (unsigned int i = 0; i < lights.size(); ++i)
+    lights[i]->hash(h);
+}
+
+// Update acceleration structures after objects have moved
+/*!
+ * Objects may be moved (such as with Sphere::set_center) between frames
+ * without re-preparing the Scene, as long as none are added or removed and
+ * bounded objects stay bounded.  This refits the object hierarchy to the
+ * objects' new positions, which is much cheaper than rebuilding it.
+ *
+ * \param threads  Number of threads to refit with
+ * \returns        true if the hierarchy had degraded enough to be rebuilt
+ */
+bool Scene::refit(unsigned int threads)
+{
+  assert(prepared);
+
+  vector<AABB> object_bounds;
+  get_object_bounds(object_bounds);
+
+  return object_bvh.refit(object_bounds, threads);
+}
+
+/*!
+ * Lights behind the surface are rejected before any normalization,
+ * as are points beyond a light's cutoff radius.
+ *
+ * Point lights cast no shadows; area lights are passed to shade_area_light.
+ *
+ * \param      l     Light to evaluate
+ * \param      hit   Hit being shaded
+ * \param      pos   Position of the surface point
+ * \param      n     Surface normal at pos
+ * \param      so_c  Surface color at pos
+ * \param      opt   Render settings
+ * \param      rng   Random number generator for sampling area lights
+ * \param[out] c     Color to which to add the light's contribution
+ */
+inline void Scene::shade_light(const Light &l, const Hit &hit,
+                               const Vector3F &pos, const Vector3F &n,
+                               const Color &so_c, const RenderOptions &opt,
+                               Random &rng, Color &c) const
+{
+  if (l.is_area())
+  {
+    shade_area_light(l, hit, pos, n, so_c, opt, rng, c);
+    return;
+  }
+
+  // Vector from intersection to light
+  Vector3F v_l = l.get_position() - pos;
+
+  // Back-facing light contributes nothing
+  if (dot(n, v_l) <= 0) return;
+
+  // Attenuation within cutoff radius
+  float atten = l.get_attenuation(v_l.norm_sq());
+  if (atten == 0) return;
+
+  v_l.normalize();
+
+  // Filter light color with surface color and angle of incidence
+  c += l.get_color() * so_c * (dot(n, v_l) * atten);
+}
+
+/*!
+ * Averages the light from points on the emitter, each of which contributes
+ * only if the path from it to the surface point is unblocked.
+ *
+ * Points are stratified, with one jittered point in each cell of a grid over
+ * the emitter.  AREA_PROBE_GRID^2 probe points are taken first; if they all
+ * agree on whether the light arrives, the point is fully lit or in umbra and
+ * the probes are used as they are.  Otherwise the point is in penumbra, and
+ * a finer grid of up to opt.area_samples points is taken instead.  Its cells
+ * nest within the probes' cells, so each probe stands as the point of the
+ * fine cell it fell in, and only the other cells take new points.
+ *
+ * With no more than AREA_PROBE_GRID^2 samples, there is nothing to refine, so
+ * the grid of samples is taken directly.
+ *
+ * \param      l     Area light to evaluate
+ * \param      hit   Hit being shaded
+ * \param      pos   Position of the surface point
+ * \param      n     Surface normal at pos
+ * \param      so_c  Surface color at pos
+ * \param      opt   Render settings
+ * \param      rng   Random number generator for jittering sample points
+ * \param[out] c     Color to which to add the light's contribution
+ */
+void Scene::shade_area_light(const Light &l, const Hit &hit,
+                             const Vector3F &pos, const Vector3F &n,
+                             const Color &so_c, const RenderOptions &opt,
+                             Random &rng, Color &c) const
+{
+  // Reject lights wholly behind the surface
+  if (dot(n, l.get_position() - pos) <= -l.get_extent()) return;
+
+  const unsigned int probe = AREA_PROBE_GRID;
+  unsigned int grid = (unsigned int) sqrt(float(opt.area_samples));
+  float sum = 0;
+
+  if (grid <= probe)
+  {
+    // Too few samples to refine
+    grid = max(grid, 1u);
+
+    for (unsigned int i = 0; i < grid; ++i)
+    {
+      for (unsigned int j = 0; j < grid; ++j)
+      {
+        sum += sample_area_light(l, hit, pos, n, (i + rng.next_float()) / grid,
+                                 (j + rng.next_float()) / grid);
+      }
+    }
+  }
+  else
+  {
+    // Jitter within each probe cell, and the light from each probe
+    float probe_s[probe][probe], probe_t[probe][probe];
+    float probe_l[probe][probe];
+    unsigned int lit = 0;
+
+    for (unsigned int i = 0; i < probe; ++i)
+    {
+      for (unsigned int j = 0; j < probe; ++j)
+      {
+        probe_s[i][j] = rng.next_float();
+        probe_t[i][j] = rng.next_float();
+        probe_l[i][j] = sample_area_light(l, hit, pos, n,
+                                          (i + probe_s[i][j]) / probe,
+                                          (j + probe_t[i][j]) / probe);
+        sum += probe_l[i][j];
+        if (probe_l[i][j] > 0) ++lit;
+      }
+    }
+
+    if (lit == 0 || lit == probe * probe)
+    {
+      grid = probe;
+    }
+    else
+    {
+      // Refine where the probes disagree, with fine cells nesting within
+      // the probe cells
+      unsigned int sub = grid / probe;
+      grid = sub * probe;
+      sum = 0;
+
+      for (unsigned int i = 0; i < grid; ++i)
+      {
+        for (unsigned int j = 0; j < grid; ++j)
+        {
+          // Fine cell (within its probe cell) in which the probe fell
+          unsigned int pi = i / sub, pj = j / sub;
+          unsigned int si = min((unsigned int) (probe_s[pi][pj] * sub),
+                                sub - 1);
+          unsigned int sj = min((unsigned int) (probe_t[pi][pj] * sub),
+                                sub - 1);
+
+          if (i % sub == si && j % sub == sj)
+          {
+            sum += probe_l[pi][pj];
+          }
+          else
+          {
+            sum += sample_area_light(l, hit, pos, n,
+                                     (i + rng.next_float()) / grid,
+                                     (j + rng.next_float()) / grid);
+          }
+        }
+      }
+    }
+  }
+
+  if (sum > 0)
+    c += l.get_color() * so_c * (sum / (grid * grid));
+}
+
+/*!
+ * \param l    Area light to sample
+ * \param hit  Hit being shaded (skipped by shadow rays)
+ * \param pos  Position of the surface point
+ * \param n    Surface normal at pos
+ * \param s    First coordinate of the point on the light, in [0, 1)
+ * \param t    Second coordinate of the point on the light, in [0, 1)
+ * \returns    cos(angle) * attenuation of the point's light at pos
+ *             (0 if the point is blocked or faces away)
+ */
+float Scene::sample_area_light(const Light &l, const Hit &hit,
+                               const Vector3F &pos, const Vector3F &n,
+                               float s, float t) const
+{
+  Vector3F v_l = l.sample_point(s, t, pos) - pos;
+
+  // Back-facing point
+  float d = dot(n, v_l);
+  if (d <= 0) return 0;
+
+  // Attenuation within cutoff radius
+  float dist_sq = v_l.norm_sq();
+  float atten = l.get_attenuation(dist_sq);
+  if (atten == 0) return 0;
+
+  // (Shadow rays start on the surface, skipping it)
+  if (occluded(pos, pos + v_l, hit)) return 0;
+
+  return d / sqrt(dist_sq) * atten;
+}
+
+/*!
+ * \param r    Ray which hit the surface
+ * \param hit  Hit on the surface
+ * \param pos  Position of the hit
+ * \param n    Surface normal at pos
+ * \returns    Differentials of the hit's position & normal per pixel
+ */
+SurfaceDifferentials Scene::hit_differentials(const Ray &r, const Hit &hit,
+                                              const Vector3F &pos,
+                                              const Vector3F &n)
+{
+  SurfaceDifferentials sd = r.get_surface_differentials(hit.t, n);
+  sd.dndx = hit.obj->get_normal_differential(pos, sd.dpdx);
+  sd.dndy = hit.obj->get_normal_differential(pos, sd.dpdy);
+
+  return sd;
 }
 
+/*!
+ * Evaluates the lights reaching a surface point (every light, or
+ * opt.light_samples lights picked stochastically), without reflections.
+ *
+ * \param hit  Hit on the surface being shaded
+ * \param pos  Position of the surface point
+ * \param n    Surface normal at pos
+ * \param sd   Differentials of the hit (over which to filter textures)
+ * \param opt  Render settings
+ * \param rng  Random number generator for stochastic sampling
+ * \returns    The Color of light reflected directly from the surface
+ */
+Color Scene::shade(const Hit &hit, const Vector3F &pos, const Vector3F &n,
+                   const SurfaceDifferentials &sd, const RenderOptions &opt,
+                   Random &rng) const
+{
+  Color c = Color(0, 0, 0);
+
+  // Surface color of object at the point (from its texture, if any)
+  Color so_c = hit.obj->get_color(pos, sd.dpdx, sd.dpdy);
 
-// Trace a ray
+  if (opt.light_samples > 0)
+  {
+    // Pick a fixed number of lights by estimated contribution,
+    // weighting each by 1 / (probability of picking it)
+    for (unsigned int i = 0; i < opt.light_samples; ++i)
+    {
+      float pdf;
+      const Light *l = light_tree.sample(pos, n, rng.next_float(), pdf);
+
+      if (l == NULL) continue;
+
+      Color l_c;
+      shade_light(*l, hit, pos, n, so_c, opt, rng, l_c);
+      c += l_c / (pdf * opt.light_samples);
+    }
+  }
+  else
+  {
+    // Lights which may reach any point
+    for (unsigned int i = 0; i < unbounded_lights.size(); ++i)
+      shade_light(*unbounded_lights[i], hit, pos, n, so_c, opt, rng, c);
+
+    // Only the bounded lights whose cutoff region contains the point
+    light_bvh.traverse(
+        [&pos](const AABB &b) { return b.contains(pos); },
+        [&](unsigned int i)
+        { shade_light(*bounded_lights[i], hit, pos, n, so_c, opt, rng, c); });
+  }
+
+  // Stochastic estimates are left unclamped, as clamping individual samples
+  // would bias the estimate; render() clamps the averaged pixel instead.
+  // HDR renders keep the full range.
+  if (opt.light_samples == 0 && !opt.hdr)
+    c.clamp();
+
+  return c;
+}
+
+// Trace a ray, evaluating every light
 /*!
  * \param r         Ray to trace for SceneObjects
  * \param max_depth Maximum remaining number of intersections allowed
@@ -46,47 +471,66 @@ void Scene::add_light(SPLight l)
  */
 Color Scene::trace_ray(const Ray &r, unsigned int max_depth) const
 {
-  // Color of ray initially black
-  // Color of the surface based on lighting
-  Color c = Color(0, 0, 0);
+  // Default settings never draw random numbers
+  Random rng;
+  return trace_ray(r, RenderOptions(), rng, max_depth);
+}
 
-  // Position of nearest intersection
-  float t;
-  // Pointer to closest object
-  SPSceneObject so = find_closest_object(r, t);
+// Trace a ray using given render settings
+/*!
+ * \param r         Ray to trace for SceneObjects
+ * \param opt       Render settings
+ * \param rng       Random number generator for stochastic sampling
+ * \param max_depth Maximum remaining number of intersections allowed
+ * \returns         the Color along the traced ray, or black if no intersection.
+ */
+Color Scene::trace_ray(const Ray &r, const RenderOptions &opt, Random &rng,
+                       unsigned int max_depth) const
+{
+  return trace_ray(r, Hit(), opt, rng, max_depth);
+}
 
-  // Return if no intersection
-  if (t == SceneObject::no_intersection)
-    return c;
+/*!
+ * \param r         Ray to trace for SceneObjects
+ * \param from      Hit on the surface the ray leaves (or no hit)
+ * \param opt       Render settings
+ * \param rng       Random number generator for stochastic sampling
+ * \param max_depth Maximum remaining number of intersections allowed
+ * \returns         the Color along the traced ray, or black if no intersection.
+ */
+Color Scene::trace_ray(const Ray &r, const Hit &from, const RenderOptions &opt,
+                       Random &rng, unsigned int max_depth) const
+{
+  // Nearest intersection
+  Hit hit = find_closest_hit(r, from);
+  const SceneObject *so = hit.obj;
+
+  // Color of ray is black if no intersection
+  if (so == NULL)
+    return Color(0, 0, 0);
 
+  if (opt.refine_hits)
+    hit.t = so->refine_intersection(r, hit.t, hit.prim);
 
   // Position of intersection point
-  Vector3F pos = r.get_point_at_t(t);
+  Vector3F pos = r.get_point_at_t(hit.t);
 
   // Surface normal of object at point
-  Vector3F n = so->get_normal(pos);
+  Vector3F n = so->get_normal(pos, hit.prim);
 
-  // Surface color of object
-  const Color &so_c = so->get_surface_color();
-
-  for (unsigned int i = 0; i < lights.size(); ++i)
-  {
-    // Normalized vector from intersection to light
-    Vector3F v_l = lights[i]->get_position() - pos;
-    v_l.normalize();
-
-    // Filter light color with surface color and angle of incidence
-    c += lights[i]->get_color() * so_c * fmax(dot(n, v_l), 0);
-  }
+  // Footprint of the ray on the surface
+  SurfaceDifferentials sd = hit_differentials(r, hit, pos, n);
 
-  c.clamp();
+  // Color of the surface based on lighting
+  Color c = shade(hit, pos, n, sd, opt, rng);
 
   // Surface reflectivity
   float so_r = so->get_surface_reflectivity();
   if (so_r != 0 && max_depth > 0)
   {
-    // Color based on reflection
-    Color reflect_c = trace_ray(r.reflect(pos, n), max_depth - 1);
+    // Color based on reflection (skipping the point reflected from)
+    Color reflect_c = trace_ray(r.reflect(pos, n, sd), hit, opt, rng,
+                                max_depth - 1);
 
     return so_r * reflect_c + ((1 - so_r) * c);
   }
@@ -94,65 +538,549 @@ Color Scene::trace_ray(const Ray &r, unsigned int max_depth) const
     return c;
 }
 
+/*!
+ * Tests a ray against one object of a built-in primitive type.
+ *
+ * The qualified calls to T's methods bypass virtual dispatch.  (The
+ * primitives define intersection() inline in their headers, so the call for
+ * every object but the one the ray leaves can also be inlined.)
+ *
+ * \param[in]  obj   Object of exact type T
+ * \param[in]  r     Ray to trace along
+ * \param[in]  from  Hit on the surface the ray leaves (or no hit)
+ * \param[out] prim  Primitive hit
+ * \returns          The t value of the nearest intersection,
+ *                   or SceneObject::no_intersection
+ */
+template <typename T>
+static inline float intersect_direct(const T *obj, const Ray &r,
+                                     const Hit &from, unsigned int &prim)
+{
+  if (obj != from.obj)
+  {
+    prim = 0;
+    return obj->T::intersection(r);
+  }
+
+  return obj->T::intersection_from(r, from.prim, prim);
+}
+
+/*!
+ * Tests a ray against each object in a homogeneous array, with a direct
+ * call for every object.
+ *
+ * \param[in]     objs     Objects of exact type T
+ * \param[in]     r        Ray to trace along
+ * \param[in]     from     Hit on the surface the ray leaves (or no hit)
+ * \param[in,out] hit      Nearest hit found so far
+ */
+template <typename T>
+static inline void find_closest_of_type(const vector<const T *> &objs,
+                                        const Ray &r, const Hit &from,
+                                        Hit &hit)
+{
+  for (unsigned int i = 0; i < objs.size(); ++i)
+  {
+    // Get intersection of Object & Ray
+    unsigned int prim;
+    float intxn = intersect_direct(objs[i], r, from, prim);
+
+    if (intxn != SceneObject::no_intersection && intxn < hit.t)
+    {
+      hit.t = intxn;
+      hit.obj = objs[i];
+      hit.prim = prim;
+    }
+  }
+}
+
+/*!
+ * \param[in]  obj   Any object
+ * \param[in]  r     Ray to trace along
+ * \param[in]  from  Hit on the surface the ray leaves (or no hit)
+ * \param[out] prim  Primitive hit
+ * \returns          The t value of the nearest intersection,
+ *                   or SceneObject::no_intersection
+ */
+static inline float intersect_virtual(const SceneObject *obj, const Ray &r,
+                                      const Hit &from, unsigned int &prim)
+{
+  return obj->intersection_from(
+      r, (obj == from.obj) ? from.prim : SceneObject::no_primitive, prim);
+}
+
+/*!
+ * \param[in]  p     A bounded object
+ * \param[in]  r     Ray to trace along
+ * \param[in]  from  Hit on the surface the ray leaves (or no hit)
+ * \param[out] prim  Primitive hit
+ * \returns          The t value of the nearest intersection,
+ *                   or SceneObject::no_intersection
+ */
+inline float Scene::intersect(const Primitive &p, const Ray &r,
+                              const Hit &from, unsigned int &prim)
+{
+  // Direct calls for the built-in primitives
+  switch (p.type)
+  {
+    case Primitive::SPHERE:
+      return intersect_direct(static_cast<const Sphere *>(p.obj), r, from,
+                              prim);
+    case Primitive::CYLINDER:
+      return intersect_direct(static_cast<const Cylinder *>(p.obj), r, from,
+                              prim);
+    default:
+      return intersect_virtual(p.obj, r, from, prim);
+  }
+}
+
 /*!
  * \param[in]  r  Ray to trace along
  * \param[out] t  Intersection point along ray, or SceneObject::no_intersection
- * \returns A shared pointer to the closest object, NULL if no intersection
+ * \returns A pointer to the closest object (owned by the Scene),
+ *          NULL if no intersection
  */
-SPSceneObject Scene::find_closest_object(const Ray &r, float &t) const
+const SceneObject * Scene::find_closest_object(const Ray &r, float &t) const
 {
-  // Pointer to closest object yet found
-  SPSceneObject closest = SPSceneObject();
-  // Position of nearest intersection (start from max float value)
-  t = FLT_MAX;
+  Hit hit = find_closest_hit(r);
 
-  for (unsigned int i = 0; i < objects.size(); ++i)
+  t = hit.t;
+  return hit.obj;
+}
+
+/*!
+ * A ray leaving a surface (a reflected ray, say) passes the hit it leaves,
+ * whose primitive then skips the ray's origin, rather than the ray being
+ * moved off the surface by a fixed distance.
+ *
+ * \param r     Ray to trace along
+ * \param from  Hit on the surface the ray leaves (or no hit)
+ * \returns     The nearest hit (with no object if there is none)
+ */
+Hit Scene::find_closest_hit(const Ray &r, const Hit &from) const
+{
+  // Nearest hit yet found (start from max float value)
+  Hit hit;
+  hit.t = FLT_MAX;
+
+  // Unbounded objects are tested against every ray
+  find_closest_of_type(planes, r, from, hit);
+
+  for (unsigned int i = 0; i < unbounded_objects.size(); ++i)
   {
-    // Get intersection of Object & Ray
-    float intxn = objects[i]->intersection(r);
+    unsigned int prim;
+    float intxn = intersect_virtual(unbounded_objects[i], r, from, prim);
 
-    if (intxn != SceneObject::no_intersection && intxn < t)
+    if (intxn != SceneObject::no_intersection && intxn < hit.t)
     {
-      t = intxn;
-      closest = objects[i];
+      hit.t = intxn;
+      hit.obj = unbounded_objects[i];
+      hit.prim = prim;
     }
   }
 
-  if (closest == NULL)
-    t = SceneObject::no_intersection;
+  // Bounded objects only when the ray reaches their boxes before the
+  // nearest intersection found so far
+  const Vector3F &orig = r.get_orig();
+  const Vector3F &dir = r.get_dir();
+  Vector3F inv_dir = {1 / dir[0], 1 / dir[1], 1 / dir[2]};
+
+  object_bvh.traverse(
+      [&](const AABB &b) { return b.intersects(orig, inv_dir, hit.t); },
+      [&](unsigned int i)
+      {
+        unsigned int prim;
+        float intxn = intersect(bounded_objects[i], r, from, prim);
+
+        if (intxn != SceneObject::no_intersection && intxn < hit.t)
+        {
+          hit.t = intxn;
+          hit.obj = bounded_objects[i].obj;
+          hit.prim = prim;
+        }
+      });
 
-  return closest;
+  if (hit.obj == NULL)
+    hit.t = SceneObject::no_intersection;
+
+  return hit;
 }
 
 /*!
+ * Stops at the first object found, rather than finding the closest.
+ *
+ * \param from      Start of the segment
+ * \param to        End of the segment
+ * \param from_hit  Hit on the surface at from (skipped), or no hit
+ * \returns         true if the segment intersects some object
+ */
+bool Scene::occluded(const Vector3F &from, const Vector3F &to,
+                     const Hit &from_hit) const
+{
+  Vector3F d = to - from;
+  float dist = d.norm();
+
+  if (dist == 0) return false;
+
+  Ray r(from, d);
+  unsigned int prim;
+
+  // Check if an intersection lies within the segment
+  auto blocks = [dist](float t)
+  {
+    return t != SceneObject::no_intersection && t < dist;
+  };
+
+  for (unsigned int i = 0; i < planes.size(); ++i)
+    if (blocks(intersect_direct(planes[i], r, from_hit, prim))) return true;
+
+  for (unsigned int i = 0; i < unbounded_objects.size(); ++i)
+  {
+    if (blocks(intersect_virtual(unbounded_objects[i], r, from_hit, prim)))
+      return true;
+  }
+
+  const Vector3F &dir = r.get_dir();
+  Vector3F inv_dir = {1 / dir[0], 1 / dir[1], 1 / dir[2]};
+  bool hit = false;
+
+  // (Once hit, every node test fails, ending the traversal)
+  object_bvh.traverse(
+      [&](const AABB &b) { return !hit && b.intersects(from, inv_dir, dist); },
+      [&](unsigned int i)
+      {
+        hit = hit
+              || blocks(intersect(bounded_objects[i], r, from_hit, prim));
+      });
+
+  return hit;
+}
+
+/*!
+ * Renders a single pass of opt.pixel_samples samples per pixel.
+ *
  * \param cam       Camera from which to render the scene
  * \param img_size  Pixel dimensions of image (Only square images supported)
  * \param os        Output stream to write image in ppm format
+ * \param opt       Render settings (optional)
+ */
+void Scene::render(const Camera &cam, int img_size, ostream &os,
+                   const RenderOptions &opt) const
+{
+  Framebuffer fb(img_size, img_size);
+  fb.set_tone_map(opt.tone_map);
+
+  render_pass(cam, fb, opt, 0);
+
+  fb.write_ppm(os);
+}
+
+/*!
+ * Adds opt.pixel_samples samples to every pixel of the framebuffer.
+ *
+ * The first sample of the first pass goes through the center of each pixel;
+ * all other samples are jittered within the pixel.  Each pass draws from
+ * different random streams, so successive passes refine the image.
+ *
+ * \param cam   Camera from which to render the scene
+ * \param fb    Framebuffer in which to accumulate samples
+ *              (Only square images supported)
+ * \param opt   Render settings
+ * \param pass  Index of this pass (0 for the first)
  */
-void Scene::render(const Camera &cam, int img_size, ostream &os) const
+void Scene::render_pass(const Camera &cam, Framebuffer &fb,
+                        const RenderOptions &opt, unsigned int pass) const
 {
-  // Maximum integer value for colors
-  static int MAX_C = 255;
+  render_rows(cam, fb, opt, pass * opt.pixel_samples, 0, fb.get_height());
+
+  fb.end_pass(opt.pixel_samples);
+}
 
-  // Header of a PPM file
-  os << "P3 " << img_size << ' ' << img_size << ' ' << MAX_C << endl;
+/*!
+ * Adds opt.pixel_samples samples to each pixel in rows [y_begin, y_end),
+ * numbered from first_sample, exactly as render_pass() would, but without
+ * ending the pass.  Bands of rows may therefore be rendered separately (even
+ * in different processes) and combined into the same image, and an image may
+ * be refined by rendering the samples following those it already has.
+ *
+ * Rows are shared out among opt.threads threads as each finishes its last.
+ * Every sample's random numbers are keyed by its pixel and sample number,
+ * so the image is identical whatever the number of threads.
+ * If opt.wavefront is set, the rows are rendered by render_rows_wavefront
+ * instead, and if opt.pixel_order is a curve, by render_tiles.  Both give
+ * the same image.
+ *
+ * \param cam           Camera from which to render the scene
+ * \param fb            Framebuffer in which to accumulate samples
+ *                      (Only square images supported)
+ * \param opt           Render settings
+ * \param first_sample  Number of the first sample to take for each pixel
+ * \param y_begin       First row to render
+ * \param y_end         One past the last row to render
+ */
+void Scene::render_rows(const Camera &cam, Framebuffer &fb,
+                        const RenderOptions &opt, unsigned int first_sample,
+                        int y_begin, int y_end) const
+{
+  assert(prepared);
+  assert(fb.get_width() == fb.get_height());
+  assert(0 <= y_begin && y_begin <= y_end && y_end <= fb.get_height());
 
-  // Iterate through pixels of image
-  for (int y = 0; y < img_size; ++y)
+  unsigned int threads = opt.threads;
+  if (threads == 0) threads = thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+
+  if (opt.wavefront)
+  {
+    render_rows_wavefront(cam, fb, opt, first_sample, y_begin, y_end,
+                          threads);
+    return;
+  }
+
+  if (opt.pixel_order != RenderOptions::ROW_MAJOR)
+  {
+    render_tiles(cam, fb, opt, first_sample, y_begin, y_end, threads);
+    return;
+  }
+
+  if (threads == 1 || y_end - y_begin <= 1)
+  {
+    for (int y = y_begin; y < y_end; ++y)
+      render_row(cam, fb, opt, first_sample, y);
+    return;
+  }
+
+  // Next row to render, shared by all threads
+  atomic<int> next_row(y_begin);
+
+  auto worker = [&]()
   {
-    for (int x = 0; x < img_size; ++x)
+    for (int y = next_row++; y < y_end; y = next_row++)
+      render_row(cam, fb, opt, first_sample, y);
+  };
+
+  vector<thread> pool;
+  for (unsigned int t = 0; t < threads; ++t)
+    pool.push_back(thread(worker));
+
+  for (unsigned int t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+/*!
+ * \param cam           Camera from which to render the scene
+ * \param fb            Framebuffer in which to accumulate samples
+ * \param opt           Render settings
+ * \param first_sample  Number of the first sample to take for each pixel
+ * \param y             Row to render
+ */
+void Scene::render_row(const Camera &cam, Framebuffer &fb,
+                       const RenderOptions &opt, unsigned int first_sample,
+                       int y) const
+{
+  for (int x = 0; x < fb.get_width(); ++x)
+    render_pixel(cam, fb, opt, first_sample, x, y);
+}
+
+/*!
+ * \param cam           Camera from which to render the scene
+ * \param fb            Framebuffer in which to accumulate samples
+ * \param opt           Render settings
+ * \param first_sample  Number of the first sample to take for each pixel
+ * \param x             Column of the pixel to render
+ * \param y             Row of the pixel to render
+ */
+void Scene::render_pixel(const Camera &cam, Framebuffer &fb,
+                         const RenderOptions &opt, unsigned int first_sample,
+                         int x, int y) const
+{
+  int img_size = fb.get_width();
+
+  for (unsigned int i = 0; i < opt.pixel_samples; ++i)
+  {
+    // Number of this sample among all the pixel's samples
+    uint32_t sample = first_sample + i;
+
+    // Random numbers keyed by pixel and sample
+    Random rng(opt.seed, uint64_t(y) * img_size + x, sample);
+
+    float dx = 0, dy = 0;
+    if (sample > 0)
     {
-      // Get ray and color for pixel
-      Ray r = cam.get_ray_for_pixel(x, y, img_size);
-      Color c = trace_ray(r);
-
-      // Output for each pixel
-      os << int(c.get_red() * MAX_C + 0.5) << ' ';
-      os << int(c.get_green() * MAX_C + 0.5) << ' ';
-      os << int(c.get_blue() * MAX_C + 0.5) << endl;
+      dx = rng.next_float() - 0.5f;
+      dy = rng.next_float() - 0.5f;
     }
+
+    // Get ray and color for sample
+    Ray r = cam.get_ray_for_pixel(x + dx, y + dy, img_size);
+    fb.add(x, y, trace_ray(r, opt, rng, opt.max_depth));
   }
 }
 
+/*!
+ * Lists the cells of a grid in the order a space-filling curve visits them.
+ * The curve covers the smallest power-of-2 square containing the grid, and
+ * skips the cells outside it.
+ *
+ * \param[in]  order   Curve to follow (MORTON or HILBERT)
+ * \param[in]  w       Width of the grid
+ * \param[in]  h       Height of the grid
+ * \param[out] cells   Index (y * w + x) of every cell, in curve order
+ */
+static void curve_order(RenderOptions::PixelOrder order, unsigned int w,
+                        unsigned int h, vector<uint32_t> &cells)
+{
+  unsigned int n = 1;
+  while (n < w || n < h) n *= 2;
+
+  // Pairs of (distance along curve, cell)
+  vector<pair<uint32_t, uint32_t> > keyed;
+
+  for (unsigned int y = 0; y < h; ++y)
+  {
+    for (unsigned int x = 0; x < w; ++x)
+    {
+      uint32_t d = (order == RenderOptions::HILBERT)
+                   ? hilbert_encode2(n, x, y) : morton_encode2(x, y);
+      keyed.push_back(make_pair(d, y * w + x));
+    }
+  }
+
+  sort(keyed.begin(), keyed.end());
 
+  cells.resize(keyed.size());
+  for (unsigned int i = 0; i < keyed.size(); ++i)
+    cells[i] = keyed[i].second;
+}
 
+/*!
+ * Renders the same samples as render_row() does for each row, but in
+ * PIXEL_TILE x PIXEL_TILE tiles rather than whole rows.  The tiles are
+ * taken along the curve given by opt.pixel_order, as are the pixels within
+ * each tile, so pixels rendered one after another (by one thread, or by
+ * threads working on neighbouring tiles) are close together in the image.
+ * Their rays then tend to visit the same hierarchy nodes & objects, which
+ * are more likely to still be in cache than for pixels along a long row.
+ *
+ * Tiles are shared out among the threads as each finishes its last.
+ *
+ * \param cam           Camera from which to render the scene
+ * \param fb            Framebuffer in which to accumulate samples
+ * \param opt           Render settings
+ * \param first_sample  Number of the first sample to take for each pixel
+ * \param y_begin       First row to render
+ * \param y_end         One past the last row to render
+ * \param threads       Number of threads to render with
+ */
+void Scene::render_tiles(const Camera &cam, Framebuffer &fb,
+                         const RenderOptions &opt, unsigned int first_sample,
+                         int y_begin, int y_end, unsigned int threads) const
+{
+  int img_size = fb.get_width();
+
+  int tiles_x = (img_size + PIXEL_TILE - 1) / PIXEL_TILE;
+  int tiles_y = (y_end - y_begin + PIXEL_TILE - 1) / PIXEL_TILE;
+
+  vector<uint32_t> tiles, pixels;
+  curve_order(opt.pixel_order, tiles_x, tiles_y, tiles);
+  curve_order(opt.pixel_order, PIXEL_TILE, PIXEL_TILE, pixels);
+
+  // Next tile to render, shared by all threads
+  atomic<unsigned int> next_tile(0);
+
+  auto worker = [&]()
+  {
+    for (unsigned int t = next_tile++; t < tiles.size(); t = next_tile++)
+    {
+      int x0 = (tiles[t] % tiles_x) * PIXEL_TILE;
+      int y0 = y_begin + (tiles[t] / tiles_x) * PIXEL_TILE;
+
+      for (unsigned int i = 0; i < pixels.size(); ++i)
+      {
+        int x = x0 + pixels[i] % PIXEL_TILE;
+        int y = y0 + pixels[i] / PIXEL_TILE;
+
+        if (x < img_size && y < y_end)
+          render_pixel(cam, fb, opt, first_sample, x, y);
+      }
+    }
+  };
+
+  if (threads == 1 || tiles.size() <= 1)
+  {
+    worker();
+    return;
+  }
+
+  vector<thread> pool;
+  for (unsigned int t = 0; t < threads; ++t)
+    pool.push_back(thread(worker));
+
+  for (unsigned int t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+/*!
+ * Renders passes of opt.pixel_samples samples per pixel into a framebuffer,
+ * until opt.max_samples samples per pixel have been taken or until another
+ * pass would be expected to exceed opt.time_budget seconds.
+ * At least one pass is always rendered.
+ *
+ * A snapshot of the image so far is written to snapshot_path after a pass
+ * once opt.snapshot_interval seconds have passed since the last snapshot
+ * (or after every pass, if the interval is 0).
+ *
+ * \param cam            Camera from which to render the scene
+ * \param img_size       Pixel dimensions of image (Only square images)
+ * \param os             Output stream to write final image in ppm format
+ * \param opt            Render settings
+ * \param snapshot_path  File to which to write snapshots (empty for none)
+ * \returns              Number of samples per pixel in the final image
+ */
+unsigned int Scene::render_progressive(const Camera &cam, int img_size,
+                                       ostream &os, const RenderOptions &opt,
+                                       const string &snapshot_path) const
+{
+  typedef chrono::steady_clock Clock;
+
+  Framebuffer fb(img_size, img_size);
+  fb.set_tone_map(opt.tone_map);
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point last_snapshot = start;
+
+  for (unsigned int pass = 0; ; ++pass)
+  {
+    Clock::time_point pass_start = Clock::now();
+
+    render_pass(cam, fb, opt, pass);
+
+    Clock::time_point now = Clock::now();
+    double elapsed = chrono::duration<double>(now - start).count();
+    double pass_time = chrono::duration<double>(now - pass_start).count();
+
+    // Check budgets
+    bool done = false;
+    if (opt.max_samples > 0
+        && fb.get_samples() + opt.pixel_samples > opt.max_samples)
+      done = true;
+    if (opt.time_budget > 0 && elapsed + pass_time > opt.time_budget)
+      done = true;
+
+    // Write a snapshot of intermediate images
+    if (!done && !snapshot_path.empty()
+        && chrono::duration<double>(now - last_snapshot).count()
+           >= opt.snapshot_interval)
+    {
+      if (!fb.write_ppm(snapshot_path))
+        cerr << "Warning: Couldn't write snapshot " << snapshot_path << endl;
+      last_snapshot = now;
+    }
+
+    if (done) break;
+  }
+
+  fb.write_ppm(os);
+
+  return fb.get_samples();
+}
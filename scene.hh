@@ -10,49 +10,226 @@
 #define _SCENE_HH__
 
 #include "sceneobject.hh"
+#include "sphere.hh"
+#include "plane.hh"
+#include "cylinder.hh"
 #include "light.hh"
+#include "bvh.hh"
+#include "lighttree.hh"
+#include "renderoptions.hh"
+#include "random.hh"
+#include "framebuffer.hh"
 #include "camera.hh"
 #include "ray.hh"
 #include <vector>
 #include <iostream>
+#include <string>
 
 //! A scene representation listing a combination of SceneObjects and Lights.
 /*!
  * Lights and SceneObjects passed in are dynamically allocated and referenced
  * using Boost::shared_ptrs.  The shared pointers manage deleting objects.
+ *
+ * The Scene owns an Arena, in which the scene readers allocate primitives
+ * and lights.  Objects allocated there are grouped by type and freed in bulk
+ * along with the Arena once the last pointer into it is released.
  */
 class Scene
 {
+  //! Arena in which the Scene's objects are allocated
+  SPArena arena;
+
+  //! Cache through which the Scene's image textures are sampled
+  SPTextureCache texture_cache;
+
   //! Vector of SceneObject pointers
   std::vector<SPSceneObject> objects;
 
+  /* Closed-set object store.
+   *
+   * Objects of the built-in primitive types are also listed in a homogeneous
+   * array for each type, so that find_closest_object can loop over each type
+   * with direct calls rather than a virtual call per object.
+   * Any other SceneObject subclass is listed under other_objects.
+   */
+  //! Spheres in the scene
+  std::vector<const Sphere *> spheres;
+  //! Planes in the scene
+  std::vector<const Plane *> planes;
+  //! Cylinders in the scene
+  std::vector<const Cylinder *> cylinders;
+  //! SceneObjects which are not one of the built-in primitive types
+  std::vector<const SceneObject *> other_objects;
+
+  /* Object culling structures (built by prepare()) */
+
+  //! A bounded object, tagged with its type for direct dispatch
+  struct Primitive
+  {
+    //! Type of the object
+    enum Type { SPHERE, CYLINDER, OTHER } type;
+    //! Pointer to the object
+    const SceneObject *obj;
+  };
+
+  //! Objects with bounds, indexed by object_bvh
+  std::vector<Primitive> bounded_objects;
+  //! Objects other than planes which have no bounds
+  std::vector<const SceneObject *> unbounded_objects;
+  //! Hierarchy over the bounds of bounded_objects
+  BVH object_bvh;
+
+  //! Intersect a ray with a bounded object, calling its type directly
+  static float intersect(const Primitive &p, const Ray &r, const Hit &from,
+                         unsigned int &prim);
+
+  //! Bounds of each of bounded_objects, at their current positions
+  void get_object_bounds(std::vector<AABB> &bounds) const;
+
   //! Vector of Light pointers
   std::vector<SPLight> lights;
 
+  /* Light culling structures (built by prepare()) */
+
+  //! Lights without a cutoff radius, which may light any point
+  std::vector<const Light *> unbounded_lights;
+  //! Lights with a cutoff radius, indexed by light_bvh
+  std::vector<const Light *> bounded_lights;
+  //! Hierarchy over the regions lit by bounded_lights
+  BVH light_bvh;
+
+  //! Tree over all lights, for stochastic light selection
+  LightTree light_tree;
+
+  //! Flag for whether prepare() has been called since the last change
+  bool prepared;
+
+  //! Render samples into one pixel of a framebuffer
+  void render_pixel(const Camera &cam, Framebuffer &fb,
+                    const RenderOptions &opt, unsigned int first_sample,
+                    int x, int y) const;
+
+  //! Render samples into one row of a framebuffer
+  void render_row(const Camera &cam, Framebuffer &fb,
+                  const RenderOptions &opt, unsigned int first_sample,
+                  int y) const;
+
+  //! Render samples into a band of rows, in tiles along a curve
+  void render_tiles(const Camera &cam, Framebuffer &fb,
+                    const RenderOptions &opt, unsigned int first_sample,
+                    int y_begin, int y_end, unsigned int threads) const;
+
+  //! Render samples into a band of rows in stages over queues of rays
+  void render_rows_wavefront(const Camera &cam, Framebuffer &fb,
+                             const RenderOptions &opt,
+                             unsigned int first_sample,
+                             int y_begin, int y_end,
+                             unsigned int threads) const;
+
+  //! Differentials of a ray's hit on a surface, including its normal's
+  static SurfaceDifferentials hit_differentials(const Ray &r, const Hit &hit,
+                                                const Vector3F &pos,
+                                                const Vector3F &n);
+
+  //! Light reflected directly from a surface point
+  Color shade(const Hit &hit, const Vector3F &pos, const Vector3F &n,
+              const SurfaceDifferentials &sd, const RenderOptions &opt,
+              Random &rng) const;
+
+  //! Add the contribution of one light to a surface point
+  void shade_light(const Light &l, const Hit &hit, const Vector3F &pos,
+                   const Vector3F &n, const Color &so_c,
+                   const RenderOptions &opt, Random &rng, Color &c) const;
+
+  //! Add the contribution of an area light, with soft shadows
+  void shade_area_light(const Light &l, const Hit &hit, const Vector3F &pos,
+                        const Vector3F &n, const Color &so_c,
+                        const RenderOptions &opt, Random &rng,
+                        Color &c) const;
+
+  //! Shading from a point on an area light, if its path is unblocked
+  float sample_area_light(const Light &l, const Hit &hit,
+                          const Vector3F &pos, const Vector3F &n, float s,
+                          float t) const;
+
+  //! Trace a ray leaving a surface, using given render settings
+  Color trace_ray(const Ray &r, const Hit &from, const RenderOptions &opt,
+                  Random &rng, unsigned int max_depth) const;
+
   public:
   // === Constructors/Destructors & methods
 
   //! Default constructor creates an empty scene
   Scene();
 
-  //! Add a SceneObject (allocated on heap)
+  //! Accessor for the Arena in which to allocate objects for this Scene
+  Arena & get_arena() const;
+
+  //! Accessor for the cache in which to open image textures for this Scene
+  const SPTextureCache & get_texture_cache() const;
+
+  //! Add a SceneObject (allocated on heap or in the Scene's Arena)
   void add_object(SPSceneObject so);
 
-  //! Add a Light (allocated on heap)
+  //! Add a Light (allocated on heap or in the Scene's Arena)
   void add_light(SPLight l);
 
+  //! Build acceleration structures (Must be called before rendering)
+  void prepare();
+
+  //! Check if the scene has been prepared since it was last changed
+  bool is_prepared() const;
 
-  //! Trace a ray
+  //! Add every object and light to a hash
+  void hash(Hash &h) const;
+
+  //! Update acceleration structures after objects have moved
+  bool refit(unsigned int threads = 1);
+
+
+  //! Trace a ray, evaluating every light
   Color trace_ray(const Ray &r, unsigned int max_depth = 6) const;
 
+  //! Trace a ray using given render settings
+  Color trace_ray(const Ray &r, const RenderOptions &opt, Random &rng,
+                  unsigned int max_depth) const;
+
   //! Identify the closest object along a ray
-  SPSceneObject find_closest_object(const Ray &r, float &t) const;
+  const SceneObject * find_closest_object(const Ray &r, float &t) const;
+
+  //! Identify the closest hit along a ray, skipping the surface it leaves
+  Hit find_closest_hit(const Ray &r, const Hit &from = Hit()) const;
+
+  //! Check if any object lies between two points
+  bool occluded(const Vector3F &from, const Vector3F &to,
+                const Hit &from_hit = Hit()) const;
 
   //! Render this Scene using a provided Camera and given image size
-  void render(const Camera &cam, int img_size, std::ostream &os) const;
+  void render(const Camera &cam, int img_size, std::ostream &os,
+              const RenderOptions &opt = RenderOptions()) const;
+
+  //! Render one pass of samples into a framebuffer
+  void render_pass(const Camera &cam, Framebuffer &fb,
+                   const RenderOptions &opt, unsigned int pass) const;
+
+  //! Render samples into a band of rows of a framebuffer
+  void render_rows(const Camera &cam, Framebuffer &fb,
+                   const RenderOptions &opt, unsigned int first_sample,
+                   int y_begin, int y_end) const;
+
+  //! Render progressively, until a sample or time budget is reached
+  unsigned int render_progressive(const Camera &cam, int img_size,
+                                  std::ostream &os, const RenderOptions &opt,
+                                  const std::string &snapshot_path) const;
 };
 
+// === Inline function definitions
 
-
+inline Arena & Scene::get_arena() const { return *arena; }
+inline const SPTextureCache & Scene::get_texture_cache() const
+{
+  return texture_cache;
+}
+inline bool Scene::is_prepared() const { return prepared; }
 
 #endif
@@ -4,15 +4,24 @@
  */
 
 #include "sceneobject.hh"
+#include <typeinfo>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
 
 // Return value for no intersection
 const float SceneObject::no_intersection = -1;
 
+// Primitive index for a ray which doesn't start on the object
+const unsigned int SceneObject::no_primitive = ~0u;
+
 // Default constructor
 // Initializes surface color to gray (0.5, 0.5, 0.5)
 SceneObject::SceneObject()
   : surface_c(0.5, 0.5, 0.5)
   , surface_r(0)
+  , texture()
 { }
 
 // Constructor specifying surface color
@@ -23,6 +32,7 @@ SceneObject::SceneObject()
 SceneObject::SceneObject(const Color &c, float r)
   : surface_c(c)
   , surface_r(r)
+  , texture()
 { }
 
 // Virtual Destructor
@@ -31,8 +41,101 @@ SceneObject::~SceneObject()
 
 // Get the color at a point p
 // p is assumed to be a point on the surface of the SceneObject
-// By default, returns the general surface color
-Color SceneObject::get_color(const Vector3F &p) const
+// By default, returns the texture's color if there is one, and the general
+// surface color otherwise
+Color SceneObject::get_color(const Vector3F &p, const Vector3F &dpdx,
+                             const Vector3F &dpdy) const
+{
+  return texture ? texture->get_color(p, dpdx, dpdy) : surface_c;
+}
+
+// Get the surface normal at a point p on a known primitive
+// By default, the primitive is ignored
+Vector3F SceneObject::get_normal(const Vector3F &p, unsigned int prim) const
+{
+  return get_normal(p);
+}
+
+// Get the change in the surface normal over a small step along the surface
+// By default, surfaces are flat
+Vector3F SceneObject::get_normal_differential(const Vector3F &p,
+                                              const Vector3F &dp) const
+{
+  return Vector3F();
+}
+
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void SceneObject::hash(Hash &h) const
+{
+  h.add(string(type_tag()));
+  h.add(surface_c).add(surface_r);
+
+  if (texture) texture->hash(h);
+}
+
+// Name of the object's type, for hashing
+// (See sceneobject.hh)
+const char *SceneObject::type_tag() const
+{
+  return typeid(*this).name();
+}
+
+// Identify first intersection with a ray, and the primitive hit
+// (See sceneobject.hh)
+float SceneObject::intersection_from(const Ray &r, unsigned int from,
+                                     unsigned int &prim) const
+{
+  prim = 0;
+
+  if (from == no_primitive)
+    return intersection(r);
+
+  // Start the ray past any hit on the surface at its origin
+  const Vector3F &o = r.get_orig();
+  float scale = max(fabs(o[0]), max(fabs(o[1]), fabs(o[2])));
+  float eps = surface_epsilon(scale) / r.get_dir().norm();
+
+  float t = intersection(Ray(r.get_point_at_t(eps), r.get_dir(), false));
+
+  return (t == no_intersection) ? t : t + eps;
+}
+
+// Refine the t value of a hit in double precision
+// By default, hits are unchanged
+float SceneObject::refine_intersection(const Ray &r, float t,
+                                       unsigned int prim) const
+{
+  return t;
+}
+
+/*!
+ * The roots are found without cancellation between b and the square root
+ * of the discriminant, so each is accurate to double precision.
+ *
+ * \param a  Coefficient of t^2 (positive)
+ * \param b  Half the coefficient of t
+ * \param c  Constant term
+ * \param t  Approximate root, such as a hit found in single precision
+ * \returns  The positive root nearest t, or t if there is none
+ */
+float SceneObject::nearest_root(double a, double b, double c, float t)
+{
+  double disc = b * b - a * c;
+  if (disc < 0) return t;
+
+  double q = -(b + copysign(sqrt(disc), b));
+  if (q == 0) return t;
+
+  double t1 = q / a, t2 = c / q;
+  double root = (fabs(t1 - t) < fabs(t2 - t)) ? t1 : t2;
+
+  return (root > 0) ? float(root) : t;
+}
+
+// Get a bounding box for the object
+// By default, objects are unbounded
+bool SceneObject::get_bounds(AABB &b) const
 {
-  return surface_c;
+  return false;
 }
@@ -9,6 +9,10 @@
 #include "vector.hh"
 #include "color.hh"
 #include "ray.hh"
+#include "arena.hh"
+#include "aabb.hh"
+#include "hash.hh"
+#include "texture.hh"
 #include <boost/shared_ptr.hpp>
 
 //! An abstract base class representing an object in a scene
@@ -24,12 +28,18 @@ class SceneObject
    */
   float surface_r;
 
+  //! Texture replacing the surface color (NULL if none)
+  SPTexture texture;
+
   public:
   // === Constants
 
   //! Return value for no intersection
   static const float no_intersection;
 
+  //! Primitive index for a ray which doesn't start on the object
+  static const unsigned int no_primitive;
+
 
   // === Constructors & methods
 
@@ -50,6 +60,10 @@ class SceneObject
   void set_surface_color(const Color &c);
   //! Mutator to set surface reflectivity
   void set_surface_reflectivity(float r);
+  //! Accessor for texture
+  const SPTexture & get_texture() const;
+  //! Mutator to set texture (NULL for none)
+  void set_texture(const SPTexture &t);
 
   //! Identify first intersection with a ray
   /*!
@@ -58,6 +72,38 @@ class SceneObject
    */
   virtual float intersection(const Ray &r) const = 0;
 
+  //! Identify first intersection with a ray, and the primitive hit
+  /*!
+   * A ray leaving a point on the object's surface (such as a reflected or
+   * shadow ray) passes the primitive it leaves, so that the hit at its
+   * origin is skipped.  By default, objects have one primitive (0), and
+   * intersections within surface_epsilon() of such a ray's origin are
+   * skipped; subclasses which know their shape skip it exactly instead.
+   *
+   * \param[in]  r     Ray to intersect
+   * \param[in]  from  Primitive of this object on which the ray starts,
+   *                   or no_primitive
+   * \param[out] prim  Primitive hit (if any)
+   * \returns          The t value of the nearest intersection
+   *                   or SceneObject::no_intersection if there was none.
+   */
+  virtual float intersection_from(const Ray &r, unsigned int from,
+                                  unsigned int &prim) const;
+
+  //! Refine the t value of a hit in double precision
+  /*!
+   * Called for the closest hit only (when enabled by
+   * RenderOptions::refine_hits), so finding hits stays in single precision.
+   * By default, the hit is returned unchanged.
+   *
+   * \param r     Ray which hit the object
+   * \param t     The t value of the hit, from intersection_from()
+   * \param prim  Primitive hit
+   * \returns     The refined t value
+   */
+  virtual float refine_intersection(const Ray &r, float t,
+                                    unsigned int prim) const;
+
   //! Get the surface normal at a point p
   /*!
    * \param p A point assumed to be on the object's surface
@@ -65,20 +111,97 @@ class SceneObject
    */
   virtual Vector3F get_normal(const Vector3F &p) const = 0;
 
+  //! Get the surface normal at a point p on a known primitive
+  /*!
+   * Lets objects made of many primitives skip finding the one p lies on.
+   * By default, the primitive is ignored.
+   * \param p     A point assumed to be on the object's surface
+   * \param prim  Primitive hit at p, from intersection_from()
+   * \returns     A normalized direction vector for the surface normal
+   */
+  virtual Vector3F get_normal(const Vector3F &p, unsigned int prim) const;
+
+  //! Get the change in the surface normal over a small step along the surface
+  /*!
+   * Used to spread the differentials of reflected rays where the surface
+   * curves.  By default, surfaces are taken as flat, and the normal doesn't
+   * change.
+   * \param p   A point assumed to be on the object's surface
+   * \param dp  A small step from p, along the surface
+   * \returns   The change in the (normalized) surface normal over dp
+   */
+  virtual Vector3F get_normal_differential(const Vector3F &p,
+                                           const Vector3F &dp) const;
+
   //! Get the surface color at a point p
   /*!
-   * By default, returns the object's surface color.
-   * \param p A point assumed to be on the object's surface
-   * \returns The color of the surface point
+   * By default, returns the object's texture at p if it has one (filtered
+   * over the area the differentials of p span), and its surface color
+   * otherwise.
+   * \param p     A point assumed to be on the object's surface
+   * \param dpdx  Change in p per pixel along x (zero for a point sample)
+   * \param dpdy  Change in p per pixel along y (zero for a point sample)
+   * \returns     The color of the surface point
+   */
+  virtual Color get_color(const Vector3F &p, const Vector3F &dpdx,
+                          const Vector3F &dpdy) const;
+
+  //! Get a bounding box for the object
+  /*!
+   * By default, objects are unbounded.
+   * \param[out] b  Bounding box of the object (if bounded)
+   * \returns       true if the object is bounded
+   */
+  virtual bool get_bounds(AABB &b) const;
+
+  //! Add everything affecting the object's appearance to a hash
+  /*!
+   * Adds the object's type, surface and texture (if any).  Subclasses should extend this
+   * with their geometry and any other state they add.
+   * \param h Hash to which to add the object
    */
-  virtual Color get_color(const Vector3F &p) const;
+  virtual void hash(Hash &h) const;
+
+  //! Name of the object's type, for hashing
+  /*!
+   * By default, the compiler's name for the class (its typeid name), which
+   * differs between compilers.  Subclasses should return a fixed name
+   * instead, so hashes (and render cache keys) are the same whichever
+   * compiler built the renderer.
+   * \returns Name unique to the object's class
+   */
+  virtual const char *type_tag() const;
+
+  //! Distance within which a hit counts as the surface a ray leaves
+  static float surface_epsilon(float scale);
+
+  protected:
+  //! The root of a t^2 + 2 b t + c nearest to t, in double precision
+  static float nearest_root(double a, double b, double c, float t);
+};
+
+//! The nearest hit of a ray on the objects of a Scene
+struct Hit
+{
+  //! Distance along the ray (or SceneObject::no_intersection)
+  float t;
+  //! Object hit (NULL if none)
+  const SceneObject *obj;
+  //! Primitive of the object hit (such as a triangle of a mesh)
+  unsigned int prim;
+
+  //! Default constructor gives no hit
+  Hit();
 };
 
 //! Boost Shared Pointer to SceneObject
 typedef boost::shared_ptr<SceneObject> SPSceneObject;
 
 //! Function type which reads an istream and produces a scene object
-typedef SPSceneObject (*SceneObjectReader)(std::istream &is);
+/*!
+ * The object is constructed within the provided Arena.
+ */
+typedef SPSceneObject (*SceneObjectReader)(std::istream &is, Arena &arena);
 
 // === Inline function definitions
 
@@ -100,4 +223,33 @@ inline void SceneObject::set_surface_reflectivity(float r)
   surface_r = r;
 }
 
+// Accessor & Mutator for texture
+inline const SPTexture & SceneObject::get_texture() const
+{
+  return texture;
+}
+inline void SceneObject::set_texture(const SPTexture &t)
+{
+  texture = t;
+}
+
+/*!
+ * Hits are computed in single precision, so a ray leaving a surface may hit
+ * it again within a few rounding errors of its origin, in proportion to the
+ * size of the coordinates involved.
+ *
+ * \param scale  Magnitude of the coordinates involved (such as a radius)
+ * \returns      Distance below which a hit is taken as the origin's surface
+ */
+inline float SceneObject::surface_epsilon(float scale)
+{
+  return scale * (1.f / (1 << 16));
+}
+
+inline Hit::Hit()
+  : t(SceneObject::no_intersection)
+  , obj(NULL)
+  , prim(SceneObject::no_primitive)
+{ }
+
 #endif
@@ -0,0 +1,334 @@
+/* scenereader.cc
+ *
+ * Reading of scene descriptions
+ */
+
+#include "scenereader.hh"
+#include "instance.hh"
+#include "csg.hh"
+#include "texture.hh"
+#include "rebase.hh"
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+//! A texture named by a texture line
+struct NamedTexture
+{
+  //! The texture read without the origin, for objects which evaluate it in
+  //! the unrebased space of their geometry
+  SPTexture own;
+  //! The texture read relative to the origin, for objects placed in the
+  //! rebased scene (the same as own unless rebasing)
+  SPTexture rebased;
+};
+
+/*!
+ * Reads an object of any type (except lights) from the given input stream
+ *
+ * \param[in]  type       Type of object to read
+ * \param[in]  is         An input stream from which to read the object
+ * \param[in]  readFuncs  A mapping of names to a function that takes an
+ *                        istream and returns SPSceneObjects
+ * \param[in]  defined    Objects named by define lines
+ * \param[in]  textures   Textures named by texture lines
+ * \param[in]  arena      Arena in which to allocate the object
+ * \returns               The object, or NULL if reading failed
+ */
+static SPSceneObject read_object(const string &type, istream &is,
+                                 map<string, SceneObjectReader> &readFuncs,
+                                 const map<string, SPSceneObject> &defined,
+                                 const map<string, NamedTexture> &textures,
+                                 Arena &arena)
+{
+  if (readFuncs.find(type) != readFuncs.end())
+    return readFuncs[type](is, arena);
+
+  if (type == "textured")
+  {
+    string name, obj_type;
+    is >> name >> obj_type;
+
+    map<string, NamedTexture>::const_iterator t = textures.find(name);
+    if (!is || t == textures.end()) return SPSceneObject();
+
+    SPSceneObject obj = read_object(obj_type, is, readFuncs, defined,
+                                    textures, arena);
+
+    // Instances & csg evaluate textures in the space of their geometry,
+    // which isn't rebased; other objects read with the origin are
+    bool rebased = get_read_origin(is) != NULL
+                   && obj_type != "instance" && obj_type != "csg";
+
+    if (obj != NULL)
+      obj->set_texture(rebased ? t->second.rebased : t->second.own);
+
+    return obj;
+  }
+
+  if (type == "instance")
+  {
+    string name;
+    is >> name;
+
+    map<string, SPSceneObject>::const_iterator g = defined.find(name);
+    if (g == defined.end()) return SPSceneObject();
+
+    return read_Instance(is, g->second, arena);
+  }
+
+  if (type == "csg")
+  {
+    SPSceneObject csg = read_CSG(is, defined, arena);
+
+    // The operands are defined objects, which are read without the origin,
+    // so the result is moved instead (keeping float precision only as far
+    // as the offset allows)
+    const Vector3D *origin = get_read_origin(is);
+    if (csg != NULL && origin != NULL)
+    {
+      Vector3F offset(-*origin);
+      csg = arena.create<Instance>(csg, Transform::translate(offset));
+    }
+
+    return csg;
+  }
+
+  return SPSceneObject();
+}
+
+/*!
+ * Reads a scene from the given input stream
+ *
+ * Each line of input should describe a different component of the scene.
+ * A line starts with the type of component being described, followed by
+ * the relevant construction for that component.  These are as follows:
+ *
+ * - camera (position vector) (look at vector) (up vector)
+ * - light (position vector) [color] [cutoff radius]
+ * - sphere_light (center position vector) radius [color] [cutoff radius]
+ * - rect_light (center position vector) (edge vector) (edge vector) [color]
+ *   [cutoff radius]
+ * - plane  distance_from_orign (normal vector) [color]
+ * - sphere (center position vector) radius [color]
+ * - mesh file.obj [color] reflectivity
+ * - define name object_type object_description
+ * - instance name (position vector) (rotation axis vector) degrees
+ *   (scale vector) [color] reflectivity
+ * - csg union|intersection|difference name name [color] reflectivity
+ * - texture name checker|noise (origin position vector) size [color] [color]
+ * - texture name image file.ppm (origin position vector) (edge vector)
+ *   (edge vector)
+ * - textured name object_type object_description
+ *
+ * Vectors are in the format "(x y z)"
+ * and Colors are in the format "[r g b]"
+ *
+ * A define line reads an object of any type as usual, but instead of adding
+ * it to the scene, names it for later lines to use: as geometry for instance
+ * lines to place (every instance sharing the geometry; see Instance), or as
+ * an operand of csg lines (which must be a sphere, cylinder or csg).
+ *
+ * A texture line names a texture (see texture.hh) for textured lines, which
+ * read an object of any type as usual, and give it the texture in place of
+ * its surface color.  Textures are evaluated in the space of the object
+ * using them, so an instance of textured geometry carries its texture with
+ * it.  Image textures are opened in the Scene's TextureCache.
+ *
+ * If multiple Camera lines are provided, only the last is used.
+ * At least one camera must be defined.
+ *
+ * Empty lines are ignored, as are comment lines which begin with "#".
+ * The pound sign must be the first character on the line.
+ *
+ * When rebasing, every position (except in define lines, which are in the
+ * space of their instances) is read relative to the camera's position, in
+ * double precision, so the camera is at the origin and the scene's float
+ * coordinates are as precise as they can be near it (see rebase.hh).
+ * Texture origins move with the objects placed directly in the scene, but
+ * not with instances & csg, whose textures stay in their geometry's space.
+ *
+ * \param[in]  is         An input stream to read.  Reading stops at EOF.
+ * \param[in]  readFuncs  A mapping of names to a function that takes an
+ *                        istream and returns SPSceneObjects
+ * \param[in]  lightFuncs A mapping of names to a function that takes an
+ *                        istream and returns SPLights
+ * \param[out] scn        Scene containing described objects
+ * \param[out] cam        Camera read from scene
+ * \param[in]  rebase     Whether to read positions relative to the camera's
+ * \param[out] origin     Position subtracted from every position read
+ *                        (zero unless rebasing)
+ * \returns               true if input reaches EOF successfully.
+ */
+bool read_Scene(istream &is, map<string, SceneObjectReader> readFuncs,
+           map<string, LightReader> lightFuncs, Scene &scn, Camera &cam,
+           bool rebase, Vector3D &origin)
+{
+  // Create an empty scene
+  scn = Scene();
+
+  // Create a blank camera
+  cam = Camera();
+
+  // Success flag (continue reading lines after error, to identify all errors)
+  bool success = true;
+
+  // Geometry named by define lines
+  map<string, SPSceneObject> defined;
+
+  // Textures named by texture lines
+  map<string, NamedTexture> textures;
+
+  // Every line of input (the camera may come after the objects)
+  vector<string> lines;
+  string line;
+  for (getline(is, line); is.good(); getline(is, line))
+    lines.push_back(line);
+
+  // Origin: the position of the last camera, read in double precision
+  origin = Vector3D();
+  for (unsigned int i = 0; rebase && i < lines.size(); ++i)
+  {
+    istringstream iss(lines[i]);
+    string type;
+    Vector3D p;
+
+    if (iss >> type >> p && type == "camera")
+      origin = p;
+  }
+
+  // Loop through lines in input
+  for (unsigned int ln = 1; ln <= lines.size(); ++ln)
+  {
+    line = lines[ln - 1];
+
+    // Check for comment line
+    if (line.length() == 0 || line[0] == '#') continue;
+
+    // Create a string stream to read the line
+    istringstream iss(line);
+    if (rebase) set_read_origin(iss, &origin);
+
+    // Read in the next component type
+    string type;
+    iss >> type;
+
+    // Check for empty line
+    if (!iss) continue;
+
+    if (readFuncs.find(type) != readFuncs.end() || type == "instance"
+        || type == "csg" || type == "textured")
+    {
+      // New object to read
+      SPSceneObject obj;
+
+      // Read object using appropriate function
+      obj = read_object(type, iss, readFuncs, defined, textures,
+                        scn.get_arena());
+
+      if (obj == NULL)
+      {
+        success = false;
+        cerr << "Error: Couldn't read " << type << " on line " << ln << endl;
+      }
+      else
+      {
+        scn.add_object(obj);
+      }
+    }
+    else if (type == "define")
+    {
+      // Named object to read (in its own space)
+      string name, obj_type;
+      iss >> name >> obj_type;
+      set_read_origin(iss, NULL);
+
+      SPSceneObject obj;
+      if (iss)
+        obj = read_object(obj_type, iss, readFuncs, defined, textures,
+                          scn.get_arena());
+
+      if (obj == NULL)
+      {
+        success = false;
+        cerr << "Error: Couldn't read define on line " << ln << endl;
+      }
+      else
+      {
+        defined[name] = obj;
+      }
+    }
+    else if (type == "texture")
+    {
+      // Named texture to read, in its own space and (if rebasing)
+      // relative to the origin
+      string name;
+      iss >> name;
+      streampos start = iss.tellg();
+
+      NamedTexture t;
+      if (iss)
+      {
+        set_read_origin(iss, NULL);
+        t.own = read_Texture(iss, scn.get_arena(), scn.get_texture_cache());
+        t.rebased = t.own;
+      }
+
+      if (t.own != NULL && rebase)
+      {
+        iss.seekg(start);
+        set_read_origin(iss, &origin);
+        t.rebased = read_Texture(iss, scn.get_arena(),
+                                 scn.get_texture_cache());
+      }
+
+      if (t.rebased == NULL)
+      {
+        success = false;
+        cerr << "Error: Couldn't read texture on line " << ln << endl;
+      }
+      else
+      {
+        textures[name] = t;
+      }
+    }
+    else if (lightFuncs.find(type) != lightFuncs.end())
+    {
+      // New light to read
+      SPLight l;
+
+      l = lightFuncs[type](iss, scn.get_arena());
+
+      if (l == NULL)
+      {
+        success = false;
+        cerr << "Error: Couldn't read " << type << " on line " << ln << endl;
+      }
+      else
+      {
+        scn.add_light(l);
+      }
+    }
+    else if (type == "camera")
+    {
+      cam = read_Camera(iss);
+
+      if (!cam.valid())
+      {
+        success = false;
+        cerr << "Error: Couldn't read camera (or invalid camera) on line ";
+        cerr << ln << endl;
+      }
+    }
+    else
+    {
+      success = false;
+      cerr << "Error: Unrecognized type \"" << type << "\" on line " << ln;
+      cerr << endl;
+    }
+
+  }
+
+  return success;
+}
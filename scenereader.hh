@@ -0,0 +1,23 @@
+/* scenereader.hh
+ *
+ * Reading of scene descriptions
+ */
+
+#ifndef _SCENEREADER_HH__
+#define _SCENEREADER_HH__
+
+#include "scene.hh"
+#include "camera.hh"
+#include "sceneobject.hh"
+#include "light.hh"
+#include <iostream>
+#include <string>
+#include <map>
+
+//! Read a Scene & Camera from a scene description
+bool read_Scene(std::istream &is,
+                std::map<std::string, SceneObjectReader> readFuncs,
+                std::map<std::string, LightReader> lightFuncs,
+                Scene &scn, Camera &cam, bool rebase, Vector3D &origin);
+
+#endif
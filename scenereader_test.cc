@@ -0,0 +1,57 @@
+/* scenereader_test.cc
+ *
+ * gtest Unit Test Suite for reading scene descriptions
+ */
+
+#include "scenereader.hh"
+#include "sphere.hh"
+#include "testscene.hh"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace std;
+using namespace testing;
+
+//! Read a scene description, rendering it as a PPM image
+static string read_and_render(const string &desc, bool rebase)
+{
+  map<string, SceneObjectReader> readFuncs;
+  readFuncs["sphere"] = read_Sphere;
+
+  map<string, LightReader> lightFuncs;
+  lightFuncs["light"] = read_Light;
+
+  istringstream iss(desc);
+  Scene scn;
+  Camera cam;
+  Vector3D origin;
+  EXPECT_TRUE(read_Scene(iss, readFuncs, lightFuncs, scn, cam, rebase,
+                         origin));
+  scn.prepare();
+
+  return render_ppm(scn, cam, 48);
+}
+
+// Rebasing leaves textures on instances, csg & spheres where they were
+TEST(ReadSceneTest, RebasedTextures)
+{
+  string desc =
+      "camera (0 0 5) (0 0 0) (0 1 0)\n"
+      "light (-10 10 5) [1 1 1]\n"
+      "texture chk checker (0.05 0.05 0.05) 0.3 [1 0 0] [0 0 1]\n"
+      "define s sphere (0 0 0) 1 [1 1 1] 0\n"
+      "define c sphere (0.5 0 0) 1 [1 1 1] 0\n"
+      "textured chk instance s (-1.5 1 0) (0 1 0) 0 (1 1 1) [1 1 1] 0\n"
+      "textured chk csg intersection s c [1 1 1] 0\n"
+      "textured chk sphere (1.5 -1 0) 0.8 [1 1 1] 0\n";
+
+  EXPECT_EQ(read_and_render(desc, false), read_and_render(desc, true));
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+/* session.cc
+ *
+ * A long-lived rendering of a Scene, re-rendered as the Camera changes
+ */
+
+#include "session.hh"
+#include <cassert>
+
+using namespace std;
+
+/*!
+ * The session starts with an invalid Camera; one must be set before
+ * rendering.
+ *
+ * \param scene     Prepared Scene to render (must outlive the session)
+ * \param img_size  Pixel dimensions of image (Only square images supported)
+ * \param opt       Render settings (optional)
+ */
+RenderSession::RenderSession(const Scene &scene, int img_size,
+                             const RenderOptions &opt)
+  : scene(scene)
+  , camera()
+  , opt(opt)
+  , fb(img_size, img_size)
+  , pass(0)
+{
+  assert(scene.is_prepared());
+  fb.set_tone_map(opt.tone_map);
+}
+
+/*!
+ * \param cam Camera for the new view
+ */
+void RenderSession::set_camera(const Camera &cam)
+{
+  camera = cam;
+  restart();
+}
+
+/*!
+ * \param opt New render settings
+ */
+void RenderSession::set_options(const RenderOptions &opt)
+{
+  this->opt = opt;
+  fb.set_tone_map(opt.tone_map);
+  restart();
+}
+
+/*!
+ * Reallocates the framebuffer only if the size changes.
+ *
+ * \param img_size  Pixel dimensions of image (Only square images supported)
+ */
+void RenderSession::set_image_size(int img_size)
+{
+  if (img_size != fb.get_width())
+    fb.resize(img_size, img_size);
+
+  restart();
+}
+
+// Discard accumulated samples
+void RenderSession::restart()
+{
+  fb.clear();
+  pass = 0;
+}
+
+/*!
+ * \returns The image rendered so far, including the new pass
+ */
+const Framebuffer & RenderSession::render()
+{
+  scene.render_pass(camera, fb, opt, pass);
+  ++pass;
+
+  return fb;
+}
@@ -0,0 +1,86 @@
+/* session.hh
+ *
+ * A long-lived rendering of a Scene, re-rendered as the Camera changes
+ */
+
+#ifndef _SESSION_HH__
+#define _SESSION_HH__
+
+#include "scene.hh"
+#include "camera.hh"
+#include "framebuffer.hh"
+#include "renderoptions.hh"
+#include <iostream>
+
+//! A long-lived rendering of a prepared Scene
+/*!
+ * A session keeps a prepared Scene (with its acceleration structures) and an
+ * allocated framebuffer, so that changing the Camera only retraces pixels:
+ * nothing is parsed, built or allocated.
+ *
+ * Each call to render() adds a pass of samples to the framebuffer, so
+ * repeated calls with an unchanged camera refine the image progressively.
+ * Changing the camera discards the accumulated samples.
+ *
+ * The session refers to the Scene it renders, which must outlive it.
+ */
+class RenderSession
+{
+  //! Scene being rendered
+  const Scene &scene;
+  //! Camera for the current view
+  Camera camera;
+  //! Render settings
+  RenderOptions opt;
+  //! Accumulated image for the current view
+  Framebuffer fb;
+  //! Number of passes accumulated in fb
+  unsigned int pass;
+
+  public:
+  // === Constructors & methods
+
+  //! Construct a session rendering a prepared Scene
+  RenderSession(const Scene &scene, int img_size,
+                const RenderOptions &opt = RenderOptions());
+
+  // Accessors
+  //! Accessor for the Scene being rendered
+  const Scene & get_scene() const;
+  //! Accessor for the current Camera
+  const Camera & get_camera() const;
+  //! Accessor for the render settings
+  const RenderOptions & get_options() const;
+  //! Accessor for the image rendered so far
+  const Framebuffer & get_framebuffer() const;
+
+  //! Change the Camera, discarding accumulated samples
+  void set_camera(const Camera &cam);
+
+  //! Change the render settings, discarding accumulated samples
+  void set_options(const RenderOptions &opt);
+
+  //! Change the image size, discarding accumulated samples
+  void set_image_size(int img_size);
+
+  //! Discard accumulated samples
+  void restart();
+
+  //! Render another pass of samples for the current view
+  const Framebuffer & render();
+};
+
+// === Inline function definitions
+
+inline const Scene & RenderSession::get_scene() const { return scene; }
+inline const Camera & RenderSession::get_camera() const { return camera; }
+inline const RenderOptions & RenderSession::get_options() const
+{
+  return opt;
+}
+inline const Framebuffer & RenderSession::get_framebuffer() const
+{
+  return fb;
+}
+
+#endif
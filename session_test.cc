@@ -0,0 +1,86 @@
+/* session_test.cc
+ *
+ * gtest Unit Test Suite for RenderSession
+ */
+
+#include "session.hh"
+#include "testscene.hh"
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+struct RenderSessionTest : public Test
+{
+  Scene scn;
+  Camera cam1;
+  Camera cam2;
+
+  virtual void SetUp()
+  {
+    build_test_scene(scn);
+    cam1 = test_camera(-1.5);
+    cam2 = test_camera(1.5);
+  }
+};
+
+// A session reproduces a from-scratch render, before & after a camera swap
+TEST_F(RenderSessionTest, MatchesSceneRender)
+{
+  RenderSession session(scn, 32);
+
+  session.set_camera(cam1);
+  EXPECT_EQ(render_ppm(scn, cam1, 32), to_ppm(session.render(), 0, 32));
+
+  session.set_camera(cam2);
+  EXPECT_EQ(render_ppm(scn, cam2, 32), to_ppm(session.render(), 0, 32));
+}
+
+// Repeated renders accumulate, and swapping the camera restarts
+TEST_F(RenderSessionTest, AccumulatesUntilCameraChanges)
+{
+  RenderSession session(scn, 16);
+
+  session.set_camera(cam1);
+  session.render();
+  session.render();
+  EXPECT_EQ(2u, session.get_framebuffer().get_samples());
+
+  session.set_camera(cam2);
+  EXPECT_EQ(0u, session.get_framebuffer().get_samples());
+
+  session.render();
+  EXPECT_EQ(1u, session.get_framebuffer().get_samples());
+}
+
+// Stochastic renders are identical whatever the number of threads
+TEST_F(RenderSessionTest, DeterministicAcrossThreads)
+{
+  RenderOptions opt;
+  opt.pixel_samples = 3;
+  opt.light_samples = 1;
+  opt.seed = 7;
+
+  string images[3];
+  for (unsigned int t = 0; t < 3; ++t)
+  {
+    opt.threads = 1 + 2 * t;
+
+    RenderSession session(scn, 24, opt);
+    session.set_camera(cam1);
+    session.render();
+
+    images[t] = to_ppm(session.render(), 0, 24);
+  }
+
+  EXPECT_EQ(images[0], images[1]);
+  EXPECT_EQ(images[0], images[2]);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -4,6 +4,7 @@
  */
 
 #include "sphere.hh"
+#include "rebase.hh"
 #include <cassert>
 #include <cmath>
 
@@ -122,18 +123,58 @@ int Sphere::get_intersections(const Ray &r, float &t1, float &t2) const
   return 0;
 }
 
-// Identify first intersection with a ray
-// (See sceneobject.hh)
-float Sphere::intersection(const Ray &r) const
+// Identify first intersection with a ray, and the primitive hit
+/*!
+ * A ray leaving the sphere's surface has its origin as one root of the
+ * quadratic, so the other root, t = -2 (d . (o - c)) / (d . d), is the only
+ * hit: where a ray heading inwards reaches the far side.  Chords shorter than
+ * surface_epsilon() of the radius are rays grazing the surface, whose roots
+ * are lost in rounding.
+ *
+ * \param[in]  r     Ray to intersect
+ * \param[in]  from  0 if the ray starts on the sphere, or no_primitive
+ * \param[out] prim  Primitive hit (always 0)
+ * \returns          The t value of the nearest intersection
+ *                   or SceneObject::no_intersection
+ */
+float Sphere::intersection_from(const Ray &r, unsigned int from,
+                                unsigned int &prim) const
 {
-  float t1, t2;
+  prim = 0;
+
+  if (from == no_primitive)
+    return intersection(r);
+
+  const Vector3F &d = r.get_dir();
+  float a = d.norm_sq();
+  float t = -2 * dot(d, r.get_orig() - center) / a;
+
+  if (t * sqrt(a) <= surface_epsilon(radius))
+    return no_intersection;
+
+  return t;
+}
 
-  // Get the intersections
-  get_intersections(r, t1, t2);
+// Refine the t value of a hit in double precision
+/*!
+ * Solves the quadratic again in double precision, relative to the center,
+ * taking the root nearest the hit found in single precision.  (Far from
+ * the origin, the single precision terms of the quadratic cancel, leaving
+ * the hit off the surface by many rounding errors.)
+ *
+ * \param r     Ray which hit the sphere
+ * \param t     The t value of the hit
+ * \param prim  Primitive hit (always 0)
+ * \returns     The refined t value
+ */
+float Sphere::refine_intersection(const Ray &r, float t,
+                                  unsigned int prim) const
+{
+  Vector3D d(r.get_dir());
+  Vector3D oc = Vector3D(r.get_orig()) - Vector3D(center);
 
-  // Only care about the first intersection,
-  // which will already be flagged if there are none
-  return t1;
+  return nearest_root(dot(d, d), dot(d, oc),
+                      dot(oc, oc) - double(radius) * radius, t);
 }
 
 // Get the normal to the surface at a point p
@@ -147,6 +188,42 @@ Vector3F Sphere::get_normal(const Vector3F &p) const
   return result.normalize();
 }
 
+// Get the change in the surface normal over a small step along the surface
+// (See sceneobject.hh)
+Vector3F Sphere::get_normal_differential(const Vector3F &p,
+                                         const Vector3F &dp) const
+{
+  Vector3F offset = p - center;
+  float len = offset.norm();
+  Vector3F n = offset / len;
+
+  // Differentiating offset / |offset|
+  return (dp - dot(dp, n) * n) / len;
+}
+
+// Get a bounding box for the object
+// (See sceneobject.hh)
+bool Sphere::get_bounds(AABB &b) const
+{
+  b = AABB::around_sphere(center, radius);
+  return true;
+}
+
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void Sphere::hash(Hash &h) const
+{
+  SceneObject::hash(h);
+  h.add(center).add(radius);
+}
+
+// Name of the object's type, for hashing
+// (See sceneobject.hh)
+const char *Sphere::type_tag() const
+{
+  return "Sphere";
+}
+
 /*! \relates Sphere
  * Reads a Sphere from the provided input stream in the format:
  * "center radius color"
@@ -154,10 +231,14 @@ Vector3F Sphere::get_normal(const Vector3F &p) const
  * With the read formats for Vectors & Colors, this looks like:
  * "(x y z) radius [r g b]"
  *
- * \param is  Input stream from which to read a new Plane
- * \returns   Pointer to a new Sphere, or NULL if reading failed
+ * The center is read with read_position(), so is relative to the stream's
+ * origin, if it has one.
+ *
+ * \param is     Input stream from which to read a new Plane
+ * \param arena  Arena in which to allocate the new object
+ * \returns      Pointer to a new Sphere, or NULL if reading failed
  */
-SPSceneObject read_Sphere(std::istream &is)
+SPSceneObject read_Sphere(std::istream &is, Arena &arena)
 {
   // Check if stream is already bad
   if (!is) return SPSceneObject();
@@ -168,16 +249,14 @@ SPSceneObject read_Sphere(std::istream &is)
   float ref;
 
   // Read components
-  is >> pos;
+  read_position(is, pos);
   is >> r;
   is >> c;
   is >> ref;
 
   if (is)
   {
-    SPSceneObject sso(new Sphere(pos, r, c, ref));
-
-    return sso;
+    return arena.create<Sphere>(pos, r, c, ref);
   }
   else
   {
@@ -33,6 +33,9 @@ class Sphere : public SceneObject
   //! Accessor for sphere radius
   float get_radius() const;
 
+  //! Mutator to move the sphere's center
+  void set_center(const Vector3F &c);
+
   //! Identify all (up to 2) intersections with a ray
   int get_intersections(const Ray &r, float &t1, float &t2) const;
 
@@ -40,20 +43,61 @@ class Sphere : public SceneObject
   // (See sceneobject.hh)
   float intersection(const Ray &r) const;
 
+  // Identify first intersection with a ray, and the primitive hit
+  // (See sceneobject.hh)
+  float intersection_from(const Ray &r, unsigned int from,
+                          unsigned int &prim) const;
+
+  // Refine the t value of a hit in double precision
+  // (See sceneobject.hh)
+  float refine_intersection(const Ray &r, float t, unsigned int prim) const;
+
   // Get the normal to the surface at a point p
   // (See sceneobject.hh)
   Vector3F get_normal(const Vector3F &p) const;
+
+  // Get the change in the surface normal over a small step along the surface
+  // (See sceneobject.hh)
+  Vector3F get_normal_differential(const Vector3F &p,
+                                   const Vector3F &dp) const;
+
+  // Get a bounding box for the object
+  // (See sceneobject.hh)
+  bool get_bounds(AABB &b) const;
+
+  // Add everything affecting the object's appearance to a hash
+  // (See sceneobject.hh)
+  void hash(Hash &h) const;
+
+  // Name of the object's type, for hashing
+  // (See sceneobject.hh)
+  const char *type_tag() const;
 };
 
 /*! \relates Sphere
  * \brief Function to read a Sphere from an input stream
  */
-SPSceneObject read_Sphere(std::istream &is);
+SPSceneObject read_Sphere(std::istream &is, Arena &arena);
 
 // === Inline function definitions
 
 // Accessors for members
 inline const Vector3F & Sphere::get_center() const { return center; }
 inline float Sphere::get_radius() const { return radius; }
+inline void Sphere::set_center(const Vector3F &c) { center = c; }
+
+// Identify first intersection with a ray
+// (See sceneobject.hh)
+inline float Sphere::intersection(const Ray &r) const
+{
+  float t1, t2;
+
+  // Get the intersections
+  get_intersections(r, t1, t2);
+
+  // Only care about the first intersection,
+  // which will already be flagged if there are none
+  return t1;
+}
 
 #endif
@@ -0,0 +1,62 @@
+/* testscene.cc
+ *
+ * A small scene, and helpers to render it, shared by the unit tests
+ */
+
+#include "testscene.hh"
+#include <sstream>
+
+using namespace std;
+
+/*!
+ * \param scn  Empty Scene to which to add the objects & light
+ */
+void build_test_scene(Scene &scn)
+{
+  scn.add_object(scn.get_arena().create<Plane>(
+      0, Vector3F({0, 1, 0}), Color(0.5, 0, 0.5), 0.2));
+  scn.add_object(scn.get_arena().create<Sphere>(
+      Vector3F({0, 0.5, 0}), 0.5, Color(0, 1, 0), 0.2));
+  scn.add_light(scn.get_arena().create<Light>(
+      Vector3F({-10, 10, 5}), Color(0.8, 0.8, 0.8)));
+  scn.prepare();
+}
+
+/*!
+ * \param x  Position of the camera along x (at 1 above the floor, 3 in
+ *           front of the ball)
+ * \returns  Camera looking at the center of the ball
+ */
+Camera test_camera(float x)
+{
+  return Camera(Vector3F({x, 1, 3}), Vector3F({0, 0.5, 0}),
+                Vector3F({0, 1, 0}));
+}
+
+/*!
+ * \param scn       Prepared Scene to render
+ * \param cam       Camera from which to render the scene
+ * \param img_size  Pixel dimensions of image
+ * \param opt       Render settings
+ * \returns         Image in PPM format
+ */
+string render_ppm(const Scene &scn, const Camera &cam, int img_size,
+                  const RenderOptions &opt)
+{
+  ostringstream oss;
+  scn.render(cam, img_size, oss, opt);
+  return oss.str();
+}
+
+/*!
+ * \param fb       Framebuffer to write
+ * \param y_begin  First row to write
+ * \param y_end    Row after the last to write
+ * \returns        Rows in PPM format
+ */
+string to_ppm(const Framebuffer &fb, int y_begin, int y_end)
+{
+  ostringstream oss;
+  fb.write_ppm(oss, y_begin, y_end);
+  return oss.str();
+}
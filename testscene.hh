@@ -0,0 +1,31 @@
+/* testscene.hh
+ *
+ * A small scene, and helpers to render it, shared by the unit tests
+ */
+
+#ifndef _TESTSCENE_HH__
+#define _TESTSCENE_HH__
+
+#include "scene.hh"
+#include "camera.hh"
+#include "framebuffer.hh"
+#include "renderoptions.hh"
+#include <string>
+
+//! Add a purple floor and a green ball, lit by a point light, to a Scene
+/*!
+ * The Scene is prepared after the objects are added.
+ */
+void build_test_scene(Scene &scn);
+
+//! A Camera looking at the ball of the test scene from above the floor
+Camera test_camera(float x = -1.5f);
+
+//! Render a whole image through Scene::render, in PPM format
+std::string render_ppm(const Scene &scn, const Camera &cam, int img_size,
+                       const RenderOptions &opt = RenderOptions());
+
+//! Rows of a framebuffer in PPM format
+std::string to_ppm(const Framebuffer &fb, int y_begin, int y_end);
+
+#endif
@@ -0,0 +1,488 @@
+/* texture.cc
+ *
+ * Textures giving the surface color of SceneObjects from point to point
+ */
+
+#include "texture.hh"
+#include "rebase.hh"
+#include <typeinfo>
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//! Number of points whose texture coordinates are found at a time
+static const unsigned int CHUNK_POINTS = 64;
+
+// === Helpers
+//
+// The SSE2 & scalar versions of each helper round identically, so a point
+// gets the same color whether it's evaluated alone or in a batch.
+
+/*!
+ * \param x  Any float within the range of an int
+ * \returns  The largest integer not greater than x
+ */
+static inline int floor_int(float x)
+{
+  int i = int(x);
+  return i - (float(i) > x);
+}
+
+/*!
+ * \param x  Any float within the range of an int
+ * \returns  The fractional part of x, in [0, 1)
+ */
+static inline float fract(float x)
+{
+  return x - float(floor_int(x));
+}
+
+/*!
+ * A float-only hash ("hash without sine"), so it vectorizes without integer
+ * multiplies.  Lattice points are small integers, held exactly in floats.
+ *
+ * \param x, y, z  Coordinates of a lattice point
+ * \returns        A pseudo-random value in [0, 1)
+ */
+static inline float lattice_hash(float x, float y, float z)
+{
+  float a = fract(x * 0.1031f), b = fract(y * 0.1031f);
+  float c = fract(z * 0.1031f);
+
+  float d = a * (b + 33.33f) + b * (c + 33.33f) + c * (a + 33.33f);
+  return fract((a + d + b + d) * (c + d));
+}
+
+/*!
+ * \param t  Position between two lattice points, in [0, 1)
+ * \returns  Smoothed weight of the second point
+ */
+static inline float smooth(float t)
+{
+  return t * t * (3.f - 2.f * t);
+}
+
+#ifdef __SSE2__
+static inline __m128i floor_int4(__m128 x)
+{
+  __m128i i = _mm_cvttps_epi32(x);
+  // (Comparison masks are -1 where true)
+  __m128 above = _mm_cmpgt_ps(_mm_cvtepi32_ps(i), x);
+  return _mm_add_epi32(i, _mm_castps_si128(above));
+}
+
+static inline __m128 fract4(__m128 x)
+{
+  return _mm_sub_ps(x, _mm_cvtepi32_ps(floor_int4(x)));
+}
+
+static inline __m128 lattice_hash4(__m128 x, __m128 y, __m128 z)
+{
+  const __m128 k = _mm_set1_ps(0.1031f), add = _mm_set1_ps(33.33f);
+
+  __m128 a = fract4(_mm_mul_ps(x, k)), b = fract4(_mm_mul_ps(y, k));
+  __m128 c = fract4(_mm_mul_ps(z, k));
+
+  __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_add_ps(b, add)),
+                                   _mm_mul_ps(b, _mm_add_ps(c, add))),
+                        _mm_mul_ps(c, _mm_add_ps(a, add)));
+  __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(a, d), b), d);
+  return fract4(_mm_mul_ps(sum, _mm_add_ps(c, d)));
+}
+
+static inline __m128 smooth4(__m128 t)
+{
+  return _mm_mul_ps(_mm_mul_ps(t, t),
+                    _mm_sub_ps(_mm_set1_ps(3.f),
+                               _mm_mul_ps(_mm_set1_ps(2.f), t)));
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+  return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+#endif
+
+// === Texture
+
+// Virtual Destructor
+Texture::~Texture()
+{ }
+
+// Evaluate the texture at n points, filtered over their differentials
+// By default, the differentials are ignored
+void Texture::evaluate_filtered(const float *const p[3],
+                                const float *const dpdx[3],
+                                const float *const dpdy[3],
+                                unsigned int n, Color *c) const
+{
+  evaluate(p, n, c);
+}
+
+// Add everything affecting the texture's appearance to a hash
+// (See texture.hh)
+void Texture::hash(Hash &h) const
+{
+  h.add(string(type_tag()));
+}
+
+// Name of the texture's type, for hashing
+// (See texture.hh)
+const char *Texture::type_tag() const
+{
+  return typeid(*this).name();
+}
+
+// === CheckerTexture
+
+/*!
+ * \param origin  A corner of a cube
+ * \param size    Length of the cubes' sides
+ * \param c1      Color of the cube at the origin, and every other cube
+ * \param c2      Color of the remaining cubes
+ */
+CheckerTexture::CheckerTexture(const Vector3F &origin, float size,
+                               const Color &c1, const Color &c2)
+  : origin(origin)
+  , size(size)
+  , color1(c1)
+  , color2(c2)
+{ }
+
+// Evaluate the texture at n points
+// (See texture.hh)
+void CheckerTexture::evaluate(const float *const p[3], unsigned int n,
+                              Color *c) const
+{
+  float inv = 1 / size;
+  unsigned int i = 0;
+
+#ifdef __SSE2__
+  const __m128 inv4 = _mm_set1_ps(inv);
+
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i sum = _mm_setzero_si128();
+
+    for (int k = 0; k < 3; ++k)
+    {
+      __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p[k] + i),
+                                       _mm_set1_ps(origin[k])), inv4);
+      sum = _mm_add_epi32(sum, floor_int4(x));
+    }
+
+    int odd[4];
+    _mm_storeu_si128((__m128i *) odd, _mm_and_si128(sum, _mm_set1_epi32(1)));
+
+    for (int j = 0; j < 4; ++j)
+      c[i + j] = odd[j] ? color2 : color1;
+  }
+#endif
+
+  for (; i < n; ++i)
+  {
+    int sum = 0;
+    for (int k = 0; k < 3; ++k)
+      sum += floor_int((p[k][i] - origin[k]) * inv);
+
+    c[i] = (sum & 1) ? color2 : color1;
+  }
+}
+
+// Add everything affecting the texture's appearance to a hash
+// (See texture.hh)
+void CheckerTexture::hash(Hash &h) const
+{
+  Texture::hash(h);
+  h.add(origin).add(size).add(color1).add(color2);
+}
+
+// Name of the texture's type, for hashing
+// (See texture.hh)
+const char *CheckerTexture::type_tag() const
+{
+  return "CheckerTexture";
+}
+
+// === NoiseTexture
+
+/*!
+ * \param origin  A point of the lattice
+ * \param scale   Spacing of the lattice
+ * \param c1      Color where the noise is 0
+ * \param c2      Color where the noise is 1
+ */
+NoiseTexture::NoiseTexture(const Vector3F &origin, float scale,
+                           const Color &c1, const Color &c2)
+  : origin(origin)
+  , scale(scale)
+  , color1(c1)
+  , color2(c2)
+{ }
+
+// Evaluate the texture at n points
+// (See texture.hh)
+void NoiseTexture::evaluate(const float *const p[3], unsigned int n,
+                            Color *c) const
+{
+  float inv = 1 / scale;
+  float v[4];
+  unsigned int i = 0;
+
+#ifdef __SSE2__
+  const __m128 inv4 = _mm_set1_ps(inv), one = _mm_set1_ps(1.f);
+
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 cell[3], w[3];
+
+    for (int k = 0; k < 3; ++k)
+    {
+      __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p[k] + i),
+                                       _mm_set1_ps(origin[k])), inv4);
+      cell[k] = _mm_cvtepi32_ps(floor_int4(x));
+      w[k] = smooth4(_mm_sub_ps(x, cell[k]));
+    }
+
+    __m128 x1 = _mm_add_ps(cell[0], one), y1 = _mm_add_ps(cell[1], one);
+    __m128 z1 = _mm_add_ps(cell[2], one);
+
+    // Interpolate the cube's corners along x, then y, then z
+    __m128 n00 = lerp4(lattice_hash4(cell[0], cell[1], cell[2]),
+                       lattice_hash4(x1, cell[1], cell[2]), w[0]);
+    __m128 n10 = lerp4(lattice_hash4(cell[0], y1, cell[2]),
+                       lattice_hash4(x1, y1, cell[2]), w[0]);
+    __m128 n01 = lerp4(lattice_hash4(cell[0], cell[1], z1),
+                       lattice_hash4(x1, cell[1], z1), w[0]);
+    __m128 n11 = lerp4(lattice_hash4(cell[0], y1, z1),
+                       lattice_hash4(x1, y1, z1), w[0]);
+
+    _mm_storeu_ps(v, lerp4(lerp4(n00, n10, w[1]), lerp4(n01, n11, w[1]),
+                           w[2]));
+
+    for (int j = 0; j < 4; ++j)
+      c[i + j] = color1 + (color2 - color1) * v[j];
+  }
+#endif
+
+  for (; i < n; ++i)
+  {
+    float cell[3], w[3];
+
+    for (int k = 0; k < 3; ++k)
+    {
+      float x = (p[k][i] - origin[k]) * inv;
+      cell[k] = float(floor_int(x));
+      w[k] = smooth(x - cell[k]);
+    }
+
+    float x1 = cell[0] + 1.f, y1 = cell[1] + 1.f, z1 = cell[2] + 1.f;
+    float h, n00, n10, n01, n11;
+
+    h = lattice_hash(cell[0], cell[1], cell[2]);
+    n00 = h + w[0] * (lattice_hash(x1, cell[1], cell[2]) - h);
+    h = lattice_hash(cell[0], y1, cell[2]);
+    n10 = h + w[0] * (lattice_hash(x1, y1, cell[2]) - h);
+    h = lattice_hash(cell[0], cell[1], z1);
+    n01 = h + w[0] * (lattice_hash(x1, cell[1], z1) - h);
+    h = lattice_hash(cell[0], y1, z1);
+    n11 = h + w[0] * (lattice_hash(x1, y1, z1) - h);
+
+    float n0 = n00 + w[1] * (n10 - n00), n1 = n01 + w[1] * (n11 - n01);
+    v[0] = n0 + w[2] * (n1 - n0);
+
+    c[i] = color1 + (color2 - color1) * v[0];
+  }
+}
+
+// Add everything affecting the texture's appearance to a hash
+// (See texture.hh)
+void NoiseTexture::hash(Hash &h) const
+{
+  Texture::hash(h);
+  h.add(origin).add(scale).add(color1).add(color2);
+}
+
+// Name of the texture's type, for hashing
+// (See texture.hh)
+const char *NoiseTexture::type_tag() const
+{
+  return "NoiseTexture";
+}
+
+// === ImageTexture
+
+/*!
+ * \param cache   Cache in which the image is open
+ * \param image   Id of the image in the cache
+ * \param path    Path of the image's file
+ * \param origin  Corner of the image (its top left, as stored)
+ * \param u       Edge along the image's rows
+ * \param v       Edge down the image's columns
+ */
+ImageTexture::ImageTexture(const SPTextureCache &cache, int image,
+                           const string &path, const Vector3F &origin,
+                           const Vector3F &u, const Vector3F &v)
+  : cache(cache)
+  , image(image)
+  , path(path)
+  , origin(origin)
+  , u_scaled(u / dot(u, u))
+  , v_scaled(v / dot(v, v))
+{ }
+
+// Evaluate the texture at n points
+// (See texture.hh)
+void ImageTexture::evaluate(const float *const p[3], unsigned int n,
+                            Color *c) const
+{
+  float s[CHUNK_POINTS], t[CHUNK_POINTS];
+
+  for (unsigned int i0 = 0; i0 < n; i0 += CHUNK_POINTS)
+  {
+    unsigned int points = min(CHUNK_POINTS, n - i0);
+
+    for (unsigned int i = 0; i < points; ++i)
+    {
+      float x = p[0][i0 + i] - origin[0], y = p[1][i0 + i] - origin[1];
+      float z = p[2][i0 + i] - origin[2];
+
+      s[i] = x * u_scaled[0] + y * u_scaled[1] + z * u_scaled[2];
+      t[i] = x * v_scaled[0] + y * v_scaled[1] + z * v_scaled[2];
+    }
+
+    cache->sample(image, 0, s, t, points, c + i0);
+  }
+}
+
+// Evaluate the texture at n points, filtered over their differentials
+// (See texture.hh)
+void ImageTexture::evaluate_filtered(const float *const p[3],
+                                     const float *const dpdx[3],
+                                     const float *const dpdy[3],
+                                     unsigned int n, Color *c) const
+{
+  float s[CHUNK_POINTS], t[CHUNK_POINTS], lod[CHUNK_POINTS];
+
+  float w = cache->get_width(image), h = cache->get_height(image);
+
+  for (unsigned int i0 = 0; i0 < n; i0 += CHUNK_POINTS)
+  {
+    unsigned int points = min(CHUNK_POINTS, n - i0);
+
+    for (unsigned int i = 0; i < points; ++i)
+    {
+      unsigned int j = i0 + i;
+      Vector3F q = {p[0][j] - origin[0], p[1][j] - origin[1],
+                    p[2][j] - origin[2]};
+      Vector3F dx = {dpdx[0][j], dpdx[1][j], dpdx[2][j]};
+      Vector3F dy = {dpdy[0][j], dpdy[1][j], dpdy[2][j]};
+
+      s[i] = dot(q, u_scaled);
+      t[i] = dot(q, v_scaled);
+
+      // Footprint in texels: the longer of the pixel's two edges
+      float x_s = dot(dx, u_scaled) * w, x_t = dot(dx, v_scaled) * h;
+      float y_s = dot(dy, u_scaled) * w, y_t = dot(dy, v_scaled) * h;
+      float len_sq = max(x_s * x_s + x_t * x_t, y_s * y_s + y_t * y_t);
+
+      // (log2 of the length, from its square)
+      lod[i] = 0.5f * log2(len_sq);
+    }
+
+    cache->sample_filtered(image, s, t, lod, points, c + i0);
+  }
+}
+
+// Add everything affecting the texture's appearance to a hash
+// (See texture.hh)
+void ImageTexture::hash(Hash &h) const
+{
+  Texture::hash(h);
+  h.add(path);
+  h.add(uint32_t(cache->get_width(image)));
+  h.add(uint32_t(cache->get_height(image)));
+
+  // (So an image rewritten in place changes the hash too)
+  uint64_t contents = cache->get_contents_hash(image);
+  h.add(uint32_t(contents >> 32)).add(uint32_t(contents));
+  h.add(origin).add(u_scaled).add(v_scaled);
+}
+
+// Name of the texture's type, for hashing
+// (See texture.hh)
+const char *ImageTexture::type_tag() const
+{
+  return "ImageTexture";
+}
+
+/*! \relates Texture
+ * Reads a Texture from the provided input stream in one of the formats:
+ * "checker origin size color1 color2"
+ * "noise origin scale color1 color2"
+ * "image file origin u v"
+ *
+ * With the read formats for Vectors & Colors, these look like:
+ * "checker (x y z) size [r g b] [r g b]"
+ * "noise (x y z) scale [r g b] [r g b]"
+ * "image file.ppm (x y z) (ux uy uz) (vx vy vz)"
+ *
+ * The named image (which may not contain spaces in its name) must be a
+ * binary PPM, and is opened in the cache without reading its texels.
+ * Origins are read with read_position(), so are relative to the stream's
+ * origin, if it has one.
+ *
+ * \param is     Input stream from which to read a new Texture
+ * \param arena  Arena in which to allocate the new texture
+ * \param cache  Cache in which to open images
+ * \returns      Pointer to a new Texture, or NULL if reading failed
+ */
+SPTexture read_Texture(std::istream &is, Arena &arena,
+                       const SPTextureCache &cache)
+{
+  // Check if stream is already bad
+  if (!is) return SPTexture();
+
+  string type;
+  Vector3F origin;
+  is >> type;
+
+  if (type == "checker" || type == "noise")
+  {
+    float size;
+    Color c1, c2;
+
+    read_position(is, origin);
+    is >> size >> c1 >> c2;
+
+    if (!is || !(size > 0)) return SPTexture();
+
+    if (type == "checker")
+      return arena.create<CheckerTexture>(origin, size, c1, c2);
+    else
+      return arena.create<NoiseTexture>(origin, size, c1, c2);
+  }
+  else if (type == "image")
+  {
+    string path;
+    Vector3F u, v;
+
+    is >> path;
+    read_position(is, origin);
+    is >> u >> v;
+
+    if (!is || u.norm() == 0 || v.norm() == 0) return SPTexture();
+
+    int image = cache->open(path);
+    if (image < 0) return SPTexture();
+
+    return arena.create<ImageTexture>(cache, image, path, origin, u, v);
+  }
+
+  return SPTexture();
+}
@@ -0,0 +1,249 @@
+/* texture.hh
+ *
+ * Textures giving the surface color of SceneObjects from point to point
+ */
+
+#ifndef _TEXTURE_HH__
+#define _TEXTURE_HH__
+
+#include "vector.hh"
+#include "color.hh"
+#include "hash.hh"
+#include "arena.hh"
+#include "texturecache.hh"
+#include <boost/shared_ptr.hpp>
+#include <iostream>
+#include <string>
+
+//! An abstract base class for textures, giving a color at each point
+/*!
+ * Textures are evaluated at points in space (for an Instance, in the space
+ * of its geometry), and replace the surface color of the objects using them.
+ *
+ * Points are passed as an array of each coordinate, so a texture evaluated
+ * at many points at once can work through them several at a time.
+ *
+ * A point may also come with its differentials (the change in the point per
+ * pixel along the image's x & y), spanning the area of the surface its
+ * pixel covers, for the texture to filter over.
+ */
+class Texture
+{
+  public:
+  // === Constructors & methods
+
+  //! Virtual Destructor
+  virtual ~Texture();
+
+  //! Evaluate the texture at n points
+  /*!
+   * \param[in]  p  Arrays of the x, y and z coordinates of the points
+   * \param[in]  n  Number of points
+   * \param[out] c  Color at each point
+   */
+  virtual void evaluate(const float *const p[3], unsigned int n,
+                        Color *c) const = 0;
+
+  //! Evaluate the texture at n points, filtered over their differentials
+  /*!
+   * By default, the differentials are ignored, and the points sampled as
+   * evaluate() does.
+   * \param[in]  p     Arrays of the x, y and z coordinates of the points
+   * \param[in]  dpdx  Arrays of the coordinates of each point's change per
+   *                   pixel along x
+   * \param[in]  dpdy  Arrays of the coordinates of each point's change per
+   *                   pixel along y
+   * \param[in]  n     Number of points
+   * \param[out] c     Color at each point
+   */
+  virtual void evaluate_filtered(const float *const p[3],
+                                 const float *const dpdx[3],
+                                 const float *const dpdy[3],
+                                 unsigned int n, Color *c) const;
+
+  //! Evaluate the texture at a point
+  Color get_color(const Vector3F &p) const;
+
+  //! Evaluate the texture at a point, filtered over its differentials
+  Color get_color(const Vector3F &p, const Vector3F &dpdx,
+                  const Vector3F &dpdy) const;
+
+  //! Add everything affecting the texture's appearance to a hash
+  /*!
+   * Adds the texture's type.  Subclasses should extend this with their
+   * parameters.
+   * \param h Hash to which to add the texture
+   */
+  virtual void hash(Hash &h) const;
+
+  //! Name of the texture's type, for hashing
+  /*!
+   * By default, the compiler's name for the class; subclasses should return
+   * a fixed name instead (See SceneObject::type_tag).
+   * \returns Name unique to the texture's class
+   */
+  virtual const char *type_tag() const;
+};
+
+//! Boost Shared Pointer to a Texture
+typedef boost::shared_ptr<Texture> SPTexture;
+
+//! A 3D checkerboard of cubes alternating between two colors
+class CheckerTexture : public Texture
+{
+  //! A corner of a cube
+  Vector3F origin;
+  //! Length of the cubes' sides
+  float size;
+  //! Color of the cube at the origin, and every other cube
+  Color color1;
+  //! Color of the remaining cubes
+  Color color2;
+
+  public:
+  //! Construct a checkerboard
+  CheckerTexture(const Vector3F &origin, float size, const Color &c1,
+                 const Color &c2);
+
+  // Evaluate the texture at n points
+  // (See texture.hh)
+  void evaluate(const float *const p[3], unsigned int n, Color *c) const;
+
+  // Add everything affecting the texture's appearance to a hash
+  // (See texture.hh)
+  void hash(Hash &h) const;
+
+  // Name of the texture's type, for hashing
+  // (See texture.hh)
+  const char *type_tag() const;
+};
+
+//! Value noise blending between two colors
+/*!
+ * A random value is hashed at each point of an integer lattice, and
+ * interpolated smoothly between them, giving a blotchy pattern with
+ * features about the lattice spacing in size.
+ */
+class NoiseTexture : public Texture
+{
+  //! A point of the lattice
+  Vector3F origin;
+  //! Spacing of the lattice
+  float scale;
+  //! Color where the noise is 0
+  Color color1;
+  //! Color where the noise is 1
+  Color color2;
+
+  public:
+  //! Construct a noise texture
+  NoiseTexture(const Vector3F &origin, float scale, const Color &c1,
+               const Color &c2);
+
+  // Evaluate the texture at n points
+  // (See texture.hh)
+  void evaluate(const float *const p[3], unsigned int n, Color *c) const;
+
+  // Add everything affecting the texture's appearance to a hash
+  // (See texture.hh)
+  void hash(Hash &h) const;
+
+  // Name of the texture's type, for hashing
+  // (See texture.hh)
+  const char *type_tag() const;
+};
+
+//! An image projected along a plane, repeating across it
+/*!
+ * The image is stretched over the parallelogram with a corner at the
+ * origin and edges u (along the image's rows) and v (down its columns),
+ * and projected perpendicular to it.  Texels are sampled through a
+ * TextureCache, so only the tiles sampled are ever loaded.
+ *
+ * Filtered samples pick a mip level from the footprint the differentials
+ * span in the image, so distant or minified surfaces sample small levels.
+ */
+class ImageTexture : public Texture
+{
+  //! Cache through which to sample the image
+  SPTextureCache cache;
+  //! Id of the image in the cache
+  int image;
+  //! Path of the image's file
+  std::string path;
+
+  //! Corner of the image
+  Vector3F origin;
+  //! Edge along the image's rows, over its squared length
+  Vector3F u_scaled;
+  //! Edge down the image's columns, over its squared length
+  Vector3F v_scaled;
+
+  public:
+  //! Construct a texture of an image opened in a cache
+  ImageTexture(const SPTextureCache &cache, int image,
+               const std::string &path, const Vector3F &origin,
+               const Vector3F &u, const Vector3F &v);
+
+  // Evaluate the texture at n points
+  // (See texture.hh)
+  void evaluate(const float *const p[3], unsigned int n, Color *c) const;
+
+  // Evaluate the texture at n points, filtered over their differentials
+  // (See texture.hh)
+  void evaluate_filtered(const float *const p[3], const float *const dpdx[3],
+                         const float *const dpdy[3], unsigned int n,
+                         Color *c) const;
+
+  // Add everything affecting the texture's appearance to a hash
+  // (See texture.hh)
+  void hash(Hash &h) const;
+
+  // Name of the texture's type, for hashing
+  // (See texture.hh)
+  const char *type_tag() const;
+};
+
+/*! \relates Texture
+ * \brief Function to read a Texture of any type from an input stream
+ */
+SPTexture read_Texture(std::istream &is, Arena &arena,
+                       const SPTextureCache &cache);
+
+// === Inline function definitions
+
+/*!
+ * \param p  Point at which to evaluate the texture
+ * \returns  Color of the texture at p
+ */
+inline Color Texture::get_color(const Vector3F &p) const
+{
+  float x = p[0], y = p[1], z = p[2];
+  const float *const coords[3] = { &x, &y, &z };
+
+  Color c;
+  evaluate(coords, 1, &c);
+  return c;
+}
+
+/*!
+ * \param p     Point at which to evaluate the texture
+ * \param dpdx  Change in p per pixel along x
+ * \param dpdy  Change in p per pixel along y
+ * \returns     Color of the texture about p
+ */
+inline Color Texture::get_color(const Vector3F &p, const Vector3F &dpdx,
+                                const Vector3F &dpdy) const
+{
+  float v[9] = { p[0], p[1], p[2], dpdx[0], dpdx[1], dpdx[2],
+                 dpdy[0], dpdy[1], dpdy[2] };
+  const float *const coords[3] = { &v[0], &v[1], &v[2] };
+  const float *const dx[3] = { &v[3], &v[4], &v[5] };
+  const float *const dy[3] = { &v[6], &v[7], &v[8] };
+
+  Color c;
+  evaluate_filtered(coords, dx, dy, 1, &c);
+  return c;
+}
+
+#endif
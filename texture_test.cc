@@ -0,0 +1,363 @@
+/* texture_test.cc
+ *
+ * gtest Unit Test Suite for textures & the texture cache
+ */
+
+#include "texture.hh"
+#include "texturecache.hh"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace testing;
+
+// Evaluate a texture at n points in one batch, and at each point alone
+static void evaluate_both(const Texture &tex, const vector<float> *p,
+                          vector<Color> &batch, vector<Color> &single)
+{
+  unsigned int n = p[0].size();
+  const float *const coords[3] = { &p[0][0], &p[1][0], &p[2][0] };
+
+  batch.resize(n);
+  tex.evaluate(coords, n, &batch[0]);
+
+  single.resize(n);
+  for (unsigned int i = 0; i < n; ++i)
+    single[i] = tex.get_color(Vector3F({p[0][i], p[1][i], p[2][i]}));
+}
+
+// Points scattered about the origin (an odd number, to leave a tail)
+static void scatter_points(vector<float> *p, unsigned int n)
+{
+  srand(7);
+  for (int k = 0; k < 3; ++k)
+  {
+    p[k].resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+      p[k][i] = (rand() / float(RAND_MAX) - 0.5f) * 20;
+  }
+}
+
+// Cubes alternate colors, across negative coordinates too
+TEST(CheckerTextureTest, Pattern)
+{
+  CheckerTexture tex(Vector3F({0.5, 0, 0}), 2, Color(1, 1, 1),
+                     Color(0, 0, 0));
+
+  EXPECT_EQ(1, tex.get_color(Vector3F({1, 1, 1})).get_red());
+  EXPECT_EQ(0, tex.get_color(Vector3F({3, 1, 1})).get_red());
+  EXPECT_EQ(0, tex.get_color(Vector3F({0, 1, 1})).get_red());
+  EXPECT_EQ(1, tex.get_color(Vector3F({-2, 1, 1})).get_red());
+  EXPECT_EQ(1, tex.get_color(Vector3F({0, -1, 1})).get_red());
+
+  vector<float> p[3];
+  vector<Color> batch, single;
+  scatter_points(p, 103);
+  evaluate_both(tex, p, batch, single);
+
+  for (unsigned int i = 0; i < batch.size(); ++i)
+    EXPECT_EQ(single[i].get_red(), batch[i].get_red()) << i;
+}
+
+// Noise is smooth, within its colors, and the same in batches or alone
+TEST(NoiseTextureTest, Smooth)
+{
+  NoiseTexture tex(Vector3F({0, 0, 0}), 1.5, Color(0, 0, 0), Color(1, 2, 4));
+
+  vector<float> p[3];
+  vector<Color> batch, single;
+  scatter_points(p, 103);
+  evaluate_both(tex, p, batch, single);
+
+  float lo = 4, hi = 0;
+  for (unsigned int i = 0; i < batch.size(); ++i)
+  {
+    EXPECT_EQ(single[i].get_blue(), batch[i].get_blue()) << i;
+    EXPECT_FLOAT_EQ(batch[i].get_blue(), 4 * batch[i].get_red());
+    lo = min(lo, batch[i].get_blue());
+    hi = max(hi, batch[i].get_blue());
+  }
+
+  EXPECT_GE(lo, 0);
+  EXPECT_LE(hi, 4);
+  EXPECT_GT(hi - lo, 1);
+
+  // Nearby points have nearby values
+  Vector3F q({1.3, -2.7, 0.4}), dq({0.001, 0.001, 0.001});
+  EXPECT_NEAR(tex.get_color(q).get_blue(), tex.get_color(q + dq).get_blue(),
+              0.05);
+}
+
+// Test fixture writing a PPM image for the cache to open
+class TextureCacheTest : public Test
+{
+  protected:
+  string path;
+  int width, height;
+
+  // Write a w x h image with pseudo-random texels
+  void write_image(int w, int h)
+  {
+    width = w;
+    height = h;
+
+    char tmpl[] = "/tmp/texture_test.XXXXXX";
+    int fd = mkstemp(tmpl);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path = tmpl;
+
+    ofstream ofs(path.c_str(), ios::binary);
+    ofs << "P6\n# test image\n" << w << " " << h << "\n255\n";
+    for (int i = 0; i < w * h * 3; ++i)
+      ofs.put(char(texel(i)));
+  }
+
+  static unsigned char texel(int i) { return (i * 37 + i / 7) & 0xff; }
+
+  // Texture coordinates of the center of a texel of a level
+  static float center(int x, int size) { return (x + 0.5f) / size; }
+
+  void TearDown()
+  {
+    if (!path.empty()) unlink(path.c_str());
+  }
+};
+
+// Texel centers sample exact texels, and smaller levels average them
+TEST_F(TextureCacheTest, MipLevels)
+{
+  write_image(5, 3);
+
+  TextureCache cache;
+  int id = cache.open(path);
+  ASSERT_GE(id, 0);
+  EXPECT_EQ(id, cache.open(path));
+  EXPECT_EQ(-1, cache.open(path + ".missing"));
+
+  // 5x3, 3x2, 2x1, 1x1
+  ASSERT_EQ(4, cache.get_levels(id));
+  EXPECT_EQ(3, cache.get_width(id, 1));
+  EXPECT_EQ(2, cache.get_height(id, 1));
+  EXPECT_EQ(1, cache.get_height(id, 2));
+  EXPECT_EQ(1, cache.get_width(id, 3));
+
+  for (int y = 0; y < 3; ++y)
+  {
+    for (int x = 0; x < 5; ++x)
+    {
+      float s = center(x, 5), t = center(y, 3);
+      Color c;
+      cache.sample(id, 0, &s, &t, 1, &c);
+      EXPECT_FLOAT_EQ(texel((y * 5 + x) * 3) / 255.f, c.get_red());
+    }
+  }
+
+  // Level 1 texel (1, 0) covers texels (2-3, 0-1) of the full image
+  unsigned int sum = 0;
+  for (int y = 0; y < 2; ++y)
+    for (int x = 2; x < 4; ++x)
+      sum += texel((y * 5 + x) * 3 + 1);
+
+  float s = center(1, 3), t = center(0, 2);
+  Color c;
+  cache.sample(id, 1, &s, &t, 1, &c);
+  EXPECT_FLOAT_EQ(((sum + 2) / 4) / 255.f, c.get_green());
+
+  // Coordinates wrap around
+  float s2 = s + 2, t2 = t - 1;
+  Color c2;
+  cache.sample(id, 1, &s2, &t2, 1, &c2);
+  EXPECT_NEAR(c.get_green(), c2.get_green(), 1e-5);
+}
+
+// A tiny budget evicts tiles as it goes, with the same results
+TEST_F(TextureCacheTest, Budget)
+{
+  write_image(150, 90);
+
+  TextureCache small(4000), large;
+  int id_small = small.open(path), id_large = large.open(path);
+  ASSERT_GE(id_small, 0);
+  ASSERT_GE(id_large, 0);
+
+  const unsigned int n = 500;
+  vector<float> s(n), t(n);
+  srand(11);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    s[i] = rand() / float(RAND_MAX) * 3 - 1;
+    t[i] = rand() / float(RAND_MAX) * 3 - 1;
+  }
+
+  for (int level = 0; level < 3; ++level)
+  {
+    vector<Color> c_small(n), c_large(n);
+    small.sample(id_small, level, &s[0], &t[0], n, &c_small[0]);
+    large.sample(id_large, level, &s[0], &t[0], n, &c_large[0]);
+
+    for (unsigned int i = 0; i < n; ++i)
+      EXPECT_EQ(c_large[i].get_red(), c_small[i].get_red()) << i;
+
+    EXPECT_LE(small.get_bytes(), 4000u);
+  }
+
+  EXPECT_GT(small.get_misses(), large.get_misses());
+  EXPECT_GT(large.get_hits(), 0u);
+
+  large.set_max_bytes(0);
+  EXPECT_LE(large.get_bytes(), small.get_bytes());
+}
+
+// Threads sharing a cache (loading & evicting as they go) sample the same
+// colors as a single thread
+TEST_F(TextureCacheTest, Threads)
+{
+  write_image(200, 120);
+
+  TextureCache shared(20000), alone;
+  int id_shared = shared.open(path), id_alone = alone.open(path);
+  ASSERT_GE(id_shared, 0);
+  ASSERT_GE(id_alone, 0);
+
+  const unsigned int n = 2000, threads = 8;
+  vector<float> s(n), t(n), lod(n);
+  srand(13);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    s[i] = rand() / float(RAND_MAX) * 3 - 1;
+    t[i] = rand() / float(RAND_MAX) * 3 - 1;
+    lod[i] = rand() / float(RAND_MAX) * 4;
+  }
+
+  vector<Color> expected(n);
+  alone.sample_filtered(id_alone, &s[0], &t[0], &lod[0], n, &expected[0]);
+
+  // Each thread samples every point, one at a time, from its own start
+  vector<vector<Color> > c(threads, vector<Color>(n));
+  vector<thread> pool;
+  for (unsigned int k = 0; k < threads; ++k)
+  {
+    pool.push_back(thread([&, k]()
+    {
+      for (unsigned int j = 0; j < n; ++j)
+      {
+        unsigned int i = (j + k * n / threads) % n;
+        shared.sample_filtered(id_shared, &s[i], &t[i], &lod[i], 1,
+                               &c[k][i]);
+      }
+    }));
+  }
+
+  for (unsigned int k = 0; k < threads; ++k)
+    pool[k].join();
+
+  for (unsigned int k = 0; k < threads; ++k)
+    for (unsigned int i = 0; i < n; ++i)
+      ASSERT_EQ(expected[i].get_red(), c[k][i].get_red()) << k << " " << i;
+
+  EXPECT_GT(shared.get_hits(), 0u);
+  EXPECT_LE(shared.get_bytes(), 20000u + threads * 3072);
+}
+
+// Filtered samples of an image pick a mip level from their footprint, and
+// each level is built once
+TEST_F(TextureCacheTest, Footprint)
+{
+  write_image(256, 256);
+
+  SPTextureCache cache(new TextureCache());
+  int id = cache->open(path);
+  ASSERT_GE(id, 0);
+
+  // Image over the unit square of z = 0
+  ImageTexture tex(cache, id, path, Vector3F(), Vector3F({1, 0, 0}),
+                   Vector3F({0, 1, 0}));
+
+  // A footprint of 16 texels samples level 4 (a single 16x16 tile), built
+  // from (and keeping) every tile above: 64 + 16 + 4 + 1 + 1 tiles
+  Vector3F p({0.3, 0.7, 0}), dx({1 / 16.f, 0, 0}), dy({0, 1 / 32.f, 0});
+  Color c = tex.get_color(p, dx, dy);
+
+  EXPECT_EQ(86u, cache->get_misses());
+  EXPECT_EQ(86u * 3072, cache->get_bytes());
+
+  // No level is built again
+  float s = 0.3f, t = 0.7f;
+  Color c4, c2;
+  cache->sample(id, 4, &s, &t, 1, &c4);
+  cache->sample(id, 2, &s, &t, 1, &c2);
+  EXPECT_FLOAT_EQ(c4.get_green(), c.get_green());
+  EXPECT_EQ(86u, cache->get_misses());
+
+  // No footprint samples the full image
+  Vector3F zero;
+  EXPECT_EQ(tex.get_color(p).get_red(),
+            tex.get_color(p, zero, zero).get_red());
+
+  // With level 1 loaded, a tile of level 2 reduces just the four tiles it
+  // covers
+  TextureCache fresh;
+  id = fresh.open(path);
+  for (int ty = 0; ty < 4; ++ty)
+  {
+    for (int tx = 0; tx < 4; ++tx)
+    {
+      s = center(tx * 32, 128);
+      t = center(ty * 32, 128);
+      fresh.sample(id, 1, &s, &t, 1, &c);
+    }
+  }
+  EXPECT_EQ(64u + 16, fresh.get_misses());
+
+  uint64_t hits = fresh.get_hits();
+  fresh.sample(id, 2, &s, &t, 1, &c2);
+  EXPECT_EQ(64u + 16 + 1, fresh.get_misses());
+  EXPECT_EQ(hits + 4, fresh.get_hits());
+}
+
+// An image rewritten in place hashes differently
+TEST_F(TextureCacheTest, ContentsHash)
+{
+  write_image(40, 20);
+
+  SPTextureCache cache(new TextureCache());
+  int id = cache->open(path);
+  ASSERT_GE(id, 0);
+
+  ImageTexture tex(cache, id, path, Vector3F(), Vector3F({1, 0, 0}),
+                   Vector3F({0, 1, 0}));
+  Hash h1, h2;
+  tex.hash(h1);
+  tex.hash(h2);
+  EXPECT_EQ(h1.get_value(), h2.get_value());
+
+  // The same size, with one texel changed
+  {
+    fstream fs(path.c_str(), ios::binary | ios::in | ios::out);
+    fs.seekp(-1, ios::end);
+    fs.put(char(texel(40 * 20 * 3 - 1) ^ 1));
+  }
+
+  SPTextureCache other(new TextureCache());
+  int other_id = other->open(path);
+  ASSERT_GE(other_id, 0);
+
+  ImageTexture changed(other, other_id, path, Vector3F(),
+                       Vector3F({1, 0, 0}), Vector3F({0, 1, 0}));
+  Hash h3;
+  changed.hash(h3);
+  EXPECT_NE(h1.get_value(), h3.get_value());
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,596 @@
+/* texturecache.cc
+ *
+ * A cache of tiles of mip-mapped image textures, within a memory budget
+ */
+
+#include "texturecache.hh"
+#include "hash.hh"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Default maximum size of the loaded tiles
+const size_t TextureCache::default_max_bytes = size_t(64) << 20;
+
+// Texels along each side of a tile
+const int TextureCache::TILE_SIZE;
+
+// Number of bits of a tile's key choosing its shard
+const unsigned int TextureCache::SHARD_BITS;
+
+// Number of independently locked shards of the tiles
+const unsigned int TextureCache::SHARDS;
+
+//! Number of channels per texel (RGB)
+static const int TEXEL_CHANNELS = 3;
+
+/*!
+ * \param id     Image id
+ * \param level  Mip level
+ * \param tx     Column of the tile
+ * \param ty     Row of the tile
+ * \returns      Key of the tile in the cache
+ */
+static inline uint64_t tile_key(int id, int level, int tx, int ty)
+{
+  return (uint64_t(id) << 40) | (uint64_t(level) << 32)
+         | (uint64_t(ty) << 16) | uint64_t(tx);
+}
+
+/*!
+ * Skips whitespace and comments ("#" to the end of the line) in a PPM header,
+ * then reads a number.
+ *
+ * \param      is  Stream from which to read
+ * \param[out] v   Number read
+ * \returns        true if a number was read
+ */
+static bool read_header_int(istream &is, int &v)
+{
+  while (is)
+  {
+    int ch = is.peek();
+
+    if (ch == '#')
+      is.ignore(numeric_limits<streamsize>::max(), '\n');
+    else if (isspace(ch))
+      is.get();
+    else
+      break;
+  }
+
+  return bool(is >> v);
+}
+
+/*!
+ * \param max_bytes  Maximum total size of the loaded tiles in bytes
+ *                   (the tile last loaded is always kept)
+ */
+TextureCache::TextureCache(size_t max_bytes)
+  : images()
+  , tables()
+  , image_ids()
+  , contents()
+  , next_evict(0)
+  , max_bytes(max_bytes)
+  , bytes(0)
+  , hits(0)
+  , misses(0)
+{
+  tables.push_back(boost::shared_ptr<const ImageTable>(new ImageTable()));
+  images = tables.back().get();
+}
+
+TextureCache::~TextureCache()
+{
+  const ImageTable &table = *images;
+
+  for (unsigned int i = 0; i < table.size(); ++i)
+    close(table[i].fd);
+}
+
+/*!
+ * Only the header is read; texels are read as their tiles are sampled.
+ * Opening the same path again gives the same id.
+ *
+ * \param path  Path of a binary PPM (P6) file with 8-bit channels
+ * \returns     Id of the image, or -1 if it couldn't be opened
+ */
+int TextureCache::open(const string &path)
+{
+  lock_guard<mutex> guard(image_lock);
+
+  map<string, int>::const_iterator found = image_ids.find(path);
+  if (found != image_ids.end()) return found->second;
+
+  Image img;
+  img.path = path;
+
+  ifstream ifs(path.c_str(), ios::binary);
+
+  char magic[2] = { 0, 0 };
+  int width, height, maxval;
+  ifs.read(magic, 2);
+
+  if (!ifs || magic[0] != 'P' || magic[1] != '6'
+      || !read_header_int(ifs, width)
+      || !read_header_int(ifs, height)
+      || !read_header_int(ifs, maxval)
+      || width <= 0 || height <= 0 || maxval != 255)
+  {
+    cerr << "Error: Couldn't read texture " << path
+         << " (must be a binary PPM with 8-bit channels)" << endl;
+    return -1;
+  }
+
+  // A single whitespace character separates the header from the texels
+  ifs.get();
+  img.data_offset = ifs.tellg();
+
+  img.fd = ::open(path.c_str(), O_RDONLY);
+  if (img.fd < 0)
+  {
+    cerr << "Error: Couldn't open texture " << path << endl;
+    return -1;
+  }
+
+  // Levels down to a single texel
+  while (true)
+  {
+    img.width.push_back(width);
+    img.height.push_back(height);
+    if (width == 1 && height == 1) break;
+
+    // (Rounded up, so the last row or column of an odd level is kept)
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+
+  // Publish a new table with the image added
+  ImageTable *table = new ImageTable(*images);
+  table->push_back(img);
+  tables.push_back(boost::shared_ptr<const ImageTable>(table));
+  images = table;
+
+  int id = table->size() - 1;
+  image_ids[path] = id;
+
+  return id;
+}
+
+/*!
+ * Needs no lock: images are never changed once opened.
+ *
+ * \param id  Id of an open image
+ * \returns   The image
+ */
+const TextureCache::Image & TextureCache::get_image(int id) const
+{
+  return (*images)[id];
+}
+
+/*!
+ * Keys are mixed before picking a shard, so neighboring tiles (whose keys
+ * differ only in their low bits) spread over the shards.
+ *
+ * \param key  Key of a tile
+ * \returns    The shard which holds the tile if it's loaded
+ */
+TextureCache::Shard & TextureCache::get_shard(uint64_t key)
+{
+  return shards[(key * 0x9e3779b97f4a7c15ULL) >> (64 - SHARD_BITS)];
+}
+
+/*!
+ * \param id  Id of an open image
+ */
+int TextureCache::get_levels(int id) const
+{
+  return get_image(id).width.size();
+}
+
+/*!
+ * \param id     Id of an open image
+ * \param level  Mip level (0 for the full image)
+ */
+int TextureCache::get_width(int id, int level) const
+{
+  return get_image(id).width[level];
+}
+
+/*!
+ * \param id     Id of an open image
+ * \param level  Mip level (0 for the full image)
+ */
+int TextureCache::get_height(int id, int level) const
+{
+  return get_image(id).height[level];
+}
+
+/*!
+ * The whole file is read the first time an image's hash is asked for (so
+ * only renders which hash their scene, for caching or farming, pay for it),
+ * and the hash is kept for later calls.
+ *
+ * \param id  Id of an open image
+ * \returns   Hash of every byte of the image's file
+ */
+uint64_t TextureCache::get_contents_hash(int id)
+{
+  {
+    lock_guard<mutex> guard(image_lock);
+
+    map<int, uint64_t>::const_iterator found = contents.find(id);
+    if (found != contents.end()) return found->second;
+  }
+
+  // (Read with the lock released, through a stream of its own)
+  Hash h;
+  ifstream ifs(get_image(id).path.c_str(), ios::binary);
+  char buf[1 << 16];
+
+  while (ifs.read(buf, sizeof(buf)) || ifs.gcount() > 0)
+    h.add(buf, ifs.gcount());
+
+  lock_guard<mutex> guard(image_lock);
+  contents[id] = h.get_value();
+
+  return h.get_value();
+}
+
+/*!
+ * Texels outside the image (beyond the last row or column of the level) are
+ * left black.
+ *
+ * \param[in]  img   Image whose full size level the tile is on
+ * \param[in]  tx    Column of the tile
+ * \param[in]  ty    Row of the tile
+ * \param[out] tile  Texels of the tile
+ */
+void TextureCache::read_tile(const Image &img, int tx, int ty,
+                             Tile &tile) const
+{
+  int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+  int cols = min(TILE_SIZE, img.width[0] - x0);
+  int rows = min(TILE_SIZE, img.height[0] - y0);
+
+  for (int y = 0; y < rows; ++y)
+  {
+    off_t offset = (off_t(y0 + y) * img.width[0] + x0) * TEXEL_CHANNELS;
+    ssize_t len = cols * TEXEL_CHANNELS;
+
+    if (pread(img.fd, &tile[y * TILE_SIZE * TEXEL_CHANNELS], len,
+              img.data_offset + offset) != len)
+    {
+      cerr << "Error: Couldn't read texels of texture " << img.path << endl;
+      return;
+    }
+  }
+}
+
+/*!
+ * Each texel is the average of the (up to) 2x2 texels it covers on the level
+ * above.  A tile covers exactly four tiles above it (or fewer at the edges),
+ * so each is fetched and used up in turn (loading any which aren't loaded).
+ *
+ * \param[in]  id     Image id
+ * \param[in]  level  Mip level of the tile (at least 1)
+ * \param[in]  tx     Column of the tile
+ * \param[in]  ty     Row of the tile
+ * \param[out] tile   Texels of the tile
+ */
+void TextureCache::reduce_tile(int id, int level, int tx, int ty, Tile &tile)
+{
+  assert(level > 0);
+
+  const Image &img = get_image(id);
+  int w = img.width[level], h = img.height[level];
+  int cw = img.width[level - 1], ch = img.height[level - 1];
+
+  const int HALF = TILE_SIZE / 2;
+
+  for (int dy = 0; dy < 2; ++dy)
+  {
+    for (int dx = 0; dx < 2; ++dx)
+    {
+      int ctx = 2 * tx + dx, cty = 2 * ty + dy;
+      if (ctx * TILE_SIZE >= cw || cty * TILE_SIZE >= ch) continue;
+
+      SPTile child = get_tile(id, level - 1, ctx, cty, false);
+      const unsigned char *src = &(*child)[0];
+
+      // Texels of this tile covering the child tile
+      int x_begin = tx * TILE_SIZE + dx * HALF;
+      int y_begin = ty * TILE_SIZE + dy * HALF;
+      int x_end = min(w, x_begin + HALF), y_end = min(h, y_begin + HALF);
+
+      for (int y = y_begin; y < y_end; ++y)
+      {
+        // Rows above, within the child tile (clamped at an odd last row)
+        int cy0 = 2 * y - cty * TILE_SIZE;
+        int cy1 = min(2 * y + 1, ch - 1) - cty * TILE_SIZE;
+
+        for (int x = x_begin; x < x_end; ++x)
+        {
+          int cx0 = 2 * x - ctx * TILE_SIZE;
+          int cx1 = min(2 * x + 1, cw - 1) - ctx * TILE_SIZE;
+
+          unsigned char *out = &tile[((y - ty * TILE_SIZE) * TILE_SIZE
+                                      + x - tx * TILE_SIZE) * TEXEL_CHANNELS];
+
+          for (int k = 0; k < TEXEL_CHANNELS; ++k)
+          {
+            unsigned int sum =
+                src[(cy0 * TILE_SIZE + cx0) * TEXEL_CHANNELS + k]
+                + src[(cy0 * TILE_SIZE + cx1) * TEXEL_CHANNELS + k]
+                + src[(cy1 * TILE_SIZE + cx0) * TEXEL_CHANNELS + k]
+                + src[(cy1 * TILE_SIZE + cx1) * TEXEL_CHANNELS + k];
+            out[k] = (unsigned char) ((sum + 2) / 4);
+          }
+        }
+      }
+    }
+  }
+}
+
+/*!
+ * No lock may be held.  The tile's shard is locked only to look for and
+ * insert the tile: a tile which isn't loaded is read or reduced with no lock
+ * held.
+ *
+ * A sampled tile becomes the most recently used of its shard.  A tile only
+ * fetched to reduce another is kept only if it fits within the budget, as
+ * the least recently used (and is left where it is, if loaded): it's there to
+ * build the rest of its level while there's room, but never pushes out the
+ * tiles being sampled.
+ *
+ * \param id       Image id
+ * \param level    Mip level
+ * \param tx       Column of the tile
+ * \param ty       Row of the tile
+ * \param sampled  Whether the tile is to be sampled
+ *                 (rather than fetched to reduce another)
+ * \returns        The tile (which stays valid even if evicted)
+ */
+TextureCache::SPTile TextureCache::get_tile(int id, int level, int tx, int ty,
+                                            bool sampled)
+{
+  uint64_t key = tile_key(id, level, tx, ty);
+  Shard &shard = get_shard(key);
+
+  {
+    lock_guard<mutex> guard(shard.lock);
+
+    unordered_map<uint64_t, Entry>::iterator found = shard.tiles.find(key);
+    if (found != shard.tiles.end())
+    {
+      ++hits;
+      if (sampled)
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second.lru);
+      return found->second.tile;
+    }
+  }
+
+  ++misses;
+
+  boost::shared_ptr<Tile> tile(
+      new Tile(TILE_SIZE * TILE_SIZE * TEXEL_CHANNELS, 0));
+
+  if (level == 0)
+    read_tile(get_image(id), tx, ty, *tile);
+  else
+    reduce_tile(id, level, tx, ty, *tile);
+
+  {
+    lock_guard<mutex> guard(shard.lock);
+
+    // Another thread may have loaded the tile meanwhile
+    unordered_map<uint64_t, Entry>::iterator found = shard.tiles.find(key);
+    if (found != shard.tiles.end())
+    {
+      if (sampled)
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second.lru);
+      return found->second.tile;
+    }
+
+    if (!sampled && bytes + tile->size() > max_bytes) return tile;
+
+    Entry &e = shard.tiles[key];
+    e.tile = tile;
+    e.lru = shard.lru.insert(sampled ? shard.lru.begin() : shard.lru.end(),
+                             key);
+    bytes += tile->size();
+  }
+
+  if (sampled) evict(key);
+
+  return tile;
+}
+
+/*!
+ * No lock may be held.  Shards are visited in turn, starting from a
+ * different shard each call, each giving up its least recently used tiles.
+ *
+ * \param keep  Key of a tile to keep (all ones for none)
+ */
+void TextureCache::evict(uint64_t keep)
+{
+  unsigned int first = next_evict++;
+
+  for (unsigned int i = 0; i < SHARDS && bytes > max_bytes; ++i)
+  {
+    Shard &shard = shards[(first + i) % SHARDS];
+    lock_guard<mutex> guard(shard.lock);
+
+    list<uint64_t>::iterator k = shard.lru.end();
+    while (bytes > max_bytes && k != shard.lru.begin())
+    {
+      --k;
+      if (*k == keep) continue;
+
+      unordered_map<uint64_t, Entry>::iterator e = shard.tiles.find(*k);
+      bytes -= e->second.tile->size();
+      shard.tiles.erase(e);
+      k = shard.lru.erase(k);
+    }
+  }
+}
+
+/*!
+ * Texture coordinates run from 0 to 1 across the level (from its top left
+ * corner, as stored), and wrap around outside that range.  Colors are the
+ * texels' 8-bit values scaled to [0, 1].
+ *
+ * \param img    An open image
+ * \param id     Id of the image
+ * \param level  Mip level to sample (within the image's levels)
+ * \param s      Horizontal texture coordinate
+ * \param t      Vertical texture coordinate
+ * \param memo   The last tile sampled from, updated to the last tile used
+ * \returns      Color at (s, t)
+ */
+Color TextureCache::bilinear(const Image &img, int id, int level, float s,
+                             float t, TileMemo &memo)
+{
+  int w = img.width[level], h = img.height[level];
+
+  // Texel coordinates, with texel centers at half integers
+  float x = (s - floor(s)) * w - 0.5f;
+  float y = (t - floor(t)) * h - 0.5f;
+
+  float fx = x - floor(x), fy = y - floor(y);
+  int x0 = int(floor(x)), y0 = int(floor(y));
+
+  int xs[2] = { (x0 + w) % w, (x0 + 1) % w };
+  int ys[2] = { (y0 + h) % h, (y0 + 1) % h };
+
+  float texel[2][2][TEXEL_CHANNELS];
+
+  for (int j = 0; j < 2; ++j)
+  {
+    for (int k = 0; k < 2; ++k)
+    {
+      int tx = xs[k] / TILE_SIZE, ty = ys[j] / TILE_SIZE;
+      uint64_t key = tile_key(id, level, tx, ty);
+
+      if (key != memo.key)
+      {
+        memo.tile = get_tile(id, level, tx, ty);
+        memo.key = key;
+      }
+
+      const unsigned char *p = &(*memo.tile)[
+          ((ys[j] % TILE_SIZE) * TILE_SIZE + xs[k] % TILE_SIZE)
+          * TEXEL_CHANNELS];
+
+      for (int ch = 0; ch < TEXEL_CHANNELS; ++ch)
+        texel[j][k][ch] = p[ch];
+    }
+  }
+
+  float rgb[TEXEL_CHANNELS];
+  for (int ch = 0; ch < TEXEL_CHANNELS; ++ch)
+  {
+    float top = texel[0][0][ch] + fx * (texel[0][1][ch] - texel[0][0][ch]);
+    float bottom = texel[1][0][ch] + fx * (texel[1][1][ch] - texel[1][0][ch]);
+    rgb[ch] = (top + fy * (bottom - top)) * (1.f / 255);
+  }
+
+  return Color(rgb[0], rgb[1], rgb[2]);
+}
+
+/*!
+ * Texture coordinates run from 0 to 1 across the image, and wrap around
+ * outside that range (see bilinear()).
+ *
+ * \param[in]  id     Id of an open image
+ * \param[in]  level  Mip level to sample (clamped to the image's levels)
+ * \param[in]  s      Horizontal texture coordinate of each point
+ * \param[in]  t      Vertical texture coordinate of each point
+ * \param[in]  n      Number of points
+ * \param[out] c      Color at each point
+ */
+void TextureCache::sample(int id, int level, const float *s, const float *t,
+                          unsigned int n, Color *c)
+{
+  const Image &img = get_image(id);
+  level = max(0, min(level, int(img.width.size()) - 1));
+
+  TileMemo memo;
+  for (unsigned int i = 0; i < n; ++i)
+    c[i] = bilinear(img, id, level, s[i], t[i], memo);
+}
+
+/*!
+ * Each point's level of detail is the log2 of its footprint in texels of
+ * the full image, so a footprint of one texel (or less) samples level 0,
+ * and of 2^k texels samples level k.  Fractional levels blend the two
+ * nearest levels.
+ *
+ * \param[in]  id   Id of an open image
+ * \param[in]  s    Horizontal texture coordinate of each point
+ * \param[in]  t    Vertical texture coordinate of each point
+ * \param[in]  lod  Level of detail of each point (clamped to the levels)
+ * \param[in]  n    Number of points
+ * \param[out] c    Color at each point
+ */
+void TextureCache::sample_filtered(int id, const float *s, const float *t,
+                                   const float *lod, unsigned int n, Color *c)
+{
+  const Image &img = get_image(id);
+  float last = float(img.width.size() - 1);
+
+  // Last tiles used on the finer & coarser of the two levels
+  TileMemo memo[2];
+
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    // (NaN, from a degenerate footprint, falls to level 0)
+    float l = (lod[i] > 0) ? min(lod[i], last) : 0.f;
+    int level = int(l);
+    float f = l - level;
+
+    c[i] = bilinear(img, id, level, s[i], t[i], memo[level & 1]);
+
+    if (f > 0)
+    {
+      Color coarse = bilinear(img, id, level + 1, s[i], t[i],
+                              memo[(level + 1) & 1]);
+      c[i] += (coarse - c[i]) * f;
+    }
+  }
+}
+
+/*!
+ * Tiles beyond the new budget are evicted straight away.
+ *
+ * \param max_bytes  Maximum total size of the loaded tiles in bytes
+ */
+void TextureCache::set_max_bytes(size_t max_bytes)
+{
+  this->max_bytes = max_bytes;
+  evict(~uint64_t(0));
+}
+
+size_t TextureCache::get_bytes() const
+{
+  return bytes;
+}
+
+uint64_t TextureCache::get_hits() const
+{
+  return hits;
+}
+
+uint64_t TextureCache::get_misses() const
+{
+  return misses;
+}
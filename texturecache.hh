@@ -0,0 +1,216 @@
+/* texturecache.hh
+ *
+ * A cache of tiles of mip-mapped image textures, within a memory budget
+ */
+
+#ifndef _TEXTURECACHE_HH__
+#define _TEXTURECACHE_HH__
+
+#include "color.hh"
+#include <boost/shared_ptr.hpp>
+#include <sys/types.h>
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! A cache of tiles of mip-mapped image textures, within a memory budget
+/*!
+ * Images are binary PPM (P6) files, which are opened by reading only their
+ * headers.  Each level of an image's mip map (each half the size of the
+ * last, down to a single texel) is split into square tiles, which are
+ * loaded when first sampled: tiles of the full image are read straight from
+ * their rows of the file, and tiles of each smaller level are averaged from
+ * the four tiles they cover on the level above.  Tiles built on the way
+ * to a smaller level are kept too while they fit in the budget (and are
+ * first in line for eviction), so each level is built once, and a tile of a
+ * small level which isn't loaded reduces just the four tiles it covers.
+ *
+ * Loaded tiles are kept until the total size of the tiles passes the
+ * budget, when the least recently used tiles are evicted.  So a scene may
+ * reference far more texture data than fits in memory, and only the tiles
+ * (and levels) its rays actually sample are ever held.
+ *
+ * The cache is thread safe.  Tiles are spread over SHARDS shards by key,
+ * each with its own lock, and each lock is held only to find or insert a
+ * tile: tiles are read and reduced with no lock held, so threads sampling
+ * other tiles carry on meanwhile.  (Two threads missing the same tile may
+ * both load it; the first inserted is kept.)  Recency is kept per shard, so
+ * the tiles evicted are the least recently used of their shards.
+ */
+class TextureCache
+{
+  //! Texels along each side of a tile
+  static const int TILE_SIZE = 32;
+
+  //! Number of bits of a tile's key choosing its shard
+  static const unsigned int SHARD_BITS = 4;
+  //! Number of independently locked shards of the tiles
+  static const unsigned int SHARDS = 1 << SHARD_BITS;
+
+  //! The texels of a tile, as 8-bit RGB in rows of TILE_SIZE texels
+  typedef std::vector<unsigned char> Tile;
+  //! Shared pointer to a tile (so a tile in use may be evicted)
+  typedef boost::shared_ptr<const Tile> SPTile;
+
+  //! An image opened for sampling (unchanged once opened)
+  struct Image
+  {
+    //! Path of the image's file
+    std::string path;
+    //! Descriptor of the open file, from which to read tiles of the full
+    //! image (with pread, so threads needn't share a file position)
+    int fd;
+    //! Offset of the first texel in the file
+    off_t data_offset;
+    //! Width of each level in texels
+    std::vector<int> width;
+    //! Height of each level in texels
+    std::vector<int> height;
+  };
+
+  //! Every image opened, indexed by id
+  typedef std::vector<Image> ImageTable;
+
+  //! A loaded tile and its place in its shard's recency list
+  struct Entry
+  {
+    //! The tile's texels
+    SPTile tile;
+    //! Position of the tile's key in the recency list
+    std::list<uint64_t>::iterator lru;
+  };
+
+  //! A share of the loaded tiles, under its own lock
+  struct Shard
+  {
+    //! Lock on the shard's tiles
+    std::mutex lock;
+    //! Loaded tiles, by key
+    std::unordered_map<uint64_t, Entry> tiles;
+    //! Keys of the loaded tiles, most recently used first
+    std::list<uint64_t> lru;
+  };
+
+  //! The latest table of images opened
+  /*!
+   * Opening an image publishes a new table rather than changing this one,
+   * so samples read it with no lock.
+   */
+  std::atomic<const ImageTable *> images;
+  //! Every table published (kept, as samples may still read older ones)
+  std::vector<boost::shared_ptr<const ImageTable> > tables;
+  //! Ids of images opened, by path
+  std::map<std::string, int> image_ids;
+  //! Hashes of the contents of images' files, by id (once hashed)
+  std::map<int, uint64_t> contents;
+  //! Lock on opening images, and on the image members above
+  mutable std::mutex image_lock;
+
+  //! The loaded tiles
+  Shard shards[SHARDS];
+  //! Shard from which to start evicting next (so shards take turns)
+  std::atomic<unsigned int> next_evict;
+
+  //! Maximum total size of the loaded tiles in bytes
+  std::atomic<std::size_t> max_bytes;
+  //! Total size of the loaded tiles in bytes
+  std::atomic<std::size_t> bytes;
+
+  //! Number of tiles found loaded
+  std::atomic<uint64_t> hits;
+  //! Number of tiles loaded
+  std::atomic<uint64_t> misses;
+
+  //! The last tile a sample used (consecutive samples mostly share tiles)
+  struct TileMemo
+  {
+    //! Key of the tile (all ones for none)
+    uint64_t key;
+    //! The tile
+    SPTile tile;
+
+    //! Default constructor gives no tile
+    TileMemo() : key(~uint64_t(0)), tile() { }
+  };
+
+  //! Accessor for an open image
+  const Image & get_image(int id) const;
+
+  //! Shard holding a tile
+  Shard & get_shard(uint64_t key);
+
+  //! Get a tile, loading it if need be
+  SPTile get_tile(int id, int level, int tx, int ty, bool sampled = true);
+
+  //! Bilinearly filtered color of a level of an image
+  Color bilinear(const Image &img, int id, int level, float s, float t,
+                 TileMemo &memo);
+
+  //! Read a tile of the full image from its file
+  void read_tile(const Image &img, int tx, int ty, Tile &tile) const;
+
+  //! Average a tile from the four tiles it covers on the level above
+  void reduce_tile(int id, int level, int tx, int ty, Tile &tile);
+
+  //! Evict least recently used tiles until within the budget
+  void evict(uint64_t keep);
+
+  // Not copyable: the locks & files belong to one cache
+  TextureCache(const TextureCache &);
+  TextureCache & operator=(const TextureCache &);
+
+  public:
+  // === Constants
+
+  //! Default maximum size of the loaded tiles (in bytes)
+  static const std::size_t default_max_bytes;
+
+  // === Constructors/Destructors & methods
+
+  //! Construct an empty cache
+  explicit TextureCache(std::size_t max_bytes = default_max_bytes);
+
+  //! Destructor closes the images' files
+  ~TextureCache();
+
+  //! Open an image, returning its id (or -1 if it couldn't be read)
+  int open(const std::string &path);
+
+  //! Accessor for the number of mip levels of an image
+  int get_levels(int id) const;
+  //! Accessor for the width of a mip level of an image
+  int get_width(int id, int level = 0) const;
+  //! Accessor for the height of a mip level of an image
+  int get_height(int id, int level = 0) const;
+
+  //! Hash of the contents of an image's file
+  uint64_t get_contents_hash(int id);
+
+  //! Bilinearly filtered colors of an image at texture coordinates
+  void sample(int id, int level, const float *s, const float *t,
+              unsigned int n, Color *c);
+
+  //! Trilinearly filtered colors of an image, at a level of detail each
+  void sample_filtered(int id, const float *s, const float *t,
+                       const float *lod, unsigned int n, Color *c);
+
+  //! Mutator for the maximum size of the loaded tiles
+  void set_max_bytes(std::size_t max_bytes);
+
+  //! Accessor for the total size of the loaded tiles
+  std::size_t get_bytes() const;
+  //! Accessor for the number of tiles found loaded
+  uint64_t get_hits() const;
+  //! Accessor for the number of tiles loaded
+  uint64_t get_misses() const;
+};
+
+//! Boost Shared Pointer to a TextureCache
+typedef boost::shared_ptr<TextureCache> SPTextureCache;
+
+#endif
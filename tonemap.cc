@@ -0,0 +1,166 @@
+/* tonemap.cc
+ *
+ * Mapping of high dynamic range colors to 8-bit display values
+ */
+
+#include "tonemap.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//! Number of entries in the transfer function table
+/*!
+ * Steep enough near black for sRGB to stay within a tenth of a level.
+ */
+static const int LUT_SIZE = 1 << 14;
+
+//! Number of pixels mapped at a time (fits on the stack)
+static const int CHUNK_PIXELS = 64;
+
+//! Coefficients of Narkowicz's ACES fit: x (a x + b) / (x (c x + d) + e)
+static const float ACES_A = 2.51f, ACES_B = 0.03f, ACES_C = 2.43f,
+                   ACES_D = 0.59f, ACES_E = 0.14f;
+
+//! 8x8 Bayer matrix for ordered dithering
+static const unsigned char BAYER[8][8] = {
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 } };
+
+/*!
+ * \param exposure  Exposure adjustment in stops
+ * \param op        Tone curve
+ * \param srgb      Whether to encode with the sRGB transfer function
+ *                  (otherwise values are quantized linearly)
+ * \param dither    Whether to dither values before quantizing
+ */
+ToneMap::ToneMap(float exposure, Operator op, bool srgb, bool dither)
+  : scale(pow(2.f, exposure))
+  , op(op)
+  , dither(dither)
+  , lut(LUT_SIZE)
+{
+  for (int i = 0; i < LUT_SIZE; ++i)
+  {
+    double v = double(i) / (LUT_SIZE - 1);
+
+    if (srgb)
+      v = (v <= 0.0031308) ? 12.92 * v : 1.055 * pow(v, 1 / 2.4) - 0.055;
+
+    lut[i] = float(v * 255 + 0.5);
+  }
+}
+
+/*!
+ * \param[in]  v      Channel values (scaled by exposure)
+ * \param[in]  count  Number of values
+ * \param[in]  op     Tone curve
+ * \param[out] index  Table index for each value
+ */
+static void to_indices(const float *v, int count, ToneMap::Operator op,
+                       int *index)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+  const __m128 last = _mm_set1_ps(LUT_SIZE - 1);
+
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(v + i);
+
+    if (op == ToneMap::REINHARD)
+    {
+      x = _mm_div_ps(x, _mm_add_ps(one, x));
+    }
+    else if (op == ToneMap::ACES)
+    {
+      __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ACES_A), x),
+                                            _mm_set1_ps(ACES_B)));
+      __m128 den = _mm_add_ps(
+          _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ACES_C), x),
+                                   _mm_set1_ps(ACES_D))),
+          _mm_set1_ps(ACES_E));
+      x = _mm_div_ps(num, den);
+    }
+
+    // Clamp to [0,1] (NaN becomes 1) & round to the nearest entry
+    x = _mm_max_ps(_mm_min_ps(x, one), zero);
+    __m128i k = _mm_cvtps_epi32(_mm_mul_ps(x, last));
+    _mm_storeu_si128((__m128i *) (index + i), k);
+  }
+#endif
+
+  for (; i < count; ++i)
+  {
+    float x = v[i];
+
+    if (op == ToneMap::REINHARD)
+      x = x / (1 + x);
+    else if (op == ToneMap::ACES)
+      x = x * (ACES_A * x + ACES_B) / (x * (ACES_C * x + ACES_D) + ACES_E);
+
+    x = (x < 1) ? x : 1;
+    x = (x > 0) ? x : 0;
+    index[i] = int(x * (LUT_SIZE - 1) + 0.5f);
+  }
+}
+
+/*!
+ * \param[in]  sums   Summed samples of each pixel of the row
+ * \param[in]  n      Number of samples in each pixel (nonzero)
+ * \param[in]  y      Row of the image (for dithering)
+ * \param[in]  width  Number of pixels in the row
+ * \param[out] rgb    Red, green & blue bytes of each pixel (3 * width bytes)
+ */
+void ToneMap::map_row(const Color *sums, unsigned int n, int y, int width,
+                      unsigned char *rgb) const
+{
+  assert(n > 0);
+
+  float v[3 * CHUNK_PIXELS];
+  int index[3 * CHUNK_PIXELS];
+
+  // Thresholds for this row, centered on zero
+  float threshold[8];
+  for (int x = 0; x < 8; ++x)
+    threshold[x] = dither ? (BAYER[y & 7][x] + 0.5f) / 64 - 0.5f : 0;
+
+  float s = scale / n;
+
+  for (int x0 = 0; x0 < width; x0 += CHUNK_PIXELS)
+  {
+    int pixels = min(CHUNK_PIXELS, width - x0);
+
+    for (int x = 0; x < pixels; ++x)
+    {
+      const Color &c = sums[x0 + x];
+      v[3 * x] = c.get_red() * s;
+      v[3 * x + 1] = c.get_green() * s;
+      v[3 * x + 2] = c.get_blue() * s;
+    }
+
+    to_indices(v, 3 * pixels, op, index);
+
+    // (Table values are in [0.5, 255.5], so adding a threshold & truncating
+    // rounds to a level in [0, 255])
+    for (int x = 0; x < pixels; ++x)
+    {
+      float t = threshold[(x0 + x) & 7];
+      for (int k = 0; k < 3; ++k)
+        *rgb++ = (unsigned char) (lut[index[3 * x + k]] + t);
+    }
+  }
+}
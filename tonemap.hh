@@ -0,0 +1,56 @@
+/* tonemap.hh
+ *
+ * Mapping of high dynamic range colors to 8-bit display values
+ */
+
+#ifndef _TONEMAP_HH__
+#define _TONEMAP_HH__
+
+#include "color.hh"
+#include <vector>
+
+//! Mapping of averaged pixel colors to 8-bit RGB for display
+/*!
+ * Each channel is scaled by the exposure, compressed by a tone curve,
+ * clamped to [0,1], encoded with the display's transfer function and
+ * quantized, optionally with ordered dithering to break up banding.
+ *
+ * The transfer function is tabulated, so mapping a pixel costs no powers;
+ * the arithmetic up to the table lookup is done four channels at a time.
+ * Mapping is thread safe, so rows may be mapped in parallel.
+ */
+class ToneMap
+{
+  public:
+  //! Tone curve compressing colors into [0,1]
+  enum Operator
+  {
+    CLAMP,     //!< None: colors above 1 are clipped
+    REINHARD,  //!< c / (1 + c)
+    ACES       //!< Narkowicz's fit of the ACES filmic curve
+  };
+
+  private:
+  //! Multiplier for colors (2 to the power of the exposure)
+  float scale;
+  //! Tone curve
+  Operator op;
+  //! Whether values are dithered before quantizing
+  bool dither;
+
+  //! 8-bit value (plus 0.5 for rounding) at evenly spaced points of [0,1]
+  std::vector<float> lut;
+
+  public:
+  // === Constructors & methods
+
+  //! Construct a tone map
+  ToneMap(float exposure = 0, Operator op = CLAMP, bool srgb = false,
+          bool dither = false);
+
+  //! Map a row of summed colors to 8-bit RGB
+  void map_row(const Color *sums, unsigned int n, int y, int width,
+               unsigned char *rgb) const;
+};
+
+#endif
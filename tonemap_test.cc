@@ -0,0 +1,112 @@
+/* tonemap_test.cc
+ *
+ * gtest Unit Test Suite for tone mapping
+ */
+
+#include "tonemap.hh"
+#include "framebuffer.hh"
+#include <gtest/gtest.h>
+#include <cmath>
+
+using namespace std;
+using namespace testing;
+
+// Map a single color (one sample) in the first column & row
+static int map1(const ToneMap &tm, float v)
+{
+  Color c(v, v, v);
+  unsigned char rgb[3];
+  tm.map_row(&c, 1, 0, 1, rgb);
+  EXPECT_EQ(rgb[0], rgb[1]);
+  EXPECT_EQ(rgb[0], rgb[2]);
+  return rgb[0];
+}
+
+// Without any mapping, the result matches plain clamping & rounding
+TEST(ToneMapTest, Linear)
+{
+  Framebuffer fb(37, 3), fb_tm(37, 3);
+  for (int y = 0; y < 3; ++y)
+  {
+    for (int x = 0; x < 37; ++x)
+    {
+      Color c(x / 30.f, 0.003f * x * y, 1.f - x / 36.f);
+      fb.add(x, y, c);
+      fb_tm.add(x, y, c);
+    }
+  }
+
+  ToneMap tm;
+  fb_tm.set_tone_map(&tm);
+
+  unsigned char rgb[3 * 37], rgb_tm[3 * 37];
+  for (int y = 0; y < 3; ++y)
+  {
+    fb.get_rgb8(y, 1, rgb);
+    fb_tm.get_rgb8(y, 1, rgb_tm);
+
+    for (int i = 0; i < 3 * 37; ++i)
+      EXPECT_NEAR(rgb[i], rgb_tm[i], 1) << i;
+  }
+}
+
+// The sRGB curve, exposure & tone curves
+TEST(ToneMapTest, Curves)
+{
+  ToneMap srgb(0, ToneMap::CLAMP, true);
+  EXPECT_EQ(0, map1(srgb, 0));
+  EXPECT_EQ(255, map1(srgb, 1));
+  EXPECT_EQ(255, map1(srgb, 7));
+  EXPECT_EQ(188, map1(srgb, 0.5f));
+  EXPECT_EQ(13, map1(srgb, 0.004f));
+
+  ToneMap exposed(-2);
+  EXPECT_EQ(64, map1(exposed, 1));
+
+  // Reinhard maps 1 to a half, & compresses highlights gradually
+  ToneMap reinhard(0, ToneMap::REINHARD);
+  EXPECT_EQ(128, map1(reinhard, 1));
+  EXPECT_EQ(232, map1(reinhard, 10));
+  EXPECT_EQ(252, map1(reinhard, 100));
+
+  // ACES is nearly linear near black, & saturates
+  ToneMap aces(0, ToneMap::ACES);
+  EXPECT_EQ(0, map1(aces, 0));
+  EXPECT_EQ(255, map1(aces, 20));
+  EXPECT_LT(map1(aces, 0.1f), map1(aces, 0.2f));
+}
+
+// Dithering a value between two levels mixes both, averaging to the value
+TEST(ToneMapTest, Dither)
+{
+  const int w = 16;
+  vector<Color> row(w, Color(0.3f, 0.3f, 0.3f));
+  unsigned char rgb[3 * w];
+
+  ToneMap plain, dithered(0, ToneMap::CLAMP, false, true);
+
+  double sum = 0;
+  for (int y = 0; y < 8; ++y)
+  {
+    plain.map_row(&row[0], 1, y, w, rgb);
+    for (int i = 0; i < 3 * w; ++i)
+      EXPECT_EQ(77, rgb[i]);
+
+    dithered.map_row(&row[0], 1, y, w, rgb);
+    for (int i = 0; i < 3 * w; ++i)
+    {
+      EXPECT_TRUE(rgb[i] == 76 || rgb[i] == 77) << int(rgb[i]);
+      sum += rgb[i];
+    }
+  }
+
+  EXPECT_NEAR(0.3 * 255, sum / (8 * 3 * w), 0.05);
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,256 @@
+/*! \file
+ * \brief An affine transformation of 3D space.
+ */
+
+#ifndef _TRANSFORM_HH__
+#define _TRANSFORM_HH__
+
+#include "vector.hh"
+#include "aabb.hh"
+#include "hash.hh"
+#include <cmath>
+
+//! An invertible affine transformation, stored with its inverse
+/*!
+ * Transforms are built up from translations, rotations and scales, each of
+ * whose inverse is known exactly, so the inverse of any composition is kept
+ * alongside it rather than computed by inverting a matrix.
+ *
+ * Each is stored as the top three rows of a 4x4 matrix (the bottom row of
+ * an affine transform always being 0 0 0 1).
+ */
+class Transform
+{
+  //! Matrix mapping points to their transformed positions
+  float m[3][4];
+  //! Matrix of the inverse transform
+  float inv[3][4];
+
+  //! Product of two matrices (as 4x4 affine matrices)
+  static void multiply(const float a[3][4], const float b[3][4],
+                       float result[3][4]);
+
+  public:
+  // === Constructors & methods
+
+  //! Default constructor gives the identity
+  Transform();
+
+  //! Construct a translation
+  static Transform translate(const Vector3F &offset);
+
+  //! Construct a rotation (right-handed) about an axis through the origin
+  static Transform rotate(const Vector3F &axis, float degrees);
+
+  //! Construct a scale along each axis (each must be non-zero)
+  static Transform scale(const Vector3F &factors);
+
+  //! Composition, applying another transform and then this one
+  Transform operator*(const Transform &t) const;
+
+  //! Inverse of the transform
+  Transform get_inverse() const;
+
+  //! Transform a point
+  Vector3F apply_point(const Vector3F &p) const;
+
+  //! Transform a direction (ignoring translation)
+  Vector3F apply_vector(const Vector3F &v) const;
+
+  //! Transform a surface normal (not normalized)
+  Vector3F apply_normal(const Vector3F &n) const;
+
+  //! Box bounding a transformed box
+  AABB apply_bounds(const AABB &b) const;
+
+  //! Add the transform to a hash
+  void hash(Hash &h) const;
+};
+
+// === Inline function definitions
+
+inline Transform::Transform()
+{
+  for (unsigned int i = 0; i < 3; ++i)
+    for (unsigned int j = 0; j < 4; ++j)
+      m[i][j] = inv[i][j] = (i == j) ? 1 : 0;
+}
+
+inline void Transform::multiply(const float a[3][4], const float b[3][4],
+                                float result[3][4])
+{
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    for (unsigned int j = 0; j < 4; ++j)
+    {
+      result[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j]
+                     + a[i][2] * b[2][j];
+    }
+
+    result[i][3] += a[i][3];
+  }
+}
+
+/*!
+ * \param offset  Vector by which to move points
+ */
+inline Transform Transform::translate(const Vector3F &offset)
+{
+  Transform t;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    t.m[i][3] = offset[i];
+    t.inv[i][3] = -offset[i];
+  }
+
+  return t;
+}
+
+/*!
+ * Uses Rodrigues' rotation formula.  The inverse is the transpose.
+ *
+ * \param axis     Axis of rotation (must be non-zero)
+ * \param degrees  Angle of rotation, counter-clockwise looking down the axis
+ */
+inline Transform Transform::rotate(const Vector3F &axis, float degrees)
+{
+  Vector3F a = axis.get_normalized();
+  float rad = degrees * float(M_PI) / 180;
+  float c = std::cos(rad), s = std::sin(rad);
+
+  Transform t;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    for (unsigned int j = 0; j < 3; ++j)
+    {
+      // (1 - cos) a a^T + cos I + sin [a]x
+      float r = (1 - c) * a[i] * a[j] + ((i == j) ? c : 0);
+
+      if ((j + 3 - i) % 3 == 1)
+        r -= s * a[3 - i - j];
+      else if ((j + 3 - i) % 3 == 2)
+        r += s * a[3 - i - j];
+
+      t.m[i][j] = r;
+      t.inv[j][i] = r;
+    }
+  }
+
+  return t;
+}
+
+/*!
+ * \param factors  Factor by which to scale along each axis
+ */
+inline Transform Transform::scale(const Vector3F &factors)
+{
+  Transform t;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    t.m[i][i] = factors[i];
+    t.inv[i][i] = 1 / factors[i];
+  }
+
+  return t;
+}
+
+/*!
+ * \param t  Transform to apply first
+ * \returns  Transform applying t and then this
+ */
+inline Transform Transform::operator*(const Transform &t) const
+{
+  Transform result;
+
+  multiply(m, t.m, result.m);
+  multiply(t.inv, inv, result.inv);
+
+  return result;
+}
+
+inline Transform Transform::get_inverse() const
+{
+  Transform result;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    for (unsigned int j = 0; j < 4; ++j)
+    {
+      result.m[i][j] = inv[i][j];
+      result.inv[i][j] = m[i][j];
+    }
+  }
+
+  return result;
+}
+
+inline Vector3F Transform::apply_point(const Vector3F &p) const
+{
+  Vector3F result;
+
+  for (unsigned int i = 0; i < 3; ++i)
+    result[i] = m[i][0] * p[0] + m[i][1] * p[1] + m[i][2] * p[2] + m[i][3];
+
+  return result;
+}
+
+inline Vector3F Transform::apply_vector(const Vector3F &v) const
+{
+  Vector3F result;
+
+  for (unsigned int i = 0; i < 3; ++i)
+    result[i] = m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+
+  return result;
+}
+
+/*!
+ * Normals transform by the inverse transpose, so they stay perpendicular
+ * to transformed surfaces.  The result must be normalized if the transform
+ * scales.
+ */
+inline Vector3F Transform::apply_normal(const Vector3F &n) const
+{
+  Vector3F result;
+
+  for (unsigned int i = 0; i < 3; ++i)
+    result[i] = inv[0][i] * n[0] + inv[1][i] * n[1] + inv[2][i] * n[2];
+
+  return result;
+}
+
+/*!
+ * Transforms the box's center, and its half-extents by the absolute values
+ * of the matrix (as in Arvo, Graphics Gems, 1990), which gives the tightest
+ * box around the transformed corners.
+ *
+ * \param b  Box to transform (may be empty)
+ */
+inline AABB Transform::apply_bounds(const AABB &b) const
+{
+  if (b.empty()) return b;
+
+  Vector3F c = apply_point(b.get_center());
+  Vector3F e = 0.5f * (b.get_max() - b.get_min());
+  Vector3F ext;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    ext[i] = std::fabs(m[i][0]) * e[0] + std::fabs(m[i][1]) * e[1]
+             + std::fabs(m[i][2]) * e[2];
+  }
+
+  return AABB(c - ext, c + ext);
+}
+
+inline void Transform::hash(Hash &h) const
+{
+  for (unsigned int i = 0; i < 3; ++i)
+    for (unsigned int j = 0; j < 4; ++j)
+      h.add(m[i][j]);
+}
+
+#endif
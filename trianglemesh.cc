@@ -0,0 +1,568 @@
+/* trianglemesh.cc
+ *
+ * A SceneObject representing an indexed mesh of triangles
+ */
+
+#include "trianglemesh.hh"
+#include "rebase.hh"
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+//! Tolerance of get_normal() relative to the size of the mesh
+static const float NORMAL_TOLERANCE = 1e-4f;
+
+// Construct an empty mesh with default color & reflectivity
+TriangleMesh::TriangleMesh()
+  : tolerance(0)
+{ }
+
+// Construct an empty mesh
+/*!
+ * \param c   Surface color of mesh
+ * \param r   Surface reflectivity of mesh
+ */
+TriangleMesh::TriangleMesh(const Color &c, float r)
+  : SceneObject(c, r)
+  , tolerance(0)
+{ }
+
+/*!
+ * \param p  Position of the vertex
+ * \returns  Index of the new vertex
+ */
+unsigned int TriangleMesh::add_vertex(const Vector3F &p)
+{
+  xs.push_back(p[0]);
+  ys.push_back(p[1]);
+  zs.push_back(p[2]);
+
+  bounds.expand(p);
+
+  return xs.size() - 1;
+}
+
+/*!
+ * The corners must already have been added.  The triangle faces the side
+ * from which they run counter-clockwise.
+ *
+ * \param a  Index of the first corner
+ * \param b  Index of the second corner
+ * \param c  Index of the third corner
+ */
+void TriangleMesh::add_triangle(unsigned int a, unsigned int b,
+                                unsigned int c)
+{
+  assert(a < xs.size() && b < xs.size() && c < xs.size());
+
+  corner[0].push_back(a);
+  corner[1].push_back(b);
+  corner[2].push_back(c);
+}
+
+/*!
+ * Must be called after the last triangle is added, and before the mesh is
+ * intersected (or added to a Scene which is then prepared).
+ */
+void TriangleMesh::build()
+{
+  vector<AABB> tri_bounds(get_triangle_count());
+
+  for (unsigned int i = 0; i < tri_bounds.size(); ++i)
+  {
+    for (unsigned int k = 0; k < 3; ++k)
+      tri_bounds[i].expand(get_vertex(corner[k][i]));
+  }
+
+  bvh.build(tri_bounds);
+
+  // Hit points are only as precise as the coordinates around them
+  float size = 1;
+  if (!bounds.empty())
+  {
+    for (unsigned int k = 0; k < 3; ++k)
+    {
+      size = fmax(size, fabs(bounds.get_min()[k]));
+      size = fmax(size, fabs(bounds.get_max()[k]));
+    }
+  }
+
+  tolerance = NORMAL_TOLERANCE * size;
+}
+
+/*!
+ * \param tri  Index of a triangle with non-zero area
+ * \returns    Unit normal, facing the side from which its corners run
+ *             counter-clockwise
+ */
+Vector3F TriangleMesh::get_triangle_normal(unsigned int tri) const
+{
+  Vector3F a = get_vertex(corner[0][tri]);
+  Vector3F b = get_vertex(corner[1][tri]);
+  Vector3F c = get_vertex(corner[2][tri]);
+
+  return cross(b - a, c - a).get_normalized();
+}
+
+/*!
+ * \param r  Ray to transform
+ */
+TriangleMesh::ShearedRay::ShearedRay(const Ray &r)
+  : orig(r.get_orig())
+{
+  const Vector3F &dir = r.get_dir();
+
+  // Axis along which the ray is longest becomes z
+  kz = 0;
+  if (fabs(dir[1]) > fabs(dir[kz])) kz = 1;
+  if (fabs(dir[2]) > fabs(dir[kz])) kz = 2;
+
+  kx = (kz + 1) % 3;
+  ky = (kx + 1) % 3;
+
+  // Preserve the winding of triangles
+  if (dir[kz] < 0) swap(kx, ky);
+
+  sx = dir[kx] / dir[kz];
+  sy = dir[ky] / dir[kz];
+  sz = 1 / dir[kz];
+}
+
+/*!
+ * \param r    Ray to intersect
+ * \param tri  Index of the triangle
+ * \returns    The t value of the intersection (if in front of the origin),
+ *             or SceneObject::no_intersection
+ */
+float TriangleMesh::intersect_triangle(const Ray &r, unsigned int tri) const
+{
+  return intersect_triangle(ShearedRay(r), tri);
+}
+
+/*!
+ * Uses the watertight test of Woop, Benthin & Wald (2013).  The corners are
+ * translated to the ray's origin and sheared so the ray runs along an axis;
+ * the ray then hits the triangle iff the origin lies within the corners'
+ * projection, judged by the signs of three 2D edge functions.  Points on an
+ * edge shared by two triangles give an edge function of exactly 0 in both,
+ * so such rays hit one or both of them but never slip between.  Edge
+ * functions which round to 0 are recomputed in double precision.
+ *
+ * \param sr   Ray to intersect
+ * \param tri  Index of the triangle
+ * \returns    The t value of the intersection (if in front of the origin),
+ *             or SceneObject::no_intersection
+ */
+float TriangleMesh::intersect_triangle(const ShearedRay &sr,
+                                       unsigned int tri) const
+{
+  const unsigned int kx = sr.kx, ky = sr.ky, kz = sr.kz;
+  const float sx = sr.sx, sy = sr.sy, sz = sr.sz;
+
+  // Corners relative to the ray's origin
+  Vector3F a = get_vertex(corner[0][tri]) - sr.orig;
+  Vector3F b = get_vertex(corner[1][tri]) - sr.orig;
+  Vector3F c = get_vertex(corner[2][tri]) - sr.orig;
+
+  float ax = a[kx] - sx * a[kz], ay = a[ky] - sy * a[kz];
+  float bx = b[kx] - sx * b[kz], by = b[ky] - sy * b[kz];
+  float cx = c[kx] - sx * c[kz], cy = c[ky] - sy * c[kz];
+
+  // Edge functions (scaled barycentric coordinates)
+  float u = cx * by - cy * bx;
+  float v = ax * cy - ay * cx;
+  float w = bx * ay - by * ax;
+
+  if (u == 0 || v == 0 || w == 0)
+  {
+    u = float(double(cx) * by - double(cy) * bx);
+    v = float(double(ax) * cy - double(ay) * cx);
+    w = float(double(bx) * ay - double(by) * ax);
+  }
+
+  // Origin must lie on the same side of every edge
+  if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+    return no_intersection;
+
+  float det = u + v + w;
+  if (det == 0) return no_intersection;
+
+  // Scaled distance along the ray
+  float t_scaled = u * sz * a[kz] + v * sz * b[kz] + w * sz * c[kz];
+
+  float t = t_scaled / det;
+  if (!(t > 0)) return no_intersection;
+
+  return t;
+}
+
+// Identify first intersection with a ray
+// (See sceneobject.hh)
+float TriangleMesh::intersection(const Ray &r) const
+{
+  unsigned int tri;
+  return intersection_from(r, no_primitive, tri);
+}
+
+// Identify first intersection with a ray, and the primitive hit
+/*!
+ * Primitives are triangles.  A ray leaving a triangle skips just that
+ * triangle, as a flat surface can't be hit again by a ray leaving it, while
+ * its neighbours (across a concave edge, say) can be.
+ *
+ * \param[in]  r     Ray to intersect
+ * \param[in]  from  Triangle on which the ray starts, or no_primitive
+ * \param[out] prim  Triangle hit (if any)
+ * \returns          The t value of the nearest intersection
+ *                   or SceneObject::no_intersection
+ */
+float TriangleMesh::intersection_from(const Ray &r, unsigned int from,
+                                      unsigned int &prim) const
+{
+  const Vector3F &orig = r.get_orig();
+  const Vector3F &dir = r.get_dir();
+  Vector3F inv_dir = {1 / dir[0], 1 / dir[1], 1 / dir[2]};
+
+  ShearedRay sr(r);
+  float t = FLT_MAX;
+
+  // Only nodes reached before the nearest intersection found so far
+  bvh.traverse(
+      [&](const AABB &b) { return b.intersects(orig, inv_dir, t); },
+      [&](unsigned int i)
+      {
+        if (i == from) return;
+
+        float intxn = intersect_triangle(sr, i);
+
+        if (intxn != no_intersection && intxn < t)
+        {
+          t = intxn;
+          prim = i;
+        }
+      });
+
+  return (t == FLT_MAX) ? no_intersection : t;
+}
+
+/*!
+ * Finds the closest point of the triangle by the regions of its Voronoi
+ * diagram (as in Ericson, Real-Time Collision Detection, 5.1.5).
+ *
+ * \param p    A point
+ * \param tri  Index of a triangle
+ * \returns    Squared distance from p to the nearest point of the triangle
+ */
+float TriangleMesh::dist_sq_to_triangle(const Vector3F &p,
+                                        unsigned int tri) const
+{
+  Vector3F a = get_vertex(corner[0][tri]);
+  Vector3F b = get_vertex(corner[1][tri]);
+  Vector3F c = get_vertex(corner[2][tri]);
+
+  Vector3F ab = b - a, ac = c - a, ap = p - a;
+
+  // Vertex region of a
+  float d1 = dot(ab, ap), d2 = dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) return ap.norm_sq();
+
+  // Vertex region of b
+  Vector3F bp = p - b;
+  float d3 = dot(ab, bp), d4 = dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) return bp.norm_sq();
+
+  // Edge region of ab
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    return (ap - ab * (d1 / (d1 - d3))).norm_sq();
+
+  // Vertex region of c
+  Vector3F cp = p - c;
+  float d5 = dot(ab, cp), d6 = dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) return cp.norm_sq();
+
+  // Edge region of ac
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    return (ap - ac * (d2 / (d2 - d6))).norm_sq();
+
+  // Edge region of bc
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+    return (bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))).norm_sq();
+
+  // Face region
+  float denom = va + vb + vc;
+  if (denom == 0) return ap.norm_sq();
+
+  Vector3F n = cross(ab, ac);
+  float d = dot(ap, n);
+  return d * d / n.norm_sq();
+}
+
+// Get the normal to the surface at a point p
+/*!
+ * The point is matched to the triangle nearest it, among those whose
+ * bounds (widened by the tolerance of hit points) contain it.
+ *
+ * \param p A point assumed to be on the mesh's surface
+ * \returns The normal of the triangle on which p lies
+ */
+Vector3F TriangleMesh::get_normal(const Vector3F &p) const
+{
+  Vector3F margin = {tolerance, tolerance, tolerance};
+
+  unsigned int best = 0;
+  float best_dist_sq = FLT_MAX;
+
+  bvh.traverse(
+      [&](const AABB &b)
+      { return AABB(b.get_min() - margin, b.get_max() + margin).contains(p); },
+      [&](unsigned int i)
+      {
+        // Degenerate triangles are never hit
+        Vector3F a = get_vertex(corner[0][i]);
+        if (cross(get_vertex(corner[1][i]) - a,
+                  get_vertex(corner[2][i]) - a).norm_sq() == 0)
+          return;
+
+        float d = dist_sq_to_triangle(p, i);
+        if (d < best_dist_sq)
+        {
+          best = i;
+          best_dist_sq = d;
+        }
+      });
+
+  assert(best_dist_sq != FLT_MAX);
+
+  return get_triangle_normal(best);
+}
+
+// Get the normal to the surface at a point p on a known triangle
+/*!
+ * \param p     A point on the mesh's surface (unused)
+ * \param prim  Triangle hit at p, from intersection_from()
+ * \returns     The normal of the triangle
+ */
+Vector3F TriangleMesh::get_normal(const Vector3F &p, unsigned int prim) const
+{
+  return get_triangle_normal(prim);
+}
+
+// Get a bounding box for the object
+// (See sceneobject.hh)
+bool TriangleMesh::get_bounds(AABB &b) const
+{
+  b = bounds;
+  return true;
+}
+
+// Add everything affecting the object's appearance to a hash
+// (See sceneobject.hh)
+void TriangleMesh::hash(Hash &h) const
+{
+  SceneObject::hash(h);
+
+  h.add(uint32_t(xs.size()));
+  for (unsigned int i = 0; i < xs.size(); ++i)
+    h.add(xs[i]).add(ys[i]).add(zs[i]);
+
+  h.add(uint32_t(get_triangle_count()));
+  for (unsigned int i = 0; i < get_triangle_count(); ++i)
+    h.add(uint32_t(corner[0][i])).add(uint32_t(corner[1][i]))
+     .add(uint32_t(corner[2][i]));
+}
+
+// Name of the object's type, for hashing
+// (See sceneobject.hh)
+const char *TriangleMesh::type_tag() const
+{
+  return "TriangleMesh";
+}
+
+/*!
+ * Parses the vertex of a face, "v", "v/vt", "v//vn" or "v/vt/vn", of which
+ * only the position index is used.  Negative indices count back from the
+ * last vertex read.
+ *
+ * \param[in,out] s      Position in the line, advanced past the vertex
+ * \param[in]     count  Number of vertices read so far
+ * \param[out]    v      Index of the vertex (from 0)
+ * \returns              true if a valid vertex was read
+ */
+static bool parse_face_vertex(const char *&s, unsigned int count,
+                              unsigned int &v)
+{
+  char *end;
+  errno = 0;
+  long i = strtol(s, &end, 10);
+
+  if (end == s || errno != 0) return false;
+  s = end;
+
+  // Skip texture coordinate & normal indices
+  while (*s != '\0' && !isspace((unsigned char) *s)) ++s;
+
+  if (i > 0 && (unsigned long) i <= count)
+    v = i - 1;
+  else if (i < 0 && (unsigned long) -i <= count)
+    v = count + i;
+  else
+    return false;
+
+  return true;
+}
+
+/*! \relates TriangleMesh
+ * Reads "v x y z" vertex lines and "f v1 v2 v3 ..." face lines, adding them
+ * to the mesh.  Faces with more than three vertices are split into a fan of
+ * triangles.  Faces may only refer to vertices already read.  All other
+ * lines (texture coordinates, normals, groups, materials & comments) are
+ * ignored.
+ *
+ * The file is read a line at a time, parsing each in place, so that very
+ * large files are read with little more memory than the mesh itself.
+ *
+ * If the stream has an origin (see rebase.hh), vertex positions are read
+ * in double precision and made relative to it.
+ *
+ * The mesh's hierarchy is not built.
+ *
+ * \param is    Input stream from which to read the OBJ file
+ * \param mesh  Mesh to which to add the vertices and triangles
+ * \returns     true if the whole file was read successfully
+ */
+bool read_OBJ(std::istream &is, TriangleMesh &mesh)
+{
+  // Indices of the first vertex read, and of each face's vertices
+  unsigned int base = mesh.get_vertex_count();
+  vector<unsigned int> face;
+
+  const Vector3D *origin = get_read_origin(is);
+
+  string line;
+  int ln = 0;
+
+  while (getline(is, line))
+  {
+    ++ln;
+
+    const char *s = line.c_str();
+    while (isspace((unsigned char) *s)) ++s;
+
+    if (s[0] == 'v' && isspace((unsigned char) s[1]))
+    {
+      // Vertex position
+      Vector3F p;
+      char *end;
+      ++s;
+
+      for (unsigned int k = 0; k < 3; ++k, s = end)
+      {
+        if (origin == NULL)
+          p[k] = strtof(s, &end);
+        else
+          p[k] = float(strtod(s, &end) - (*origin)[k]);
+
+        if (end == s)
+        {
+          cerr << "Error: Couldn't read OBJ vertex on line " << ln << endl;
+          return false;
+        }
+      }
+
+      mesh.add_vertex(p);
+    }
+    else if (s[0] == 'f' && isspace((unsigned char) s[1]))
+    {
+      // Face, as a fan of triangles about its first vertex
+      unsigned int count = mesh.get_vertex_count() - base;
+      face.clear();
+      ++s;
+
+      while (true)
+      {
+        while (isspace((unsigned char) *s)) ++s;
+        if (*s == '\0') break;
+
+        unsigned int v;
+        if (!parse_face_vertex(s, count, v))
+        {
+          cerr << "Error: Invalid OBJ face vertex on line " << ln << endl;
+          return false;
+        }
+
+        face.push_back(base + v);
+      }
+
+      if (face.size() < 3)
+      {
+        cerr << "Error: OBJ face with fewer than 3 vertices on line " << ln
+             << endl;
+        return false;
+      }
+
+      for (unsigned int i = 2; i < face.size(); ++i)
+        mesh.add_triangle(face[0], face[i - 1], face[i]);
+    }
+  }
+
+  return is.eof();
+}
+
+/*! \relates TriangleMesh
+ * Reads a TriangleMesh from the provided input stream in the format:
+ * "file color reflectivity"
+ *
+ * With the read formats for Colors, this looks like:
+ * "file.obj [r g b] reflectivity"
+ *
+ * The named Wavefront OBJ file (which may not contain spaces in its name)
+ * is read with read_OBJ, relative to the stream's origin if it has one,
+ * and the mesh's hierarchy built.
+ *
+ * \param is     Input stream from which to read a new TriangleMesh
+ * \param arena  Arena in which to allocate the new object
+ * \returns      Pointer to a new TriangleMesh, or NULL if reading failed
+ */
+SPSceneObject read_TriangleMesh(std::istream &is, Arena &arena)
+{
+  // Check if stream is already bad
+  if (!is) return SPSceneObject();
+
+  string file;
+  Color c;
+  float ref;
+
+  // Read components
+  is >> file;
+  is >> c;
+  is >> ref;
+
+  if (!is) return SPSceneObject();
+
+  ifstream ifs(file.c_str());
+  if (!ifs)
+  {
+    cerr << "Error: Couldn't open mesh file " << file << endl;
+    return SPSceneObject();
+  }
+
+  set_read_origin(ifs, get_read_origin(is));
+
+  boost::shared_ptr<TriangleMesh> mesh = arena.create<TriangleMesh>(c, ref);
+
+  if (!read_OBJ(ifs, *mesh))
+    return SPSceneObject();
+
+  mesh->build();
+  return mesh;
+}
@@ -0,0 +1,161 @@
+/* trianglemesh.hh
+ *
+ * A SceneObject representing an indexed mesh of triangles
+ */
+
+#ifndef _TRIANGLEMESH_HH__
+#define _TRIANGLEMESH_HH__
+
+#include "sceneobject.hh"
+#include "bvh.hh"
+#include <istream>
+#include <vector>
+
+//! A SceneObject representing an indexed mesh of triangles
+/*!
+ * Vertex positions are stored as separate arrays of x, y and z coordinates,
+ * and each triangle as indices of its three corners into them, so vertices
+ * shared between triangles are stored once.
+ *
+ * The whole mesh is a single object in the Scene; rays which reach its
+ * bounds traverse the mesh's own BVH over its triangles.  The BVH must be
+ * built (with build()) after the last triangle is added and before the
+ * mesh is intersected.
+ *
+ * Triangles are intersected with a watertight test, so rays through shared
+ * edges and vertices never slip between adjacent triangles.  Both sides of
+ * a triangle can be hit, but the normal is that given by the right-hand rule
+ * on its corners in order (counter-clockwise is the front, as in OBJ files).
+ */
+class TriangleMesh: public SceneObject
+{
+  //! X coordinates of vertices
+  std::vector<float> xs;
+  //! Y coordinates of vertices
+  std::vector<float> ys;
+  //! Z coordinates of vertices
+  std::vector<float> zs;
+
+  //! Indices of each triangle's corners (corner[k][i] for corner k of i)
+  std::vector<unsigned int> corner[3];
+
+  //! Bounds of all vertices
+  AABB bounds;
+
+  //! Hierarchy over the triangles
+  BVH bvh;
+
+  //! Distance from a point to a triangle within which it is on the surface
+  float tolerance;
+
+  //! A ray transformed for intersect_triangle
+  struct ShearedRay
+  {
+    //! Origin of the ray
+    Vector3F orig;
+    //! Axes mapped to x, y & z (z being the ray's dominant axis)
+    unsigned int kx, ky, kz;
+    //! Shear & scale taking the ray to the unit z vector
+    float sx, sy, sz;
+
+    //! Construct from a ray
+    explicit ShearedRay(const Ray &r);
+  };
+
+  //! Accessor for a vertex's position
+  Vector3F get_vertex(unsigned int v) const;
+
+  //! Intersect a pre-transformed ray with one triangle
+  float intersect_triangle(const ShearedRay &sr, unsigned int tri) const;
+
+  //! Squared distance from a point to a triangle
+  float dist_sq_to_triangle(const Vector3F &p, unsigned int tri) const;
+
+  public:
+  // === Constructors & methods
+
+  //! Construct an empty mesh with default color & reflectivity
+  TriangleMesh();
+
+  //! Construct an empty mesh
+  TriangleMesh(const Color &c, float r = 0);
+
+  //! Add a vertex
+  unsigned int add_vertex(const Vector3F &p);
+
+  //! Add a triangle from three vertex indices
+  void add_triangle(unsigned int a, unsigned int b, unsigned int c);
+
+  //! Build the hierarchy over the triangles
+  void build();
+
+  //! Number of vertices
+  unsigned int get_vertex_count() const;
+
+  //! Number of triangles
+  unsigned int get_triangle_count() const;
+
+  //! Unit normal of a triangle (by the right-hand rule)
+  Vector3F get_triangle_normal(unsigned int tri) const;
+
+  //! Intersect a ray with one triangle
+  float intersect_triangle(const Ray &r, unsigned int tri) const;
+
+  // Identify first intersection with a ray
+  // (See sceneobject.hh)
+  float intersection(const Ray &r) const;
+
+  // Identify first intersection with a ray, and the triangle hit
+  // (See sceneobject.hh)
+  float intersection_from(const Ray &r, unsigned int from,
+                          unsigned int &prim) const;
+
+  // Get the normal to the surface at a point p
+  // (See sceneobject.hh)
+  Vector3F get_normal(const Vector3F &p) const;
+
+  // Get the normal to the surface at a point p on a known triangle
+  // (See sceneobject.hh)
+  Vector3F get_normal(const Vector3F &p, unsigned int prim) const;
+
+  // Get a bounding box for the object
+  // (See sceneobject.hh)
+  bool get_bounds(AABB &b) const;
+
+  // Add everything affecting the object's appearance to a hash
+  // (See sceneobject.hh)
+  void hash(Hash &h) const;
+
+  // Name of the object's type, for hashing
+  // (See sceneobject.hh)
+  const char *type_tag() const;
+};
+
+/*! \relates TriangleMesh
+ * \brief Function to read the vertices and faces of a Wavefront OBJ file
+ */
+bool read_OBJ(std::istream &is, TriangleMesh &mesh);
+
+/*! \relates TriangleMesh
+ * \brief Function to read a TriangleMesh from an input stream
+ */
+SPSceneObject read_TriangleMesh(std::istream &is, Arena &arena);
+
+// === Inline function definitions
+
+inline Vector3F TriangleMesh::get_vertex(unsigned int v) const
+{
+  return Vector3F({xs[v], ys[v], zs[v]});
+}
+
+inline unsigned int TriangleMesh::get_vertex_count() const
+{
+  return xs.size();
+}
+
+inline unsigned int TriangleMesh::get_triangle_count() const
+{
+  return corner[0].size();
+}
+
+#endif
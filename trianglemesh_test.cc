@@ -0,0 +1,166 @@
+/* trianglemesh_test.cc
+ *
+ * gtest Unit Test Suite for TriangleMesh and OBJ reading
+ */
+
+#include "trianglemesh.hh"
+#include "random.hh"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace std;
+using namespace testing;
+
+// A unit square in the z = 0 plane, split into n x n quads of two triangles
+static void make_grid(TriangleMesh &mesh, unsigned int n)
+{
+  for (unsigned int j = 0; j <= n; ++j)
+    for (unsigned int i = 0; i <= n; ++i)
+      mesh.add_vertex(Vector3F({float(i) / n, float(j) / n, 0}));
+
+  for (unsigned int j = 0; j < n; ++j)
+  {
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      unsigned int v = j * (n + 1) + i;
+      mesh.add_triangle(v, v + 1, v + n + 2);
+      mesh.add_triangle(v, v + n + 2, v + n + 1);
+    }
+  }
+
+  mesh.build();
+}
+
+// Rays through shared edges and vertices never slip between triangles
+TEST(TriangleMeshTest, Watertight)
+{
+  TriangleMesh mesh;
+  make_grid(mesh, 7);
+
+  Random rng(5);
+
+  for (int k = 0; k < 20000; ++k)
+  {
+    // Aim at an inner edge or vertex of the grid, or anywhere within it
+    float x = rng.next_float(), y = rng.next_float();
+    if (k % 3 == 0) x = float(1 + k % 6) / 7;
+    if (k % 3 == 1) y = x;
+
+    Vector3F target = {x, y, 0};
+    Vector3F orig = {4 * rng.next_float() - 2, 4 * rng.next_float() - 2,
+                     0.5f + rng.next_float()};
+
+    Ray r(orig, target - orig);
+    float t = mesh.intersection(r);
+
+    ASSERT_NE(SceneObject::no_intersection, t) << "missed " << x << ", " << y;
+    EXPECT_NEAR((target - orig).norm(), t, 1e-5);
+  }
+}
+
+// Traversing the hierarchy finds the same nearest hit as testing every
+// triangle
+TEST(TriangleMeshTest, MatchesBruteForce)
+{
+  TriangleMesh mesh;
+  Random rng(9);
+
+  for (int i = 0; i < 500; ++i)
+  {
+    Vector3F c = {4 * rng.next_float() - 2, 4 * rng.next_float() - 2,
+                  4 * rng.next_float() - 2};
+    unsigned int v = mesh.add_vertex(c);
+
+    for (int k = 0; k < 2; ++k)
+      mesh.add_vertex(c + Vector3F({rng.next_float() - 0.5f,
+                                    rng.next_float() - 0.5f,
+                                    rng.next_float() - 0.5f}) * 0.6f);
+
+    mesh.add_triangle(v, v + 1, v + 2);
+  }
+  mesh.build();
+
+  for (int k = 0; k < 1000; ++k)
+  {
+    Vector3F orig = {6 * rng.next_float() - 3, 6 * rng.next_float() - 3, -4};
+    Vector3F dir = {rng.next_float() - 0.5f, rng.next_float() - 0.5f, 1};
+    Ray r(orig, dir);
+
+    float expected = SceneObject::no_intersection;
+    for (unsigned int i = 0; i < mesh.get_triangle_count(); ++i)
+    {
+      float t = mesh.intersect_triangle(r, i);
+      if (t != SceneObject::no_intersection
+          && (expected == SceneObject::no_intersection || t < expected))
+        expected = t;
+    }
+
+    EXPECT_EQ(expected, mesh.intersection(r));
+  }
+}
+
+// Normals face out of a closed, counter-clockwise wound mesh
+TEST(TriangleMeshTest, NormalsFaceOutward)
+{
+  istringstream iss("# tetrahedron\n"
+                    "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 0 0 1\n"
+                    "f 1 3 2\nf 1 2 4\nf 1 4 3\nf 2 3 4\n");
+  TriangleMesh mesh;
+  ASSERT_TRUE(read_OBJ(iss, mesh));
+  mesh.build();
+
+  Vector3F center = {0.25, 0.25, 0.25};
+
+  for (unsigned int i = 0; i < mesh.get_triangle_count(); ++i)
+  {
+    // Hit each face from inside
+    Vector3F n = mesh.get_triangle_normal(i);
+    Ray r(center, n);
+    unsigned int prim;
+    float t = mesh.intersection_from(r, SceneObject::no_primitive, prim);
+    ASSERT_NE(SceneObject::no_intersection, t);
+    EXPECT_EQ(i, prim);
+
+    Vector3F normal = mesh.get_normal(r.get_point_at_t(t));
+    EXPECT_GT(dot(normal, r.get_point_at_t(t) - center), 0);
+    EXPECT_FLOAT_EQ(1, dot(normal, n));
+
+    // The triangle hit gives the same normal, without a search
+    EXPECT_FLOAT_EQ(1, dot(mesh.get_normal(r.get_point_at_t(t), prim), n));
+  }
+}
+
+// Faces may use any vertex format, negative indices & many vertices
+TEST(TriangleMeshTest, ReadOBJ)
+{
+  istringstream iss("o quad\n"
+                    "v 0 0 0\n  v 1 0 0\nv 1 1 0\nv 0 1 0 1.0\n"
+                    "vt 0 0\nvn 0 0 1\n"
+                    "s off\n"
+                    "f 1/1/1 2/1/1 3//1 4\n"
+                    "v 2 0 0\n"
+                    "f -4 -1 -3\n");
+  TriangleMesh mesh;
+  ASSERT_TRUE(read_OBJ(iss, mesh));
+
+  EXPECT_EQ(5u, mesh.get_vertex_count());
+  EXPECT_EQ(3u, mesh.get_triangle_count());
+
+  mesh.build();
+  Ray r(Vector3F({0.25, 0.75, 1}), Vector3F({0, 0, -1}));
+  EXPECT_FLOAT_EQ(1, mesh.intersection(r));
+  EXPECT_FLOAT_EQ(1, mesh.get_normal(r.get_point_at_t(1))[2]);
+
+  // Vertices must be read before use
+  istringstream bad("v 0 0 0\nv 1 0 0\nf 1 2 3\n");
+  TriangleMesh bad_mesh;
+  EXPECT_FALSE(read_OBJ(bad, bad_mesh));
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
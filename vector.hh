@@ -35,6 +35,10 @@ class Vector
   //! Initializer list constructor
   Vector(std::initializer_list<E> init);
 
+  //! Converting constructor from a vector of another element type
+  template <typename F>
+  explicit Vector(const Vector<F, DIM> &v);
+
 
   //! Subscript Operator (const)
   E operator[](unsigned int i) const;
@@ -166,6 +170,21 @@ Vector<E, DIM>::Vector(std::initializer_list<E> init)
     data[i] = *it;
 }
 
+// Converting Constructor
+/*!
+ * Converts each element, so (for example) a Vector3D can be rounded to a
+ * Vector3F: Vector3F v(vd);
+ *
+ * \param v  A vector of the same size with elements of type F.
+ */
+template <typename E, unsigned int DIM>
+template <typename F>
+Vector<E, DIM>::Vector(const Vector<F, DIM> &v)
+{
+  for (unsigned int i = 0; i < DIM; ++i)
+    data[i] = E(v[i]);
+}
+
 // Subscript Operator (const)
 /*!
  * Bounds are checked via assertions!
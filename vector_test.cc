@@ -4,6 +4,7 @@
  */
 
 #include "vector.hh"
+#include "rebase.hh"
 #include "sstream"
 #include <gtest/gtest.h>
 
@@ -368,6 +369,43 @@ TEST(Vector3FTest, StreamInput)
   EXPECT_FLOAT_EQ(3.5, v1[1]);
   EXPECT_FLOAT_EQ(500, v1[2]);
 }
+
+// Verify conversion between element types
+TEST(Vector3FTest, ConvertingCtor)
+{
+  Vector3D vd = {1e6 + 0.125, -0.1, 3};
+  Vector3F v1(vd);
+
+  EXPECT_EQ(float(1e6 + 0.125), v1[0]);
+  EXPECT_EQ(-0.1f, v1[1]);
+  EXPECT_EQ(3, v1[2]);
+  EXPECT_EQ(double(-0.1f), Vector3D(v1)[1]);
+}
+
+// Test reading positions relative to a stream's origin
+TEST(Vector3FTest, ReadPosition)
+{
+  Vector3F v1, v2;
+
+  // Without an origin, as for a plain vector
+  istringstream iss("(1000000.03 2 3)");
+  read_position(iss, v1);
+  EXPECT_EQ(1000000.03f, v1[0]);
+
+  // Offsets smaller than a float's precision at the origin are kept
+  Vector3D origin = {1000000, 0, -1};
+  istringstream iss2("(1000000.03 2 3) (1 2 3)");
+  set_read_origin(iss2, &origin);
+  EXPECT_EQ(&origin, get_read_origin(iss2));
+
+  read_position(iss2, v1);
+  EXPECT_NEAR(0.03, v1[0], 1e-7);
+  EXPECT_FLOAT_EQ(2, v1[1]);
+  EXPECT_FLOAT_EQ(4, v1[2]);
+
+  iss2 >> v2;
+  EXPECT_FLOAT_EQ(1, v2[0]);
+}
 int main(int argc, char **argv)
 {
   // Parse gtest arguments
@@ -0,0 +1,628 @@
+/* wavefront.cc
+ *
+ * Rendering in stages over batches of rays, rather than a pixel at a time
+ */
+
+#include "wavefront.hh"
+#include "scene.hh"
+#include "morton.hh"
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+using namespace std;
+
+//! Most paths (samples) traced together in one batch
+static const unsigned int WAVEFRONT_PATHS = 1 << 16;
+
+//! Number of queue entries a thread takes at a time
+static const unsigned int WAVEFRONT_CHUNK = 256;
+
+//! Fewest reflected rays worth sorting for coherence
+static const unsigned int COHERENCE_MIN_RAYS = 4096;
+
+//! Cells along each axis of the grid on which ray origins are ordered
+static const unsigned int COHERENCE_GRID = 512;
+
+/*!
+ * \param n  Number of rays to hold (new slots are left unset)
+ */
+void RayQueue::resize(unsigned int n)
+{
+  for (unsigned int k = 0; k < 3; ++k)
+  {
+    orig[k].resize(n);
+    dir[k].resize(n);
+  }
+
+  path.resize(n);
+  from_obj.resize(n);
+  from_prim.resize(n);
+  diff.resize(n);
+}
+
+/*!
+ * \param keep  Flag for each slot, nonzero to keep the ray in it
+ */
+void RayQueue::compact(const vector<unsigned char> &keep)
+{
+  assert(keep.size() == size());
+
+  unsigned int n = 0;
+
+  for (unsigned int i = 0; i < keep.size(); ++i)
+  {
+    if (!keep[i]) continue;
+
+    for (unsigned int k = 0; k < 3; ++k)
+    {
+      orig[k][n] = orig[k][i];
+      dir[k][n] = dir[k][i];
+    }
+
+    path[n] = path[i];
+    from_obj[n] = from_obj[i];
+    from_prim[n] = from_prim[i];
+    diff[n] = diff[i];
+    ++n;
+  }
+
+  resize(n);
+}
+
+/*!
+ * Rays are binned by the octant of their direction, then ordered within
+ * each octant by the Morton code of their origin on a COHERENCE_GRID^3 grid
+ * over the bounds of all the origins.  Rays leaving nearby surfaces in
+ * similar directions then sit together in the queue, so consecutive rays
+ * tend to visit the same nodes of a hierarchy.
+ *
+ * The sort is an LSD radix sort of the 30-bit keys, so takes time linear in
+ * the number of rays.  Rays keep their paths, so the order does not affect
+ * the image.
+ */
+void RayQueue::sort_coherent()
+{
+  unsigned int n = size();
+  if (n <= 1) return;
+
+  // Grid over the bounds of the origins
+  float lo[3], scale[3];
+  for (unsigned int k = 0; k < 3; ++k)
+  {
+    lo[k] = *min_element(orig[k].begin(), orig[k].end());
+    float hi = *max_element(orig[k].begin(), orig[k].end());
+    scale[k] = (hi > lo[k]) ? (COHERENCE_GRID - 0.5f) / (hi - lo[k]) : 0;
+  }
+
+  // Key of each ray: octant above Morton code
+  vector<uint32_t> keys(n), order(n);
+
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    uint32_t octant = 0, cell[3];
+
+    for (unsigned int k = 0; k < 3; ++k)
+    {
+      if (dir[k][i] < 0) octant |= 1 << k;
+      cell[k] = min(uint32_t((orig[k][i] - lo[k]) * scale[k]),
+                    uint32_t(COHERENCE_GRID - 1));
+    }
+
+    keys[i] = (octant << 27) | morton_encode3(cell[0], cell[1], cell[2]);
+    order[i] = i;
+  }
+
+  // Radix sort, a byte of the key at a time
+  vector<uint32_t> keys_out(n), order_out(n);
+
+  for (unsigned int shift = 0; shift < 32; shift += 8)
+  {
+    unsigned int start[257] = {0};
+
+    for (unsigned int i = 0; i < n; ++i)
+      ++start[((keys[i] >> shift) & 0xff) + 1];
+
+    for (unsigned int b = 0; b < 256; ++b)
+      start[b + 1] += start[b];
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+      unsigned int dest = start[(keys[i] >> shift) & 0xff]++;
+      keys_out[dest] = keys[i];
+      order_out[dest] = order[i];
+    }
+
+    keys.swap(keys_out);
+    order.swap(order_out);
+  }
+
+  // Gather every field into the sorted order
+  vector<float> f(n);
+
+  for (unsigned int k = 0; k < 3; ++k)
+  {
+    for (unsigned int i = 0; i < n; ++i) f[i] = orig[k][order[i]];
+    orig[k].swap(f);
+
+    for (unsigned int i = 0; i < n; ++i) f[i] = dir[k][order[i]];
+    dir[k].swap(f);
+  }
+
+  vector<uint32_t> &p = keys_out;
+  for (unsigned int i = 0; i < n; ++i) p[i] = path[order[i]];
+  path.swap(p);
+
+  vector<const SceneObject *> o(n);
+  for (unsigned int i = 0; i < n; ++i) o[i] = from_obj[order[i]];
+  from_obj.swap(o);
+
+  for (unsigned int i = 0; i < n; ++i) p[i] = from_prim[order[i]];
+  from_prim.swap(p);
+
+  vector<RayDifferentials> d(n);
+  for (unsigned int i = 0; i < n; ++i) d[i] = diff[order[i]];
+  diff.swap(d);
+}
+
+/*!
+ * \param n  Number of hits to hold (new slots are left unset)
+ */
+void HitQueue::resize(unsigned int n)
+{
+  t.resize(n);
+  obj.resize(n);
+  prim.resize(n);
+}
+
+WavefrontStats::WavefrontStats()
+  : batches(0)
+  , camera_rays(0)
+  , reflected_rays(0)
+  , sorted_rays(0)
+  , sort_time(0)
+  , intersect_time(0)
+  , shade_time(0)
+{ }
+
+/*!
+ * \param rhs  Stats to add to these
+ * \returns    Reference to these stats
+ */
+WavefrontStats & WavefrontStats::operator+=(const WavefrontStats &rhs)
+{
+  batches += rhs.batches;
+  camera_rays += rhs.camera_rays;
+  reflected_rays += rhs.reflected_rays;
+  sorted_rays += rhs.sorted_rays;
+  sort_time += rhs.sort_time;
+  intersect_time += rhs.intersect_time;
+  shade_time += rhs.shade_time;
+  return *this;
+}
+
+/*! \relates WavefrontStats
+ * Prints the ray counts, and the time of each stage per million rays.
+ *
+ * \param os  Output stream to which to print
+ * \param s   Stats to print
+ * \returns   The output stream
+ */
+ostream & operator<<(ostream &os, const WavefrontStats &s)
+{
+  uint64_t rays = s.camera_rays + s.reflected_rays;
+
+  // Microseconds per ray are seconds per million rays
+  auto per_mray = [](double t, uint64_t n) { return n ? t * 1e6 / n : 0; };
+
+  os << "Wavefront: " << s.batches << " batches, "
+     << s.camera_rays << " camera rays, "
+     << s.reflected_rays << " reflected rays ("
+     << s.sorted_rays << " sorted)" << endl;
+  os << "  sort:      " << s.sort_time << " s ("
+     << per_mray(s.sort_time, s.sorted_rays) << " s per million rays)"
+     << endl;
+  os << "  intersect: " << s.intersect_time << " s ("
+     << per_mray(s.intersect_time, rays) << " s per million rays)" << endl;
+  os << "  shade:     " << s.shade_time << " s ("
+     << per_mray(s.shade_time, rays) << " s per million rays)" << endl;
+
+  return os;
+}
+
+/*!
+ * Threads which run the stages of a wavefront render.  They are started
+ * once per render and wait between stages, rather than being started &
+ * joined for every stage of every batch.
+ */
+class StageWorkers
+{
+public:
+  //! Function processing the items in [begin, end)
+  typedef function<void(unsigned int, unsigned int)> Fn;
+
+  //! Start the workers for a number of threads (including the caller's)
+  explicit StageWorkers(unsigned int threads);
+
+  //! Stop the workers
+  ~StageWorkers();
+
+  //! Run one stage over n items, returning once all are processed
+  void run(unsigned int n, const Fn &fn);
+
+private:
+  //! Process chunks of the current stage until none remain
+  void take_chunks();
+
+  //! Body of each worker thread
+  void work();
+
+  //! Worker threads
+  vector<thread> pool;
+
+  //! Guards the fields below, except next
+  mutex m;
+  //! Signalled when a stage starts, or the workers stop
+  condition_variable start_cv;
+  //! Signalled when the last worker finishes a stage
+  condition_variable done_cv;
+
+  //! Function of the current stage
+  const Fn *fn;
+  //! Number of items in the current stage
+  unsigned int n;
+  //! Start of the next chunk, shared by all threads
+  atomic<unsigned int> next;
+  //! Number of the current stage, by which workers tell a new one starts
+  unsigned int stage;
+  //! Number of workers still in the current stage
+  unsigned int busy;
+  //! Whether the workers are to stop
+  bool stop;
+};
+
+/*!
+ * \param threads  Number of threads to run stages on (the calling thread
+ *                 works too, so one fewer are started)
+ */
+StageWorkers::StageWorkers(unsigned int threads)
+  : fn(NULL)
+  , n(0)
+  , next(0)
+  , stage(0)
+  , busy(0)
+  , stop(false)
+{
+  for (unsigned int t = 1; t < threads; ++t)
+    pool.push_back(thread(&StageWorkers::work, this));
+}
+
+// Stop & join the workers
+StageWorkers::~StageWorkers()
+{
+  {
+    lock_guard<mutex> lock(m);
+    stop = true;
+  }
+  start_cv.notify_all();
+
+  for (unsigned int t = 0; t < pool.size(); ++t)
+    pool[t].join();
+}
+
+/*!
+ * Calls fn(begin, end) over chunks of [0, n), shared out among the threads
+ * as each finishes its last chunk.
+ *
+ * \param n   Number of items
+ * \param fn  Function to process the items in [begin, end)
+ */
+void StageWorkers::run(unsigned int n, const Fn &fn)
+{
+  if (pool.empty() || n <= WAVEFRONT_CHUNK)
+  {
+    fn(0, n);
+    return;
+  }
+
+  {
+    lock_guard<mutex> lock(m);
+    this->fn = &fn;
+    this->n = n;
+    next = 0;
+    busy = pool.size();
+    ++stage;
+  }
+  start_cv.notify_all();
+
+  take_chunks();
+
+  unique_lock<mutex> lock(m);
+  done_cv.wait(lock, [this]() { return busy == 0; });
+}
+
+// Process chunks of the current stage until none remain
+void StageWorkers::take_chunks()
+{
+  for (unsigned int b = next.fetch_add(WAVEFRONT_CHUNK); b < n;
+       b = next.fetch_add(WAVEFRONT_CHUNK))
+    (*fn)(b, min(n, b + WAVEFRONT_CHUNK));
+}
+
+// Wait for each stage, and help process it
+void StageWorkers::work()
+{
+  unsigned int done_stage = 0;
+
+  for (;;)
+  {
+    {
+      unique_lock<mutex> lock(m);
+      start_cv.wait(lock, [&]() { return stop || stage != done_stage; });
+      if (stop) return;
+      done_stage = stage;
+    }
+
+    take_chunks();
+
+    lock_guard<mutex> lock(m);
+    if (--busy == 0)
+      done_cv.notify_one();
+  }
+}
+
+/*!
+ * Renders the same samples as render_row() does for each row, but rather
+ * than tracing each sample depth-first, a batch of up to WAVEFRONT_PATHS
+ * samples (whole rows of them) is traced together in stages:
+ *
+ *  - generate: a camera ray for each sample, into a RayQueue
+ *  - intersect: the closest hit for every ray in the queue
+ *  - shade: the light reflected from every hit, and a reflected ray for
+ *    each hit on a reflective surface, into the queue for the next round
+ *
+ * Intersecting and shading repeat until no rays remain.  Each stage runs
+ * over the whole queue, shared among the threads, so every thread works
+ * through the same code and data at once.  If opt.coherence_sort is set,
+ * each round of reflected rays large enough to be worth it is sorted by
+ * RayQueue::sort_coherent before being intersected.
+ *
+ * The light shaded at each bounce of a sample is kept, and combined from the
+ * last bounce back to the first as trace_ray() unwinds its recursion.  Each
+ * sample also draws from its own Random generator in the same order as
+ * trace_ray() does, so the image is identical to render_row()'s.
+ *
+ * \param cam           Camera from which to render the scene
+ * \param fb            Framebuffer in which to accumulate samples
+ * \param opt           Render settings
+ * \param first_sample  Number of the first sample to take for each pixel
+ * \param y_begin       First row to render
+ * \param y_end         One past the last row to render
+ * \param threads       Number of threads to render with
+ *
+ * Counts and stage timings are added to *opt.stats, if it is set.
+ */
+void Scene::render_rows_wavefront(const Camera &cam, Framebuffer &fb,
+                                  const RenderOptions &opt,
+                                  unsigned int first_sample,
+                                  int y_begin, int y_end,
+                                  unsigned int threads) const
+{
+  int img_size = fb.get_width();
+  unsigned int samples = opt.pixel_samples;
+  unsigned int row_paths = img_size * samples;
+
+  // Whole rows per batch
+  int batch_rows = max(1u, WAVEFRONT_PATHS / max(1u, row_paths));
+
+  // Most bounces a path can have (the camera ray's hit, then reflections)
+  unsigned int max_bounces = opt.max_depth + 1;
+
+  // Rays still to trace, and reflected rays for the next round
+  RayQueue rays, next;
+  // Hits of rays
+  HitQueue hits;
+  // Flag for each ray of whether it was reflected into next
+  vector<unsigned char> reflected;
+
+  /* Per-path state, indexed by path */
+
+  // Random number generator of each path
+  vector<Random> rngs;
+  // Number of bounces of each path
+  vector<unsigned int> bounces;
+  // Light shaded at each bounce, in slots of max_bounces per path
+  vector<Color> bounce_c;
+  // Reflectivity applied at each bounce (0 if nothing was reflected)
+  vector<float> bounce_r;
+  // Color of each path
+  vector<Color> colors;
+
+  typedef chrono::steady_clock Clock;
+  WavefrontStats stats;
+
+  // Threads for every stage of every batch
+  StageWorkers workers(threads);
+
+  // Seconds since a time, resetting the time to now
+  auto lap = [](Clock::time_point &start)
+  {
+    Clock::time_point now = Clock::now();
+    double t = chrono::duration<double>(now - start).count();
+    start = now;
+    return t;
+  };
+
+  for (int y0 = y_begin; y0 < y_end; y0 += batch_rows)
+  {
+    int y1 = min(y_end, y0 + batch_rows);
+    unsigned int n = (y1 - y0) * row_paths;
+
+    // Paths are numbered in the order render_row() takes samples
+    rays.resize(n);
+    rngs.resize(n);
+    bounces.assign(n, 0);
+    bounce_c.resize(n * max_bounces);
+    bounce_r.resize(n * max_bounces);
+    colors.resize(n);
+
+    ++stats.batches;
+    stats.camera_rays += n;
+
+    // Generate a camera ray for each sample
+    workers.run(n, [&](unsigned int b, unsigned int e)
+    {
+      for (unsigned int p = b; p < e; ++p)
+      {
+        unsigned int pixel = p / samples;
+        int x = pixel % img_size;
+        int y = y0 + pixel / img_size;
+
+        // Number of this sample among all the pixel's samples
+        uint32_t sample = first_sample + p % samples;
+
+        // Random numbers keyed by pixel and sample
+        rngs[p] = Random(opt.seed, uint64_t(y) * img_size + x, sample);
+
+        float dx = 0, dy = 0;
+        if (sample > 0)
+        {
+          dx = rngs[p].next_float() - 0.5f;
+          dy = rngs[p].next_float() - 0.5f;
+        }
+
+        rays.set(p, cam.get_ray_for_pixel(x + dx, y + dy, img_size), p);
+      }
+    });
+
+    for (unsigned int depth = 0; rays.size() > 0; ++depth)
+    {
+      unsigned int m = rays.size();
+      hits.resize(m);
+      next.resize(m);
+      reflected.resize(m);
+
+      Clock::time_point start = Clock::now();
+
+      if (depth > 0)
+      {
+        stats.reflected_rays += m;
+
+        // Reflected rays leave in all directions, so group similar rays
+        // (Camera rays are already coherent, in pixel order)
+        if (opt.coherence_sort && m >= COHERENCE_MIN_RAYS)
+        {
+          rays.sort_coherent();
+          stats.sorted_rays += m;
+          stats.sort_time += lap(start);
+        }
+      }
+
+      // Intersect every ray
+      workers.run(m, [&](unsigned int b, unsigned int e)
+      {
+        for (unsigned int i = b; i < e; ++i)
+        {
+          Hit hit = find_closest_hit(rays.get_ray(i), rays.get_from(i));
+          hits.t[i] = hit.t;
+          hits.obj[i] = hit.obj;
+          hits.prim[i] = hit.prim;
+        }
+      });
+
+      stats.intersect_time += lap(start);
+
+      // Shade every hit, reflecting rays while depth remains
+      workers.run(m, [&](unsigned int b, unsigned int e)
+      {
+        for (unsigned int i = b; i < e; ++i)
+        {
+          reflected[i] = 0;
+
+          const SceneObject *so = hits.obj[i];
+          if (so == NULL) continue;
+
+          uint32_t p = rays.get_path(i);
+          Ray r = rays.get_ray(i);
+          r.set_differentials(rays.get_differentials(i));
+
+          Hit hit;
+          hit.t = hits.t[i];
+          hit.obj = so;
+          hit.prim = hits.prim[i];
+
+          if (opt.refine_hits)
+            hit.t = so->refine_intersection(r, hit.t, hit.prim);
+
+          Vector3F pos = r.get_point_at_t(hit.t);
+          Vector3F n = so->get_normal(pos, hit.prim);
+
+          SurfaceDifferentials sd = hit_differentials(r, hit, pos, n);
+
+          Color c = shade(hit, pos, n, sd, opt, rngs[p]);
+
+          float so_r = so->get_surface_reflectivity();
+          if (so_r != 0 && depth < opt.max_depth)
+          {
+            next.set(i, r.reflect(pos, n, sd), p, hit);
+            reflected[i] = 1;
+          }
+          else
+            so_r = 0;
+
+          bounce_c[p * max_bounces + depth] = c;
+          bounce_r[p * max_bounces + depth] = so_r;
+          bounces[p] = depth + 1;
+        }
+      });
+
+      stats.shade_time += lap(start);
+
+      next.compact(reflected);
+      swap(rays, next);
+    }
+
+    // Combine each path's bounces from the last, as trace_ray() returns
+    workers.run(n, [&](unsigned int b, unsigned int e)
+    {
+      for (unsigned int p = b; p < e; ++p)
+      {
+        // (Black beyond the last bounce, as for a reflected ray's miss)
+        Color c = Color(0, 0, 0);
+
+        for (unsigned int k = bounces[p]; k-- > 0; )
+        {
+          float so_r = bounce_r[p * max_bounces + k];
+          const Color &so_c = bounce_c[p * max_bounces + k];
+
+          if (so_r != 0)
+            c = so_r * c + ((1 - so_r) * so_c);
+          else
+            c = so_c;
+        }
+
+        colors[p] = c;
+      }
+    });
+
+    // Accumulate samples in the order render_row() adds them
+    for (unsigned int p = 0; p < n; ++p)
+    {
+      unsigned int pixel = p / samples;
+      fb.add(pixel % img_size, y0 + pixel / img_size, colors[p]);
+    }
+  }
+
+  if (opt.stats != NULL)
+  {
+    // (Renders may run concurrently, sharing the stats)
+    static mutex stats_mutex;
+    lock_guard<mutex> lock(stats_mutex);
+    *opt.stats += stats;
+  }
+}
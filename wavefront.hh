@@ -0,0 +1,179 @@
+/* wavefront.hh
+ *
+ * Queues of rays and hits for rendering in stages over batches of rays
+ */
+
+#ifndef _WAVEFRONT_HH__
+#define _WAVEFRONT_HH__
+
+#include "ray.hh"
+#include "sceneobject.hh"
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+
+//! A queue of rays, each belonging to a path, stored as structure-of-arrays
+/*!
+ * Each stage of a wavefront render reads one or two fields of every ray in
+ * turn, so each field is kept in its own array and a stage only streams
+ * through the fields it uses.
+ */
+class RayQueue
+{
+  //! Components of each ray's origin
+  std::vector<float> orig[3];
+  //! Components of each ray's direction
+  std::vector<float> dir[3];
+  //! Path (sample) to which each ray belongs
+  std::vector<uint32_t> path;
+  //! Object each ray leaves (NULL for camera rays)
+  std::vector<const SceneObject *> from_obj;
+  //! Primitive of the object each ray leaves
+  std::vector<unsigned int> from_prim;
+  //! Differentials of each ray (only read when shading its hit)
+  std::vector<RayDifferentials> diff;
+
+  public:
+  // === Constructors & methods
+
+  //! Accessor for the number of rays
+  unsigned int size() const;
+
+  //! Resize to hold n rays
+  void resize(unsigned int n);
+
+  //! Set the ray in a slot
+  void set(unsigned int i, const Ray &r, uint32_t p,
+           const Hit &from = Hit());
+
+  //! Get the ray in a slot (without its differentials)
+  Ray get_ray(unsigned int i) const;
+
+  //! Get the differentials of the ray in a slot
+  const RayDifferentials & get_differentials(unsigned int i) const;
+
+  //! Get the path to which the ray in a slot belongs
+  uint32_t get_path(unsigned int i) const;
+
+  //! Get the surface which the ray in a slot leaves
+  Hit get_from(unsigned int i) const;
+
+  //! Remove the rays not flagged to keep, preserving order
+  void compact(const std::vector<unsigned char> &keep);
+
+  //! Sort the rays by direction octant, then by origin along a Morton curve
+  void sort_coherent();
+};
+
+//! The closest hit found for each ray of a RayQueue, as structure-of-arrays
+struct HitQueue
+{
+  //! Distance along each ray to its hit (SceneObject::no_intersection if none)
+  std::vector<float> t;
+  //! Object hit by each ray (NULL if none)
+  std::vector<const SceneObject *> obj;
+  //! Primitive of the object hit by each ray
+  std::vector<unsigned int> prim;
+
+  //! Resize to hold n hits
+  void resize(unsigned int n);
+};
+
+//! Counts and timings of the stages of wavefront rendering
+struct WavefrontStats
+{
+  //! Number of batches rendered
+  uint64_t batches;
+  //! Number of camera rays traced
+  uint64_t camera_rays;
+  //! Number of reflected rays traced
+  uint64_t reflected_rays;
+  //! Number of reflected rays sorted for coherence before tracing
+  uint64_t sorted_rays;
+
+  //! Seconds spent sorting rays
+  double sort_time;
+  //! Seconds spent intersecting rays
+  double intersect_time;
+  //! Seconds spent shading hits
+  double shade_time;
+
+  //! Default constructor gives empty stats
+  WavefrontStats();
+
+  //! Add the stats of another render
+  WavefrontStats & operator+=(const WavefrontStats &rhs);
+};
+
+/*! \relates WavefrontStats
+ * \brief Function to print wavefront rendering stats
+ */
+std::ostream & operator<<(std::ostream &os, const WavefrontStats &s);
+
+// === Inline function definitions
+
+inline unsigned int RayQueue::size() const { return path.size(); }
+
+inline uint32_t RayQueue::get_path(unsigned int i) const { return path[i]; }
+
+inline const RayDifferentials &
+RayQueue::get_differentials(unsigned int i) const
+{
+  return diff[i];
+}
+
+/*!
+ * \param i     Slot to set (less than size())
+ * \param r     Ray to store
+ * \param p     Path to which the ray belongs
+ * \param from  Surface the ray leaves (no hit for a camera ray)
+ */
+inline void RayQueue::set(unsigned int i, const Ray &r, uint32_t p,
+                          const Hit &from)
+{
+  const Vector3F &o = r.get_orig();
+  const Vector3F &d = r.get_dir();
+
+  for (unsigned int k = 0; k < 3; ++k)
+  {
+    orig[k][i] = o[k];
+    dir[k][i] = d[k];
+  }
+
+  path[i] = p;
+  from_obj[i] = from.obj;
+  from_prim[i] = from.prim;
+  diff[i] = r.get_differentials();
+}
+
+/*!
+ * Only the object & primitive of the returned hit are set.
+ *
+ * \param i  Slot to get (less than size())
+ * \returns  The surface which the ray in slot i leaves
+ */
+inline Hit RayQueue::get_from(unsigned int i) const
+{
+  Hit h;
+  h.obj = from_obj[i];
+  h.prim = from_prim[i];
+  return h;
+}
+
+/*!
+ * The direction is returned exactly as stored, without renormalizing it.
+ * The differentials, which only shading needs, are left zero (see
+ * get_differentials()).
+ *
+ * \param i  Slot to get (less than size())
+ * \returns  The ray in slot i
+ */
+inline Ray RayQueue::get_ray(unsigned int i) const
+{
+  Vector3F o = {orig[0][i], orig[1][i], orig[2][i]};
+  Vector3F d = {dir[0][i], dir[1][i], dir[2][i]};
+
+  return Ray(o, d, false);
+}
+
+#endif
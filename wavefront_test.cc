@@ -0,0 +1,157 @@
+/* wavefront_test.cc
+ *
+ * gtest Unit Test Suite for wavefront rendering
+ */
+
+#include "scene.hh"
+#include "wavefront.hh"
+#include "random.hh"
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+// Mirrored balls on a reflective floor, lit by a point and an area light
+struct WavefrontTest : public Test
+{
+  Scene scn;
+  Camera cam;
+
+  virtual void SetUp()
+  {
+    scn.add_object(scn.get_arena().create<Plane>(
+        0, Vector3F({0, 1, 0}), Color(0.5, 0, 0.5), 0.3));
+    scn.add_object(scn.get_arena().create<Sphere>(
+        Vector3F({-0.6, 0.5, 0}), 0.5, Color(0, 1, 0), 0.9));
+    scn.add_object(scn.get_arena().create<Sphere>(
+        Vector3F({0.6, 0.5, 0}), 0.5, Color(1, 1, 0), 0.5));
+    scn.add_light(scn.get_arena().create<Light>(
+        Vector3F({-10, 10, 5}), Color(0.8, 0.8, 0.8)));
+    scn.add_light(scn.get_arena().create<Light>(
+        Vector3F({0, 3, 0}), Vector3F({1, 0, 0}), Vector3F({0, 0, 1}),
+        Color(0.5, 0.5, 0.5)));
+    scn.prepare();
+
+    cam = Camera(Vector3F({0, 1, 3}), Vector3F({0, 0.5, 0}),
+                 Vector3F({0, 1, 0}));
+  }
+
+  // Render a band of rows, and expect both renderers to agree exactly
+  void expect_same(const RenderOptions &opt, int y_begin, int y_end)
+  {
+    const int size = 48;
+    Framebuffer fb(size, size), fb_wave(size, size);
+
+    RenderOptions wave_opt = opt;
+    wave_opt.wavefront = true;
+
+    scn.render_rows(cam, fb, opt, 1, y_begin, y_end);
+    scn.render_rows(cam, fb_wave, wave_opt, 1, y_begin, y_end);
+
+    for (int y = 0; y < size; ++y)
+    {
+      for (int x = 0; x < size; ++x)
+      {
+        const Color &c = fb.get_sum(x, y);
+        const Color &c_wave = fb_wave.get_sum(x, y);
+
+        ASSERT_EQ(c.get_red(), c_wave.get_red()) << x << ", " << y;
+        ASSERT_EQ(c.get_green(), c_wave.get_green()) << x << ", " << y;
+        ASSERT_EQ(c.get_blue(), c_wave.get_blue()) << x << ", " << y;
+      }
+    }
+  }
+};
+
+// Stochastic samples with deep reflections match the depth-first renderer
+TEST_F(WavefrontTest, MatchesDepthFirst)
+{
+  WavefrontStats stats;
+  RenderOptions opt;
+  opt.pixel_samples = 3;
+  opt.threads = 1;
+  opt.stats = &stats;
+  expect_same(opt, 0, 48);
+
+  EXPECT_EQ(48u * 48 * 3, stats.camera_rays);
+  EXPECT_LT(0u, stats.sorted_rays);
+
+  // (Few enough rays that reflections go unsorted)
+  opt.light_samples = 1;
+  opt.max_depth = 2;
+  opt.threads = 3;
+  expect_same(opt, 5, 17);
+}
+
+// Compacting a queue keeps the flagged rays in order
+TEST(RayQueueTest, Compact)
+{
+  RayQueue q;
+  q.resize(4);
+
+  for (unsigned int i = 0; i < 4; ++i)
+    q.set(i, Ray(Vector3F({float(i), 0, 0}), Vector3F({0, 0, 1})), 10 + i);
+
+  vector<unsigned char> keep = {0, 1, 0, 1};
+  q.compact(keep);
+
+  ASSERT_EQ(2u, q.size());
+  EXPECT_EQ(11u, q.get_path(0));
+  EXPECT_EQ(13u, q.get_path(1));
+  EXPECT_EQ(3, q.get_ray(1).get_orig()[0]);
+}
+
+// Sorting for coherence reorders whole rays, grouped by octant
+TEST(RayQueueTest, SortCoherent)
+{
+  const unsigned int N = 5000;
+  RayQueue q;
+  q.resize(N);
+
+  Random rng(1);
+  for (unsigned int i = 0; i < N; ++i)
+  {
+    Vector3F o = {rng.next_float(), rng.next_float(), rng.next_float()};
+    Vector3F d = {rng.next_float() - 0.5f, rng.next_float() - 0.5f,
+                  rng.next_float() - 0.5f};
+    q.set(i, Ray(o * 10.f, d), i);
+  }
+
+  RayQueue sorted = q;
+  sorted.sort_coherent();
+  ASSERT_EQ(N, sorted.size());
+
+  vector<bool> seen(N, false);
+  unsigned int last_octant = 0;
+
+  for (unsigned int i = 0; i < N; ++i)
+  {
+    uint32_t p = sorted.get_path(i);
+    ASSERT_LT(p, N);
+    EXPECT_FALSE(seen[p]);
+    seen[p] = true;
+
+    // Each ray is unchanged
+    Ray r = sorted.get_ray(i), r_orig = q.get_ray(p);
+    for (unsigned int k = 0; k < 3; ++k)
+    {
+      EXPECT_EQ(r_orig.get_orig()[k], r.get_orig()[k]);
+      EXPECT_EQ(r_orig.get_dir()[k], r.get_dir()[k]);
+    }
+
+    unsigned int octant = 0;
+    for (unsigned int k = 0; k < 3; ++k)
+      if (r.get_dir()[k] < 0) octant |= 1 << k;
+
+    EXPECT_LE(last_octant, octant);
+    last_octant = octant;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Parse gtest arguments
+  InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}